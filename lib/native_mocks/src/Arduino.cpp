@@ -0,0 +1,645 @@
+#include <Arduino.h>
+#include "native.h"
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+// Clock
+
+static bool clock_frozen = false;
+static uint64_t clock_offset_us = 0;
+static uint64_t frozen_us = 0;
+static time_t time_base = 0;
+static uint64_t time_base_us = 0;
+
+static uint64_t host_us() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t now_us() {
+  return clock_frozen ? frozen_us : host_us() + clock_offset_us;
+}
+
+void native_clock_freeze(bool frozen) {
+  if (frozen && !clock_frozen) {
+    frozen_us = now_us();
+  } else if (!frozen && clock_frozen) {
+    clock_offset_us = frozen_us - host_us();
+  }
+  clock_frozen = frozen;
+}
+
+void native_advance_us(uint64_t us) {
+  if (clock_frozen) {
+    frozen_us += us;
+  } else {
+    clock_offset_us += us;
+  }
+}
+
+void native_advance_ms(uint64_t ms) {
+  native_advance_us(ms * 1000);
+}
+
+void native_time_set(time_t now) {
+  time_base = now;
+  time_base_us = now_us();
+}
+
+#ifndef __THROW
+#define __THROW
+#endif
+
+// Replaces the C library's, so the firmware's time() follows the clock above
+extern "C" time_t time(time_t *out) __THROW {
+  time_t now;
+  if (time_base) {
+    now = time_base + (time_t)((now_us() - time_base_us) / 1000000);
+  } else {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = ts.tv_sec;
+  }
+  if (out) {
+    *out = now;
+  }
+  return now;
+}
+
+unsigned long millis() {
+  return (unsigned long)(uint32_t)(now_us() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(uint32_t)now_us();
+}
+
+void delay(unsigned long ms) {
+  uint64_t until = now_us() + ms * 1000;
+  do {
+    yield();
+    if (clock_frozen) {
+      frozen_us = until;
+    } else if (now_us() < until) {
+      std::this_thread::sleep_for(std::chrono::microseconds(std::min<uint64_t>(until - now_us(), 1000)));
+    }
+  } while (now_us() < until);
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (clock_frozen) {
+    frozen_us += us;
+    return;
+  }
+  uint64_t until = now_us() + us;
+  while (now_us() < until) {
+  }
+}
+
+// timer1 and GPIO
+
+volatile uint32_t GPOS = 0;
+volatile uint32_t GPOC = 0;
+
+static timercallback timer1_isr = NULL;
+static bool timer1_on = false;
+static uint32_t timer1_ticks = 0;
+static uint64_t timer1_due_ns = 0;
+
+static uint64_t now_ns() {
+  return now_us() * 1000;
+}
+
+void timer1_attachInterrupt(timercallback userFunc) {
+  timer1_isr = userFunc;
+}
+
+void timer1_detachInterrupt() {
+  timer1_isr = NULL;
+  timer1_on = false;
+}
+
+void timer1_enable(uint8_t, uint8_t, uint8_t) {
+  timer1_on = true;
+}
+
+void timer1_disable() {
+  timer1_on = false;
+}
+
+void timer1_write(uint32_t ticks) {
+  timer1_ticks = ticks;
+  // 80 MHz, TIM_DIV1: 12.5 ns a tick
+  uint64_t from = timer1_due_ns > now_ns() ? timer1_due_ns : now_ns();
+  timer1_due_ns = from + ticks * 25 / 2;
+}
+
+bool native_timer1_fire() {
+  if (!timer1_on || !timer1_isr) {
+    return false;
+  }
+  timer1_isr();
+  return true;
+}
+
+uint32_t native_timer1_ticks() {
+  return timer1_ticks;
+}
+
+bool native_timer1_enabled() {
+  return timer1_on && timer1_isr;
+}
+
+static void timer1_poll() {
+  while (timer1_on && timer1_isr && timer1_due_ns <= now_ns()) {
+    timer1_isr();
+  }
+}
+
+void yield() {
+  timer1_poll();
+  native_http_poll();
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (value) {
+    GPOS = 1UL << pin;
+  } else {
+    GPOC = 1UL << pin;
+  }
+}
+
+int digitalRead(uint8_t) {
+  return LOW;
+}
+
+char *dtostrf(double number, signed char width, unsigned char prec, char *s) {
+  sprintf(s, "%*.*f", width, prec, number);
+  return s;
+}
+
+void configTime(const char *tz, const char *, const char *, const char *) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+// String
+
+String::String(const char *cstr) : _len(0), _capacity(sizeof(_inline) - 1), _sso(true) {
+  _inline[0] = '\0';
+  if (cstr) {
+    concat(cstr, strlen(cstr));
+  }
+}
+
+String::String(const char *cstr, size_t len) : String("") {
+  concat(cstr, len);
+}
+
+String::String(const String &other) : String("") {
+  concat(other);
+}
+
+String::String(String &&other) : String("") {
+  *this = std::move(other);
+}
+
+String::String(char c) : String("") {
+  concat(c);
+}
+
+#define STRING_NUMBER(type, fmt_signed)                                      \
+  String::String(type value, unsigned char base) : String("") {              \
+    char buf[8 * sizeof(long long) + 2];                                     \
+    if (base == 10) {                                                        \
+      snprintf(buf, sizeof(buf), fmt_signed, value);                         \
+    } else {                                                                 \
+      unsigned long long v = (unsigned long long)value;                      \
+      char *p = buf + sizeof(buf) - 1;                                       \
+      *p = '\0';                                                             \
+      do {                                                                   \
+        *--p = "0123456789abcdefghijklmnopqrstuvwxyz"[v % base];             \
+        v /= base;                                                           \
+      } while (v);                                                           \
+      memmove(buf, p, strlen(p) + 1);                                        \
+    }                                                                        \
+    concat(buf);                                                             \
+  }
+
+STRING_NUMBER(unsigned char, "%u")
+STRING_NUMBER(int, "%d")
+STRING_NUMBER(unsigned int, "%u")
+STRING_NUMBER(long, "%ld")
+STRING_NUMBER(unsigned long, "%lu")
+
+String::String(double value, unsigned char decimals) : String("") {
+  char buf[40];
+  concat(dtostrf(value, 0, decimals, buf));
+}
+
+String::~String() {
+  if (!_sso) {
+    free(_buffer);
+  }
+}
+
+String &String::operator=(const String &rhs) {
+  if (this != &rhs) {
+    _len = 0;
+    wbuffer()[0] = '\0';
+    concat(rhs);
+  }
+  return *this;
+}
+
+String &String::operator=(String &&rhs) {
+  if (this == &rhs) {
+    return *this;
+  }
+  if (!_sso) {
+    free(_buffer);
+  }
+  memcpy((void *)this, (const void *)&rhs, sizeof(String));
+  rhs._sso = true;
+  rhs._len = 0;
+  rhs._capacity = sizeof(rhs._inline) - 1;
+  rhs._inline[0] = '\0';
+  return *this;
+}
+
+String &String::operator=(const char *cstr) {
+  _len = 0;
+  wbuffer()[0] = '\0';
+  if (cstr) {
+    concat(cstr);
+  }
+  return *this;
+}
+
+bool String::reserve(unsigned int size) {
+  if (size <= _capacity) {
+    return true;
+  }
+  unsigned int capacity = (size + 16) & ~0xfu;
+  char *buffer = (char *)(_sso ? malloc(capacity) : realloc(_buffer, capacity));
+  if (!buffer) {
+    return false;
+  }
+  if (_sso) {
+    memcpy(buffer, _inline, _len + 1);
+  }
+  _buffer = buffer;
+  _sso = false;
+  _capacity = capacity - 1;
+  return true;
+}
+
+bool String::concat(const char *cstr, unsigned int len) {
+  if (!len) {
+    return true;
+  }
+  // cstr may point into this string
+  size_t from = cstr >= c_str() && cstr < c_str() + _len ? cstr - c_str() : (size_t)-1;
+  if (!reserve(_len + len)) {
+    return false;
+  }
+  memmove(wbuffer() + _len, from != (size_t)-1 ? c_str() + from : cstr, len);
+  _len += len;
+  wbuffer()[_len] = '\0';
+  return true;
+}
+
+bool String::equalsIgnoreCase(const String &s) const {
+  return _len == s._len && strncasecmp(c_str(), s.c_str(), _len) == 0;
+}
+
+bool String::startsWith(const String &prefix) const {
+  return prefix._len <= _len && memcmp(c_str(), prefix.c_str(), prefix._len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+  return suffix._len <= _len && memcmp(c_str() + _len - suffix._len, suffix.c_str(), suffix._len) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  const char *p = from < _len ? (const char *)memchr(c_str() + from, c, _len - from) : NULL;
+  return p ? p - c_str() : -1;
+}
+
+int String::indexOf(const char *str, unsigned int from) const {
+  const char *p = from < _len ? strstr(c_str() + from, str) : NULL;
+  return p ? p - c_str() : -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    std::swap(from, to);
+  }
+  to = to > _len ? _len : to;
+  return from >= to ? String() : String(c_str() + from, to - from);
+}
+
+void String::toCharArray(char *buf, unsigned int size, unsigned int index) const {
+  if (!size || !buf) {
+    return;
+  }
+  unsigned int n = index < _len ? _len - index : 0;
+  n = n < size - 1 ? n : size - 1;
+  memcpy(buf, c_str() + index, n);
+  buf[n] = '\0';
+}
+
+void String::toLowerCase() {
+  for (unsigned int i = 0; i < _len; i++) {
+    wbuffer()[i] = tolower(wbuffer()[i]);
+  }
+}
+
+// Print
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    if (!write(*buffer++)) {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+size_t Print::printNumber(unsigned long long n, int base) {
+  char buf[8 * sizeof(n) + 1];
+  char *p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    *--p = "0123456789ABCDEF"[n % base];
+    n /= base;
+  } while (n);
+  return write(p);
+}
+
+size_t Print::printSigned(long long n, int base) {
+  if (base == 10 && n < 0) {
+    return print('-') + printNumber(-(unsigned long long)n, 10);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::printFloat(double number, int digits) {
+  char buf[40];
+  return write(dtostrf(number, 0, digits, buf));
+}
+
+size_t Print::vprintf(const char *format, va_list args) {
+  char buf[64];
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(buf, sizeof(buf), format, copy);
+  va_end(copy);
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len < sizeof(buf)) {
+    return write((const uint8_t *)buf, len);
+  }
+  // As the core does: longer output goes through a heap buffer
+  char *big = (char *)malloc(len + 1);
+  if (!big) {
+    return 0;
+  }
+  vsnprintf(big, len + 1, format, args);
+  size_t n = write((const uint8_t *)big, len);
+  free(big);
+  return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  size_t n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+size_t Print::printf_P(PGM_P format, ...) {
+  va_list args;
+  va_start(args, format);
+  size_t n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+// Serial
+
+#define UART_FIFO 128
+
+HardwareSerial Serial;
+static bool serial_echo = true;
+static uint32_t serial_written = 0;
+
+void native_serial_echo(bool echo) {
+  serial_echo = echo;
+}
+
+uint32_t native_serial_written() {
+  return serial_written;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  _baud = baud;
+  _fifo = 0;
+  _drained_us = now_us();
+}
+
+// Bytes sent since the last look, 10 bits each (8N1)
+void HardwareSerial::drain() {
+  uint64_t now = now_us();
+  uint64_t sent = (now - _drained_us) * _baud / 10 / 1000000;
+  if (sent >= _fifo) {
+    _fifo = 0;
+    _drained_us = now;
+  } else if (sent) {
+    _fifo -= sent;
+    _drained_us += sent * 10 * 1000000 / _baud;
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  drain();
+  while (_fifo >= UART_FIFO) {
+    if (clock_frozen) {
+      frozen_us += 10 * 1000000 / _baud + 1;
+    }
+    drain();
+  }
+  _fifo++;
+  serial_written++;
+  if (serial_echo) {
+    ::write(1, &c, 1);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+int HardwareSerial::availableForWrite() {
+  drain();
+  return UART_FIFO - _fifo;
+}
+
+void HardwareSerial::flush() {
+  while (availableForWrite() < UART_FIFO) {
+    if (clock_frozen) {
+      frozen_us += 10 * 1000000 / _baud + 1;
+    }
+  }
+}
+
+// IPAddress
+
+IPAddress::IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  uint8_t bytes[4] = {a, b, c, d};
+  memcpy(&_address, bytes, 4);
+}
+
+bool IPAddress::fromString(const char *address) {
+  unsigned a, b, c, d;
+  char end;
+  if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+    return false;
+  }
+  *this = IPAddress(a, b, c, d);
+  return true;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(buf);
+}
+
+size_t IPAddress::printTo(Print &p) const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return p.print(buf);
+}
+
+// ESP
+
+EspClass ESP;
+
+#define RTC_USER_BYTES 512
+#define FLASH_SIZE (4 * 1024 * 1024)
+#define FLASH_SECTOR 4096
+
+static uint32_t rtc_memory[RTC_USER_BYTES / 4];
+static uint8_t *flash = NULL;
+
+uint32_t EspClass::getFreeHeap() {
+  return native_heap_free();
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+  return native_heap_max_block();
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+  return native_heap_fragmentation();
+}
+
+// NATIVE_CHIP_ID tells several native nodes apart
+uint32_t EspClass::getChipId() {
+  const char *id = getenv("NATIVE_CHIP_ID");
+  return id ? strtoul(id, NULL, 0) : 0xC0FFEE;
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(now_us() * 80);
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+  if (offset * 4 + size > RTC_USER_BYTES) {
+    return false;
+  }
+  memcpy(data, (uint8_t *)rtc_memory + offset * 4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+  if (offset * 4 + size > RTC_USER_BYTES) {
+    return false;
+  }
+  memcpy((uint8_t *)rtc_memory + offset * 4, data, size);
+  return true;
+}
+
+static std::mt19937 &rng() {
+  static std::mt19937 gen(std::random_device{}());
+  return gen;
+}
+
+uint32_t EspClass::random() {
+  return rng()();
+}
+
+void EspClass::random(uint8_t *data, size_t size) {
+  while (size--) {
+    *data++ = rng()();
+  }
+}
+
+uint8_t *native_flash(uint32_t address) {
+  if (!flash) {
+    NativeHeapScope host(false);
+    flash = (uint8_t *)malloc(FLASH_SIZE);
+    memset(flash, 0xFF, FLASH_SIZE);
+  }
+  return address < FLASH_SIZE ? flash + address : NULL;
+}
+
+bool EspClass::flashRead(uint32_t address, uint32_t *data, size_t size) {
+  if (address % 4 || address + size > FLASH_SIZE) {
+    return false;
+  }
+  memcpy(data, native_flash(address), size);
+  return true;
+}
+
+bool EspClass::flashWrite(uint32_t address, const uint32_t *data, size_t size) {
+  if (address % 4 || size % 4 || address + size > FLASH_SIZE) {
+    return false;
+  }
+  uint8_t *to = native_flash(address);
+  const uint8_t *from = (const uint8_t *)data;
+  for (size_t i = 0; i < size; i++) {
+    to[i] &= from[i];
+  }
+  return true;
+}
+
+bool EspClass::flashEraseSector(uint32_t sector) {
+  if ((uint64_t)(sector + 1) * FLASH_SECTOR > FLASH_SIZE) {
+    return false;
+  }
+  memset(native_flash(sector * FLASH_SECTOR), 0xFF, FLASH_SECTOR);
+  return true;
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "ESP.restart()\n");
+  exit(0);
+}
@@ -0,0 +1,281 @@
+#pragma once
+// Host stand-in for the ESP8266 Arduino core, for [env:native].
+//
+// Only what the firmware uses. PROGMEM is plain memory, millis()/micros()
+// run on the host clock (see native.h to drive them by hand), Serial is
+// paced like a 115200 baud UART with its 128 byte TX FIFO, and the heap
+// figures of ESP come from the simulated heap of native_heap.cpp.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+// Flash strings
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+#define FPSTR(p) ((const __FlashStringHelper *)(p))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+// Runs the network (native HTTP server) and the timer1 interrupt
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+char *dtostrf(double number, signed char width, unsigned char prec, char *s);
+void configTime(const char *tz, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+
+// WString: heap buffer grown in 16 byte steps, up to 11 chars kept inline
+
+class String {
+ public:
+  String(const char *cstr = "");
+  String(const char *cstr, size_t len);
+  String(const String &other);
+  String(String &&other);
+  String(const __FlashStringHelper *str) : String((const char *)str) {}
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(double value, unsigned char decimals = 2);
+  ~String();
+
+  String &operator=(const String &rhs);
+  String &operator=(String &&rhs);
+  String &operator=(const char *cstr);
+
+  bool reserve(unsigned int size);
+  unsigned int length() const { return _len; }
+  const char *c_str() const { return _sso ? _inline : _buffer; }
+  bool isEmpty() const { return _len == 0; }
+
+  bool concat(const char *cstr, unsigned int len);
+  bool concat(const char *cstr) { return concat(cstr, strlen(cstr)); }
+  bool concat(const String &s) { return concat(s.c_str(), s._len); }
+  bool concat(char c) { return concat(&c, 1); }
+  String &operator+=(const String &rhs) { concat(rhs); return *this; }
+  String &operator+=(const char *cstr) { concat(cstr); return *this; }
+  String &operator+=(char c) { concat(c); return *this; }
+  friend String operator+(const String &lhs, const String &rhs) { String s(lhs); s += rhs; return s; }
+  friend String operator+(const String &lhs, const char *rhs) { String s(lhs); s += rhs; return s; }
+  friend String operator+(const char *lhs, const String &rhs) { String s(lhs); s += rhs; return s; }
+
+  bool equals(const char *cstr) const { return strcmp(c_str(), cstr ? cstr : "") == 0; }
+  bool equals(const String &s) const { return _len == s._len && memcmp(c_str(), s.c_str(), _len) == 0; }
+  bool equalsIgnoreCase(const String &s) const;
+  bool operator==(const String &rhs) const { return equals(rhs); }
+  bool operator==(const char *cstr) const { return equals(cstr); }
+  bool operator!=(const String &rhs) const { return !equals(rhs); }
+  bool operator!=(const char *cstr) const { return !equals(cstr); }
+  bool startsWith(const String &prefix) const;
+  bool endsWith(const String &suffix) const;
+
+  char operator[](unsigned int index) const { return index < _len ? c_str()[index] : 0; }
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const char *str, unsigned int from = 0) const;
+  String substring(unsigned int from) const { return substring(from, _len); }
+  String substring(unsigned int from, unsigned int to) const;
+  void toCharArray(char *buf, unsigned int size, unsigned int index = 0) const;
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return atof(c_str()); }
+  void toLowerCase();
+
+ private:
+  char *wbuffer() { return _sso ? _inline : _buffer; }
+
+  union {
+    char *_buffer;
+    char _inline[12];
+  };
+  unsigned int _len;
+  unsigned int _capacity;
+  bool _sso;
+};
+
+// Print
+
+class Print;
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return 0; }
+
+  size_t print(const __FlashStringHelper *str) { return write((const char *)str); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return printNumber(n, base); }
+  size_t print(int n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned int n, int base = DEC) { return printNumber(n, base); }
+  size_t print(long n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+  size_t print(long long n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned long long n, int base = DEC) { return printNumber(n, base); }
+  size_t print(double n, int digits = 2) { return printFloat(n, digits); }
+  size_t print(const Printable &p) { return p.printTo(*this); }
+
+  template <typename T>
+  size_t println(const T &value) { size_t n = print(value); return n + println(); }
+  template <typename T>
+  size_t println(const T &value, int format) { size_t n = print(value, format); return n + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  size_t printf_P(PGM_P format, ...) __attribute__((format(printf, 2, 3)));
+
+ private:
+  size_t printNumber(unsigned long long n, int base);
+  size_t printSigned(long long n, int base);
+  size_t printFloat(double number, int digits);
+  size_t vprintf(const char *format, va_list args);
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+// UART0: bytes leave at baud/10 per second through a 128 byte FIFO,
+// write() waits for room like the core does. Echoed to stdout (see native.h).
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long baud);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override;
+  void flush();
+  operator bool() const { return true; }
+
+ private:
+  void drain();
+
+  unsigned long _baud = 115200;
+  uint32_t _fifo = 0;        // bytes still in the FIFO
+  uint64_t _drained_us = 0;  // micros() the FIFO level was computed at
+};
+
+extern HardwareSerial Serial;
+
+// IPv4 address, the uint32 is in network byte order as on the ESP8266
+
+class IPAddress : public Printable {
+ public:
+  IPAddress() : _address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+  IPAddress(uint32_t address) : _address(address) {}
+  operator uint32_t() const { return _address; }
+  uint8_t operator[](int index) const { return ((const uint8_t *)&_address)[index]; }
+  bool operator==(const IPAddress &other) const { return _address == other._address; }
+  bool isSet() const { return _address != 0; }
+  bool fromString(const char *address);
+  String toString() const;
+  size_t printTo(Print &p) const override;
+
+ private:
+  uint32_t _address;
+};
+
+// ESP
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize();
+  uint8_t getHeapFragmentation();
+  uint32_t getChipId();
+  uint8_t getCpuFreqMHz() { return 80; }
+  uint32_t getCycleCount();
+  uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+  String getResetReason() { return "Power On"; }
+  // 512 bytes in 4 byte blocks, kept across native_restart()
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+  uint32_t random();
+  void random(uint8_t *data, size_t size);
+  // 4 MB of NOR flash: writes can only clear bits, erase sets a sector to 0xFF
+  bool flashRead(uint32_t address, uint32_t *data, size_t size);
+  bool flashWrite(uint32_t address, const uint32_t *data, size_t size);
+  bool flashEraseSector(uint32_t sector);
+  void restart();
+};
+
+extern EspClass ESP;
+
+// timer1, its interrupt is run by yield() once it is due (see native.h)
+
+#define TIM_DIV1 0
+#define TIM_DIV16 1
+#define TIM_DIV256 3
+#define TIM_EDGE 0
+#define TIM_LEVEL 1
+#define TIM_SINGLE 0
+#define TIM_LOOP 1
+
+typedef void (*timercallback)(void);
+void timer1_attachInterrupt(timercallback userFunc);
+void timer1_detachInterrupt();
+void timer1_enable(uint8_t divider, uint8_t int_type, uint8_t reload);
+void timer1_disable();
+void timer1_write(uint32_t ticks);
+
+// GPIO set/clear registers, written as is
+extern volatile uint32_t GPOS;
+extern volatile uint32_t GPOC;
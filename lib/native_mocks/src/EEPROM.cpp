@@ -0,0 +1,68 @@
+#include <EEPROM.h>
+#include "native.h"
+
+#define EEPROM_SECTOR_SIZE 4096
+
+EEPROMClass EEPROM;
+// The flash sector, kept across begin()/end()
+static uint8_t sector[EEPROM_SECTOR_SIZE];
+static bool sector_erased = false;
+static uint32_t commits = 0;
+
+uint32_t native_eeprom_commits() {
+  return commits;
+}
+
+void EEPROMClass::begin(size_t size) {
+  if (!sector_erased) {
+    memset(sector, 0xFF, sizeof(sector));
+    sector_erased = true;
+  }
+  size = (size + 3) & ~3;
+  if (size > EEPROM_SECTOR_SIZE) {
+    size = EEPROM_SECTOR_SIZE;
+  }
+  // As the core: the RAM copy comes from the heap
+  delete[] _data;
+  _data = new uint8_t[size];
+  _size = size;
+  memcpy(_data, sector, size);
+  _dirty = false;
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return address >= 0 && (size_t)address < _size ? _data[address] : 0;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address >= 0 && (size_t)address < _size && _data[address] != value) {
+    _data[address] = value;
+    _dirty = true;
+  }
+}
+
+bool EEPROMClass::commit() {
+  if (!_size) {
+    return false;
+  }
+  if (!_dirty) {
+    return true;
+  }
+  memcpy(sector, _data, _size);
+  commits++;
+  _dirty = false;
+  return true;
+}
+
+bool EEPROMClass::end() {
+  bool ok = commit();
+  delete[] _data;
+  _data = nullptr;
+  _size = 0;
+  return ok;
+}
+
+uint8_t *EEPROMClass::getDataPtr() {
+  _dirty = true;
+  return _data;
+}
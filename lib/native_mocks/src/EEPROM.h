@@ -0,0 +1,41 @@
+#pragma once
+// Host stand-in for the ESP8266 core's EEPROM: a RAM copy of the 4 KB
+// sector between begin() and end(), written back by commit().
+#include <Arduino.h>
+
+class EEPROMClass {
+ public:
+  void begin(size_t size);
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  bool commit();
+  bool end();
+  uint8_t *getDataPtr();
+  size_t length() { return _size; }
+
+  template <typename T>
+  T &get(int address, T &t) {
+    if (address >= 0 && address + sizeof(T) <= _size) {
+      memcpy((uint8_t *)&t, _data + address, sizeof(T));
+    }
+    return t;
+  }
+
+  template <typename T>
+  const T &put(int address, const T &t) {
+    if (address >= 0 && address + sizeof(T) <= _size) {
+      if (memcmp(_data + address, (const uint8_t *)&t, sizeof(T)) != 0) {
+        _dirty = true;
+        memcpy(_data + address, (const uint8_t *)&t, sizeof(T));
+      }
+    }
+    return t;
+  }
+
+ private:
+  uint8_t *_data = nullptr;
+  size_t _size = 0;
+  bool _dirty = false;
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,48 @@
+#pragma once
+// Host stand-in for the ESP8266 WiFi station: begin() associates at once,
+// the address is NATIVE_IP from the environment (default 127.0.0.1).
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+class ESP8266WiFiClass {
+ public:
+  bool mode(WiFiMode_t mode);
+  bool persistent(bool persistent);
+  bool setAutoReconnect(bool autoReconnect);
+  wl_status_t begin(const char *ssid, const char *passphrase = NULL, int32_t channel = 0,
+                    const uint8_t *bssid = NULL, bool connect = true);
+  // All zero: back to DHCP
+  bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0,
+              IPAddress dns2 = (uint32_t)0);
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+  uint8_t *BSSID();
+  int32_t channel();
+  int32_t RSSI();
+  String macAddress();
+
+  // What the last config() set, 0 with DHCP (native only)
+  IPAddress staticIP() { return _static_ip; }
+
+ private:
+  wl_status_t _status = WL_DISCONNECTED;
+  int32_t _channel = 6;
+  IPAddress _static_ip;
+};
+
+extern ESP8266WiFiClass WiFi;
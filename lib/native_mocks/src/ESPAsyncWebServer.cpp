@@ -0,0 +1,675 @@
+#include "ESPAsyncWebServer.h"
+#include <MD5Builder.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const String empty_string;
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static String url_decode(const char *text, size_t len) {
+  String out;
+  out.reserve(len);
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    if (c == '+') {
+      c = ' ';
+    } else if (c == '%' && i + 2 < len && hex_value(text[i + 1]) >= 0 && hex_value(text[i + 2]) >= 0) {
+      c = hex_value(text[i + 1]) * 16 + hex_value(text[i + 2]);
+      i += 2;
+    }
+    out += c;
+  }
+  return out;
+}
+
+static String md5_hex(const String &text) {
+  MD5Builder md5;
+  md5.begin();
+  md5.add(text);
+  md5.calculate();
+  return md5.toString();
+}
+
+static String base64(const String &text) {
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const uint8_t *p = (const uint8_t *)text.c_str();
+  size_t len = text.length();
+  String out;
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = p[i] << 16 | (i + 1 < len ? p[i + 1] << 8 : 0) | (i + 2 < len ? p[i + 2] : 0);
+    out += digits[(v >> 18) & 63];
+    out += digits[(v >> 12) & 63];
+    out += i + 1 < len ? digits[(v >> 6) & 63] : '=';
+    out += i + 2 < len ? digits[v & 63] : '=';
+  }
+  return out;
+}
+
+// Responses
+
+AsyncWebServerResponse::AsyncWebServerResponse(int code, const String &contentType, size_t contentLength,
+                                               bool chunked)
+    : _code(code), _contentType(contentType), _contentLength(contentLength), _chunked(chunked) {
+}
+
+void AsyncWebServerResponse::addHeader(const String &name, const String &value) {
+  _headers += name;
+  _headers += ": ";
+  _headers += value;
+  _headers += "\r\n";
+}
+
+AsyncBasicResponse::AsyncBasicResponse(int code, const String &contentType, const String &content)
+    : AsyncWebServerResponse(code, contentType, content.length(), false), _content(content) {
+  if (_contentLength && !_contentType.length()) {
+    _contentType = "text/plain";
+  }
+}
+
+size_t AsyncBasicResponse::fill(uint8_t *buf, size_t len, size_t index) {
+  size_t n = min(len, _content.length() - index);
+  memcpy(buf, _content.c_str() + index, n);
+  return n;
+}
+
+AsyncProgmemResponse::AsyncProgmemResponse(int code, const String &contentType, const uint8_t *content, size_t len)
+    : AsyncWebServerResponse(code, contentType, len, false), _content(content) {
+}
+
+size_t AsyncProgmemResponse::fill(uint8_t *buf, size_t len, size_t index) {
+  size_t n = min(len, _contentLength - index);
+  memcpy_P(buf, _content + index, n);
+  return n;
+}
+
+AsyncCallbackResponse::AsyncCallbackResponse(const String &contentType, size_t len, AwsResponseFiller callback,
+                                             bool chunked)
+    : AsyncWebServerResponse(200, contentType, len, chunked), _callback(callback) {
+}
+
+size_t AsyncCallbackResponse::fill(uint8_t *buf, size_t len, size_t index) {
+  if (!_chunked) {
+    len = min(len, _contentLength - index);
+    if (!len) {
+      return 0;
+    }
+  }
+  return _callback(buf, len, index);
+}
+
+AsyncResponseStream::AsyncResponseStream(const String &contentType, size_t bufferSize)
+    : AsyncWebServerResponse(200, contentType, 0, false), _size(bufferSize) {
+  _buffer = (uint8_t *)malloc(bufferSize);
+}
+
+AsyncResponseStream::~AsyncResponseStream() {
+  free(_buffer);
+}
+
+size_t AsyncResponseStream::write(const uint8_t *data, size_t len) {
+  if (len > _size - _contentLength) {
+    size_t size = _contentLength + len;
+    uint8_t *grown = (uint8_t *)malloc(size);
+    if (!grown) {
+      return 0;
+    }
+    memcpy(grown, _buffer, _contentLength);
+    free(_buffer);
+    _buffer = grown;
+    _size = size;
+  }
+  memcpy(_buffer + _contentLength, data, len);
+  _contentLength += len;
+  return len;
+}
+
+size_t AsyncResponseStream::fill(uint8_t *buf, size_t len, size_t index) {
+  size_t n = min(len, _contentLength - index);
+  memcpy(buf, _buffer + index, n);
+  return n;
+}
+
+// Request
+
+AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer *server)
+    : _tempObject(NULL),
+      _server(server),
+      _method(HTTP_ANY),
+      _contentLength(0),
+      _parsedLength(0),
+      _isPlainPost(false),
+      _handled(false),
+      _isDigest(false),
+      _attached(NULL),
+      _sent(NULL) {
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+  for (AsyncWebHeader *h : _headers) {
+    delete h;
+  }
+  for (AsyncWebParameter *p : _params) {
+    delete p;
+  }
+  delete _sent;
+  free(_tempObject);
+}
+
+const char *AsyncWebServerRequest::methodToString() const {
+  switch (_method) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    case HTTP_DELETE: return "DELETE";
+    case HTTP_PUT: return "PUT";
+    case HTTP_PATCH: return "PATCH";
+    case HTTP_HEAD: return "HEAD";
+    case HTTP_OPTIONS: return "OPTIONS";
+  }
+  return "UNKNOWN";
+}
+
+const String &AsyncWebServerRequest::arg(const char *name) const {
+  for (AsyncWebParameter *p : _params) {
+    if (p->name() == name) {
+      return p->value();
+    }
+  }
+  return empty_string;
+}
+
+const String &AsyncWebServerRequest::arg(size_t i) const {
+  return i < _params.size() ? _params[i]->value() : empty_string;
+}
+
+const String &AsyncWebServerRequest::argName(size_t i) const {
+  return i < _params.size() ? _params[i]->name() : empty_string;
+}
+
+bool AsyncWebServerRequest::hasArg(const char *name) const {
+  for (AsyncWebParameter *p : _params) {
+    if (p->name() == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const String &AsyncWebServerRequest::header(const char *name) const {
+  for (AsyncWebHeader *h : _headers) {
+    if (h->name().equalsIgnoreCase(name)) {
+      return h->value();
+    }
+  }
+  return empty_string;
+}
+
+bool AsyncWebServerRequest::hasHeader(const char *name) const {
+  for (AsyncWebHeader *h : _headers) {
+    if (h->name().equalsIgnoreCase(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Value of name="value" or name=value in a Digest header, empty if absent
+static String digest_field(const String &header, const char *name) {
+  const char *p = header.c_str();
+  size_t name_len = strlen(name);
+  while (*p) {
+    while (*p == ' ' || *p == ',') {
+      p++;
+    }
+    const char *eq = strchr(p, '=');
+    if (!eq) {
+      break;
+    }
+    bool match = (size_t)(eq - p) == name_len && strncasecmp(p, name, name_len) == 0;
+    const char *value = eq + 1;
+    const char *end;
+    if (*value == '"') {
+      value++;
+      end = strchr(value, '"');
+      if (!end) {
+        end = value + strlen(value);
+      }
+      p = *end ? end + 1 : end;
+    } else {
+      end = strchr(value, ',');
+      if (!end) {
+        end = value + strlen(value);
+      }
+      p = end;
+    }
+    if (match) {
+      return String(value, end - value);
+    }
+  }
+  return String();
+}
+
+// As the library: Basic, or Digest without a nonce check
+bool AsyncWebServerRequest::authenticate(const char *username, const char *password, const char *realm,
+                                         bool passwordIsHash) {
+  if (!_authorization.length()) {
+    return false;
+  }
+  if (!_isDigest) {
+    if (passwordIsHash) {
+      return _authorization.equals(password);
+    }
+    return _authorization.equals(base64(String(username) + ":" + password));
+  }
+  if (digest_field(_authorization, "username") != username) {
+    return false;
+  }
+  String myRealm = digest_field(_authorization, "realm");
+  if (realm && myRealm != realm) {
+    return false;
+  }
+  String ha1 = passwordIsHash ? String(password) : md5_hex(String(username) + ":" + myRealm + ":" + password);
+  String ha2 = md5_hex(String(methodToString()) + ":" + digest_field(_authorization, "uri"));
+  String expected = md5_hex(ha1 + ":" + digest_field(_authorization, "nonce") + ":" +
+                            digest_field(_authorization, "nc") + ":" + digest_field(_authorization, "cnonce") +
+                            ":" + digest_field(_authorization, "qop") + ":" + ha2);
+  return digest_field(_authorization, "response") == expected;
+}
+
+static String random_md5() {
+  char seed[12];
+  snprintf(seed, sizeof(seed), "%08x", (unsigned)ESP.random());
+  return md5_hex(seed);
+}
+
+void AsyncWebServerRequest::requestAuthentication(const char *realm, bool isDigest) {
+  AsyncWebServerResponse *r = beginResponse(401);
+  if (!isDigest) {
+    r->addHeader("WWW-Authenticate", String("Basic realm=\"") + (realm ? realm : "Login Required") + "\"");
+  } else {
+    r->addHeader("WWW-Authenticate", String("Digest realm=\"") + (realm ? realm : "asyncesp") +
+                                         "\", qop=\"auth\", nonce=\"" + random_md5() + "\", opaque=\"" +
+                                         random_md5() + "\"");
+  }
+  send(r);
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response) {
+  if (_sent) {
+    // Only the first response goes out
+    delete response;
+    return;
+  }
+  _sent = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content) {
+  send(beginResponse(code, contentType, content));
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType,
+                                                             const String &content) {
+  return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse_P(int code, const String &contentType,
+                                                               const uint8_t *content, size_t len) {
+  return new AsyncProgmemResponse(code, contentType, content, len);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType,
+                                                                    AwsResponseFiller callback) {
+  return new AsyncCallbackResponse(contentType, 0, callback, true);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(const String &contentType, size_t len,
+                                                             AwsResponseFiller callback) {
+  return new AsyncCallbackResponse(contentType, len, callback);
+}
+
+AsyncResponseStream *AsyncWebServerRequest::beginResponseStream(const String &contentType, size_t bufferSize) {
+  return new AsyncResponseStream(contentType, bufferSize);
+}
+
+// name=value pairs separated by '&'
+void AsyncWebServerRequest::addParams(const char *query, size_t len, bool form) {
+  const char *end = query + len;
+  while (query < end) {
+    const char *amp = (const char *)memchr(query, '&', end - query);
+    const char *stop = amp ? amp : end;
+    const char *eq = (const char *)memchr(query, '=', stop - query);
+    if (stop > query) {
+      const char *name_end = eq ? eq : stop;
+      const char *value = eq ? eq + 1 : stop;
+      _params.push_back(new AsyncWebParameter(url_decode(query, name_end - query),
+                                              url_decode(value, stop - value), form));
+    }
+    query = stop + 1;
+  }
+}
+
+void AsyncWebServerRequest::_begin(const char *method, const char *url, const char *headers) {
+  static const char *const methods[] = {"GET", "POST", "DELETE", "PUT", "PATCH", "HEAD", "OPTIONS"};
+  for (uint8_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+    if (strcmp(method, methods[i]) == 0) {
+      _method = 1 << i;
+    }
+  }
+  const char *query = strchr(url, '?');
+  if (query) {
+    _url = url_decode(url, query - url);
+    addParams(query + 1, strlen(query + 1), false);
+  } else {
+    _url = url_decode(url, strlen(url));
+  }
+  const char *line = headers ? headers : "";
+  while (*line) {
+    const char *eol = strstr(line, "\r\n");
+    size_t len = eol ? eol - line : strlen(line);
+    const char *colon = (const char *)memchr(line, ':', len);
+    if (colon) {
+      String name(line, colon - line);
+      const char *value = colon + 1;
+      while (*value == ' ') {
+        value++;
+      }
+      String text(value, line + len - value);
+      if (name.equalsIgnoreCase("Content-Type")) {
+        _contentType = text;
+      } else if (name.equalsIgnoreCase("Content-Length")) {
+        _contentLength = text.toInt();
+      } else if (name.equalsIgnoreCase("Authorization")) {
+        if (text.startsWith("Basic ")) {
+          _authorization = text.substring(6);
+        } else if (text.startsWith("Digest ")) {
+          _isDigest = true;
+          _authorization = text.substring(7);
+        }
+      }
+      _headers.push_back(new AsyncWebHeader(name, text));
+    }
+    line += eol ? len + 2 : len;
+  }
+  _server->_attachHandler(this);
+}
+
+// As the library's _parsePlainPostChar()
+void AsyncWebServerRequest::parsePlainPostChar(char c) {
+  if (c && c != '&') {
+    _temp += c;
+  }
+  if (!c || c == '&' || _parsedLength == _contentLength) {
+    String name = "body";
+    String value = _temp;
+    if (!_temp.startsWith("{") && !_temp.startsWith("[") && _temp.indexOf('=') > 0) {
+      name = _temp.substring(0, _temp.indexOf('='));
+      value = _temp.substring(_temp.indexOf('=') + 1);
+    }
+    _params.push_back(new AsyncWebParameter(url_decode(name.c_str(), name.length()),
+                                            url_decode(value.c_str(), value.length()), true));
+    _temp = String();
+  }
+}
+
+static bool is_param_char(char c) {
+  return c && c != '{' && c != '[' && c != '&' && c != '=';
+}
+
+void AsyncWebServerRequest::_onBody(const uint8_t *data, size_t len) {
+  if (len && _parsedLength == 0) {
+    const char *text = (const char *)data;
+    if (_contentType.startsWith("application/x-www-form-urlencoded")) {
+      _isPlainPost = true;
+    } else if (_contentType == "text/plain" && is_param_char(text[0])) {
+      // A text body that looks like name=value is taken as a form
+      size_t i = 0;
+      while (i < len && is_param_char(text[i++])) {
+      }
+      if (i < len && text[i - 1] == '=') {
+        _isPlainPost = true;
+      }
+    }
+  }
+  if (!_isPlainPost) {
+    if (len && _attached) {
+      _attached->handleBody(this, (uint8_t *)data, len, _parsedLength, _contentLength);
+    }
+    _parsedLength += len;
+  } else if (_attached && !_attached->isRequestHandlerTrivial()) {
+    for (size_t i = 0; i < len; i++) {
+      _parsedLength++;
+      parsePlainPostChar(data[i]);
+    }
+  } else {
+    _parsedLength += len;
+  }
+  if (_parsedLength >= _contentLength && !_handled) {
+    _handled = true;
+    if (_attached) {
+      _attached->handleRequest(this);
+    } else {
+      send(501);
+    }
+  }
+}
+
+void AsyncWebServerRequest::_onDisconnect() {
+  if (_onDisconnectfn) {
+    _onDisconnectfn();
+  }
+}
+
+// Handlers
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request) {
+  if (!_onRequest || !(_method & request->method())) {
+    return false;
+  }
+  if (_uri.length() && _uri.endsWith("*")) {
+    return request->url().startsWith(_uri.substring(0, _uri.length() - 1));
+  }
+  return !_uri.length() || request->url() == _uri || request->url().startsWith(_uri + "/");
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest *request) {
+  if (_onRequest) {
+    _onRequest(request);
+  } else {
+    request->send(500);
+  }
+}
+
+void AsyncCallbackWebHandler::handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                                         size_t total) {
+  if (_onBody) {
+    _onBody(request, data, len, index, total);
+  }
+}
+
+// Server-Sent Events
+
+AsyncEventSourceClient::AsyncEventSourceClient(AsyncEventSource *source, int fd)
+    : _source(source), _fd(fd), _connected(true) {
+}
+
+AsyncEventSourceClient::~AsyncEventSourceClient() {
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+}
+
+// retry:, id:, event: then one data: line per line of the message
+static String event_message(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  String ev;
+  if (reconnect) {
+    ev += "retry: ";
+    ev += String(reconnect);
+    ev += "\r\n";
+  }
+  if (id) {
+    ev += "id: ";
+    ev += String(id);
+    ev += "\r\n";
+  }
+  if (event) {
+    ev += "event: ";
+    ev += event;
+    ev += "\r\n";
+  }
+  if (message) {
+    const char *line = message;
+    while (true) {
+      size_t len = strcspn(line, "\r\n");
+      ev += "data: ";
+      ev += String(line, len);
+      ev += "\r\n";
+      line += len;
+      if (!*line) {
+        break;
+      }
+      line += line[0] == '\r' && line[1] == '\n' ? 2 : 1;
+    }
+  }
+  ev += "\r\n";
+  return ev;
+}
+
+void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  if (!_connected) {
+    return;
+  }
+  String ev = event_message(message, event, id, reconnect);
+  if (_fd < 0) {
+    _events += ev;
+  } else if (::send(_fd, ev.c_str(), ev.length(), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)ev.length()) {
+    _connected = false;
+  }
+}
+
+void AsyncEventSourceClient::close() {
+  _connected = false;
+}
+
+AsyncEventSource::~AsyncEventSource() {
+  for (AsyncEventSourceClient *c : _clients) {
+    delete c;
+  }
+}
+
+void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  for (AsyncEventSourceClient *c : _clients) {
+    c->send(message, event, id, reconnect);
+  }
+  // TCP subscribers that went away
+  for (size_t i = 0; i < _clients.size();) {
+    if (!_clients[i]->connected() && _clients[i]->_socket() >= 0) {
+      delete _clients[i];
+      _clients.erase(_clients.begin() + i);
+    } else {
+      i++;
+    }
+  }
+}
+
+size_t AsyncEventSource::count() const {
+  size_t n = 0;
+  for (AsyncEventSourceClient *c : _clients) {
+    n += c->connected();
+  }
+  return n;
+}
+
+bool AsyncEventSource::canHandle(AsyncWebServerRequest *request) {
+  return request->method() == HTTP_GET && request->url() == _url;
+}
+
+void AsyncEventSource::handleRequest(AsyncWebServerRequest *request) {
+  request->send(new AsyncEventSourceResponse(this));
+}
+
+AsyncEventSourceClient *AsyncEventSource::_addClient(int fd) {
+  AsyncEventSourceClient *client = new AsyncEventSourceClient(this, fd);
+  _clients.push_back(client);
+  if (_connectcb) {
+    _connectcb(client);
+  }
+  return client;
+}
+
+void AsyncEventSource::_removeClient(AsyncEventSourceClient *client) {
+  for (size_t i = 0; i < _clients.size(); i++) {
+    if (_clients[i] == client) {
+      _clients.erase(_clients.begin() + i);
+      break;
+    }
+  }
+}
+
+AsyncEventSourceResponse::AsyncEventSourceResponse(AsyncEventSource *source)
+    : AsyncWebServerResponse(200, "text/event-stream", 0, false), _source(source) {
+  addHeader("Cache-Control", "no-cache");
+}
+
+// Server
+
+AsyncWebServer *AsyncWebServer::_native = NULL;
+
+AsyncWebServer::AsyncWebServer(uint16_t port) : _port(port), _started(false) {
+  _catchAllHandler = new AsyncCallbackWebHandler();
+  _native = this;
+}
+
+AsyncWebServer::~AsyncWebServer() {
+  delete _catchAllHandler;
+  if (_native == this) {
+    _native = NULL;
+  }
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler) {
+  _handlers.push_back(handler);
+  return *handler;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, ArRequestHandlerFunction onRequest) {
+  return on(uri, HTTP_ANY, onRequest);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest) {
+  return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload,
+                                            ArBodyHandlerFunction onBody) {
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler();
+  handler->setUri(uri);
+  handler->setMethod(method);
+  handler->onRequest(onRequest);
+  handler->onUpload(onUpload);
+  handler->onBody(onBody);
+  addHandler(handler);
+  return *handler;
+}
+
+void AsyncWebServer::_attachHandler(AsyncWebServerRequest *request) {
+  for (AsyncWebHandler *h : _handlers) {
+    if (h->filter(request) && h->canHandle(request)) {
+      request->_setHandler(h);
+      return;
+    }
+  }
+  request->_setHandler(_catchAllHandler);
+}
@@ -0,0 +1,343 @@
+#pragma once
+// Host stand-in for ESPAsyncWebServer (esphome fork), for [env:native].
+//
+// Same request handling as the library: handlers are tried in the order
+// they were added (filter, then canHandle()), onNotFound() takes the rest,
+// form and "plain post" bodies become params, other bodies go to the body
+// handler in TCP segments, and responses are read a send window at a time.
+// Requests come from native_request() or the TCP server of
+// native_http_listen() (see native.h).
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+// Send window of the core's default lwIP build (TCP_SND_BUF, 2 x 536 MSS)
+#define NATIVE_TCP_MSS 536
+#define NATIVE_TCP_WINDOW (2 * NATIVE_TCP_MSS)
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+class AsyncWebHandler;
+
+class AsyncWebHeader {
+ public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+ private:
+  String _name;
+  String _value;
+};
+
+class AsyncWebParameter {
+ public:
+  AsyncWebParameter(const String &name, const String &value, bool form = false)
+      : _name(name), _value(value), _isForm(form) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+  bool isPost() const { return _isForm; }
+
+ private:
+  String _name;
+  String _value;
+  bool _isForm;
+};
+
+typedef std::function<size_t(uint8_t *, size_t, size_t)> AwsResponseFiller;
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool)>
+    ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t)> ArBodyHandlerFunction;
+typedef std::function<bool(AsyncWebServerRequest *)> ArRequestFilterFunction;
+typedef std::function<void(void)> ArDisconnectHandler;
+
+// Responses
+
+class AsyncWebServerResponse {
+ public:
+  AsyncWebServerResponse(int code, const String &contentType, size_t contentLength, bool chunked);
+  virtual ~AsyncWebServerResponse() {}
+  void setCode(int code) { _code = code; }
+  void addHeader(const String &name, const String &value);
+  void setContentLength(size_t len) { _contentLength = len; }
+
+  int code() const { return _code; }
+  const String &contentType() const { return _contentType; }
+  // "Name: value\r\n" lines
+  const String &headers() const { return _headers; }
+  size_t contentLength() const { return _contentLength; }
+  bool chunked() const { return _chunked; }
+  // Next piece of the body, at most len bytes from index on: 0 at the end,
+  // RESPONSE_TRY_AGAIN if nothing is ready yet
+  virtual size_t fill(uint8_t *buf, size_t len, size_t index) = 0;
+
+ protected:
+  int _code;
+  String _contentType;
+  String _headers;
+  size_t _contentLength;
+  bool _chunked;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+ public:
+  AsyncBasicResponse(int code, const String &contentType, const String &content);
+  size_t fill(uint8_t *buf, size_t len, size_t index) override;
+
+ private:
+  String _content;
+};
+
+class AsyncProgmemResponse : public AsyncWebServerResponse {
+ public:
+  AsyncProgmemResponse(int code, const String &contentType, const uint8_t *content, size_t len);
+  size_t fill(uint8_t *buf, size_t len, size_t index) override;
+
+ private:
+  const uint8_t *_content;
+};
+
+class AsyncCallbackResponse : public AsyncWebServerResponse {
+ public:
+  AsyncCallbackResponse(const String &contentType, size_t len, AwsResponseFiller callback, bool chunked = false);
+  size_t fill(uint8_t *buf, size_t len, size_t index) override;
+
+ private:
+  AwsResponseFiller _callback;
+};
+
+// Body in a heap buffer grown by exactly what each write() needs, as the
+// library's cbuf::resizeAdd()
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+ public:
+  AsyncResponseStream(const String &contentType, size_t bufferSize);
+  ~AsyncResponseStream();
+  size_t write(const uint8_t *data, size_t len) override;
+  size_t write(uint8_t data) override { return write(&data, 1); }
+  using Print::write;
+  size_t fill(uint8_t *buf, size_t len, size_t index) override;
+
+ private:
+  uint8_t *_buffer;
+  size_t _size;
+};
+
+// Request
+
+class AsyncWebServerRequest {
+ public:
+  void *_tempObject;
+
+  AsyncWebServerRequest(AsyncWebServer *server);
+  ~AsyncWebServerRequest();
+
+  WebRequestMethodComposite method() const { return _method; }
+  const String &url() const { return _url; }
+  const char *methodToString() const;
+
+  size_t args() const { return _params.size(); }
+  const String &arg(const char *name) const;
+  const String &arg(const String &name) const { return arg(name.c_str()); }
+  const String &arg(size_t i) const;
+  const String &argName(size_t i) const;
+  bool hasArg(const char *name) const;
+  size_t params() const { return _params.size(); }
+  AsyncWebParameter *getParam(size_t i) const { return i < _params.size() ? _params[i] : NULL; }
+
+  size_t headers() const { return _headers.size(); }
+  const String &header(const char *name) const;
+  bool hasHeader(const char *name) const;
+  size_t contentLength() const { return _contentLength; }
+  const String &contentType() const { return _contentType; }
+
+  bool authenticate(const char *username, const char *password, const char *realm = NULL,
+                    bool passwordIsHash = false);
+  void requestAuthentication(const char *realm = NULL, bool isDigest = true);
+  void onDisconnect(ArDisconnectHandler fn) { _onDisconnectfn = fn; }
+
+  void send(AsyncWebServerResponse *response);
+  void send(int code, const String &contentType = String(), const String &content = String());
+  AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(),
+                                        const String &content = String());
+  AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content,
+                                          size_t len);
+  AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback);
+  AsyncWebServerResponse *beginResponse(const String &contentType, size_t len, AwsResponseFiller callback);
+  AsyncResponseStream *beginResponseStream(const String &contentType, size_t bufferSize = 1460);
+
+  // Native side (native.h): parse the request line and headers, attach
+  // the handler, then take the body and run it
+  void _begin(const char *method, const char *url, const char *headers);
+  // Body bytes as they arrive, the handler runs once all are in (at once
+  // without a body)
+  void _onBody(const uint8_t *data, size_t len);
+  void _onDisconnect();
+  AsyncWebServerResponse *_response() const { return _sent; }
+  AsyncWebHandler *_handler() const { return _attached; }
+  void _setHandler(AsyncWebHandler *handler) { _attached = handler; }
+
+ private:
+  void addParams(const char *query, size_t len, bool form);
+  void parsePlainPostChar(char c);
+
+  AsyncWebServer *_server;
+  WebRequestMethodComposite _method;
+  String _url;
+  String _contentType;
+  size_t _contentLength;
+  size_t _parsedLength;
+  bool _isPlainPost;
+  bool _handled;
+  String _temp;
+  String _authorization;
+  bool _isDigest;
+  std::vector<AsyncWebHeader *> _headers;
+  std::vector<AsyncWebParameter *> _params;
+  AsyncWebHandler *_attached;
+  AsyncWebServerResponse *_sent;
+  ArDisconnectHandler _onDisconnectfn;
+};
+
+// Handlers
+
+class AsyncWebHandler {
+ public:
+  virtual ~AsyncWebHandler() {}
+  AsyncWebHandler &setFilter(ArRequestFilterFunction fn) {
+    _filter = fn;
+    return *this;
+  }
+  bool filter(AsyncWebServerRequest *request) { return !_filter || _filter(request); }
+  virtual bool canHandle(AsyncWebServerRequest *request) { return false; }
+  virtual void handleRequest(AsyncWebServerRequest *request) {}
+  virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                          size_t total) {}
+  virtual bool isRequestHandlerTrivial() { return true; }
+
+ protected:
+  ArRequestFilterFunction _filter;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+ public:
+  AsyncCallbackWebHandler() : _method(HTTP_ANY) {}
+  void setUri(const String &uri) { _uri = uri; }
+  void setMethod(WebRequestMethodComposite method) { _method = method; }
+  void onRequest(ArRequestHandlerFunction fn) { _onRequest = fn; }
+  void onUpload(ArUploadHandlerFunction fn) { _onUpload = fn; }
+  void onBody(ArBodyHandlerFunction fn) { _onBody = fn; }
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                  size_t total) override;
+  bool isRequestHandlerTrivial() override { return !_onRequest; }
+
+ private:
+  String _uri;
+  WebRequestMethodComposite _method;
+  ArRequestHandlerFunction _onRequest;
+  ArUploadHandlerFunction _onUpload;
+  ArBodyHandlerFunction _onBody;
+};
+
+// Server-Sent Events. A subscriber of native_request() gets what is sent
+// during onConnect as the response body and is dropped when the request
+// finishes; TCP subscribers stay until they disconnect.
+
+class AsyncEventSource;
+
+class AsyncEventSourceClient {
+ public:
+  AsyncEventSourceClient(AsyncEventSource *source, int fd);
+  ~AsyncEventSourceClient();
+  void send(const char *message, const char *event = NULL, uint32_t id = 0, uint32_t reconnect = 0);
+  void close();
+  bool connected() const { return _connected; }
+  size_t packetsWaiting() const { return 0; }
+  // Events sent so far, for native_request() subscribers
+  const String &_captured() const { return _events; }
+  int _socket() const { return _fd; }
+
+ private:
+  AsyncEventSource *_source;
+  int _fd;
+  bool _connected;
+  String _events;
+};
+
+typedef std::function<void(AsyncEventSourceClient *)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler {
+ public:
+  AsyncEventSource(const String &url) : _url(url) {}
+  ~AsyncEventSource();
+  void onConnect(ArEventHandlerFunction cb) { _connectcb = cb; }
+  void send(const char *message, const char *event = NULL, uint32_t id = 0, uint32_t reconnect = 0);
+  size_t count() const;
+  size_t avgPacketsWaiting() const { return 0; }
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+
+  // Native side: subscribe, onConnect runs
+  AsyncEventSourceClient *_addClient(int fd);
+  void _removeClient(AsyncEventSourceClient *client);
+
+ private:
+  String _url;
+  std::vector<AsyncEventSourceClient *> _clients;
+  ArEventHandlerFunction _connectcb;
+};
+
+// Response of the event source, text/event-stream
+class AsyncEventSourceResponse : public AsyncWebServerResponse {
+ public:
+  AsyncEventSourceResponse(AsyncEventSource *source);
+  size_t fill(uint8_t *buf, size_t len, size_t index) override { return 0; }
+  AsyncEventSource *source() const { return _source; }
+
+ private:
+  AsyncEventSource *_source;
+};
+
+// Server
+
+class AsyncWebServer {
+ public:
+  AsyncWebServer(uint16_t port);
+  ~AsyncWebServer();
+  void begin() { _started = true; }
+  void end() { _started = false; }
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+  AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest);
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                              ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody = nullptr);
+  void onNotFound(ArRequestHandlerFunction fn) { _catchAllHandler->onRequest(fn); }
+
+  bool _isStarted() const { return _started; }
+  void _attachHandler(AsyncWebServerRequest *request);
+  // The last one created, requests of native.h go to it
+  static AsyncWebServer *_native;
+
+ private:
+  uint16_t _port;
+  bool _started;
+  std::vector<AsyncWebHandler *> _handlers;
+  AsyncCallbackWebHandler *_catchAllHandler;
+};
@@ -0,0 +1,119 @@
+#include <IRsend.h>
+#include <ir_Gree.h>
+#include "native.h"
+
+static NativeIrPulse pulses[NATIVE_IR_PULSES_MAX];
+static uint16_t pulse_count = 0;
+
+uint16_t native_ir_pulses(const NativeIrPulse **out) {
+  *out = pulses;
+  return pulse_count;
+}
+
+void native_ir_clear() {
+  pulse_count = 0;
+}
+
+static void record(bool mark, uint32_t us) {
+  // Nothing reaches the LED for a zero length mark or space
+  if (us && pulse_count < NATIVE_IR_PULSES_MAX) {
+    pulses[pulse_count++] = {mark, us};
+  }
+}
+
+IRsend::IRsend(uint16_t pin, bool, bool) : _pin(pin) {
+}
+
+void IRsend::begin() {
+}
+
+void IRsend::enableIROut(uint32_t, uint8_t) {
+}
+
+uint16_t IRsend::mark(uint16_t usec) {
+  record(true, usec);
+  delayMicroseconds(usec);
+  return usec ? 1 : 0;
+}
+
+void IRsend::space(uint32_t usec) {
+  record(false, usec);
+  delayMicroseconds(usec);
+}
+
+// From here on as in IRsend.cpp / ir_Gree.cpp of IRremoteESP8266
+
+void IRsend::sendData(uint16_t onemark, uint32_t onespace, uint16_t zeromark, uint32_t zerospace, uint64_t data,
+                      uint16_t nbits, bool MSBfirst) {
+  if (nbits == 0) {
+    return;
+  }
+  if (MSBfirst) {
+    while (nbits > sizeof(data) * 8) {
+      mark(zeromark);
+      space(zerospace);
+      nbits--;
+    }
+    for (uint64_t mask = 1ULL << (nbits - 1); mask; mask >>= 1) {
+      if (data & mask) {
+        mark(onemark);
+        space(onespace);
+      } else {
+        mark(zeromark);
+        space(zerospace);
+      }
+    }
+  } else {
+    for (uint16_t bit = 0; bit < nbits; bit++, data >>= 1) {
+      if (data & 1) {
+        mark(onemark);
+        space(onespace);
+      } else {
+        mark(zeromark);
+        space(zerospace);
+      }
+    }
+  }
+}
+
+void IRsend::sendGeneric(const uint16_t headermark, const uint32_t headerspace, const uint16_t onemark,
+                         const uint32_t onespace, const uint16_t zeromark, const uint32_t zerospace,
+                         const uint16_t footermark, const uint32_t gap, const uint8_t *dataptr,
+                         const uint16_t nbytes, const uint16_t frequency, const bool MSBfirst,
+                         const uint16_t repeat, const uint8_t dutycycle) {
+  enableIROut(frequency, dutycycle);
+  for (uint16_t r = 0; r <= repeat; r++) {
+    if (headermark) {
+      mark(headermark);
+    }
+    if (headerspace) {
+      space(headerspace);
+    }
+    for (uint16_t i = 0; i < nbytes; i++) {
+      sendData(onemark, onespace, zeromark, zerospace, *(dataptr + i), 8, MSBfirst);
+    }
+    if (footermark) {
+      mark(footermark);
+    }
+    space(gap);
+  }
+}
+
+void IRsend::sendGree(const unsigned char data[], const uint16_t nbytes, const uint16_t repeat) {
+  if (nbytes < kGreeStateLength) {
+    return;
+  }
+  for (uint16_t r = 0; r <= repeat; r++) {
+    // Block #1
+    sendGeneric(kGreeHdrMark, kGreeHdrSpace, kGreeBitMark, kGreeOneSpace, kGreeBitMark, kGreeZeroSpace, 0, 0,
+                data, 4, 38, false, 0, 50);
+    // Footer #1
+    sendData(kGreeBitMark, kGreeOneSpace, kGreeBitMark, kGreeZeroSpace, kGreeBlockFooter, kGreeBlockFooterBits,
+             false);
+    mark(kGreeBitMark);
+    space(kGreeMsgSpace);
+    // Block #2
+    sendGeneric(0, 0, kGreeBitMark, kGreeOneSpace, kGreeBitMark, kGreeZeroSpace, kGreeBitMark, kGreeMsgSpace,
+                data + 4, nbytes - 4, 38, false, 0, 50);
+  }
+}
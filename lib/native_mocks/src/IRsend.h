@@ -0,0 +1,25 @@
+#pragma once
+// Host stand-in for IRremoteESP8266's IRsend: mark() and space() are
+// recorded (see native_ir_pulses() in native.h) instead of driving a pin.
+// sendData(), sendGeneric() and sendGree() are the library's, so the
+// recording is the frame the real IRsend emits.
+#include <Arduino.h>
+
+class IRsend {
+ public:
+  explicit IRsend(uint16_t pin, bool inverted = false, bool use_modulation = true);
+  void begin();
+  void enableIROut(uint32_t freq, uint8_t duty = 50);
+  uint16_t mark(uint16_t usec);
+  void space(uint32_t usec);
+  void sendData(uint16_t onemark, uint32_t onespace, uint16_t zeromark, uint32_t zerospace, uint64_t data,
+                uint16_t nbits, bool MSBfirst = true);
+  void sendGeneric(const uint16_t headermark, const uint32_t headerspace, const uint16_t onemark,
+                   const uint32_t onespace, const uint16_t zeromark, const uint32_t zerospace,
+                   const uint16_t footermark, const uint32_t gap, const uint8_t *dataptr, const uint16_t nbytes,
+                   const uint16_t frequency, const bool MSBfirst, const uint16_t repeat, const uint8_t dutycycle);
+  void sendGree(const unsigned char data[], const uint16_t nbytes, const uint16_t repeat = 0);
+
+ private:
+  uint16_t _pin;
+};
@@ -0,0 +1,22 @@
+#pragma once
+// Host stand-in for the core's MD5Builder (RFC 1321)
+#include <Arduino.h>
+
+class MD5Builder {
+ public:
+  void begin();
+  void add(const uint8_t *data, size_t len);
+  void add(const char *data) { add((const uint8_t *)data, strlen(data)); }
+  void add(const String &data) { add((const uint8_t *)data.c_str(), data.length()); }
+  void calculate();
+  void getBytes(uint8_t *output) const;
+  void getChars(char *output) const;
+  String toString() const;
+
+ private:
+  void block(const uint8_t *p);
+
+  uint32_t _h[4];
+  uint8_t _buf[64];
+  uint64_t _len;
+};
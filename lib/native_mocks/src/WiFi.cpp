@@ -0,0 +1,133 @@
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+ESP8266WiFiClass WiFi;
+
+static const uint8_t native_bssid[6] = {0x02, 0x00, 0x00, 0x4e, 0x41, 0x54};
+
+bool ESP8266WiFiClass::mode(WiFiMode_t) {
+  return true;
+}
+
+bool ESP8266WiFiClass::persistent(bool) {
+  return true;
+}
+
+bool ESP8266WiFiClass::setAutoReconnect(bool) {
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char *, const char *, int32_t channel, const uint8_t *, bool connect) {
+  if (channel) {
+    _channel = channel;
+  }
+  _status = connect ? WL_CONNECTED : WL_DISCONNECTED;
+  return _status;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local_ip, IPAddress, IPAddress, IPAddress, IPAddress) {
+  _static_ip = local_ip;
+  return true;
+}
+
+bool ESP8266WiFiClass::disconnect(bool) {
+  _status = WL_DISCONNECTED;
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+  return _status;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+  IPAddress ip(127, 0, 0, 1);
+  const char *env = getenv("NATIVE_IP");
+  if (env) {
+    ip.fromString(env);
+  }
+  return ip;
+}
+
+IPAddress ESP8266WiFiClass::gatewayIP() {
+  return IPAddress(127, 0, 0, 1);
+}
+
+IPAddress ESP8266WiFiClass::subnetMask() {
+  return IPAddress(255, 0, 0, 0);
+}
+
+IPAddress ESP8266WiFiClass::dnsIP(uint8_t) {
+  return IPAddress(127, 0, 0, 1);
+}
+
+uint8_t *ESP8266WiFiClass::BSSID() {
+  return (uint8_t *)native_bssid;
+}
+
+int32_t ESP8266WiFiClass::channel() {
+  return _channel;
+}
+
+int32_t ESP8266WiFiClass::RSSI() {
+  return _status == WL_CONNECTED ? -55 : 31;
+}
+
+String ESP8266WiFiClass::macAddress() {
+  return "02:00:00:4E:41:54";
+}
+
+// UDP
+
+WiFiUDP::~WiFiUDP() {
+  stop();
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  if (_fd < 0) {
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+  }
+  _ip = ip;
+  _port = port;
+  _len = 0;
+  return _fd >= 0;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl) {
+  if (!beginPacket(multicastAddress, port)) {
+    return 0;
+  }
+  struct in_addr iface;
+  iface.s_addr = (uint32_t)interfaceAddress;
+  unsigned char hops = ttl;
+  unsigned char loop = 1;
+  return setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) == 0 &&
+         setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) == 0 &&
+         setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == 0;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size) {
+  size_t n = size < sizeof(_packet) - _len ? size : sizeof(_packet) - _len;
+  memcpy(_packet + _len, buffer, n);
+  _len += n;
+  return n;
+}
+
+int WiFiUDP::endPacket() {
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = _ip;
+  to.sin_port = htons(_port);
+  return _fd >= 0 && sendto(_fd, _packet, _len, 0, (struct sockaddr *)&to, sizeof(to)) == (ssize_t)_len;
+}
+
+void WiFiUDP::stop() {
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
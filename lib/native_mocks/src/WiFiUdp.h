@@ -0,0 +1,22 @@
+#pragma once
+// Host stand-in for WiFiUDP, sending through a host UDP socket
+#include <Arduino.h>
+
+class WiFiUDP : public Print {
+ public:
+  ~WiFiUDP();
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl = 1);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int endPacket();
+  void stop();
+
+ private:
+  int _fd = -1;
+  uint32_t _ip = 0;
+  uint16_t _port = 0;
+  uint8_t _packet[1472];
+  size_t _len = 0;
+};
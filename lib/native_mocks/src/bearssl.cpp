@@ -0,0 +1,131 @@
+#include <bearssl/bearssl.h>
+#include <string.h>
+
+const br_hash_class br_sha256_vtable = {sizeof(br_sha256_context)};
+
+static uint32_t ror(uint32_t x, int c) {
+  return (x >> c) | (x << (32 - c));
+}
+
+static void sha256_block(uint32_t *h, const unsigned char *p) {
+  static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)p[i * 4] << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = hh + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    hh = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+  h[5] += f;
+  h[6] += g;
+  h[7] += hh;
+}
+
+void br_sha256_init(br_sha256_context *ctx) {
+  static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(ctx->val, iv, sizeof(iv));
+  ctx->count = 0;
+}
+
+void br_sha256_update(br_sha256_context *ctx, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  while (len--) {
+    ctx->buf[ctx->count++ % 64] = *p++;
+    if (ctx->count % 64 == 0) {
+      sha256_block(ctx->val, ctx->buf);
+    }
+  }
+}
+
+void br_sha256_out(const br_sha256_context *ctx, void *out) {
+  br_sha256_context c = *ctx;
+  uint64_t bits = c.count * 8;
+  unsigned char pad = 0x80;
+  br_sha256_update(&c, &pad, 1);
+  pad = 0;
+  while (c.count % 64 != 56) {
+    br_sha256_update(&c, &pad, 1);
+  }
+  for (int i = 7; i >= 0; i--) {
+    unsigned char b = bits >> (8 * i);
+    br_sha256_update(&c, &b, 1);
+  }
+  unsigned char *o = (unsigned char *)out;
+  for (int i = 0; i < 32; i++) {
+    o[i] = c.val[i / 4] >> (24 - 8 * (i % 4));
+  }
+}
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len) {
+  unsigned char k[64] = {0};
+  if (key_len > sizeof(k)) {
+    br_sha256_context h;
+    br_sha256_init(&h);
+    br_sha256_update(&h, key, key_len);
+    br_sha256_out(&h, k);
+  } else {
+    memcpy(k, key, key_len);
+  }
+  unsigned char pad[64];
+  kc->dig_vtable = digest_vtable;
+  for (int i = 0; i < 64; i++) {
+    pad[i] = k[i] ^ 0x36;
+  }
+  br_sha256_init(&kc->ksi);
+  br_sha256_update(&kc->ksi, pad, sizeof(pad));
+  for (int i = 0; i < 64; i++) {
+    pad[i] = k[i] ^ 0x5c;
+  }
+  br_sha256_init(&kc->kso);
+  br_sha256_update(&kc->kso, pad, sizeof(pad));
+}
+
+void br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len) {
+  ctx->dig = kc->ksi;
+  ctx->kso = kc->kso;
+  ctx->out_len = out_len && out_len < br_sha256_SIZE ? out_len : br_sha256_SIZE;
+}
+
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len) {
+  br_sha256_update(&ctx->dig, data, len);
+}
+
+size_t br_hmac_out(const br_hmac_context *ctx, void *out) {
+  unsigned char inner[br_sha256_SIZE];
+  unsigned char mac[br_sha256_SIZE];
+  br_sha256_out(&ctx->dig, inner);
+  br_sha256_context outer = ctx->kso;
+  br_sha256_update(&outer, inner, sizeof(inner));
+  br_sha256_out(&outer, mac);
+  memcpy(out, mac, ctx->out_len);
+  return ctx->out_len;
+}
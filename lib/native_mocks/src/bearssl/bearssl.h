@@ -0,0 +1,41 @@
+#pragma once
+// Host stand-in for the parts of BearSSL the firmware uses: SHA-256 and
+// HMAC, same API and results as the core's bearssl.
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  size_t context_size;
+} br_hash_class;
+
+extern const br_hash_class br_sha256_vtable;
+
+#define br_sha256_SIZE 32
+
+typedef struct {
+  uint32_t val[8];
+  unsigned char buf[64];
+  uint64_t count;
+} br_sha256_context;
+
+void br_sha256_init(br_sha256_context *ctx);
+void br_sha256_update(br_sha256_context *ctx, const void *data, size_t len);
+void br_sha256_out(const br_sha256_context *ctx, void *out);
+
+// Inner and outer hash states after the padded key
+typedef struct {
+  const br_hash_class *dig_vtable;
+  br_sha256_context ksi;
+  br_sha256_context kso;
+} br_hmac_key_context;
+
+typedef struct {
+  br_sha256_context dig;
+  br_sha256_context kso;
+  size_t out_len;
+} br_hmac_context;
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len);
+void br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len);
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len);
+size_t br_hmac_out(const br_hmac_context *ctx, void *out);
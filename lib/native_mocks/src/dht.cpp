@@ -0,0 +1,21 @@
+#include <dht.h>
+#include "native.h"
+
+static float room_temperature = 23;
+static float room_humidity = 45;
+static int read_result = DHTLIB_OK;
+
+void native_dht_set(float temperature, float humidity, int result) {
+  room_temperature = temperature;
+  room_humidity = humidity;
+  read_result = result;
+}
+
+int dht::read11(uint8_t) {
+  if (read_result == DHTLIB_OK) {
+    // The DHT11 has whole degrees and percents
+    temperature = roundf(room_temperature);
+    humidity = roundf(room_humidity);
+  }
+  return read_result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+// Host stand-in for DHTStable: read11() returns what native_dht_set() gave
+#include <Arduino.h>
+
+#define DHTLIB_OK 0
+#define DHTLIB_ERROR_CHECKSUM -1
+#define DHTLIB_ERROR_TIMEOUT -2
+#define DHTLIB_ERROR_CONNECT -3
+#define DHTLIB_ERROR_ACK_L -4
+#define DHTLIB_ERROR_ACK_H -5
+
+class dht {
+ public:
+  int read11(uint8_t pin);
+  int read(uint8_t pin) { return read11(pin); }
+  float getHumidity() { return humidity; }
+  float getTemperature() { return temperature; }
+
+  float humidity = 0;
+  float temperature = 0;
+};
@@ -0,0 +1,9 @@
+#pragma once
+// FS area of eagle.flash.4m1m.ld (the nodemcuv2 layout), in the emulated
+// flash of ESP.flashRead()
+#include <Arduino.h>
+
+#define FS_PHYS_ADDR 0x100000UL
+#define FS_PHYS_SIZE 0xFA000UL
+#define FS_PHYS_PAGE 0x100
+#define FS_PHYS_BLOCK 0x2000
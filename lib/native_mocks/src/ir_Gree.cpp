@@ -0,0 +1,114 @@
+#include <ir_Gree.h>
+
+// Byte layout of the library's GreeProtocol:
+//  0: Mode:3 Power:1 Fan:2 SwingAuto:1 Sleep:1
+//  1: Temp:4 (-16) timer:4
+//  2: TimerHours:4 Turbo:1 Light:1 ModelA:1 Xfan:1
+//  3: :2 TempExtraDegreeF:1 UseFahrenheit:1 unknown1:4 (0b0101)
+//  4: SwingV:4 SwingH:3
+//  5: DisplayTemp:2 IFeel:1 unknown2:3 (0b100) WiFi:1
+//  7: :4 Sum:4
+
+IRGreeAC::IRGreeAC(uint16_t pin, uint8_t, bool inverted, bool use_modulation)
+    : _irsend(pin, inverted, use_modulation) {
+  stateReset();
+}
+
+void IRGreeAC::begin() {
+  _irsend.begin();
+}
+
+void IRGreeAC::send(uint16_t repeat) {
+  _irsend.sendGree(getRaw(), kGreeStateLength, repeat);
+}
+
+void IRGreeAC::setBits(uint8_t byte, uint8_t offset, uint8_t bits, uint8_t value) {
+  uint8_t mask = ((1 << bits) - 1) << offset;
+  _state[byte] = (_state[byte] & ~mask) | ((value << offset) & mask);
+}
+
+void IRGreeAC::stateReset() {
+  memset(_state, 0, sizeof(_state));
+  setBits(3, 4, 4, 0b0101);
+  setBits(5, 3, 3, 0b100);
+}
+
+// Same as IRKelvinatorAC::calcBlockChecksum()
+void IRGreeAC::checksum() {
+  uint8_t sum = 10;
+  for (uint8_t i = 0; i < 4; i++) {
+    sum += _state[i] & 0x0F;
+  }
+  for (uint8_t i = 4; i < kGreeStateLength - 1; i++) {
+    sum += _state[i] >> 4;
+  }
+  setBits(7, 4, 4, sum & 0x0F);
+}
+
+void IRGreeAC::setPower(bool on) {
+  setBits(0, 3, 1, on);
+  // YAW1F remotes set ModelA with the power
+  setBits(2, 6, 1, on);
+}
+
+void IRGreeAC::setMode(uint8_t mode) {
+  switch (mode) {
+    case kGreeAuto:
+      // Auto is locked to 25C
+      setTemp(25);
+      break;
+    case kGreeDry:
+      setFan(kGreeFanMin);
+      break;
+    case kGreeCool:
+    case kGreeFan:
+    case kGreeHeat:
+      break;
+    default:
+      mode = kGreeAuto;
+  }
+  setBits(0, 0, 3, mode);
+}
+
+void IRGreeAC::setTemp(uint8_t temp) {
+  temp = std::max(kGreeMinTempC, std::min(kGreeMaxTempC, temp));
+  setBits(1, 0, 4, temp - kGreeMinTempC);
+}
+
+void IRGreeAC::setFan(uint8_t speed) {
+  uint8_t fan = std::min(kGreeFanMax, speed);
+  if (getMode() == kGreeDry) {
+    fan = kGreeFanMin;
+  }
+  setBits(0, 4, 2, fan);
+}
+
+void IRGreeAC::setSwingVertical(bool automatic, uint8_t position) {
+  setBits(0, 6, 1, automatic);
+  setBits(4, 0, 4, position);
+}
+
+void IRGreeAC::setLight(bool on) {
+  setBits(2, 5, 1, on);
+}
+
+void IRGreeAC::setTurbo(bool on) {
+  setBits(2, 4, 1, on);
+}
+
+void IRGreeAC::setXFan(bool on) {
+  setBits(2, 7, 1, on);
+}
+
+void IRGreeAC::setSleep(bool on) {
+  setBits(0, 7, 1, on);
+}
+
+uint8_t *IRGreeAC::getRaw() {
+  checksum();
+  return _state;
+}
+
+void IRGreeAC::setRaw(const uint8_t new_code[]) {
+  memcpy(_state, new_code, kGreeStateLength);
+}
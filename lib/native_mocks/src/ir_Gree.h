@@ -0,0 +1,57 @@
+#pragma once
+// Host stand-in for IRremoteESP8266's IRGreeAC: the state bytes and the
+// timings of the library (YAW1F model, Celsius), send() goes through the
+// recording IRsend of IRsend.h.
+#include <Arduino.h>
+#include "IRsend.h"
+
+const uint16_t kGreeStateLength = 8;
+const uint8_t kGreeAuto = 0;
+const uint8_t kGreeCool = 1;
+const uint8_t kGreeDry = 2;
+const uint8_t kGreeFan = 3;
+const uint8_t kGreeHeat = 4;
+const uint8_t kGreeFanAuto = 0;
+const uint8_t kGreeFanMin = 1;
+const uint8_t kGreeFanMax = 3;
+const uint8_t kGreeMinTempC = 16;
+const uint8_t kGreeMaxTempC = 30;
+const uint8_t kGreeSwingAuto = 0b0001;
+
+const uint16_t kGreeHdrMark = 9000;
+const uint16_t kGreeHdrSpace = 4500;
+const uint16_t kGreeBitMark = 620;
+const uint16_t kGreeOneSpace = 1600;
+const uint16_t kGreeZeroSpace = 540;
+const uint16_t kGreeMsgSpace = 19980;
+const uint8_t kGreeBlockFooter = 0b010;
+const uint8_t kGreeBlockFooterBits = 3;
+
+class IRGreeAC {
+ public:
+  explicit IRGreeAC(uint16_t pin, uint8_t model = 1, bool inverted = false, bool use_modulation = true);
+  void begin();
+  void send(uint16_t repeat = 0);
+  void stateReset();
+
+  void setPower(bool on);
+  void setMode(uint8_t mode);
+  uint8_t getMode() const { return _state[0] & 0x07; }
+  void setTemp(uint8_t temp);
+  void setFan(uint8_t speed);
+  void setSwingVertical(bool automatic, uint8_t position);
+  void setLight(bool on);
+  void setTurbo(bool on);
+  void setXFan(bool on);
+  void setSleep(bool on);
+
+  uint8_t *getRaw();
+  void setRaw(const uint8_t new_code[]);
+
+ private:
+  void setBits(uint8_t byte, uint8_t offset, uint8_t bits, uint8_t value);
+  void checksum();
+
+  IRsend _irsend;
+  uint8_t _state[kGreeStateLength];
+};
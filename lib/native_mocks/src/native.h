@@ -0,0 +1,122 @@
+#pragma once
+// Controls of the native build, for the tests and benchmarks in test/.
+//
+// None of this exists on the device: include it from test code only.
+#include <Arduino.h>
+
+class AsyncWebServerRequest;
+
+// Clock
+
+// Stop the host clock: millis()/micros() only move with native_advance_us()
+void native_clock_freeze(bool frozen);
+void native_advance_us(uint64_t us);
+void native_advance_ms(uint64_t ms);
+// time() from now on, moving with micros(); 0 goes back to the host clock
+void native_time_set(time_t now);
+
+// Simulated heap (native_heap.cpp)
+//
+// NATIVE_HEAP_SIZE bytes, first fit with coalescing as umm_malloc on the
+// device, so ESP.getMaxFreeBlockSize() and getHeapFragmentation() show
+// fragmentation. Only allocations made while firmware code runs come from
+// it: native main() around setup()/loop(), native_request() around the
+// handler and the response, or a NativeHeapScope. The rest (test harness,
+// host sockets) uses the host heap.
+
+#ifndef NATIVE_HEAP_SIZE
+#define NATIVE_HEAP_SIZE 32768
+#endif
+
+struct NativeHeapStats {
+  uint32_t allocs;      // blocks allocated, or grown by realloc()
+  uint32_t frees;
+  uint64_t bytes;       // requested by those allocations
+  uint32_t used;        // bytes in use now, headers included
+  uint32_t peak;        // most bytes in use at a time
+  uint32_t failed;      // did not fit, served by the host heap
+};
+
+class NativeHeapScope {
+ public:
+  explicit NativeHeapScope(bool firmware = true);
+  ~NativeHeapScope();
+
+ private:
+  bool _previous;
+};
+
+const NativeHeapStats &native_heap_stats();
+// Restart the peak from the current use
+void native_heap_reset_peak();
+uint32_t native_heap_free();
+uint32_t native_heap_max_block();
+uint8_t native_heap_fragmentation();
+
+// Serial: echo what the firmware writes to stdout (default on)
+void native_serial_echo(bool echo);
+// Bytes written to Serial so far
+uint32_t native_serial_written();
+
+// timer1: run the interrupt once now, whether it is due or not.
+// Returns false if it is not enabled.
+bool native_timer1_fire();
+// Ticks passed to the last timer1_write()
+uint32_t native_timer1_ticks();
+bool native_timer1_enabled();
+
+// IR output of IRsend (mock of IRremoteESP8266), one entry per mark()/space()
+struct NativeIrPulse {
+  bool mark;
+  uint32_t us;
+};
+#define NATIVE_IR_PULSES_MAX 4096
+uint16_t native_ir_pulses(const NativeIrPulse **pulses);
+void native_ir_clear();
+
+// DHT11 readings returned by dht::read11()
+void native_dht_set(float temperature, float humidity, int result = 0);
+
+// EEPROM.commit() count
+uint32_t native_eeprom_commits();
+
+// Emulated flash content at an address (see ESP.flashRead())
+uint8_t *native_flash(uint32_t address);
+
+// HTTP requests, dispatched through the handlers registered on the
+// AsyncWebServer as the async server does.
+//
+// headers: "Name: value" lines separated by "\r\n", may be NULL. The body
+// is handed over in TCP sized pieces; form bodies become params, as do
+// text/plain ones that look like a form (the library's "plain post").
+
+struct NativeResponse {
+  int code;               // 0: the handler sent nothing
+  String content_type;
+  String headers;         // "Name: value\r\n" lines
+  String body;
+  size_t chunks;          // filler calls it took
+};
+
+AsyncWebServerRequest *native_request_new(const char *method, const char *url, const char *headers,
+                                          const char *body = NULL, size_t body_len = 0);
+// Runs the handler (and the body handler)
+void native_request_handle(AsyncWebServerRequest *request);
+// Reads the whole response as the TCP stack would, then closes the request:
+// onDisconnect handlers run and _tempObject is freed
+void native_request_finish(AsyncWebServerRequest *request, NativeResponse *response);
+// Closes the request without reading the response, a client that went away
+void native_request_abort(AsyncWebServerRequest *request);
+// All of the above, returns the status code
+int native_request(const char *method, const char *url, const char *headers, const char *body,
+                   NativeResponse *response);
+// Value of a response header, empty if absent
+String native_response_header(const NativeResponse &response, const char *name);
+// Authorization header answering the Digest challenge of a 401 response
+String native_digest_auth(const NativeResponse &challenge, const char *method, const char *uri,
+                          const char *user, const char *password);
+
+// HTTP over TCP on 127.0.0.1:port, for tools/loadgen.cpp against the native
+// build. Served from yield(), call before setup().
+bool native_http_listen(uint16_t port);
+void native_http_poll();
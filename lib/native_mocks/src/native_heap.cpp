@@ -0,0 +1,239 @@
+// Simulated ESP8266 heap (see native.h)
+//
+// malloc() and friends are replaced for the whole program. While firmware
+// code runs blocks come from a fixed pool, first fit with splitting and
+// coalescing like umm_malloc, otherwise from the C library. free() and
+// realloc() tell the two apart by address. Needs glibc (__libc_malloc); on
+// other hosts the C library heap is used throughout and the figures stay
+// at an empty pool.
+#include "native.h"
+
+#define HEAP_ALIGN 16
+#define HEAP_HEADER 16
+#define HEAP_MIN_BLOCK (HEAP_HEADER + HEAP_ALIGN)
+
+// In front of each block; sizes include the header
+struct BlockHeader {
+  uint32_t size;
+  uint32_t prev_size;   // 0 for the first block
+  uint32_t used;
+  uint32_t requested;
+};
+static_assert(sizeof(BlockHeader) == HEAP_HEADER, "header size");
+
+alignas(HEAP_ALIGN) static uint8_t pool[NATIVE_HEAP_SIZE];
+static bool pool_ready = false;
+static bool firmware = false;
+static NativeHeapStats stats;
+
+NativeHeapScope::NativeHeapScope(bool active) : _previous(firmware) {
+  firmware = active;
+}
+
+NativeHeapScope::~NativeHeapScope() {
+  firmware = _previous;
+}
+
+static BlockHeader *first() {
+  if (!pool_ready) {
+    BlockHeader *b = (BlockHeader *)pool;
+    b->size = NATIVE_HEAP_SIZE;
+    b->prev_size = 0;
+    b->used = 0;
+    pool_ready = true;
+  }
+  return (BlockHeader *)pool;
+}
+
+static BlockHeader *next(BlockHeader *b) {
+  uint8_t *n = (uint8_t *)b + b->size;
+  return n < pool + NATIVE_HEAP_SIZE ? (BlockHeader *)n : NULL;
+}
+
+static BlockHeader *prev(BlockHeader *b) {
+  return b->prev_size ? (BlockHeader *)((uint8_t *)b - b->prev_size) : NULL;
+}
+
+static bool in_pool(const void *p) {
+  return (const uint8_t *)p >= pool && (const uint8_t *)p < pool + NATIVE_HEAP_SIZE;
+}
+
+static BlockHeader *header(void *p) {
+  return (BlockHeader *)((uint8_t *)p - HEAP_HEADER);
+}
+
+static void set_size(BlockHeader *b, uint32_t size) {
+  b->size = size;
+  BlockHeader *n = next(b);
+  if (n) {
+    n->prev_size = size;
+  }
+}
+
+static void *pool_alloc(size_t len) {
+  if (len > NATIVE_HEAP_SIZE) {
+    return NULL;
+  }
+  uint32_t need = (len + HEAP_ALIGN - 1) / HEAP_ALIGN * HEAP_ALIGN + HEAP_HEADER;
+  for (BlockHeader *b = first(); b; b = next(b)) {
+    if (b->used || b->size < need) {
+      continue;
+    }
+    if (b->size - need >= HEAP_MIN_BLOCK) {
+      uint32_t rest = b->size - need;
+      set_size(b, need);
+      BlockHeader *split = next(b);
+      split->prev_size = need;
+      split->used = 0;
+      set_size(split, rest);
+    }
+    b->used = 1;
+    b->requested = len;
+    stats.allocs++;
+    stats.bytes += len;
+    stats.used += b->size;
+    if (stats.used > stats.peak) {
+      stats.peak = stats.used;
+    }
+    return (uint8_t *)b + HEAP_HEADER;
+  }
+  return NULL;
+}
+
+static void pool_free(void *p) {
+  BlockHeader *b = header(p);
+  b->used = 0;
+  stats.frees++;
+  stats.used -= b->size;
+  BlockHeader *n = next(b);
+  if (n && !n->used) {
+    set_size(b, b->size + n->size);
+  }
+  BlockHeader *pr = prev(b);
+  if (pr && !pr->used) {
+    set_size(pr, pr->size + b->size);
+  }
+}
+
+const NativeHeapStats &native_heap_stats() {
+  return stats;
+}
+
+void native_heap_reset_peak() {
+  stats.peak = stats.used;
+}
+
+uint32_t native_heap_free() {
+  first();
+  return NATIVE_HEAP_SIZE - stats.used;
+}
+
+uint32_t native_heap_max_block() {
+  uint32_t best = 0;
+  for (BlockHeader *b = first(); b; b = next(b)) {
+    if (!b->used && b->size - HEAP_HEADER > best) {
+      best = b->size - HEAP_HEADER;
+    }
+  }
+  return best;
+}
+
+// As umm_fragmentation_metric(): 100 - sqrt(sum of squared free blocks) / free
+uint8_t native_heap_fragmentation() {
+  double squares = 0;
+  double total = 0;
+  for (BlockHeader *b = first(); b; b = next(b)) {
+    if (!b->used) {
+      squares += (double)b->size * b->size;
+      total += b->size;
+    }
+  }
+  return total ? 100 - (uint8_t)(sqrt(squares) * 100 / total) : 0;
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void __libc_free(void *ptr);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_calloc(size_t count, size_t size);
+
+void *malloc(size_t size) {
+  if (firmware) {
+    void *p = pool_alloc(size);
+    if (p) {
+      return p;
+    }
+    stats.failed++;
+  }
+  return __libc_malloc(size);
+}
+
+void free(void *ptr) {
+  if (in_pool(ptr)) {
+    pool_free(ptr);
+  } else {
+    __libc_free(ptr);
+  }
+}
+
+void *calloc(size_t count, size_t size) {
+  if (!firmware) {
+    return __libc_calloc(count, size);
+  }
+  if (size && count > (size_t)-1 / size) {
+    return NULL;
+  }
+  void *p = malloc(count * size);
+  if (p) {
+    memset(p, 0, count * size);
+  }
+  return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (!ptr) {
+    return malloc(size);
+  }
+  if (!in_pool(ptr)) {
+    return __libc_realloc(ptr, size);
+  }
+  BlockHeader *b = header(ptr);
+  if (size + HEAP_HEADER <= b->size) {
+    b->requested = size;
+    return ptr;
+  }
+  // Grow in place into a free neighbour, as umm_realloc does
+  BlockHeader *n = next(b);
+  uint32_t need = (size + HEAP_ALIGN - 1) / HEAP_ALIGN * HEAP_ALIGN + HEAP_HEADER;
+  if (n && !n->used && b->size + n->size >= need) {
+    stats.used += n->size;
+    set_size(b, b->size + n->size);
+    if (b->size - need >= HEAP_MIN_BLOCK) {
+      uint32_t rest = b->size - need;
+      set_size(b, need);
+      BlockHeader *split = next(b);
+      split->prev_size = need;
+      split->used = 0;
+      set_size(split, rest);
+      stats.used -= rest;
+    }
+    if (stats.used > stats.peak) {
+      stats.peak = stats.used;
+    }
+    stats.allocs++;
+    stats.bytes += size;
+    b->requested = size;
+    return ptr;
+  }
+  void *moved = malloc(size);
+  if (moved) {
+    memcpy(moved, ptr, b->requested);
+    free(ptr);
+  }
+  return moved;
+}
+}
+
+#endif
@@ -0,0 +1,445 @@
+// Requests of native.h: in process (native_request()) or over TCP
+// (native_http_listen()), both through the AsyncWebServer mock.
+//
+// The firmware side (request, handler, response) runs in the simulated
+// heap; what the test or the socket needs stays on the host heap.
+#include "native.h"
+#include <ESPAsyncWebServer.h>
+#include <MD5Builder.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Bodies of native_request_new() until native_request_handle()
+static std::map<AsyncWebServerRequest *, std::string> pending_bodies;
+
+static const char *reason(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+  }
+  return "";
+}
+
+// Status line and headers, as AsyncAbstractResponse::_assembleHead()
+static std::string response_head(AsyncWebServerResponse *response) {
+  char line[96];
+  snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\nConnection: close\r\nAccept-Ranges: none\r\n", response->code(),
+           reason(response->code()));
+  std::string head = line;
+  if (response->chunked()) {
+    head += "Transfer-Encoding: chunked\r\n";
+  } else {
+    snprintf(line, sizeof(line), "Content-Length: %u\r\n", (unsigned)response->contentLength());
+    head += line;
+  }
+  if (response->contentType().length()) {
+    head += "Content-Type: ";
+    head += response->contentType().c_str();
+    head += "\r\n";
+  }
+  head += response->headers().c_str();
+  head += "\r\n";
+  return head;
+}
+
+enum Pump { PUMP_MORE, PUMP_DONE, PUMP_WAIT };
+
+// Next piece of the body into out, at most room bytes on the wire
+static Pump pump(AsyncWebServerResponse *response, size_t *index, size_t room, std::string *out, bool framed) {
+  if (!response->chunked() && *index >= response->contentLength()) {
+    return PUMP_DONE;
+  }
+  uint8_t buf[NATIVE_TCP_WINDOW];
+  // Chunk size line and CRLF
+  size_t max = response->chunked() ? room - 8 : room;
+  size_t n;
+  {
+    NativeHeapScope firmware;
+    n = response->fill(buf, min(max, sizeof(buf)), *index);
+  }
+  if (n == RESPONSE_TRY_AGAIN) {
+    return PUMP_WAIT;
+  }
+  if (n == 0) {
+    if (response->chunked() && framed) {
+      *out += "0\r\n\r\n";
+    }
+    return PUMP_DONE;
+  }
+  if (response->chunked() && framed) {
+    char size[12];
+    snprintf(size, sizeof(size), "%x\r\n", (unsigned)n);
+    *out += size;
+    out->append((const char *)buf, n);
+    *out += "\r\n";
+  } else {
+    out->append((const char *)buf, n);
+  }
+  *index += n;
+  return PUMP_MORE;
+}
+
+static void close_request(AsyncWebServerRequest *request) {
+  NativeHeapScope firmware;
+  request->_onDisconnect();
+  delete request;
+}
+
+static AsyncWebServerRequest *request_begin(const char *method, const char *url, const char *headers) {
+  AsyncWebServer *server = AsyncWebServer::_native;
+  if (!server) {
+    return NULL;
+  }
+  NativeHeapScope firmware;
+  AsyncWebServerRequest *request = new AsyncWebServerRequest(server);
+  request->_begin(method, url, headers);
+  return request;
+}
+
+// The body in TCP segments, then the handler
+static void request_body(AsyncWebServerRequest *request, const char *body, size_t len) {
+  uint8_t segment[NATIVE_TCP_MSS];
+  size_t at = 0;
+  do {
+    size_t n = min(len - at, sizeof(segment));
+    memcpy(segment, body + at, n);
+    NativeHeapScope firmware;
+    request->_onBody(segment, n);
+    at += n;
+  } while (at < len);
+}
+
+AsyncWebServerRequest *native_request_new(const char *method, const char *url, const char *headers,
+                                          const char *body, size_t body_len) {
+  if (body && !body_len) {
+    body_len = strlen(body);
+  }
+  std::string head = headers ? headers : "";
+  if (body_len) {
+    if (head.size() && head.compare(head.size() - 2, 2, "\r\n") != 0) {
+      head += "\r\n";
+    }
+    head += "Content-Length: " + std::to_string(body_len) + "\r\n";
+  }
+  AsyncWebServerRequest *request = request_begin(method, url, head.c_str());
+  if (request && body_len) {
+    pending_bodies[request] = std::string(body, body_len);
+  }
+  return request;
+}
+
+void native_request_handle(AsyncWebServerRequest *request) {
+  auto body = pending_bodies.find(request);
+  if (body == pending_bodies.end()) {
+    request_body(request, "", 0);
+    return;
+  }
+  std::string data;
+  data.swap(body->second);
+  pending_bodies.erase(body);
+  request_body(request, data.data(), data.size());
+}
+
+void native_request_finish(AsyncWebServerRequest *request, NativeResponse *response) {
+  NativeResponse out = {0, String(), String(), String(), 0};
+  AsyncWebServerResponse *sent = request->_response();
+  if (sent) {
+    out.code = sent->code();
+    out.content_type = sent->contentType();
+    out.headers = sent->headers();
+    AsyncEventSourceResponse *events = dynamic_cast<AsyncEventSourceResponse *>(sent);
+    if (events) {
+      // The subscriber gets what onConnect sends, then goes away
+      AsyncEventSourceClient *client;
+      {
+        NativeHeapScope firmware;
+        client = events->source()->_addClient(-1);
+      }
+      out.body = client->_captured();
+      out.chunks = 1;
+      NativeHeapScope firmware;
+      events->source()->_removeClient(client);
+      delete client;
+    } else {
+      std::string body;
+      size_t index = 0;
+      size_t room = NATIVE_TCP_WINDOW - min(response_head(sent).size(), (size_t)NATIVE_TCP_WINDOW / 2);
+      uint16_t waits = 0;
+      Pump state;
+      while ((state = pump(sent, &index, room, &body, false)) != PUMP_DONE) {
+        if (state == PUMP_WAIT) {
+          if (++waits == 1000) {
+            break;
+          }
+          yield();
+          continue;
+        }
+        out.chunks++;
+        room = NATIVE_TCP_WINDOW;
+      }
+      out.body = String(body.data(), body.size());
+    }
+  }
+  close_request(request);
+  if (response) {
+    *response = out;
+  }
+}
+
+void native_request_abort(AsyncWebServerRequest *request) {
+  close_request(request);
+}
+
+int native_request(const char *method, const char *url, const char *headers, const char *body,
+                   NativeResponse *response) {
+  AsyncWebServerRequest *request = native_request_new(method, url, headers, body, body ? strlen(body) : 0);
+  if (!request) {
+    return 0;
+  }
+  native_request_handle(request);
+  NativeResponse out;
+  native_request_finish(request, &out);
+  if (response) {
+    *response = out;
+  }
+  return out.code;
+}
+
+String native_response_header(const NativeResponse &response, const char *name) {
+  const char *line = response.headers.c_str();
+  size_t len = strlen(name);
+  while (*line) {
+    const char *eol = strstr(line, "\r\n");
+    if (!eol) {
+      eol = line + strlen(line);
+    }
+    if (strncasecmp(line, name, len) == 0 && line[len] == ':') {
+      const char *value = line + len + 1;
+      while (*value == ' ') {
+        value++;
+      }
+      return String(value, eol - value);
+    }
+    line = *eol ? eol + 2 : eol;
+  }
+  return String();
+}
+
+// Value of name="..." in a WWW-Authenticate header
+static String challenge_field(const String &header, const char *name) {
+  String key = String(name) + "=\"";
+  int at = header.indexOf(key.c_str());
+  if (at < 0) {
+    return String();
+  }
+  at += key.length();
+  int end = header.indexOf('"', at);
+  return header.substring(at, end < 0 ? header.length() : end);
+}
+
+static String md5_hex(const String &text) {
+  MD5Builder md5;
+  md5.begin();
+  md5.add(text);
+  md5.calculate();
+  return md5.toString();
+}
+
+String native_digest_auth(const NativeResponse &challenge, const char *method, const char *uri, const char *user,
+                          const char *password) {
+  String header = native_response_header(challenge, "WWW-Authenticate");
+  String realm = challenge_field(header, "realm");
+  String nonce = challenge_field(header, "nonce");
+  String opaque = challenge_field(header, "opaque");
+  const char *nc = "00000001";
+  const char *cnonce = "0a4f113b";
+  String ha1 = md5_hex(String(user) + ":" + realm + ":" + password);
+  String ha2 = md5_hex(String(method) + ":" + uri);
+  String response = md5_hex(ha1 + ":" + nonce + ":" + nc + ":" + cnonce + ":auth:" + ha2);
+  return String("Authorization: Digest username=\"") + user + "\", realm=\"" + realm + "\", nonce=\"" + nonce +
+         "\", uri=\"" + uri + "\", algorithm=MD5, response=\"" + response + "\", opaque=\"" + opaque +
+         "\", qop=auth, nc=" + nc + ", cnonce=\"" + cnonce + "\"";
+}
+
+// TCP server
+
+struct Connection {
+  int fd;
+  std::string in;
+  AsyncWebServerRequest *request;
+  std::string out;
+  size_t index;
+  bool head_sent;
+  bool done;
+};
+
+static int listen_fd = -1;
+static std::vector<Connection *> connections;
+static bool polling = false;
+
+bool native_http_listen(uint16_t port) {
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    return false;
+  }
+  int one = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+  return true;
+}
+
+// Request line, headers and the whole body are in: run it
+static void connection_request(Connection *c) {
+  size_t head_end = c->in.find("\r\n\r\n");
+  if (head_end == std::string::npos) {
+    return;
+  }
+  size_t line_end = c->in.find("\r\n");
+  std::string line = c->in.substr(0, line_end);
+  std::string headers = c->in.substr(line_end + 2, head_end - line_end);
+  size_t length = 0;
+  for (size_t at = 0; at < headers.size();) {
+    size_t eol = headers.find("\r\n", at);
+    if (strncasecmp(headers.c_str() + at, "Content-Length:", 15) == 0) {
+      length = strtoul(headers.c_str() + at + 15, NULL, 10);
+    }
+    at = eol == std::string::npos ? headers.size() : eol + 2;
+  }
+  if (c->in.size() < head_end + 4 + length) {
+    return;
+  }
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.find(' ', sp1 + 1);
+  if (sp1 == std::string::npos || sp2 == std::string::npos) {
+    c->done = true;
+    return;
+  }
+  std::string method = line.substr(0, sp1);
+  std::string url = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  c->request = request_begin(method.c_str(), url.c_str(), headers.c_str());
+  if (!c->request) {
+    c->done = true;
+    return;
+  }
+  request_body(c->request, c->in.data() + head_end + 4, length);
+}
+
+// Event stream: the socket goes to the subscriber, the request is freed
+static void connection_subscribe(Connection *c, AsyncEventSourceResponse *events) {
+  std::string head = response_head(events);
+  head.replace(head.find("Connection: close"), 17, "Connection: keep-alive");
+  send(c->fd, head.data(), head.size(), MSG_NOSIGNAL);
+  {
+    NativeHeapScope firmware;
+    events->source()->_addClient(c->fd);
+    delete c->request;
+  }
+  c->request = NULL;
+  c->fd = -1;
+  c->done = true;
+}
+
+static void connection_respond(Connection *c) {
+  AsyncWebServerResponse *response = c->request->_response();
+  if (!response) {
+    return;
+  }
+  AsyncEventSourceResponse *events = dynamic_cast<AsyncEventSourceResponse *>(response);
+  if (events) {
+    connection_subscribe(c, events);
+    return;
+  }
+  bool finished = false;
+  if (c->out.empty()) {
+    size_t room = NATIVE_TCP_WINDOW;
+    if (!c->head_sent) {
+      c->out = response_head(response);
+      c->head_sent = true;
+      room -= min(c->out.size(), (size_t)NATIVE_TCP_WINDOW / 2);
+    }
+    finished = pump(response, &c->index, room, &c->out, true) == PUMP_DONE;
+  }
+  while (!c->out.empty()) {
+    ssize_t n = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n <= 0) {
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        c->done = true;
+      }
+      return;
+    }
+    c->out.erase(0, n);
+  }
+  if (finished) {
+    c->done = true;
+  }
+}
+
+void native_http_poll() {
+  AsyncWebServer *server = AsyncWebServer::_native;
+  if (listen_fd < 0 || polling || !server || !server->_isStarted()) {
+    return;
+  }
+  polling = true;
+  NativeHeapScope host(false);
+  int fd;
+  while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    connections.push_back(new Connection{fd, std::string(), NULL, std::string(), 0, false, false});
+  }
+  for (size_t i = 0; i < connections.size();) {
+    Connection *c = connections[i];
+    if (!c->request) {
+      char buf[2048];
+      ssize_t n;
+      while ((n = recv(c->fd, buf, sizeof(buf), 0)) > 0) {
+        c->in.append(buf, n);
+      }
+      if (n == 0) {
+        c->done = true;
+      } else {
+        connection_request(c);
+      }
+    }
+    if (c->request && !c->done) {
+      connection_respond(c);
+    }
+    if (c->done) {
+      if (c->request) {
+        close_request(c->request);
+      }
+      if (c->fd >= 0) {
+        close(c->fd);
+      }
+      delete c;
+      connections.erase(connections.begin() + i);
+    } else {
+      i++;
+    }
+  }
+  polling = false;
+}
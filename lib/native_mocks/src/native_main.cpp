@@ -0,0 +1,28 @@
+// main() of the native firmware (pio run -e native): setup(), then loop()
+// forever, HTTP on 127.0.0.1:$NATIVE_HTTP_PORT (8080 by default). Unit
+// tests bring their own main().
+#ifndef PIO_UNIT_TESTING
+#include "native.h"
+#include <unistd.h>
+
+void setup();
+void loop();
+
+int main() {
+  const char *port = getenv("NATIVE_HTTP_PORT");
+  uint16_t http_port = port ? atoi(port) : 8080;
+  if (!native_http_listen(http_port)) {
+    fprintf(stderr, "native: cannot listen on 127.0.0.1:%u\n", http_port);
+    return 1;
+  }
+  fprintf(stderr, "native: HTTP on 127.0.0.1:%u\n", http_port);
+  NativeHeapScope firmware;
+  setup();
+  while (true) {
+    loop();
+    // Between loop() runs the core serves the network
+    yield();
+    usleep(100);
+  }
+}
+#endif
@@ -0,0 +1,70 @@
+// Boot and session of native_session.h
+#include "native_session.h"
+
+void setup();
+void loop();
+extern const char *www_username;
+extern const char *www_password;
+
+static String cookie;
+
+void native_boot() {
+  NativeHeapScope firmware;
+  setup();
+  for (uint8_t i = 0; i < 10; i++) {
+    loop();
+  }
+}
+
+bool native_login() {
+  NativeResponse challenge;
+  if (native_request("GET", "/", NULL, NULL, &challenge) != 401) {
+    return false;
+  }
+  String auth = native_digest_auth(challenge, "GET", "/", www_username, www_password);
+  NativeResponse page;
+  if (native_request("GET", "/", auth.c_str(), NULL, &page) != 200) {
+    return false;
+  }
+  String set = native_response_header(page, "Set-Cookie");
+  if (!set.length()) {
+    return false;
+  }
+  cookie = "Cookie: " + set.substring(0, set.indexOf(';'));
+  return true;
+}
+
+const String &native_cookie() {
+  return cookie;
+}
+
+static String session_headers(const char *body, const char *headers) {
+  String all = cookie;
+  if (headers) {
+    all += "\r\n";
+    all += headers;
+  } else if (body) {
+    all += "\r\nContent-Type: application/x-www-form-urlencoded";
+  }
+  return all;
+}
+
+AsyncWebServerRequest *native_session_start(const char *method, const char *url, const char *body,
+                                            const char *headers) {
+  String all = session_headers(body, headers);
+  AsyncWebServerRequest *request =
+      native_request_new(method, url, all.c_str(), body, body ? strlen(body) : 0);
+  native_request_handle(request);
+  return request;
+}
+
+int native_session_finish(AsyncWebServerRequest *request, NativeResponse *response) {
+  native_request_finish(request, response);
+  return response->code;
+}
+
+int native_session_request(const char *method, const char *url, const char *body, NativeResponse *response,
+                           const char *headers) {
+  String all = session_headers(body, headers);
+  return native_request(method, url, all.c_str(), body, response);
+}
@@ -0,0 +1,26 @@
+#pragma once
+// The firmware booted and logged in as the WebUI does, for the tests that
+// drive it over HTTP (see native.h for the requests themselves).
+//
+// Like native.h, for test code only. Uses setup()/loop() and the WebUI
+// credentials of main.cpp.
+#include "native.h"
+
+// setup(), then loop() until the link is up and the server started, on the
+// simulated heap
+void native_boot();
+
+// Digest login on "/", keeps the session cookie of the answer. False if a
+// step did not answer as the WebUI expects.
+bool native_login();
+// "Cookie: ..." header of the session, empty before native_login()
+const String &native_cookie();
+
+// Requests with the session cookie. headers: more header lines, else a
+// form Content-Type when there is a body.
+AsyncWebServerRequest *native_session_start(const char *method, const char *url, const char *body = NULL,
+                                            const char *headers = NULL);
+// native_request_finish(), returns the status code
+int native_session_finish(AsyncWebServerRequest *request, NativeResponse *response);
+int native_session_request(const char *method, const char *url, const char *body, NativeResponse *response,
+                           const char *headers = NULL);
@@ -0,0 +1,114 @@
+#include "ac_state.h"
+#include <Arduino.h>
+#include <ir_Gree.h>
+
+int8_t cmd_invalid_field(const uint8_t *cmd, bool only_power) {
+  for (uint8_t i = only_power ? CMD_ON_OFF : 0; i < CMD_PARAMS; i++) {
+    if (cmd[i] < CMD_FIELDS[i].min || cmd[i] > CMD_FIELDS[i].max) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void cmd_default(uint8_t *cmd) {
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    cmd[i] = CMD_FIELDS[i].def;
+  }
+}
+
+int8_t cmd_field_index(const char *name, size_t len) {
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    if (strlen(CMD_FIELDS[i].name) == len && memcmp(CMD_FIELDS[i].name, name, len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void cmd_pack(const uint8_t *cmd, uint8_t *packed) {
+  uint32_t bits = 0;
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    bits |= (uint32_t)(uint8_t)(cmd[i] - CMD_FIELDS[i].min) << cmd_field_shift(i);
+  }
+  for (uint8_t b = 0; b < CMD_PACKED_BYTES; b++) {
+    packed[b] = bits >> (8 * b);
+  }
+}
+
+void cmd_unpack(const uint8_t *packed, uint8_t *cmd) {
+  uint32_t bits = 0;
+  for (uint8_t b = 0; b < CMD_PACKED_BYTES; b++) {
+    bits |= (uint32_t)packed[b] << (8 * b);
+  }
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    uint8_t mask = (1 << CMD_FIELDS[i].bits) - 1;
+    cmd[i] = CMD_FIELDS[i].min + ((bits >> cmd_field_shift(i)) & mask);
+  }
+}
+
+bool cmd_parse_field(uint8_t field, const char *text, size_t len, uint8_t *value) {
+  if (len < 1 || len > 3) {
+    return false;
+  }
+  uint16_t v = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (text[i] < '0' || text[i] > '9') {
+      return false;
+    }
+    v = v*10 + (text[i] - '0');
+  }
+  if (v < CMD_FIELDS[field].min || v > CMD_FIELDS[field].max) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+uint32_t parse_zones(const char *list, size_t len) {
+  if (len == 3 && memcmp(list, "all", 3) == 0) {
+    return (1UL << ZONE_COUNT) - 1;
+  }
+  uint32_t mask = 0;
+  uint16_t zone = 0;
+  uint8_t digits = 0;
+  for (size_t i=0; i<=len; i++) {
+    char c = i < len ? list[i] : ',';
+    if (c >= '0' && c <= '9' && digits < 2) {
+      zone = zone*10 + (c - '0');
+      digits++;
+    } else if (c == ',' && digits && zone < ZONE_COUNT) {
+      mask |= 1UL << zone;
+      zone = 0;
+      digits = 0;
+    } else {
+      return 0;
+    }
+  }
+  return mask;
+}
+
+// How each param reaches the IRGreeAC, in command order. flap_auto has no
+// setter of its own, it goes with flap.
+typedef void (*CmdApply)(IRGreeAC &ac, const uint8_t *cmd);
+static const CmdApply cmd_apply[CMD_PARAMS] = {
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setMode(cmd[0]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setTemp(cmd[1]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setFan(cmd[2]); },
+  NULL,
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setSwingVertical(cmd[3], cmd[4]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setLight(cmd[5]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setTurbo(cmd[6]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setXFan(cmd[7]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setSleep(cmd[8]); },
+  [](IRGreeAC &ac, const uint8_t *cmd) { ac.setPower(cmd[9]); },
+};
+
+void ac_apply(IRGreeAC &ac, const uint8_t *cmd) {
+  uint8_t first = cmd[CMD_ON_OFF] == 1 ? 0 : CMD_ON_OFF;
+  for (uint8_t i = first; i < CMD_PARAMS; i++) {
+    if (cmd_apply[i]) {
+      cmd_apply[i](ac, cmd);
+    }
+  }
+}
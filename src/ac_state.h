@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class IRGreeAC;
+
+// #Params sent to AC
+#define CMD_PARAMS 10
+
+// Number of AC units (zones) driven by this node, one IR emitter each.
+// Their pins are listed in ZONE_IR_PINS (main.cpp).
+#ifndef ZONE_COUNT
+#define ZONE_COUNT 1
+#endif
+
+// State schema: one descriptor per param, in command order. Validation,
+// defaults, packing and the names used by the API are all derived from it.
+//command format:[mode, temp, fan_speed,
+//                flap_auto_flag, flap,
+//                light, turbo, xfan, sleep, on_off]
+struct CmdField {
+  const char *name;
+  uint8_t min;
+  uint8_t max;
+  uint8_t def;
+  uint8_t bits;   // packed width, holds max-min
+};
+
+constexpr CmdField CMD_FIELDS[CMD_PARAMS] = {
+  {"mode",      0,  4,  0, 3},
+  {"temp",      16, 31, 24, 4},
+  {"fan",       0,  3,  0, 2},
+  {"flap_auto", 0,  1,  1, 1},
+  {"flap",      1,  11, 1, 4},
+  {"light",     0,  1,  1, 1},
+  {"turbo",     0,  1,  0, 1},
+  {"xfan",      0,  1,  0, 1},
+  {"sleep",     0,  1,  0, 1},
+  {"on_off",    0,  1,  0, 1},
+};
+#define CMD_MODE 0
+#define CMD_TEMP 1
+#define CMD_FAN 2
+#define CMD_ON_OFF 9
+
+// Bit offset of a field in the packed form
+constexpr uint8_t cmd_field_shift(uint8_t field) {
+  return field == 0 ? 0 : cmd_field_shift(field - 1) + CMD_FIELDS[field - 1].bits;
+}
+constexpr uint8_t CMD_PACKED_BITS = cmd_field_shift(CMD_PARAMS);
+#define CMD_PACKED_BYTES ((CMD_PACKED_BITS + 7) / 8)
+
+constexpr bool cmd_schema_ok() {
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    const CmdField &f = CMD_FIELDS[i];
+    if (f.min > f.max || f.def < f.min || f.def > f.max || (f.max - f.min) >= (1 << f.bits)) {
+      return false;
+    }
+  }
+  return CMD_PACKED_BITS <= 32;
+}
+static_assert(cmd_schema_ok(), "CMD_FIELDS: bad range, default or bit width");
+
+// True if every param is in range. No early exit, the cost does not depend
+// on the values.
+constexpr bool cmd_valid(const uint8_t *cmd) {
+  bool ok = true;
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    ok &= (cmd[i] >= CMD_FIELDS[i].min) & (cmd[i] <= CMD_FIELDS[i].max);
+  }
+  return ok;
+}
+
+// Index of the first param out of range, or -1 if all are allowed.
+// With only_power, just on_off is checked (an Off command carries no settings).
+int8_t cmd_invalid_field(const uint8_t *cmd, bool only_power);
+void cmd_default(uint8_t *cmd);
+// Field index by name, -1 if unknown
+int8_t cmd_field_index(const char *name, size_t len);
+// Parse the value of a single field (partial updates): 1..3 digits, in the
+// range of CMD_FIELDS[field]
+bool cmd_parse_field(uint8_t field, const char *text, size_t len, uint8_t *value);
+
+// Packed form: each field stored as value-min in its bits, little endian.
+// Only pack valid commands; unpacked values must be validated again.
+void cmd_pack(const uint8_t *cmd, uint8_t *packed);
+void cmd_unpack(const uint8_t *packed, uint8_t *cmd);
+
+// Parse a zone list: "all" or comma separated zone numbers, e.g. "0,2".
+// Returns a bitmask of the zones, 0 if the list is not valid.
+uint32_t parse_zones(const char *list, size_t len);
+
+// Load a command into the IRGreeAC state (nothing is transmitted).
+// The other params are applied only if we are turning on the AC.
+void ac_apply(IRGreeAC &ac, const uint8_t *cmd);
@@ -0,0 +1,139 @@
+#include "announce.h"
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <EEPROM.h>
+#include <bearssl/bearssl.h>
+#include "dht_sampler.h"
+#include "eeprom_layout.h"
+#include "log.h"
+#include "wifi_link.h"
+
+#define BOOT_COUNTER_MAGIC 0x47524231UL   // "GRB1"
+// RTC user memory offset, in 4 byte blocks, after the WiFi cache
+#define BOOT_RTC_BLOCK 8
+// Boots counted in RTC memory before the EEPROM bound is moved again
+#define BOOT_RESERVE 16
+
+struct BootCounter {
+  uint32_t magic;
+  uint32_t value;
+  uint32_t check;       // ~value
+};
+static_assert(EEPROM_ANNOUNCE + sizeof(BootCounter) <= EEPROM_LAYOUT_SIZE,
+              "boot counter does not fit its EEPROM area");
+
+static WiFiUDP udp;
+static IPAddress group_ip;
+static uint16_t group_port = 0;
+static br_hmac_key_context mac_key;
+static uint32_t heartbeat = 0;
+static uint32_t node_id = 0;
+static uint32_t boot_count = 0;
+static uint32_t seq = 0;
+
+// What the last datagram carried
+static uint32_t sent_version = 0;
+static uint32_t sent_sample_at = 0;
+static uint32_t sent_at = 0;
+
+static uint32_t sent = 0;
+static uint32_t errors = 0;
+
+static bool counter_valid(const BootCounter &c) {
+  return c.magic == BOOT_COUNTER_MAGIC && c.check == ~c.value;
+}
+
+static BootCounter counter(uint32_t value) {
+  BootCounter c = {BOOT_COUNTER_MAGIC, value, ~value};
+  return c;
+}
+
+// One above the counter of any earlier boot. RTC memory holds the counter
+// of the last boot across resets; the EEPROM holds a bound above every
+// counter used so far, which the boot after a power loss starts from. The
+// bound is moved BOOT_RESERVE boots ahead when it is reached, so the
+// sector is written once per power loss or per BOOT_RESERVE resets.
+static uint32_t next_boot() {
+  BootCounter rtc, bound;
+  bool after_reset = ESP.rtcUserMemoryRead(BOOT_RTC_BLOCK, (uint32_t *)&rtc, sizeof(rtc)) && counter_valid(rtc);
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.get(EEPROM_ANNOUNCE, bound);
+  uint32_t limit = counter_valid(bound) ? bound.value : 0;
+  uint32_t boot;
+  if (after_reset && rtc.value + 1 < limit) {
+    boot = rtc.value + 1;
+  } else {
+    boot = after_reset && rtc.value + 1 > limit ? rtc.value + 1 : limit;
+    bound = counter(boot + BOOT_RESERVE);
+    EEPROM.put(EEPROM_ANNOUNCE, bound);
+    if (!EEPROM.commit()) {
+      LOG_ERROR("announce: boot counter not saved");
+    }
+  }
+  EEPROM.end();
+  rtc = counter(boot);
+  ESP.rtcUserMemoryWrite(BOOT_RTC_BLOCK, (uint32_t *)&rtc, sizeof(rtc));
+  return boot;
+}
+
+void announce_begin(const char *group, uint16_t port, const char *key, uint32_t heartbeat_ms) {
+  group_port = group_ip.fromString(group) ? port : 0;
+  br_hmac_key_init(&mac_key, &br_sha256_vtable, key, strlen(key));
+  heartbeat = heartbeat_ms;
+  node_id = ESP.getChipId();
+  if (group_port) {
+    boot_count = next_boot();
+  }
+}
+
+static void put_u32(uint8_t *buf, uint32_t v) {
+  for (uint8_t i = 0; i < 4; i++) {
+    buf[i] = v >> (8 * i);
+  }
+}
+
+void announce_loop() {
+  if (!group_port || !wifi_link_up()) {
+    return;
+  }
+  uint8_t datagram[ANNOUNCE_BYTES(ZONE_COUNT)];
+  uint8_t *frame = datagram + ANNOUNCE_HEADER_SIZE;
+  uint32_t version = status_frame(frame);
+  uint32_t sample_at = dht_filtered().at_ms;
+  if (seq && version == sent_version && sample_at == sent_sample_at && millis() - sent_at < heartbeat) {
+    return;
+  }
+  memcpy(datagram, ANNOUNCE_MAGIC, 4);
+  put_u32(datagram + ANNOUNCE_NODE_OFFSET, node_id);
+  put_u32(datagram + ANNOUNCE_BOOT_OFFSET, boot_count);
+  put_u32(datagram + ANNOUNCE_SEQ_OFFSET, ++seq);
+  size_t len = ANNOUNCE_HEADER_SIZE + STATUS_FRAME_SIZE;
+  br_hmac_context ctx;
+  br_hmac_init(&ctx, &mac_key, ANNOUNCE_MAC_LEN);
+  br_hmac_update(&ctx, datagram, len);
+  br_hmac_out(&ctx, datagram + len);
+  len += ANNOUNCE_MAC_LEN;
+
+  // Not retried: the next change or heartbeat carries the whole state again
+  if (udp.beginPacketMulticast(group_ip, group_port, WiFi.localIP()) && udp.write(datagram, len) == len
+      && udp.endPacket()) {
+    sent++;
+  } else {
+    errors++;
+  }
+  sent_version = version;
+  sent_sample_at = sample_at;
+  sent_at = millis();
+}
+
+uint32_t announce_sent() {
+  return sent;
+}
+
+uint32_t announce_errors() {
+  return errors;
+}
+
+uint32_t announce_boot() {
+  return boot_count;
+}
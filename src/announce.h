@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include "status_frame.h"
+
+// UDP multicast status announcements, so monitors find and follow the
+// nodes without polling them.
+//
+// announce_loop() sends a datagram when the status frame changes (state[],
+// IR queue, DHT values) or a new DHT sample arrives, and every heartbeat
+// otherwise. Datagram, all fields little endian:
+//   0  4  ANNOUNCE_MAGIC
+//   4  u32 node id (chip id)
+//   8  u32 boot counter, above the one of any earlier boot of the node
+//   12 u32 sequence number, from 1 on each boot
+//   16    status frame (see status_frame.h)
+//   ..  8 HMAC-SHA256 of everything before it with the shared key, truncated
+// Receivers drop a datagram whose MAC does not match, one from a boot
+// older than the last one seen for that node, and one whose sequence
+// number is not above the last one seen for that node and boot, so a
+// recorded datagram cannot be played back once the node has sent a newer
+// one. The boot counter is kept in RTC memory across resets and reserved
+// ahead in the EEPROM for the boots after a power loss (see announce.cpp).
+// No Arduino dependency here, tools/announce_listen.cpp decodes them.
+
+#define ANNOUNCE_MAGIC "GRA2"
+#define ANNOUNCE_NODE_OFFSET 4
+#define ANNOUNCE_BOOT_OFFSET 8
+#define ANNOUNCE_SEQ_OFFSET 12
+#define ANNOUNCE_HEADER_SIZE 16
+#define ANNOUNCE_MAC_LEN 8
+#define ANNOUNCE_BYTES(zones) (ANNOUNCE_HEADER_SIZE + STATUS_FRAME_BYTES(zones) + ANNOUNCE_MAC_LEN)
+
+// group: multicast address, e.g. "239.255.71.1"
+void announce_begin(const char *group, uint16_t port, const char *key, uint32_t heartbeat_ms);
+// Call from loop(), sends only while the WiFi link is up
+void announce_loop();
+
+uint32_t announce_sent();
+uint32_t announce_errors();
+// Boot counter of this boot
+uint32_t announce_boot();
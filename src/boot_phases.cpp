@@ -0,0 +1,28 @@
+#include "boot_phases.h"
+
+static const char *const phase_names[BOOT_PHASES] = {
+  "state_restored", "ir_restored", "setup_done", "link_up", "server_started", "first_request"
+};
+
+static uint32_t phase_ms[BOOT_PHASES];
+static uint8_t reached = 0;
+static_assert(BOOT_PHASES <= 8, "reached is an 8 bit mask");
+
+void boot_mark(BootPhase phase) {
+  if (!(reached & (1 << phase))) {
+    reached |= 1 << phase;
+    phase_ms[phase] = millis();
+  }
+}
+
+bool boot_phase_reached(BootPhase phase) {
+  return reached & (1 << phase);
+}
+
+uint32_t boot_phase_ms(BootPhase phase) {
+  return phase_ms[phase];
+}
+
+const char *boot_phase_name(BootPhase phase) {
+  return phase_names[phase];
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+
+// millis() at which each boot phase completed, for the
+// time-to-first-request of a node after a power blip (see /metrics).
+//
+// setup() marks its phases as it goes, the later ones are marked from
+// loop() or the web server. Only the first mark of a phase counts.
+
+enum BootPhase {
+  BOOT_STATE_RESTORED = 0,  // state[] read back from flash
+  BOOT_IR_RESTORED,         // IR objects loaded (and resent if enabled)
+  BOOT_SETUP_DONE,          // setup() returned, loop() starts
+  BOOT_LINK_UP,             // WiFi associated with an IP
+  BOOT_SERVER_STARTED,      // HTTP server listening
+  BOOT_FIRST_REQUEST,       // first request answered
+  BOOT_PHASES
+};
+
+void boot_mark(BootPhase phase);
+bool boot_phase_reached(BootPhase phase);
+// millis() when the phase was reached
+uint32_t boot_phase_ms(BootPhase phase);
+const char *boot_phase_name(BootPhase phase);
@@ -0,0 +1,75 @@
+#include "command_dedup.h"
+
+struct DedupEntry {
+  DedupTag tag;       // kind 0: free slot
+  char result[DEDUP_RESULT_MAX];
+};
+
+static DedupEntry entries[DEDUP_SLOTS];
+static uint8_t next_slot = 0;
+static uint32_t max_seq = 0;
+static bool have_seq = false;
+static uint32_t replays = 0;
+static uint32_t unchanged = 0;
+
+bool dedup_key_tag(const char *text, size_t len, DedupTag *tag) {
+  if (!len || len > DEDUP_KEY_MAX) {
+    return false;
+  }
+  tag->kind = 'k';
+  tag->len = len;
+  memcpy(tag->bytes, text, len);
+  return true;
+}
+
+void dedup_seq_tag(uint32_t seq, DedupTag *tag) {
+  tag->kind = 's';
+  tag->len = sizeof(seq);
+  memcpy(tag->bytes, &seq, sizeof(seq));
+}
+
+static bool same_tag(const DedupTag &a, const DedupTag &b) {
+  return a.kind == b.kind && a.len == b.len && memcmp(a.bytes, b.bytes, a.len) == 0;
+}
+
+const char *dedup_find(const DedupTag &tag) {
+  for (uint8_t i = 0; i < DEDUP_SLOTS; i++) {
+    if (entries[i].tag.kind && same_tag(entries[i].tag, tag)) {
+      replays++;
+      return entries[i].result;
+    }
+  }
+  return NULL;
+}
+
+// Oldest entry goes first, slots are filled in turn
+void dedup_store(const DedupTag &tag, const char *result) {
+  DedupEntry &e = entries[next_slot];
+  next_slot = (next_slot + 1) % DEDUP_SLOTS;
+  e.tag = tag;
+  strncpy(e.result, result, sizeof(e.result) - 1);
+  e.result[sizeof(e.result) - 1] = '\0';
+}
+
+bool dedup_seq_stale(uint32_t seq) {
+  return have_seq && seq <= max_seq;
+}
+
+void dedup_seq_accept(uint32_t seq) {
+  if (!have_seq || seq > max_seq) {
+    max_seq = seq;
+    have_seq = true;
+  }
+}
+
+uint32_t dedup_replays() {
+  return replays;
+}
+
+void dedup_note_unchanged() {
+  unchanged++;
+}
+
+uint32_t dedup_unchanged() {
+  return unchanged;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include "ac_state.h"
+
+// Idempotency for /acremote.
+//
+// A client tags a command with a key ("Idempotency-Key" header or "key"
+// argument) or with an increasing "seq" argument. The X-Tx-Id answered for
+// the last DEDUP_SLOTS tags is remembered, so a retry after a timeout gets
+// the same answer back instead of another IR cycle and another flash write.
+// A seq at or below the highest one accepted and no longer in the table is
+// stale. Keys are kept as they are, up to DEDUP_KEY_MAX bytes, and seqs as
+// their number ("07" is 7), so only the same tag matches. The table is lost
+// on reboot.
+
+#define DEDUP_SLOTS 8
+// A UUID
+#define DEDUP_KEY_MAX 36
+// X-Tx-Id: one id per zone, comma separated
+#define DEDUP_RESULT_MAX (12*ZONE_COUNT)
+
+struct DedupTag {
+  char kind;          // 'k' key, 's' seq, 0: none
+  uint8_t len;
+  char bytes[DEDUP_KEY_MAX];
+};
+
+// Tag of a key, false if it is empty or longer than DEDUP_KEY_MAX
+bool dedup_key_tag(const char *text, size_t len, DedupTag *tag);
+void dedup_seq_tag(uint32_t seq, DedupTag *tag);
+// Stored result for tag, NULL if not seen (counts a replay when found)
+const char *dedup_find(const DedupTag &tag);
+void dedup_store(const DedupTag &tag, const char *result);
+
+// seq tracking, the highest seq accepted since boot
+bool dedup_seq_stale(uint32_t seq);
+void dedup_seq_accept(uint32_t seq);
+
+uint32_t dedup_replays();
+// Commands that matched the current state of every zone they targeted
+void dedup_note_unchanged();
+uint32_t dedup_unchanged();
@@ -0,0 +1,77 @@
+#include "command_parser.h"
+
+static CmdParseResult fail(CmdParseError *err, CmdParseResult result, uint8_t field, size_t offset) {
+  if (err) {
+    err->result = result;
+    err->field = field;
+    err->offset = offset > 0xFFFF ? 0xFFFF : offset;
+  }
+  return result;
+}
+
+CmdParseResult parse_command(const char *buf, size_t len, uint8_t *cmd, CmdParseError *err) {
+  if (len == 0) {
+    return fail(err, CMD_PARSE_EMPTY, 0, 0);
+  }
+  uint8_t values[CMD_PARAMS];
+  uint8_t field = 0;
+  uint16_t value = 0;
+  uint8_t digits = 0;
+  for (size_t i = 0; i <= len; i++) {
+    // Treat the end of input as a final separator
+    char c = i < len ? buf[i] : ',';
+    if (c >= '0' && c <= '9') {
+      if (field >= CMD_PARAMS) {
+        return fail(err, CMD_PARSE_TOO_MANY, field, i);
+      }
+      if (++digits > 3) {
+        return fail(err, CMD_PARSE_OVERFLOW, field, i);
+      }
+      value = value * 10 + (c - '0');
+      continue;
+    }
+    if (c != ',') {
+      return fail(err, CMD_PARSE_BAD_CHAR, field, i);
+    }
+    if (digits == 0) {
+      return fail(err, CMD_PARSE_EMPTY_FIELD, field, i);
+    }
+    if (value > 255) {
+      return fail(err, CMD_PARSE_OVERFLOW, field, i);
+    }
+    values[field++] = value;
+    value = 0;
+    digits = 0;
+  }
+  if (field < CMD_PARAMS) {
+    return fail(err, CMD_PARSE_TOO_FEW, field, len);
+  }
+
+  int8_t bad = cmd_invalid_field(values, values[CMD_ON_OFF] == 0);
+  if (bad >= 0) {
+    return fail(err, CMD_PARSE_RANGE, bad, len);
+  }
+  for (uint8_t j = 0; j < CMD_PARAMS; j++) {
+    cmd[j] = values[j];
+  }
+  if (err) {
+    err->result = CMD_PARSE_OK;
+    err->field = 0;
+    err->offset = 0;
+  }
+  return CMD_PARSE_OK;
+}
+
+const char *cmd_parse_result_name(CmdParseResult result) {
+  switch (result) {
+    case CMD_PARSE_OK: return "ok";
+    case CMD_PARSE_EMPTY: return "empty";
+    case CMD_PARSE_BAD_CHAR: return "bad_char";
+    case CMD_PARSE_EMPTY_FIELD: return "empty_field";
+    case CMD_PARSE_OVERFLOW: return "overflow";
+    case CMD_PARSE_TOO_FEW: return "too_few";
+    case CMD_PARSE_TOO_MANY: return "too_many";
+    case CMD_PARSE_RANGE: return "range";
+    default: return "unknown";
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ac_state.h"
+
+// Parser for the /acremote "command" argument: CMD_PARAMS comma separated
+// decimal fields, e.g. "1,22,0,1,1,1,0,0,0,1".
+//
+// Single pass over the request buffer, no copy, no allocation. Each field is
+// 1..3 digits, no signs or blanks. Fields are range checked against
+// CMD_FIELDS (the same rules state_check() uses); for an Off command
+// (on_off=0) only on_off is checked since the UI sends zeros for the rest.
+// No pure C++ dependency beyond ac_state.h, so it can be built on a host.
+
+enum CmdParseResult {
+  CMD_PARSE_OK = 0,
+  CMD_PARSE_EMPTY,       // no input
+  CMD_PARSE_BAD_CHAR,    // not a digit or comma
+  CMD_PARSE_EMPTY_FIELD, // ",," or leading/trailing comma
+  CMD_PARSE_OVERFLOW,    // field longer than 3 digits or above 255
+  CMD_PARSE_TOO_FEW,     // less than CMD_PARAMS fields
+  CMD_PARSE_TOO_MANY,    // more than CMD_PARAMS fields
+  CMD_PARSE_RANGE        // field outside its CMD_FIELDS range
+};
+
+struct CmdParseError {
+  CmdParseResult result;
+  uint8_t field;         // index of the offending field
+  uint16_t offset;       // byte offset in the input
+};
+
+// Parse len bytes of buf into cmd[CMD_PARAMS]. cmd is only written on success.
+CmdParseResult parse_command(const char *buf, size_t len, uint8_t *cmd, CmdParseError *err);
+const char *cmd_parse_result_name(CmdParseResult result);
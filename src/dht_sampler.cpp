@@ -0,0 +1,104 @@
+#include "dht_sampler.h"
+
+static dht *sampler_dht = NULL;
+static uint8_t sampler_pin = 0;
+static uint32_t sampler_interval = DHT11_MIN_INTERVAL_MS;
+static uint32_t last_attempt = 0;
+
+static DhtReading last_reading = {0, 0, 0, false};
+static DhtReading filtered_reading = {0, 0, 0, false};
+
+// Ring of the last good readings for the median filter
+static float window_temp[DHT_MEDIAN_WINDOW];
+static float window_humidity[DHT_MEDIAN_WINDOW];
+static uint8_t window_len = 0;
+static uint8_t window_next = 0;
+
+static uint32_t reads = 0;
+static uint32_t checksum_errors = 0;
+static uint32_t timeout_errors = 0;
+static uint32_t other_errors = 0;
+
+void dht_sampler_begin(dht &sensor, uint8_t pin, uint32_t interval_ms) {
+  sampler_dht = &sensor;
+  sampler_pin = pin;
+  sampler_interval = interval_ms < DHT11_MIN_INTERVAL_MS ? DHT11_MIN_INTERVAL_MS : interval_ms;
+  // The sensor also needs ~1s after power up, first read one interval from now
+  last_attempt = millis();
+}
+
+static float median(const float *values, uint8_t len) {
+  float sorted[DHT_MEDIAN_WINDOW];
+  for (uint8_t i = 0; i < len; i++) {
+    float v = values[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j-1] > v) {
+      sorted[j] = sorted[j-1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  return sorted[len/2];
+}
+
+void dht_sampler_loop() {
+  if (sampler_dht == NULL || millis() - last_attempt < sampler_interval) {
+    return;
+  }
+  last_attempt = millis();
+  reads++;
+  int rc = sampler_dht->read11(sampler_pin);
+  switch (rc) {
+    case DHTLIB_OK:
+      break;
+    case DHTLIB_ERROR_CHECKSUM:
+      checksum_errors++;
+      return;
+    case DHTLIB_ERROR_TIMEOUT:
+      timeout_errors++;
+      return;
+    default:
+      other_errors++;
+      return;
+  }
+
+  last_reading.temperature = sampler_dht->temperature;
+  last_reading.humidity = sampler_dht->humidity;
+  last_reading.at_ms = last_attempt;
+  last_reading.valid = true;
+
+  window_temp[window_next] = last_reading.temperature;
+  window_humidity[window_next] = last_reading.humidity;
+  window_next = (window_next + 1) % DHT_MEDIAN_WINDOW;
+  if (window_len < DHT_MEDIAN_WINDOW) {
+    window_len++;
+  }
+  filtered_reading.temperature = median(window_temp, window_len);
+  filtered_reading.humidity = median(window_humidity, window_len);
+  filtered_reading.at_ms = last_attempt;
+  filtered_reading.valid = true;
+}
+
+const DhtReading &dht_last() {
+  return last_reading;
+}
+
+const DhtReading &dht_filtered() {
+  return filtered_reading;
+}
+
+uint32_t dht_reads() {
+  return reads;
+}
+
+uint32_t dht_checksum_errors() {
+  return checksum_errors;
+}
+
+uint32_t dht_timeout_errors() {
+  return timeout_errors;
+}
+
+uint32_t dht_other_errors() {
+  return other_errors;
+}
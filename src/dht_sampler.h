@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+#include <dht.h>
+
+// Background DHT11 sampler.
+//
+// dht_sampler_loop() reads the sensor at most once per interval (never faster
+// than the DHT11 allows) and caches the result, so HTTP handlers only read
+// the cache and never touch the sensor pin.
+
+// The DHT11 needs at least 1s between reads
+#define DHT11_MIN_INTERVAL_MS 1000
+// Readings kept for the median filter
+#define DHT_MEDIAN_WINDOW 5
+
+struct DhtReading {
+  float temperature;
+  float humidity;
+  uint32_t at_ms;   // millis() of the (last) good read
+  bool valid;       // false until the first good read
+};
+
+void dht_sampler_begin(dht &sensor, uint8_t pin, uint32_t interval_ms);
+// Call from loop()
+void dht_sampler_loop();
+
+// Last good reading as returned by the sensor
+const DhtReading &dht_last();
+// Median of the last DHT_MEDIAN_WINDOW good readings
+const DhtReading &dht_filtered();
+
+uint32_t dht_reads();
+uint32_t dht_checksum_errors();
+uint32_t dht_timeout_errors();
+// Connect/ack errors and anything else reported by the library
+uint32_t dht_other_errors();
@@ -0,0 +1,19 @@
+#pragma once
+
+// Layout of the EEPROM sector.
+//
+// EEPROM.commit() erases the sector and writes back only the first size bytes
+// given to EEPROM.begin(), so every module that writes begins it with
+// EEPROM_LAYOUT_SIZE and keeps to its own area.
+
+// state[] saved by firmwares older than the flash journal, read once
+#define EEPROM_LEGACY_STATE 0
+// schedule.cpp
+#define EEPROM_SCHEDULE 16
+// thermostat.cpp
+#define EEPROM_THERMOSTAT 512
+// wifi_link.cpp
+#define EEPROM_WIFI 576
+// announce.cpp
+#define EEPROM_ANNOUNCE 608
+#define EEPROM_LAYOUT_SIZE 640
@@ -0,0 +1,59 @@
+#include "event_stream.h"
+
+static AsyncEventSource source("/events");
+static EventsSnapshotFn snapshot_cb = NULL;
+static EventsAuthFn auth_cb = NULL;
+static uint32_t last_keepalive = 0;
+static uint32_t dropped = 0;
+// The retry delay goes with the first event of each subscriber
+static bool first_event = false;
+
+static void on_connect(AsyncEventSourceClient *client) {
+  // The new client is already counted
+  if (source.count() > SSE_MAX_CLIENTS) {
+    dropped++;
+    client->close();
+    return;
+  }
+  first_event = true;
+  snapshot_cb(client);
+  first_event = false;
+}
+
+void events_begin(AsyncWebServer &server, EventsAuthFn auth, EventsSnapshotFn snapshot) {
+  auth_cb = auth;
+  snapshot_cb = snapshot;
+  source.onConnect(on_connect);
+  // Filters run for every request, check the path first
+  source.setFilter([](AsyncWebServerRequest *request) {
+    return request->url() == "/events" && auth_cb(request);
+  });
+  server.addHandler(&source);
+}
+
+void events_send(AsyncEventSourceClient *client, const char *event, const char *data) {
+  client->send(data, event, 0, first_event ? SSE_RETRY_MS : 0);
+  first_event = false;
+}
+
+void events_publish(const char *event, const char *data) {
+  source.send(data, event);
+}
+
+void events_loop() {
+  if (millis() - last_keepalive < SSE_KEEPALIVE_MS) {
+    return;
+  }
+  last_keepalive = millis();
+  if (source.count()) {
+    source.send("", "ping");
+  }
+}
+
+uint8_t events_subscribers() {
+  return source.count();
+}
+
+uint32_t events_dropped() {
+  return dropped;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Server-Sent Events fan-out (GET /events).
+//
+// An AsyncEventSource of the web server: events_publish() queues one event
+// for every subscriber, each connection is written as its window allows so
+// a slow browser does not hold the others back. At most SSE_MAX_CLIENTS
+// subscribers are kept, more are refused (events_dropped()). A new
+// subscriber first gets a snapshot from the EventsSnapshotFn. events_loop()
+// sends a "ping" event every SSE_KEEPALIVE_MS so proxies keep idle streams
+// open.
+
+#define SSE_MAX_CLIENTS 4
+#define SSE_KEEPALIVE_MS 15000
+// Browser reconnect delay sent with the first event
+#define SSE_RETRY_MS 3000
+
+// Whether the request may subscribe
+typedef bool (*EventsAuthFn)(AsyncWebServerRequest *request);
+// Send the current values to a new subscriber (events_send())
+typedef void (*EventsSnapshotFn)(AsyncEventSourceClient *client);
+
+void events_begin(AsyncWebServer &server, EventsAuthFn auth, EventsSnapshotFn snapshot);
+// Write to one subscriber only (initial snapshot)
+void events_send(AsyncEventSourceClient *client, const char *event, const char *data);
+void events_publish(const char *event, const char *data);
+// Call from loop()
+void events_loop();
+
+uint8_t events_subscribers();
+uint32_t events_dropped();
@@ -0,0 +1,581 @@
+#include "history.h"
+#include <flash_hal.h>
+#include <time.h>
+#include <math.h>
+#include "dht_sampler.h"
+#include "state_journal.h"
+
+#define HISTORY_SECTOR_SIZE 4096
+#define HISTORY_FLASH_BLOCKS (HISTORY_FLASH_SECTORS * (HISTORY_SECTOR_SIZE / HISTORY_BLOCK_SIZE))
+#define HISTORY_BLANK 0xFFFFFFFFUL
+// time() below this: NTP has not set the clock yet
+#define HISTORY_MIN_EPOCH 1600000000UL
+// Readings older than this are not recorded
+#define HISTORY_STALE_MS 60000UL
+
+#define TAG_RUN_MAX 0x7F
+#define TAG_SAMPLE 0x80
+#define TAG_TEMP 0x20
+#define TAG_HUMIDITY 0x10
+#define TAG_GAP 0xC0
+#define TAG_STATE 0xC1
+// Longest records: gap + sample, state change
+#define SAMPLE_MAX (1 + 5 + 1 + 3 + 3)
+#define EVENT_MAX (1 + 5 + 1 + 5)
+// Left free by samples for the state changes until the next one
+#define EVENT_RESERVE (2 * EVENT_MAX)
+
+struct BlockHeader {
+  uint32_t start;       // minute of the first sample, HISTORY_BLANK if unused
+  uint32_t seq;         // blocks in the order they were opened
+  int16_t temp;         // first sample
+  int16_t humidity;
+  uint16_t used;        // bytes, header included
+  uint8_t state[ZONE_COUNT][CMD_PACKED_BYTES];   // packed state[] at start
+};
+
+union Block {
+  BlockHeader h;
+  uint8_t bytes[HISTORY_BLOCK_SIZE];
+  uint32_t words[HISTORY_BLOCK_SIZE / 4];
+};
+static_assert(sizeof(BlockHeader) + SAMPLE_MAX + EVENT_RESERVE < HISTORY_BLOCK_SIZE,
+              "HISTORY_BLOCK_SIZE too small for ZONE_COUNT");
+
+// RAM ring, the newest block is the one being appended to
+static Block blocks[HISTORY_BLOCKS];
+static uint8_t first = 0;
+static uint8_t count = 0;
+static bool open = false;
+
+static uint32_t cur_minute = 0;     // last sample
+static int16_t cur_temp = 0;
+static int16_t cur_humidity = 0;
+static int16_t run_at = -1;         // offset of the last record if it is a run
+static uint8_t cur_state[ZONE_COUNT][CMD_PACKED_BYTES];
+
+static uint32_t last_poll = 0;
+static uint32_t last_minute = 0;
+static uint32_t samples = 0;
+static uint32_t next_seq = 0;
+
+#if HISTORY_FLASH_SECTORS
+static bool flash_ok = false;
+static uint32_t flash_base = 0;
+static uint16_t flash_next = 0;     // next block written, the oldest one
+#endif
+static uint32_t flash_written = 0;
+
+static Block &newest() {
+  return blocks[(first + count - 1) % HISTORY_BLOCKS];
+}
+
+static uint16_t block_free() {
+  return HISTORY_BLOCK_SIZE - newest().h.used;
+}
+
+static void put_byte(uint8_t v) {
+  Block &b = newest();
+  b.bytes[b.h.used++] = v;
+}
+
+static void put_varint(uint32_t v) {
+  while (v >= 0x80) {
+    put_byte(v | 0x80);
+    v >>= 7;
+  }
+  put_byte(v);
+}
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+#if HISTORY_FLASH_SECTORS
+static uint32_t flash_addr(uint16_t block) {
+  return flash_base + (uint32_t)block * HISTORY_BLOCK_SIZE;
+}
+
+static void flash_begin() {
+  uint32_t size = (JOURNAL_SECTORS + HISTORY_FLASH_SECTORS) * HISTORY_SECTOR_SIZE;
+  if (FS_PHYS_SIZE < size) {
+    return;
+  }
+  flash_base = FS_PHYS_ADDR + FS_PHYS_SIZE - size;
+  flash_ok = true;
+  // Continue after the newest block, its start may be older than others'
+  // if the clock went back
+  for (uint16_t i = 0; i < HISTORY_FLASH_BLOCKS; i++) {
+    uint32_t head[2];
+    if (ESP.flashRead(flash_addr(i), head, 8) && head[0] != HISTORY_BLANK && head[1] >= next_seq) {
+      next_seq = head[1] + 1;
+      flash_next = (i + 1) % HISTORY_FLASH_BLOCKS;
+    }
+  }
+}
+
+static void flash_write(const Block &b) {
+  if (!flash_ok) {
+    return;
+  }
+  uint32_t addr = flash_addr(flash_next);
+  if (addr % HISTORY_SECTOR_SIZE == 0) {
+    ESP.flashEraseSector(addr / HISTORY_SECTOR_SIZE);
+  }
+  if (ESP.flashWrite(addr, b.words, HISTORY_BLOCK_SIZE)) {
+    flash_written++;
+  }
+  flash_next = (flash_next + 1) % HISTORY_FLASH_BLOCKS;
+}
+#endif
+
+static void close_block() {
+  if (!open) {
+    return;
+  }
+  open = false;
+#if HISTORY_FLASH_SECTORS
+  flash_write(newest());
+#endif
+}
+
+static void open_block(uint32_t minute, int16_t temp, int16_t humidity) {
+  close_block();
+  if (count == HISTORY_BLOCKS) {
+    first = (first + 1) % HISTORY_BLOCKS;
+    count--;
+  }
+  count++;
+  Block &b = newest();
+  memset(b.bytes, 0xFF, sizeof(b.bytes));
+  b.h.start = minute;
+  b.h.seq = next_seq++;
+  b.h.temp = temp;
+  b.h.humidity = humidity;
+  b.h.used = sizeof(BlockHeader);
+  memcpy(b.h.state, cur_state, sizeof(cur_state));
+  open = true;
+  run_at = -1;
+}
+
+static void append_sample(uint32_t minute, int16_t temp, int16_t humidity) {
+  samples++;
+  if (!open || minute <= cur_minute || block_free() < SAMPLE_MAX + EVENT_RESERVE) {
+    open_block(minute, temp, humidity);
+  } else {
+    if (minute > cur_minute + 1) {
+      put_byte(TAG_GAP);
+      put_varint(minute - cur_minute - 1);
+      run_at = -1;
+    }
+    Block &b = newest();
+    if (temp == cur_temp && humidity == cur_humidity) {
+      if (run_at >= 0 && b.bytes[run_at] < TAG_RUN_MAX) {
+        b.bytes[run_at]++;
+      } else {
+        run_at = b.h.used;
+        put_byte(0);
+      }
+    } else {
+      put_byte(TAG_SAMPLE | (temp != cur_temp ? TAG_TEMP : 0) | (humidity != cur_humidity ? TAG_HUMIDITY : 0));
+      if (temp != cur_temp) {
+        put_varint(zigzag(temp - cur_temp));
+      }
+      if (humidity != cur_humidity) {
+        put_varint(zigzag(humidity - cur_humidity));
+      }
+      run_at = -1;
+    }
+  }
+  cur_minute = minute;
+  cur_temp = temp;
+  cur_humidity = humidity;
+}
+
+void history_begin(const uint8_t *states) {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    cmd_pack(states + z * CMD_PARAMS, cur_state[z]);
+  }
+#if HISTORY_FLASH_SECTORS
+  flash_begin();
+#endif
+}
+
+void history_loop() {
+  if (millis() - last_poll < 1000) {
+    return;
+  }
+  last_poll = millis();
+  time_t now = time(NULL);
+  if (now < (time_t)HISTORY_MIN_EPOCH || (uint32_t)(now / 60) == last_minute) {
+    return;
+  }
+  last_minute = now / 60;
+  const DhtReading &reading = dht_filtered();
+  if (reading.valid && millis() - reading.at_ms < HISTORY_STALE_MS) {
+    append_sample(last_minute, lroundf(reading.temperature * 10), lroundf(reading.humidity * 10));
+  }
+}
+
+void history_note_state(uint8_t zone, const uint8_t *cmd) {
+  uint8_t packed[CMD_PACKED_BYTES];
+  cmd_pack(cmd, packed);
+  uint32_t diff = 0;
+  for (uint8_t i = 0; i < CMD_PACKED_BYTES; i++) {
+    diff |= (uint32_t)(packed[i] ^ cur_state[zone][i]) << (8 * i);
+  }
+  memcpy(cur_state[zone], packed, CMD_PACKED_BYTES);
+  time_t now = time(NULL);
+  // Without room in the block the change shows up in the next block's
+  // baseline
+  if (!diff || !open || now < (time_t)HISTORY_MIN_EPOCH || block_free() < EVENT_MAX) {
+    return;
+  }
+  uint32_t minute = now / 60;
+  put_byte(TAG_STATE);
+  put_varint(minute > cur_minute ? minute - cur_minute : 0);
+  put_byte(zone);
+  put_varint(diff);
+  run_at = -1;
+}
+
+// Decoding
+
+#define ROW_MAX 96
+
+enum CursorStage {
+  STAGE_HEADER,
+  STAGE_NEXT_BLOCK,
+  STAGE_BASELINE,
+  STAGE_RECORDS,
+  STAGE_FLUSH,
+  STAGE_DONE
+};
+
+// Decoder state kept between two history_read() calls. A step decodes one
+// baseline zone, one sample of a run or one record, which makes at most
+// one output row.
+struct HistoryCursor {
+  uint32_t from;        // minutes
+  uint32_t to;
+  uint32_t step;
+  uint8_t what;
+  bool binary;
+  uint8_t stage;
+  // block being decoded, a copy: the ring may move on meanwhile
+  Block block;
+  uint32_t next_seq;    // lowest sequence number not decoded yet
+  uint16_t pos;
+  uint32_t minute;
+  int16_t temp;
+  int16_t humidity;
+  uint8_t run_left;
+  uint8_t zone;         // next baseline zone
+  // averaging bucket
+  uint32_t bucket;
+  int32_t temp_sum;
+  int32_t humidity_sum;
+  uint16_t n;
+  // state of each zone as decoded so far
+  bool have_state;
+  uint8_t state[ZONE_COUNT][CMD_PACKED_BYTES];
+  // pending output
+  uint8_t row[ROW_MAX];
+  uint8_t row_len;
+  uint8_t row_pos;
+};
+
+static void put_row(HistoryCursor &c, const void *data, size_t len) {
+  memcpy(c.row + c.row_len, data, len);
+  c.row_len += len;
+}
+
+static void print_row(HistoryCursor &c, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf((char *)c.row + c.row_len, ROW_MAX - c.row_len, fmt, args);
+  va_end(args);
+  if (len > 0) {
+    c.row_len += len < ROW_MAX - c.row_len ? len : ROW_MAX - c.row_len - 1;
+  }
+}
+
+static void flush_bucket(HistoryCursor &c) {
+  if (!c.n) {
+    return;
+  }
+  uint32_t time = c.bucket * 60;
+  int16_t temp = lroundf((float)c.temp_sum / c.n);
+  int16_t humidity = lroundf((float)c.humidity_sum / c.n);
+  if (c.binary) {
+    put_row(c, &time, 4);
+    put_row(c, &temp, 2);
+    put_row(c, &humidity, 2);
+  } else {
+    print_row(c, "%lu,%.1f,%.1f\n", (unsigned long)time, temp / 10.0, humidity / 10.0);
+  }
+  c.n = 0;
+  c.temp_sum = 0;
+  c.humidity_sum = 0;
+}
+
+static void room_sample(HistoryCursor &c, uint32_t minute, int16_t temp, int16_t humidity) {
+  if (c.what != HISTORY_ROOM || minute < c.from || minute > c.to) {
+    return;
+  }
+  uint32_t bucket = minute - minute % c.step;
+  if (c.n && bucket != c.bucket) {
+    flush_bucket(c);
+  }
+  c.bucket = bucket;
+  c.temp_sum += temp;
+  c.humidity_sum += humidity;
+  c.n++;
+}
+
+static void state_change(HistoryCursor &c, uint32_t minute, uint8_t zone) {
+  if (c.what != HISTORY_STATE || minute < c.from || minute > c.to) {
+    return;
+  }
+  uint8_t cmd[CMD_PARAMS];
+  cmd_unpack(c.state[zone], cmd);
+  uint32_t time = minute * 60;
+  if (c.binary) {
+    put_row(c, &time, 4);
+    put_row(c, &zone, 1);
+    put_row(c, cmd, CMD_PARAMS);
+  } else {
+    print_row(c, "%lu,%u", (unsigned long)time, zone);
+    for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+      print_row(c, ",%u", cmd[i]);
+    }
+    print_row(c, "\n");
+  }
+}
+
+static bool get_varint(const Block &b, uint16_t &pos, uint32_t &v) {
+  v = 0;
+  for (uint8_t shift = 0; pos < b.h.used && shift < 35; shift += 7) {
+    uint8_t c = b.bytes[pos++];
+    v |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Copy the block opened next after the one decoded last. Blocks are looked
+// up by sequence number rather than ring position, so the cursor is not
+// confused by blocks dropped or added while it is paused, and a block kept
+// both in flash and in RAM is decoded once. Not by start minute either:
+// after the clock went back two blocks can start on the same minute, or a
+// later one before an earlier one.
+static bool next_block(HistoryCursor &c) {
+  for (;;) {
+    uint32_t best = HISTORY_BLANK;
+    int16_t best_ram = -1;
+#if HISTORY_FLASH_SECTORS
+    int32_t best_flash = -1;
+    for (uint16_t i = 0; flash_ok && i < HISTORY_FLASH_BLOCKS; i++) {
+      uint32_t head[2];
+      if (ESP.flashRead(flash_addr(i), head, 8) && head[0] != HISTORY_BLANK && head[1] >= c.next_seq &&
+          head[1] < best) {
+        best = head[1];
+        best_flash = i;
+      }
+    }
+#endif
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t at = (first + i) % HISTORY_BLOCKS;
+      if (blocks[at].h.seq >= c.next_seq && blocks[at].h.seq <= best) {
+        best = blocks[at].h.seq;
+        best_ram = at;
+      }
+    }
+    if (best_ram >= 0) {
+      // The RAM copy is the newest one, the block may still be open
+      memcpy(&c.block, &blocks[best_ram], sizeof(Block));
+    }
+#if HISTORY_FLASH_SECTORS
+    else if (best_flash < 0) {
+      return false;
+    } else if (!ESP.flashRead(flash_addr(best_flash), c.block.words, HISTORY_BLOCK_SIZE)) {
+      c.next_seq = best + 1;
+      continue;
+    }
+#else
+    else {
+      return false;
+    }
+#endif
+    c.next_seq = best + 1;
+    // Blocks after it may still be in range if the clock went back
+    if (c.block.h.start <= c.to && c.block.h.used >= sizeof(BlockHeader) &&
+        c.block.h.used <= HISTORY_BLOCK_SIZE) {
+      return true;
+    }
+  }
+}
+
+// One decoding step
+static void decode_step(HistoryCursor &c) {
+  const Block &b = c.block;
+  uint32_t v;
+  switch (c.stage) {
+    case STAGE_HEADER:
+      if (!c.binary && c.what == HISTORY_ROOM) {
+        print_row(c, "time,temp,humidity\n");
+      } else if (!c.binary) {
+        print_row(c, "time,zone");
+        for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+          print_row(c, ",%s", CMD_FIELDS[i].name);
+        }
+        print_row(c, "\n");
+      }
+      c.stage = STAGE_NEXT_BLOCK;
+      return;
+    case STAGE_NEXT_BLOCK:
+      if (!next_block(c)) {
+        c.stage = STAGE_FLUSH;
+        return;
+      }
+      c.minute = b.h.start;
+      c.temp = b.h.temp;
+      c.humidity = b.h.humidity;
+      c.pos = sizeof(BlockHeader);
+      c.run_left = 0;
+      c.zone = 0;
+      c.stage = STAGE_BASELINE;
+      return;
+    case STAGE_BASELINE:
+      if (c.zone < ZONE_COUNT) {
+        uint8_t z = c.zone++;
+        if (!c.have_state || memcmp(c.state[z], b.h.state[z], CMD_PACKED_BYTES)) {
+          memcpy(c.state[z], b.h.state[z], CMD_PACKED_BYTES);
+          state_change(c, c.minute, z);
+        }
+        return;
+      }
+      c.have_state = true;
+      room_sample(c, c.minute, c.temp, c.humidity);
+      c.stage = STAGE_RECORDS;
+      return;
+    case STAGE_RECORDS:
+      break;
+    case STAGE_FLUSH:
+      flush_bucket(c);
+      c.stage = STAGE_DONE;
+      return;
+    default:
+      return;
+  }
+  if (c.run_left) {
+    c.run_left--;
+    room_sample(c, ++c.minute, c.temp, c.humidity);
+    return;
+  }
+  if (c.pos >= b.h.used || c.minute > c.to) {
+    c.stage = STAGE_NEXT_BLOCK;
+    return;
+  }
+  uint8_t tag = b.bytes[c.pos++];
+  if (tag <= TAG_RUN_MAX) {
+    c.run_left = tag + 1;
+  } else if (tag == TAG_GAP && get_varint(b, c.pos, v)) {
+    c.minute += v;
+  } else if (tag == TAG_STATE) {
+    uint32_t offset;
+    uint8_t zone;
+    if (!get_varint(b, c.pos, offset) || c.pos >= b.h.used ||
+        (zone = b.bytes[c.pos++]) >= ZONE_COUNT || !get_varint(b, c.pos, v)) {
+      c.stage = STAGE_NEXT_BLOCK;
+      return;
+    }
+    for (uint8_t i = 0; i < CMD_PACKED_BYTES; i++) {
+      c.state[zone][i] ^= v >> (8 * i);
+    }
+    state_change(c, c.minute + offset, zone);
+  } else if ((tag & 0xC0) == TAG_SAMPLE) {
+    if ((tag & TAG_TEMP) && get_varint(b, c.pos, v)) {
+      c.temp += unzigzag(v);
+    }
+    if ((tag & TAG_HUMIDITY) && get_varint(b, c.pos, v)) {
+      c.humidity += unzigzag(v);
+    }
+    room_sample(c, ++c.minute, c.temp, c.humidity);
+  } else {
+    // Corrupt block, skip the rest of it
+    c.stage = STAGE_NEXT_BLOCK;
+  }
+}
+
+HistoryCursor *history_open(uint32_t from, uint32_t to, uint32_t step, uint8_t what, bool binary) {
+  HistoryCursor *c = (HistoryCursor *)malloc(sizeof(HistoryCursor));
+  if (!c) {
+    return NULL;
+  }
+  memset(c, 0, sizeof(*c));
+  c->from = from / 60;
+  c->to = to / 60;
+  c->step = step < 60 ? 1 : step / 60;
+  c->what = what;
+  c->binary = binary;
+  c->stage = STAGE_HEADER;
+  return c;
+}
+
+size_t history_read(HistoryCursor *c, uint8_t *buf, size_t max) {
+  size_t len = 0;
+  while (len < max) {
+    if (c->row_pos < c->row_len) {
+      size_t n = c->row_len - c->row_pos;
+      n = n < max - len ? n : max - len;
+      memcpy(buf + len, c->row + c->row_pos, n);
+      c->row_pos += n;
+      len += n;
+      continue;
+    }
+    if (c->stage == STAGE_DONE) {
+      break;
+    }
+    c->row_len = 0;
+    c->row_pos = 0;
+    decode_step(*c);
+  }
+  return len;
+}
+
+uint32_t history_oldest() {
+  uint32_t oldest = count ? blocks[first].h.start : HISTORY_BLANK;
+#if HISTORY_FLASH_SECTORS
+  for (uint16_t i = 0; flash_ok && i < HISTORY_FLASH_BLOCKS; i++) {
+    uint32_t start;
+    if (ESP.flashRead(flash_addr((flash_next + i) % HISTORY_FLASH_BLOCKS), &start, 4) && start != HISTORY_BLANK) {
+      oldest = start < oldest ? start : oldest;
+      break;
+    }
+  }
+#endif
+  return oldest == HISTORY_BLANK ? 0 : oldest * 60;
+}
+
+uint32_t history_samples() {
+  return samples;
+}
+
+uint32_t history_ram_bytes() {
+  uint32_t bytes = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    bytes += blocks[(first + i) % HISTORY_BLOCKS].h.used;
+  }
+  return bytes;
+}
+
+uint32_t history_flash_blocks_written() {
+  return flash_written;
+}
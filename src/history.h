@@ -0,0 +1,60 @@
+#pragma once
+#include <Arduino.h>
+#include "ac_state.h"
+
+// Compressed time series of the room readings and of state[] changes.
+//
+// One sample per minute (UTC minutes since 1970, once NTP has set the clock)
+// of the filtered DHT reading, in 0.1 units. Samples are appended to
+// HISTORY_BLOCK_SIZE bytes blocks, each one starting from a full baseline
+// (first sample and packed state of every zone) so it decodes on its own:
+//   0nnnnnnn            n+1 samples equal to the previous one
+//   10th0000 ...        one sample, zigzag varint delta of temp (t) and/or
+//                       humidity (h) follows
+//   11000000 <varint>   minutes without a reading
+//   11000001 <varint offset> <zone> <varint xor>
+//                       state change of a zone, offset minutes after the
+//                       last sample, XOR of its packed state
+// A DHT11 changes every few minutes, so a day takes ~1-2 KB. Blocks are kept
+// in a RAM ring of HISTORY_BLOCKS, the oldest one is dropped when it is
+// full. With HISTORY_FLASH_SECTORS every closed block is also written to a
+// flash ring just below the state journal, which survives reboots.
+
+#define HISTORY_BLOCK_SIZE 256
+#ifndef HISTORY_BLOCKS
+#define HISTORY_BLOCKS 16
+#endif
+#ifndef HISTORY_FLASH_SECTORS
+#define HISTORY_FLASH_SECTORS 0
+#endif
+
+// What a cursor outputs
+#define HISTORY_ROOM 0
+#define HISTORY_STATE 1
+
+struct HistoryCursor;
+
+void history_begin(const uint8_t *states);
+// Call from loop()
+void history_loop();
+// state[] of a zone changed
+void history_note_state(uint8_t zone, const uint8_t *cmd);
+
+// Decode the samples between from and to (unix seconds) a piece at a time,
+// for a response filled as the connection drains.
+// HISTORY_ROOM: averaged over step seconds, CSV "time,temp,humidity" rows or
+// binary records of uint32 time, int16 temp*10, int16 humidity*10.
+// HISTORY_STATE: every change, CSV "time,zone,<CMD_FIELDS names>" rows or
+// binary records of uint32 time, uint8 zone, CMD_PARAMS bytes.
+// Binary is little endian. The cursor is malloc()ed (NULL if out of
+// memory), free() it when done.
+HistoryCursor *history_open(uint32_t from, uint32_t to, uint32_t step, uint8_t what, bool binary);
+// Fill buf with up to max bytes of output, 0 at the end
+size_t history_read(HistoryCursor *cursor, uint8_t *buf, size_t max);
+
+// Unix time of the oldest sample kept, 0 if none
+uint32_t history_oldest();
+uint32_t history_samples();
+// Bytes used by the blocks in RAM
+uint32_t history_ram_bytes();
+uint32_t history_flash_blocks_written();
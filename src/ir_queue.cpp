@@ -0,0 +1,220 @@
+#include "ir_queue.h"
+#include "ir_timer.h"
+
+struct TxSlot {
+  IRGreeAC *ac;
+  // Played back by the timer interrupt
+  bool timer_tx;
+  uint8_t pin;
+  // Pending command (latest not sent yet)
+  uint8_t pending_cmd[CMD_PARAMS];
+  uint32_t pending_id;
+  // Command on air
+  uint32_t active_id;
+  uint8_t active_left;
+  uint32_t last_send;
+};
+
+static TxSlot slots[ZONE_COUNT];
+static bool tx_ready = false;
+static uint8_t tx_repeat = 1;
+static uint16_t tx_gap_ms = 0;
+// Zone to look at first on the next ir_queue_loop()
+static uint8_t next_zone = 0;
+// Frame played back by the timer
+static uint16_t frame[IR_TIMINGS_MAX];
+static TxSlot *on_air = NULL;
+static uint32_t on_air_start = 0;
+
+static uint32_t last_id = 0;
+static uint32_t done_id = 0;
+static uint32_t superseded = 0;
+static uint32_t frames_sent = 0;
+static uint32_t send_us_total = 0;
+static uint32_t send_us_max = 0;
+// Bit (id % 32) set if that id was cut short/dropped, valid for the last 32 ids
+static uint32_t superseded_mask = 0;
+
+void ir_queue_begin(IRGreeAC **acs, const uint8_t *pins, uint8_t repeat, uint16_t gap_ms) {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    memset(&slots[z], 0, sizeof(TxSlot));
+    slots[z].ac = acs[z];
+    slots[z].timer_tx = pins && ir_timer_supported(pins[z]);
+    slots[z].pin = pins ? pins[z] : 0;
+  }
+  tx_repeat = repeat ? repeat : 1;
+  tx_gap_ms = gap_ms;
+  tx_ready = true;
+}
+
+static void retire(uint32_t id, bool cut_short) {
+  if (cut_short) {
+    superseded++;
+    superseded_mask |= (1UL << (id % 32));
+  }
+  done_id = id;
+}
+
+uint32_t ir_queue_push(uint8_t zone, const uint8_t *cmd) {
+  TxSlot &slot = slots[zone];
+  if (slot.pending_id) {
+    // Never sent, replaced by this one
+    retire(slot.pending_id, true);
+  }
+  memcpy(slot.pending_cmd, cmd, CMD_PARAMS);
+  slot.pending_id = ++last_id;
+  superseded_mask &= ~(1UL << (last_id % 32));
+  return slot.pending_id;
+}
+
+static void frame_sent(uint32_t took) {
+  frames_sent++;
+  send_us_total += took;
+  if (took > send_us_max) {
+    send_us_max = took;
+  }
+}
+
+// Timer playback over, the gap of the zone starts now
+static void frame_done() {
+  frame_sent(micros() - on_air_start);
+  on_air->last_send = millis();
+  on_air = NULL;
+}
+
+// Start the next frame of a zone on the timer
+static bool timer_send(TxSlot &slot) {
+  uint16_t count = ir_gree_timings(slot.ac->getRaw(), frame, IR_TIMINGS_MAX);
+  on_air_start = micros();
+  if (!count || !ir_timer_send(slot.pin, frame, count, frame_done)) {
+    return false;
+  }
+  on_air = &slot;
+  return true;
+}
+
+// Send the next frame of a zone if it has one due, true if it did
+static bool zone_step(TxSlot &slot) {
+  if (slot.active_id && millis() - slot.last_send < tx_gap_ms) {
+    return false;
+  }
+  if (slot.pending_id) {
+    if (slot.active_id) {
+      // Sent at least once and out of its gap: the new command wins
+      retire(slot.active_id, slot.active_left > 0);
+    }
+    ac_apply(*slot.ac, slot.pending_cmd);
+    slot.active_id = slot.pending_id;
+    slot.active_left = tx_repeat;
+    slot.pending_id = 0;
+  }
+  if (!slot.active_id) {
+    return false;
+  }
+  if (slot.active_left == 0) {
+    retire(slot.active_id, false);
+    slot.active_id = 0;
+    return false;
+  }
+  slot.last_send = millis();
+  if (!slot.timer_tx || !timer_send(slot)) {
+    uint32_t start = micros();
+    slot.ac->send();
+    frame_sent(micros() - start);
+    slot.last_send = millis();
+  }
+  slot.active_left--;
+  return true;
+}
+
+void ir_queue_loop() {
+  if (!tx_ready) {
+    return;
+  }
+  ir_timer_loop();
+  if (on_air) {
+    return;
+  }
+  for (uint8_t i = 0; i < ZONE_COUNT; i++) {
+    uint8_t z = (next_zone + i) % ZONE_COUNT;
+    if (zone_step(slots[z])) {
+      next_zone = (z + 1) % ZONE_COUNT;
+      return;
+    }
+  }
+}
+
+uint8_t ir_queue_depth() {
+  uint8_t depth = 0;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    depth += (slots[z].pending_id ? 1 : 0) + (slots[z].active_id ? 1 : 0);
+  }
+  return depth;
+}
+
+uint8_t ir_queue_repeats_left() {
+  uint8_t left = 0;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    left += slots[z].active_left + (slots[z].pending_id ? tx_repeat : 0);
+  }
+  return left;
+}
+
+uint32_t ir_queue_last_id() {
+  return last_id;
+}
+
+uint32_t ir_queue_done_id() {
+  return done_id;
+}
+
+uint32_t ir_queue_superseded() {
+  return superseded;
+}
+
+uint32_t ir_queue_frames_sent() {
+  return frames_sent;
+}
+
+uint32_t ir_queue_send_us_total() {
+  return send_us_total;
+}
+
+uint32_t ir_queue_send_us_max() {
+  return send_us_max;
+}
+
+IrTxStatus ir_queue_status(uint32_t id) {
+  if (id == 0 || id > last_id) {
+    return IR_TX_UNKNOWN;
+  }
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (id == slots[z].pending_id) {
+      return IR_TX_PENDING;
+    }
+    if (id == slots[z].active_id) {
+      return IR_TX_SENDING;
+    }
+  }
+  if (last_id - id < 32 && (superseded_mask & (1UL << (id % 32)))) {
+    return IR_TX_SUPERSEDED;
+  }
+  return IR_TX_DONE;
+}
+
+IrTxStatus ir_queue_zone_status(uint8_t zone) {
+  if (slots[zone].active_id) {
+    return IR_TX_SENDING;
+  }
+  return slots[zone].pending_id ? IR_TX_PENDING : IR_TX_DONE;
+}
+
+const char *ir_tx_status_name(IrTxStatus status) {
+  switch (status) {
+    case IR_TX_PENDING: return "pending";
+    case IR_TX_SENDING: return "sending";
+    case IR_TX_DONE: return "done";
+    case IR_TX_SUPERSEDED: return "superseded";
+    default: return "unknown";
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+#include <ir_Gree.h>
+#include "ac_state.h"
+
+// Non-blocking IR transmit queue, one slot per zone.
+//
+// A command is sent `repeat` times, `gap_ms` apart, from ir_queue_loop().
+// Each zone has a single pending slot: a newer command replaces a pending one
+// that has not been sent yet, and cuts short the repeats of the one on air
+// once it has been sent at least once (it would be overwritten by the AC
+// anyway). ir_queue_loop() sends at most one frame per call, round robin over
+// the zones that are out of their gap, so the repeats of several zones are
+// interleaved instead of adding up.
+// Every pushed command gets an increasing id, see ir_queue_status().
+// With pins, frames are played back by the timer interrupt (see ir_timer.h)
+// and ir_queue_loop() only starts them: one frame is on air at a time and
+// the gap of a zone counts from the end of its frame. Without pins, or for
+// a pin the timer cannot drive, ac.send() blocks for the whole frame.
+
+enum IrTxStatus {
+  IR_TX_UNKNOWN = 0,   // id never issued
+  IR_TX_PENDING,       // queued, not sent yet
+  IR_TX_SENDING,       // on air, repeats in progress
+  IR_TX_DONE,          // all repeats sent
+  IR_TX_SUPERSEDED     // dropped or cut short by a newer command
+};
+
+// acs: the IRGreeAC of each zone (ZONE_COUNT entries), pins: their IR pins
+// for the timer playback, or NULL to send with ac.send()
+void ir_queue_begin(IRGreeAC **acs, const uint8_t *pins, uint8_t repeat, uint16_t gap_ms);
+// Queue a command for a zone, returns its id
+uint32_t ir_queue_push(uint8_t zone, const uint8_t *cmd);
+// Call from loop()
+void ir_queue_loop();
+
+// Commands pending or on air, all zones
+uint8_t ir_queue_depth();
+// Frames still to send, all zones
+uint8_t ir_queue_repeats_left();
+uint32_t ir_queue_last_id();
+// Id of the last command whose transmission ended (done or superseded)
+uint32_t ir_queue_done_id();
+uint32_t ir_queue_superseded();
+// Frames sent and their air time (wraps after ~71 min of air time)
+uint32_t ir_queue_frames_sent();
+uint32_t ir_queue_send_us_total();
+uint32_t ir_queue_send_us_max();
+// Outcomes are remembered for the last 32 ids, older ones report done
+IrTxStatus ir_queue_status(uint32_t id);
+// IR_TX_PENDING/IR_TX_SENDING, or IR_TX_DONE when the zone is idle
+IrTxStatus ir_queue_zone_status(uint8_t zone);
+const char *ir_tx_status_name(IrTxStatus status);
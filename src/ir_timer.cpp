@@ -0,0 +1,144 @@
+#include "ir_timer.h"
+#include <ir_Gree.h>
+
+// timer1 runs at 80MHz (TIM_DIV1)
+#define TICKS_PER_US 80
+#define CARRIER_TICKS (80000000UL / IR_CARRIER_HZ)
+
+struct TimingTable {
+  uint16_t *out;
+  uint16_t max;
+  uint16_t count;
+  bool overflow;
+};
+
+static void put(TimingTable &t, bool mark, uint32_t us) {
+  if (!us) {
+    return;
+  }
+  // Index of the last entry is even for a mark
+  bool last_mark = t.count % 2 == 1;
+  if (t.count && last_mark == mark) {
+    t.out[t.count - 1] += us;
+  } else if (!t.count && !mark) {
+    // Nothing on air yet
+  } else if (t.count < t.max) {
+    t.out[t.count++] = us;
+  } else {
+    t.overflow = true;
+  }
+}
+
+// LSB first, as sendGeneric(..., MSBfirst=false)
+static void put_bits(TimingTable &t, uint32_t data, uint8_t bits) {
+  for (uint8_t i = 0; i < bits; i++, data >>= 1) {
+    put(t, true, kGreeBitMark);
+    put(t, false, (data & 1) ? kGreeOneSpace : kGreeZeroSpace);
+  }
+}
+
+// Mirrors IRsend::sendGree(state, kGreeStateLength, 0)
+uint16_t ir_gree_timings(const uint8_t *state, uint16_t *timings, uint16_t max) {
+  TimingTable t = {timings, max, 0, false};
+  // Block #1: header and 4 bytes, no footer
+  put(t, true, kGreeHdrMark);
+  put(t, false, kGreeHdrSpace);
+  for (uint8_t i = 0; i < 4; i++) {
+    put_bits(t, state[i], 8);
+  }
+  // Footer #1
+  put_bits(t, kGreeBlockFooter, kGreeBlockFooterBits);
+  put(t, true, kGreeBitMark);
+  put(t, false, kGreeMsgSpace);
+  // Block #2
+  for (uint8_t i = 4; i < kGreeStateLength; i++) {
+    put_bits(t, state[i], 8);
+  }
+  put(t, true, kGreeBitMark);
+  put(t, false, kGreeMsgSpace);
+  return t.overflow ? 0 : t.count;
+}
+
+// Playback, state shared with the interrupt
+static uint16_t play[IR_TIMINGS_MAX];
+static volatile uint16_t play_count = 0;
+static volatile uint16_t play_index = 0;
+static volatile uint32_t play_left = 0;   // ticks left in the current entry
+static volatile bool carrier_on = false;
+static volatile bool busy = false;
+static volatile bool finished = false;
+static uint32_t pin_mask = 0;
+static IrTimerDoneFn done_cb = NULL;
+
+static void IRAM_ATTR on_timer() {
+  if (play_left == 0) {
+    // Next entry
+    if (play_index == play_count) {
+      GPOC = pin_mask;
+      timer1_disable();
+      busy = false;
+      finished = true;
+      return;
+    }
+    play_left = (uint32_t)play[play_index] * TICKS_PER_US;
+    play_index++;
+    carrier_on = false;
+  }
+  uint32_t ticks;
+  if (play_index % 2 == 1) {
+    // Mark: half a carrier period on, half off, the last one cut to fit
+    carrier_on = !carrier_on;
+    if (carrier_on) {
+      GPOS = pin_mask;
+    } else {
+      GPOC = pin_mask;
+    }
+    ticks = carrier_on ? CARRIER_TICKS / 2 : CARRIER_TICKS - CARRIER_TICKS / 2;
+  } else {
+    GPOC = pin_mask;
+    ticks = play_left;
+  }
+  if (ticks > play_left) {
+    ticks = play_left;
+  }
+  play_left -= ticks;
+  timer1_write(ticks);
+}
+
+bool ir_timer_supported(uint8_t pin) {
+  return pin < 16;
+}
+
+bool ir_timer_send(uint8_t pin, const uint16_t *timings, uint16_t count, IrTimerDoneFn done) {
+  if (busy || !count || count > IR_TIMINGS_MAX || !ir_timer_supported(pin)) {
+    return false;
+  }
+  memcpy(play, timings, count * sizeof(uint16_t));
+  play_count = count;
+  play_index = 0;
+  play_left = 0;
+  pin_mask = 1UL << pin;
+  done_cb = done;
+  finished = false;
+  busy = true;
+  timer1_attachInterrupt(on_timer);
+  timer1_enable(TIM_DIV1, TIM_EDGE, TIM_SINGLE);
+  // First entry on the next tick
+  timer1_write(TICKS_PER_US);
+  return true;
+}
+
+bool ir_timer_busy() {
+  return busy;
+}
+
+void ir_timer_loop() {
+  if (!finished) {
+    return;
+  }
+  finished = false;
+  timer1_detachInterrupt();
+  if (done_cb) {
+    done_cb();
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <Arduino.h>
+
+// IR transmission played back by the timer1 interrupt.
+//
+// IRsend bit-bangs the carrier with busy waits, so a Gree frame (~140ms)
+// keeps the CPU for its whole length. Here the frame is first turned into
+// a mark/space table, the same sequence IRsend::sendGree() produces, then
+// timer1 plays it back: during a mark the interrupt toggles the pin at the
+// carrier frequency, during a space it fires once at its end. loop() and
+// the network keep running meanwhile; ir_timer_loop() calls the completion
+// callback once the frame is over.
+//
+// Timer1 is taken while a frame is on air: do not use analogWrite(),
+// tone() or Servo together with it. Pins 0..15 only (GPIO16 is not on the
+// GPIO registers the interrupt writes).
+
+// Mark/space durations of one Gree frame
+#define IR_TIMINGS_MAX 160
+#define IR_CARRIER_HZ 38000
+
+typedef void (*IrTimerDoneFn)();
+
+// Mark/space durations in us of the frame IRsend::sendGree() sends for
+// state (kGreeStateLength bytes), marks at even indexes. Returns the
+// count, 0 if it does not fit in max. No Arduino dependency.
+uint16_t ir_gree_timings(const uint8_t *state, uint16_t *timings, uint16_t max);
+
+bool ir_timer_supported(uint8_t pin);
+// Start playing count timings on pin, false if a frame is still on air.
+// timings are copied.
+bool ir_timer_send(uint8_t pin, const uint16_t *timings, uint16_t count, IrTimerDoneFn done);
+bool ir_timer_busy();
+// Call from loop(): runs the completion callback of a finished frame
+void ir_timer_loop();
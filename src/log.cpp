@@ -0,0 +1,88 @@
+#include "log.h"
+#include <stdarg.h>
+
+static char ring[LOG_RING_SIZE];
+// Total bytes ever written, ring position is head % LOG_RING_SIZE
+static uint32_t head = 0;
+// Bytes of the ring already copied to the UART
+static uint32_t serial_tail = 0;
+static uint32_t lines = 0;
+static uint32_t serial_dropped = 0;
+
+static const char level_tag[] = "-EWID";
+
+static void ring_put(const char *data, size_t len) {
+  while (len--) {
+    ring[head % LOG_RING_SIZE] = *data++;
+    head++;
+  }
+}
+
+void log_printf_P(uint8_t level, PGM_P fmt, ...) {
+  char line[LOG_LINE_MAX];
+  int len = snprintf(line, sizeof(line), "%lu %c ", (unsigned long)millis(), level_tag[level]);
+  va_list args;
+  va_start(args, fmt);
+  int msg = vsnprintf_P(line + len, sizeof(line) - len - 1, fmt, args);
+  va_end(args);
+  len += msg < 0 ? 0 : msg;
+  if (len > (int)sizeof(line) - 2) {
+    len = sizeof(line) - 2;
+  }
+  line[len++] = '\n';
+  ring_put(line, len);
+  lines++;
+}
+
+void log_loop() {
+#if LOG_SERIAL
+  if (head - serial_tail > LOG_RING_SIZE) {
+    // Overwritten before it could be sent
+    serial_dropped += head - serial_tail - LOG_RING_SIZE;
+    serial_tail = head - LOG_RING_SIZE;
+  }
+  size_t room = Serial.availableForWrite();
+  while (room-- && serial_tail != head) {
+    Serial.write(ring[serial_tail % LOG_RING_SIZE]);
+    serial_tail++;
+  }
+#endif
+}
+
+// Start of the oldest whole line in the ring
+static uint32_t oldest_line() {
+  uint32_t start = head > LOG_RING_SIZE ? head - LOG_RING_SIZE : 0;
+  // After a wrap the oldest line is partial, skip it
+  if (start) {
+    while (start != head && ring[start % LOG_RING_SIZE] != '\n') {
+      start++;
+    }
+    start++;
+  }
+  return start;
+}
+
+void log_open(LogCursor *cursor) {
+  cursor->pos = oldest_line();
+  cursor->end = head;
+}
+
+size_t log_read(LogCursor *cursor, uint8_t *buf, size_t max) {
+  if (head - cursor->pos > LOG_RING_SIZE) {
+    cursor->pos = oldest_line();
+  }
+  size_t n = 0;
+  while (n < max && (int32_t)(cursor->end - cursor->pos) > 0) {
+    buf[n++] = ring[cursor->pos % LOG_RING_SIZE];
+    cursor->pos++;
+  }
+  return n;
+}
+
+uint32_t log_lines() {
+  return lines;
+}
+
+uint32_t log_dropped_bytes() {
+  return serial_dropped;
+}
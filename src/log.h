@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+
+// Logging into an in-RAM ring buffer.
+//
+// Messages below LOG_LEVEL compile away completely (set it from
+// platformio.ini, e.g. -DLOG_LEVEL=LOG_LEVEL_WARN). Enabled ones are
+// formatted into the LOG_RING_SIZE bytes ring, oldest lines are overwritten,
+// and can be read over HTTP (GET /log). With LOG_SERIAL the ring is also
+// copied to the UART from log_loop(), only as much as fits in the TX FIFO, so
+// request handlers never wait on the serial port.
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef LOG_SERIAL
+#define LOG_SERIAL 1
+#endif
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 2048
+#endif
+// Longest message, longer ones are truncated
+#define LOG_LINE_MAX 128
+
+void log_printf_P(uint8_t level, PGM_P fmt, ...) __attribute__((format(printf, 2, 3)));
+// Call from loop()
+void log_loop();
+// Reads the ring as it is at log_open(), oldest line first, a piece at a
+// time for a chunked response
+struct LogCursor {
+  uint32_t pos;
+  uint32_t end;
+};
+void log_open(LogCursor *cursor);
+// Fill buf with up to max bytes, 0 at the end. Lines overwritten since
+// log_open() are skipped.
+size_t log_read(LogCursor *cursor, uint8_t *buf, size_t max);
+uint32_t log_lines();
+uint32_t log_dropped_bytes();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) log_printf_P(LOG_LEVEL_ERROR, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) log_printf_P(LOG_LEVEL_WARN, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) log_printf_P(LOG_LEVEL_INFO, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) log_printf_P(LOG_LEVEL_DEBUG, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) do {} while (0)
+#endif
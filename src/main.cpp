@@ -1,28 +1,86 @@
 #include <Arduino.h>
 #include "IRUtils.h"
 #include <ESP8266WiFi.h>
-#include <WiFiClient.h>
 #include <IRsend.h>
 #include <ir_Gree.h>
 #include <EEPROM.h>
+#include "eeprom_layout.h"
 #include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
 #include <dht.h>
-#include <ESP8266WebServer.h>
+#include <ESPAsyncWebServer.h>
+#include "webui.h"
+#include "ac_state.h"
+#include "ir_queue.h"
+#include "dht_sampler.h"
+#include "state_journal.h"
+#include "command_parser.h"
+#include "command_dedup.h"
+#include "schedule.h"
+#include "thermostat.h"
+#include "history.h"
+#include "page_writer.h"
+#include "event_stream.h"
+#include "session_auth.h"
+#include "metrics.h"
+#include "log.h"
+#include "wifi_link.h"
+#include "boot_phases.h"
+#include "task_scheduler.h"
+#include "status_frame.h"
+#include "announce.h"
 
 // Config
-// #Params sent to AC
-#define CMD_PARAMS 10
+// Every setting below can be overridden per environment from platformio.ini,
+// e.g. build_flags = -DWIFI_SSID=\"office\" -DCMD_REPEAT=2
 // How many times the command must be sent by IR
 // Default 3 times, 1.5secs delay between each repetition
+// (sent from loop(), see ir_queue.h)
+#ifndef CMD_REPEAT
 #define CMD_REPEAT 3
+#endif
+#ifndef CMD_REPEAT_GAP_MS
+#define CMD_REPEAT_GAP_MS 1500
+#endif
+// IR frames are played back by the timer1 interrupt instead of blocking
+// loop() for ~150ms each (see ir_timer.h). 0 sends them with ac.send()
+#ifndef IR_TIMER_TX
+#define IR_TIMER_TX 1
+#endif
 // DHT Sensor  on D1 (GPIO5)
+#ifndef DHT11_PIN
 #define DHT11_PIN 5
+#endif
+// DHT sampling period (sampled from loop(), see dht_sampler.h)
+#ifndef DHT_INTERVAL_MS
+#define DHT_INTERVAL_MS 5000
+#endif
+// state[] is written to flash once it has been stable for this long
+// (see state_journal.h)
+#ifndef JOURNAL_DEBOUNCE_MS
+#define JOURNAL_DEBOUNCE_MS 10000
+#endif
 //IR on D2 (GPIO4)
+#ifndef IR_PIN
 #define IR_PIN 4
+#endif
+// IR emitter of each zone (ZONE_COUNT entries, see ac_state.h), e.g. for
+// two units -DZONE_COUNT=2 -DZONE_IR_PINS="{4,14}"
+#ifndef ZONE_IR_PINS
+#define ZONE_IR_PINS {IR_PIN}
+#endif
 
 // SSID and Password
-const char* ssid = "SSID";
-const char* password = "PASSWORD";
+#ifndef WIFI_SSID
+#define WIFI_SSID "SSID"
+#endif
+#ifndef WIFI_PASSWORD
+#define WIFI_PASSWORD "PASSWORD"
+#endif
+const char* ssid = WIFI_SSID;
+const char* password = WIFI_PASSWORD;
 
 // IP configuration (default we use DHCP so the following lines are disabled)
 //IPAddress ip(xxx, xxx, xxx, xxx);
@@ -30,687 +88,991 @@ const char* password = "PASSWORD";
 //IPAddress subnet(xxx, xxx, xxx, xxx);
 
 // WEBUI configuration (CHANGE user&pass! default: antani/antani )
-const char *www_username = "antani";
-const char *www_password = "antani";
+#ifndef WWW_USERNAME
+#define WWW_USERNAME "antani"
+#endif
+#ifndef WWW_PASSWORD
+#define WWW_PASSWORD "antani"
+#endif
+const char *www_username = WWW_USERNAME;
+const char *www_password = WWW_PASSWORD;
 const char *www_realm = "greeAC";
-const char *www_error_message = "Uh uh uh! You didn't say the magic word! Uh uh uh! Uh uh uh!";
+// /metrics is open by default (Prometheus can't do Digest), 1 to require auth
+#ifndef METRICS_AUTH
+#define METRICS_AUTH 0
+#endif
+// After a Digest login the client gets a session cookie valid this long
+// (see session_auth.h)
+#ifndef SESSION_TTL_MS
+#define SESSION_TTL_MS (15*60*1000UL)
+#endif
+// Time zone of the schedule (POSIX TZ, e.g. "CET-1CEST,M3.5.0,M10.5.0/3")
+// and the NTP server that sets the clock (see schedule.h)
+#ifndef SCHEDULE_TZ
+#define SCHEDULE_TZ "UTC0"
+#endif
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+// UDP multicast announcements of the status (see announce.h), signed with
+// ANNOUNCE_KEY; on every change, else each heartbeat. Off (port 0) unless
+// enabled, e.g. -DANNOUNCE_PORT=4571 -DANNOUNCE_KEY=\"KEY\". The key is
+// given to every listener, so it is not the WebUI password
+#ifndef ANNOUNCE_GROUP
+#define ANNOUNCE_GROUP "239.255.71.1"
+#endif
+#ifndef ANNOUNCE_PORT
+#define ANNOUNCE_PORT 0
+#endif
+#if ANNOUNCE_PORT && !defined(ANNOUNCE_KEY)
+#error "Define ANNOUNCE_KEY to enable the announcements"
+#endif
+#ifndef ANNOUNCE_KEY
+#define ANNOUNCE_KEY ""
+#endif
+#ifndef ANNOUNCE_HEARTBEAT_MS
+#define ANNOUNCE_HEARTBEAT_MS 30000
+#endif
+// 1 to transmit the restored state[] of every zone at boot, e.g. for units
+// that do not resume by themselves after a power cut
+#ifndef BOOT_IR_RESEND
+#define BOOT_IR_RESEND 0
+#endif
 
 dht DHT;
-IRGreeAC ac(IR_PIN);
-ESP8266WebServer server(80);
+const uint8_t zone_pins[] = ZONE_IR_PINS;
+static_assert(sizeof(zone_pins) == ZONE_COUNT, "ZONE_IR_PINS needs one pin per zone");
+IRGreeAC *zone_ac[ZONE_COUNT];
+AsyncWebServer server(80);
 
-// AC Remote last command/default command saved into this array
-uint8_t state[10];
+// AC Remote last command/default command of each zone saved into this array
+uint8_t state[ZONE_COUNT][CMD_PARAMS];
 
-// Check if state contains allowed values
+// Save state[] of all zones, bit-packed (see CMD_FIELDS in ac_state.h),
+// into the flash journal
+static void persist_state() {
+  uint8_t packed[JOURNAL_PAYLOAD];
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    cmd_pack(state[z], packed + z*CMD_PACKED_BYTES);
+  }
+  journal_note(packed);
+}
+
+static bool restore_state() {
+  uint8_t packed[JOURNAL_PAYLOAD];
+  if (!journal_load(packed)) {
+    return false;
+  }
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    cmd_unpack(packed + z*CMD_PACKED_BYTES, state[z]);
+  }
+  return true;
+}
+
+// Check if state contains allowed values (CMD_FIELDS, see ac_state.h)
 // If not then replace the content with default values
-// [0,24,0,1,1,1,0,0,0,1]
+// [0,24,0,1,1,1,0,0,0,0]
 void state_check() {
-  //command format:[mode, temp, fan_speed,
-  //                flap_auto_flag, flap,
-  //                light, turbo, xfan, sleep, on_off]
-  uint8_t options=1;
-  for(uint8_t j=5;j<CMD_PARAMS;j++) {
-    if(state[j]<0 || state[j]>1) {
-      options=0;
-      break;
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    if (!cmd_valid(state[z])) {
+      LOG_WARN("Incorrect values stored in state[] of zone %u, resetting to default.", z);
+      cmd_default(state[z]);
+      persist_state();
     }
   }
-  uint8_t temp=1;
-  if(state[1]<16 || state[1]>31) {
-    temp=0;
-  }
-  uint8_t flap_flag_auto=1;
-  if(state[3]<0 || state[3]>1) {
-    flap_flag_auto=0;
-  }
-  uint8_t flap=1;
-  if(state[4]<1 || state[4]>11) {
-    flap=0;
-  }
-  uint8_t fan=1;
-  if(state[2]<0 || state[2]>3) {
-    fan=0;
-  }
-  uint8_t mode=1;
-  if(state[0]<0 || state[0]>4) {
-    mode=0;
-  }
-  if (!(mode && temp && options && flap_flag_auto && fan && flap)) {
-    Serial.println("Incorrect values stored in state[], resetting to default.");
-    state[0]=0;
-    state[1]=24;
-    state[2]=0;
-    state[3]=1;
-    state[4]=1;
-    state[5]=1;
-    state[6]=0;
-    state[7]=0;
-    state[8]=0;
-    state[9]=0;
-    EEPROM.put(0,state);
-    EEPROM.commit();
-  }
-}
-
-void handleNotFound(){
-  String message = "File Not Found\n\n";
-  message += "URI: ";
-  message += server.uri();
-  message += "\nMethod: ";
-  message += (server.method() == HTTP_GET)?"GET":"POST";
-  message += "\nArguments: ";
-  message += server.args();
-  message += "\n";
-  for (uint8_t i=0; i<server.args(); i++){
-    message += " " + server.argName(i) + ": " + server.arg(i) + "\n";
-  }
-  server.send(404, "text/plain", message);
+}
+
+// Set-Cookie of a Digest login, added by send() to the response.
+// Handlers run one at a time and respond before returning.
+static char pending_cookie[96] = "";
+
+// Session cookie or Digest auth, nothing is sent
+static bool authorized(AsyncWebServerRequest *request) {
+  return session_check_cookie(request->header("Cookie")) || request->authenticate(www_username, www_password);
+}
+
+// Session cookie if the client has a valid one, else Digest auth.
+// A successful Digest login gets a new session cookie.
+static bool check_auth(AsyncWebServerRequest *request) {
+  pending_cookie[0] = '\0';
+  if (session_check_cookie(request->header("Cookie"))) {
+    return true;
+  }
+  if (!request->authenticate(www_username, www_password)) {
+    request->requestAuthentication(www_realm, true);
+    return false;
+  }
+  char token[SESSION_TOKEN_LEN+1];
+  session_issue(token);
+  snprintf(pending_cookie, sizeof(pending_cookie), SESSION_COOKIE "=%s; Path=/; HttpOnly; Max-Age=%lu",
+           token, (unsigned long)(session_ttl_ms()/1000));
+  return true;
+}
+
+static void send(AsyncWebServerRequest *request, AsyncWebServerResponse *response) {
+  if (pending_cookie[0]) {
+    response->addHeader("Set-Cookie", pending_cookie);
+    pending_cookie[0] = '\0';
+  }
+  request->send(response);
+}
+
+// Short bodies, built in the request arena (see page_writer.h)
+static AsyncWebServerResponse *body_response(AsyncWebServerRequest *request, int code, const char *type,
+                                             const char *body, size_t len) {
+  PageWriter out(request);
+  out.begin(code, type);
+  out.write((const uint8_t *)body, len);
+  return out.end();
+}
+
+static void send_text(AsyncWebServerRequest *request, int code, const char *text) {
+  send(request, body_response(request, code, "text/plain", text, strlen(text)));
+}
+
+void handleNotFound(AsyncWebServerRequest *request){
+  HandlerTimer timer(METRIC_NOT_FOUND);
+  PageWriter out(request);
+  out.begin(404, "text/plain");
+  out.print("File Not Found\n\nURI: ");
+  out.print(request->url());
+  out.print("\nMethod: ");
+  out.print((request->method() == HTTP_GET)?"GET":"POST");
+  out.print("\nArguments: ");
+  out.print(request->args());
+  out.print("\n");
+  for (uint8_t i=0; i<request->args(); i++){
+    out.print(" ");
+    out.print(request->argName(i));
+    out.print(": ");
+    out.print(request->arg(i));
+    out.print("\n");
+  }
+  request->send(out.end());
 }
 
 // AC WebGUI (see remote_ac.html)
-void handleAC() {
-  if (!server.authenticate(www_username, www_password)) {
-    return server.requestAuthentication(DIGEST_AUTH,www_realm,www_error_message);
-  }
-
-  //Read temp & humidity from DHT11
-  delay(500);
-  DHT.read11(DHT11_PIN);
-
-  String string_state="[";
-  for(int i=0; i<10;i++) {
-    char *current=(char *)malloc(sizeof(char)*4);
-    snprintf(current, sizeof(char)*3, "%d",state[i]);
-    Serial.print("Current i");
-    Serial.print(i);
-    Serial.print(" val: ");
-    Serial.print(current);
-    Serial.print(" state orig: ");
-    Serial.println(state[i]);
-    string_state+=current;
-    if(i<9) {
-      string_state+=",";
+// The page is static: it is gzipped into flash at build time
+// (tools/embed_webui.py) and revalidated by the browser through its ETag.
+// Current state and DHT readings are fetched by the page from /state.
+void handleAC(AsyncWebServerRequest *request) {
+  HandlerTimer timer(METRIC_HANDLE_AC);
+  if (!check_auth(request)) {
+    return;
+  }
+  AsyncWebServerResponse *response;
+  if (request->header("If-None-Match") == WEBUI_ETAG) {
+    response = request->beginResponse(304);
+  } else {
+    response = request->beginResponse_P(200, "text/html", WEBUI_GZ, WEBUI_GZ_LEN);
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("ETag", WEBUI_ETAG);
+  response->addHeader("Cache-Control", "no-cache");
+  send(request, response);
+}
+
+// Dynamic part of the WebUI: state[] and the cached DHT readings as JSON
+// temp/humidity are median filtered and null until the first good read.
+// "state" is zone 0 (what the WebUI drives), "zones" has every zone:
+// {"pin":4,"state":[...],"tx":"done|pending|sending"}
+static const char STATE_JSON[] PROGMEM =
+  "{\"state\":{{state}},\"zones\":[{{zones}}],\"temp\":{{temp}},\"humidity\":{{humidity}},\"dht_age_ms\":{{dht_age}},"
+  "\"journal\":{\"written\":{{journal_written}},\"avoided\":{{journal_avoided}},\"erased\":{{journal_erased}}},"
+  "\"auth\":{\"hits\":{{auth_hits}},\"misses\":{{auth_misses}},\"evictions\":{{auth_evictions}}}}";
+
+static void print_state(PageWriter &out, const uint8_t *zone_state) {
+  out.print('[');
+  for (uint8_t i=0; i<CMD_PARAMS; i++) {
+    if (i) {
+      out.print(',');
+    }
+    out.print(zone_state[i]);
+  }
+  out.print(']');
+}
+
+static void state_var(PageWriter &out, const char *name, size_t len, void *) {
+  const DhtReading &room = dht_filtered();
+  if (page_var_is(name, len, "state")) {
+    print_state(out, state[0]);
+  } else if (page_var_is(name, len, "zones")) {
+    for (uint8_t z=0; z<ZONE_COUNT; z++) {
+      out.print(z ? ",{\"pin\":" : "{\"pin\":");
+      out.print(zone_pins[z]);
+      out.print(",\"state\":");
+      print_state(out, state[z]);
+      out.print(",\"tx\":\"");
+      out.print(ir_tx_status_name(ir_queue_zone_status(z)));
+      out.print("\"}");
+    }
+  } else if (!room.valid && (page_var_is(name, len, "temp") || page_var_is(name, len, "humidity"))) {
+    out.print("null");
+  } else if (page_var_is(name, len, "temp")) {
+    out.print(room.temperature);
+  } else if (page_var_is(name, len, "humidity")) {
+    out.print(room.humidity);
+  } else if (page_var_is(name, len, "dht_age")) {
+    out.print(room.valid ? (long)(millis() - room.at_ms) : -1L);
+  } else if (page_var_is(name, len, "journal_written")) {
+    out.print((unsigned long)journal_records_written());
+  } else if (page_var_is(name, len, "journal_avoided")) {
+    out.print((unsigned long)journal_writes_avoided());
+  } else if (page_var_is(name, len, "journal_erased")) {
+    out.print((unsigned long)journal_sectors_erased());
+  } else if (page_var_is(name, len, "auth_hits")) {
+    out.print((unsigned long)session_hits());
+  } else if (page_var_is(name, len, "auth_misses")) {
+    out.print((unsigned long)session_misses());
+  } else if (page_var_is(name, len, "auth_evictions")) {
+    out.print((unsigned long)session_evictions());
+  }
+}
+
+void handleState(AsyncWebServerRequest *request) {
+  HandlerTimer timer(METRIC_STATE);
+  if (!check_auth(request)) {
+    return;
+  }
+  PageWriter out(request);
+  out.begin(200, "application/json");
+  out.render_P(STATE_JSON, state_var, NULL);
+  AsyncWebServerResponse *response = out.end();
+  response->addHeader("Cache-Control", "no-store");
+  send(request, response);
+}
+
+// Id of the last command queued for each zone, answered again for zones a
+// command leaves unchanged
+static uint32_t zone_tx_id[ZONE_COUNT];
+
+// Apply a command to the zones in the mask: a full one (fields 0) or only
+// the fields set in the fields mask. Updates and persists state[] and queues
+// the IR frames; zones whose state does not change are not sent unless
+// force. Writes the tx id of each zone to ids, comma separated.
+static void apply_command(uint32_t zones, const uint8_t *cmd, uint16_t fields, bool force,
+                          char *ids, size_t ids_size) {
+  size_t ids_len = 0;
+  bool changed = false;
+  ids[0] = '\0';
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    if (!(zones & (1UL << z))) {
+      continue;
+    }
+    uint8_t next[CMD_PARAMS];
+    memcpy(next, state[z], CMD_PARAMS);
+    if (fields) {
+      for (uint8_t h=0; h<CMD_PARAMS; h++) {
+        if (fields & (1 << h)) {
+          next[h] = cmd[h];
+        }
+      }
+    } else if (cmd[9]==1) {
+      //Save params if we are not turning off..
+      memcpy(next, cmd, CMD_PARAMS);
+    } else {
+      //And save also in state if last command was
+      // a command or Off
+      next[9] = 0;
     }
-    free(current);
-  }
-  string_state+="]";
-  String webpage="";
-  webpage+="<!DOCTYPE html>\n";
-  webpage+="<meta charset=\"utf-8\">\n";
-  webpage+="<html>\n";
-  webpage+="<body onload=\"readstate()\">\n";
-  webpage+="\n";
-  webpage+="  <style>\n";
-  webpage+="  .alert {\n";
-  webpage+="    padding: 10px;\n";
-  webpage+="    background-color: gray;\n";
-  webpage+="    color: white;\n";
-  webpage+="    font-family: Arial;\n";
-  webpage+="    font-size: 18px;\n";
-  webpage+="    width: 260px;\n";
-  webpage+="    visibility: hidden;\n";
-  webpage+="    border-radius: 10px;\n";
-  webpage+="  }\n";
-  webpage+="\n";
-  webpage+="  </style>\n";
-  webpage+="  <style>\n";
-  webpage+="  .slidecontainer {\n";
-  webpage+="      width: 100%;\n";
-  webpage+="      font-size: 24px;\n";
-  webpage+="  }\n";
-  webpage+="\n";
-  webpage+="  .slider {\n";
-  webpage+="      -webkit-appearance: none;\n";
-  webpage+="      width: 270px;\n";
-  webpage+="      height: 25px;\n";
-  webpage+="      background: linear-gradient(to right, LightSkyBlue, OrangeRed);\n";
-  webpage+="      outline: none;\n";
-  webpage+="      opacity: 1.0;\n";
-  webpage+="      -webkit-transition: .2s;\n";
-  webpage+="      transition: opacity .2s;\n";
-  webpage+="      border-radius: 10px;\n";
-  webpage+="      border: 0.2px;\n";
-  webpage+="\n";
-  webpage+="  }\n";
-  webpage+="\n";
-  webpage+="  .slider:hover {\n";
-  webpage+="      opacity: 1;\n";
-  webpage+="  }\n";
-  webpage+="\n";
-  webpage+="  .slider::-webkit-slider-thumb {\n";
-  webpage+="      -webkit-appearance: none;\n";
-  webpage+="      appearance: none;\n";
-  webpage+="      width: 25px;\n";
-  webpage+="      height: 25px;\n";
-  webpage+="      background: #4CAF50;\n";
-  webpage+="      cursor: pointer;\n";
-  webpage+="      border-radius: 10px;\n";
-  webpage+="  }\n";
-  webpage+="\n";
-  webpage+="  .slider::-moz-range-thumb {\n";
-  webpage+="      width: 25px;\n";
-  webpage+="      height: 25px;\n";
-  webpage+="      background: #4CAF50;\n";
-  webpage+="      cursor: pointer;\n";
-  webpage+="  }\n";
-  webpage+="  </style>\n";
-  webpage+="  <style>\n";
-  webpage+="    .btn {\n";
-  webpage+="      -webkit-border-radius: 28;\n";
-  webpage+="      -moz-border-radius: 28;\n";
-  webpage+="      border-radius: 28px;\n";
-  webpage+="      font-family: Arial;\n";
-  webpage+="      color: #ffffff;\n";
-  webpage+="      font-size: 20px;\n";
-  webpage+="      padding: 10px 20px 10px 20px;\n";
-  webpage+="      text-decoration: none;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="\n";
-  webpage+="    .btn_red {\n";
-  webpage+="        background: red;\n";
-  webpage+="    }\n";
-  webpage+="    .btn_blue {\n";
-  webpage+="        background: blue;\n";
-  webpage+="    }\n";
-  webpage+="  </style>\n";
-  webpage+="  <style>\n";
-  webpage+="    .box {\n";
-  webpage+="      border-radius: 40px;\n";
-  webpage+="      padding: 0px;\n";
-  webpage+="      //display: inline-block;\n";
-  webpage+="      font-family: Arial;\n";
-  webpage+="      font-size: 18px;\n";
-  webpage+="      vertical-align: middle;\n";
-  webpage+="      width: 300px\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .box_blue {\n";
-  webpage+="      background: skyblue;\n";
-  webpage+="      border: 1px solid blue;\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .box_green {\n";
-  webpage+="      background: lightgreen;\n";
-  webpage+="      border: 1px solid green;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .box_violet {\n";
-  webpage+="      background: palevioletred;\n";
-  webpage+="      border: 1px solid darkviolet;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .box_gray {\n";
-  webpage+="      background: LightGray;\n";
-  webpage+="      border: 1px solid LightSlateGray;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .remote_box {\n";
-  webpage+="      border-radius: 15px;\n";
-  webpage+="      border: 2px solid blue;\n";
-  webpage+="      background: beige;\n";
-  webpage+="      padding: 10px;\n";
-  webpage+="      display: inline-block;\n";
-  webpage+="      font-family: Arial;\n";
-  webpage+="      font-size: 18px;\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .radio-btn input[type=\"radio\"]  {\n";
-  webpage+="      display: none;\n";
-  webpage+="\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="    .radio-btn label {\n";
-  webpage+="      color: #fff;\n";
-  webpage+="      font-family: Arial;\n";
-  webpage+="      font-size: 16px;\n";
-  webpage+="      cursor: pointer;\n";
-  webpage+="      padding: 4px;\n";
-  webpage+="      border-radius: 15px;\n";
-  webpage+="\n";
-  webpage+="\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="    .radio-btn_blue input[type=\"radio\"]:checked+label {\n";
-  webpage+="      background-color: #3279ff;\n";
-  webpage+="    }\n";
-  webpage+="    .radio-btn_blue label {\n";
-  webpage+="      background-color: skyblue;\n";
-  webpage+="      border: 0.5px solid #3279ff;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .radio-btn_green input[type=\"radio\"]:checked+label {\n";
-  webpage+="      background-color: green;\n";
-  webpage+="    }\n";
-  webpage+="    .radio-btn_green label {\n";
-  webpage+="      background-color: lightgreen;\n";
-  webpage+="      border: 0.5px solid green ;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .radio-btn_violet input[type=\"radio\"]:checked+label {\n";
-  webpage+="      background-color: darkviolet;\n";
-  webpage+="    }\n";
-  webpage+="    .radio-btn_violet label {\n";
-  webpage+="      background-color: palevioletred;\n";
-  webpage+="      border: 0.5px solid darkviolet ;\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .checkbox {\n";
-  webpage+="      display: none;\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .checkbox + label {\n";
-  webpage+="      display: inline-block;\n";
-  webpage+="      background-color: LightGray;\n";
-  webpage+="      color: #fff;\n";
-  webpage+="      padding: 4px;\n";
-  webpage+="      cursor: pointer;\n";
-  webpage+="      font-family: Arial;\n";
-  webpage+="      font-size: 16px;\n";
-  webpage+="      border-radius: 15px;\n";
-  webpage+="      border: 0.5px solid LightSlateGray;\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="\n";
-  webpage+="    .checkbox + label:active,\n";
-  webpage+="    .checkbox:checked + label {\n";
-  webpage+="      background-color: LightSlateGray;\n";
-  webpage+="      border: 0.5px solid LightSlateGray;\n";
-  webpage+="    }\n";
-  webpage+="  </style>\n";
-  webpage+="  <head>\n";
-  webpage+="    <title>Gree AC</title>\n";
-  webpage+="  </head>\n";
-  webpage+="\n";
-  webpage+="      <p>\n";
-  webpage+="        <center>\n";
-  webpage+="          <h2>\n";
-  webpage+="            Current Temp: <span id=\"room_temp\"></span>";
-  webpage+=DHT.temperature;
-  webpage+="&degC\n";
-  webpage+="          <br/>\n";
-  webpage+="            Current Humidity: <span id=\"room_humidity\"></span>";
-  webpage+=DHT.humidity;
-  webpage+="&#37\n";
-  webpage+="          </h2>\n";
-  webpage+="        </center>\n";
-  webpage+="      </p>\n";
-  webpage+="\n";
-  webpage+="    <center>\n";
-  webpage+="    <div class=\"remote_box\">\n";
-  webpage+="      <p>\n";
-  webpage+="        <span id=\"showtemp\"></span>&degC\n";
-  webpage+="        <br>\n";
-  webpage+="        <input type=\"range\" min=\"16\" max=\"31\" value=\"21\" class=\"slider\" id=\"temperature\">\n";
-  webpage+="      </p>\n";
-  webpage+="        <p>\n";
-  webpage+="          <div class=\"box box_green\">\n";
-  webpage+="            <p>Mode</p>\n";
-  webpage+="            <p>\n";
-  webpage+="            <form id=\"ac_mode\" name=\"ac_mode\" class=\"radio-btn radio-btn_green\">\n";
-  webpage+="              <input type=\"radio\" name=\"Mode\" id=\"M_0\" value=\"0\" checked=\"checked\"/>\n";
-  webpage+="              <label for=\"M_0\">Auto</label>\n";
-  webpage+="              <input type=\"radio\" name=\"Mode\" id=\"M_4\" value=\"4\" />\n";
-  webpage+="              <label for=\"M_4\">Heat</label>\n";
-  webpage+="              <input type=\"radio\" name=\"Mode\" id=\"M_1\" value=\"1\" />\n";
-  webpage+="              <label for=\"M_1\">Cool</label>\n";
-  webpage+="              <input type=\"radio\" name=\"Mode\" id=\"M_2\" value=\"2\" />\n";
-  webpage+="              <label for=\"M_2\">Dry</label>\n";
-  webpage+="              <input type=\"radio\" name=\"Mode\" id=\"M_3\" value=\"3\" />\n";
-  webpage+="              <label for=\"M_3\">Fan</label>\n";
-  webpage+="            </form>\n";
-  webpage+="          </p>\n";
-  webpage+="        </div>\n";
-  webpage+="      </p>\n";
-  webpage+="\n";
-  webpage+="      <p>\n";
-  webpage+="        <div class=\"box box_violet\">\n";
-  webpage+="          <p>Direction</p>\n";
-  webpage+="          <form id=\"Flap\" name=\"Flap\" class=\"radio-btn radio-btn_violet\">\n";
-  webpage+="              <p>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_2\" value=\"2\" />\n";
-  webpage+="              <label for=\"F_2\">Highest</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_3\" value=\"3\" />\n";
-  webpage+="              <label for=\"F_3\">High</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_4\" value=\"4\" />\n";
-  webpage+="              <label for=\"F_4\">Middle</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_5\" value=\"5\" />\n";
-  webpage+="              <label for=\"F_5\">Low</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_6\" value=\"6\" />\n";
-  webpage+="              <label for=\"F_6\">Lowest</label>\n";
-  webpage+="              </p>\n";
-  webpage+="              <p>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" value=\"1\" id=\"F_1\" checked=\"checked\"/>\n";
-  webpage+="              <label for=\"F_1\">Auto</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_7\" value=\"7\" />\n";
-  webpage+="              <label for=\"F_7\">Low Auto</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_11\" value=\"11\" />\n";
-  webpage+="              <label for=\"F_11\">High Auto</label>\n";
-  webpage+="              <input type=\"radio\" name=\"flap\" id=\"F_9\" value=\"9\"  />\n";
-  webpage+="              <label for=\"F_9\">Mid Auto</label>\n";
-  webpage+="              </p>\n";
-  webpage+="          </form>\n";
-  webpage+="        </div>\n";
-  webpage+="      </p>\n";
-  webpage+="        <p>\n";
-  webpage+="        <div class=\"box box_blue\">\n";
-  webpage+="          <p>Fan Speed</p>\n";
-  webpage+="          <form id=\"FanMode\" name=\"FanMode\" class=\"radio-btn radio-btn_blue\">\n";
-  webpage+="            <p>\n";
-  webpage+="            <input type=\"radio\" name=\"fan\" value=\"0\" id=\"S_0\" checked=\"checked\"/>\n";
-  webpage+="            <label for=\"S_0\">Auto</label>\n";
-  webpage+="            <input type=\"radio\" name=\"fan\" id=\"S_1\" value=\"1\"/>\n";
-  webpage+="            <label for=\"S_1\">Slow</label>\n";
-  webpage+="            <input type=\"radio\" name=\"fan\" id=\"S_2\" value=\"2\"/>\n";
-  webpage+="            <label for=\"S_2\">Mid</label>\n";
-  webpage+="            <input type=\"radio\" name=\"fan\" id=\"S_3\" value=\"3\"/>\n";
-  webpage+="            <label for=\"S_3\">Max</label>\n";
-  webpage+="            </p>\n";
-  webpage+="          </form>\n";
-  webpage+="        </div>\n";
-  webpage+="        </p>\n";
-  webpage+="\n";
-  webpage+="        <p>\n";
-  webpage+="          <div class=\"box box_gray\">\n";
-  webpage+="            <p>Options</p>\n";
-  webpage+="              <form id=\"options\" name=\"options\">\n";
-  webpage+="                <p>\n";
-  webpage+="                <input type=\"checkbox\" name=\"light\" class=\"checkbox\" id=\"light\"/>\n";
-  webpage+="                <label for=\"light\">Light</label>\n";
-  webpage+="                <input type=\"checkbox\" name=\"turbo\" class=\"checkbox\" id=\"turbo\"/>\n";
-  webpage+="                <label for=\"turbo\">Turbo</label>\n";
-  webpage+="                <input type=\"checkbox\" name=\"xfan\" class=\"checkbox\" id=\"xfan\"/>\n";
-  webpage+="                <label for=\"xfan\">X-Fan</label>\n";
-  webpage+="                <input type=\"checkbox\" name=\"sleep\" class=\"checkbox\" id=\"sleep\"/>\n";
-  webpage+="                <label for=\"sleep\">Sleep</label>\n";
-  webpage+="                </p>\n";
-  webpage+="              </form>\n";
-  webpage+="          </div>\n";
-  webpage+="        </p>\n";
-  webpage+="\n";
-  webpage+="    <div class=\"alert\" id=\"alert_message\">\n";
-  webpage+="      <span id=\"alert_message_txt\">____</span>\n";
-  webpage+="    </div>\n";
-  webpage+="    <br/>\n";
-  webpage+="    <div>\n";
-  webpage+="        <button class=\"btn btn_blue\" onclick=\"sendCommand()\">Send Command</button>\n";
-  webpage+="        <button class=\"btn btn_red\" onclick=\"turnoff()\">Turn Off</button>\n";
-  webpage+="    </div>\n";
-  webpage+="  </div>\n";
-  webpage+="</center>\n";
-  webpage+="    <script>\n";
-  webpage+="      var slider = document.getElementById(\"temperature\");\n";
-  webpage+="      var output = document.getElementById(\"showtemp\");\n";
-  webpage+="      output.innerHTML = slider.value;\n";
-  webpage+="\n";
-  webpage+="      slider.oninput = function() {\n";
-  webpage+="        output.innerHTML = this.value;\n";
-  webpage+="      }\n";
-  webpage+="    </script>\n";
-  webpage+="    <script>\n";
-  webpage+="    function alrt_message(text, timeout, bgcolor, hide) {\n";
-  webpage+="      var alert_msg=document.getElementById(\"alert_message\");\n";
-  webpage+="      var alert_text=document.getElementById(\"alert_message_txt\");\n";
-  webpage+="      alert_text.innerHTML=text;\n";
-  webpage+="      alert_message.style.backgroundColor=bgcolor;\n";
-  webpage+="      alert_msg.style.visibility=\"visible\";\n";
-  webpage+="      if (hide) {\n";
-  webpage+="        window.setTimeout(function() {\n";
-  webpage+="          alert_msg.style.visibility=\"hidden\";\n";
-  webpage+="        }, timeout);\n";
-  webpage+="      }\n";
-  webpage+="    }\n";
-  webpage+="    function sendCommand() {\n";
-  webpage+="        var light = 0;\n";
-  webpage+="        var turbo = 0;\n";
-  webpage+="        var sleep = 0;\n";
-  webpage+="        var xfan = 0;\n";
-  webpage+="        var on = 1;\n";
-  webpage+="        var temperature = document.getElementById(\"temperature\").value;\n";
-  webpage+="        var fanspeed = document.FanMode.fan.value;\n";
-  webpage+="        var acmode =  document.ac_mode.Mode.value;\n";
-  webpage+="        var flap =  document.Flap.flap.value;\n";
-  webpage+="        var flap_automatic = 0;\n";
-  webpage+="        if (flap>6 || flap==1) {\n";
-  webpage+="          flap_automatic = 1;\n";
-  webpage+="          console.log(\"Flap auto enabled.\")\n";
-  webpage+="        }\n";
-  webpage+="\n";
-  webpage+="        var light_checkbox = document.querySelector('#light:checked');\n";
-  webpage+="        if (light_checkbox) {\n";
-  webpage+="          light = 1;\n";
-  webpage+="          console.log(\"Light On\");\n";
-  webpage+="        }\n";
-  webpage+="        var turbo_checkbox = document.querySelector('#turbo:checked');\n";
-  webpage+="        if (turbo_checkbox) {\n";
-  webpage+="          turbo = 1;\n";
-  webpage+="          console.log(\"Turbo On\");\n";
-  webpage+="        }\n";
-  webpage+="        var sleep_checkbox =  document.querySelector('#sleep:checked');\n";
-  webpage+="        if(sleep_checkbox) {\n";
-  webpage+="          sleep = 1;\n";
-  webpage+="          console.log(\"Sleep on\");\n";
-  webpage+="        }\n";
-  webpage+="        var xfan_checkbox =  document.querySelector('#xfan:checked');\n";
-  webpage+="        if(xfan_checkbox) {\n";
-  webpage+="          xfan = 1;\n";
-  webpage+="          console.log(\"X-Fan on\");\n";
-  webpage+="        }\n";
-  webpage+="\n";
-  webpage+="        //command format:[mode, temp, fan_speed,\n";
-  webpage+="        //                flap_auto_flag, flap,\n";
-  webpage+="        //                light, turbo, xfan, sleep, on_off]\n";
-  webpage+="        var command = [acmode, temperature, fanspeed, flap_automatic,flap, light, turbo, xfan, sleep, on];\n";
-  webpage+="        //POST\n";
-  webpage+="        var xhr = new XMLHttpRequest();\n";
-  webpage+="        xhr.open(\"POST\", \"/acremote\");\n";
-  webpage+="        xhr.setRequestHeader(\"Content-type\", \"application/x-www-form-urlencoded\");\n";
-  webpage+="        xhr.timeout=6000;\n";
-  webpage+="        xhr.ontimeout = function() {\n";
-  webpage+="          alrt_message(\"Timed Out.\",3000,\"red\");\n";
-  webpage+="        }\n";
-  webpage+="        xhr.send(\"command=\"+command);\n";
-  webpage+="        alrt_message(\"Sending Command....\",5000,\"gray\",false);\n";
-  webpage+="        xhr.onreadystatechange = function() {\n";
-  webpage+="          if(xhr.readyState == XMLHttpRequest.DONE && xhr.status == 200) {\n";
-  webpage+="            alrt_message(\"Command Sent.\", 3000,\"green\", true);\n";
-  webpage+="          }\n";
-  webpage+="          else if (xhr.readyState== XMLHttpRequest.DONE && xhr.status!=200){\n";
-  webpage+="            alrt_message(\"Error.\",3000,\"red\",true);\n";
-  webpage+="\n";
-  webpage+="          }\n";
-  webpage+="        }\n";
-  webpage+="\n";
-  webpage+="\n";
-  webpage+="    }\n";
-  webpage+="    </script>\n";
-  webpage+="    <script>\n";
-  webpage+="    function alrt_message(text, timeout, bgcolor, hide) {\n";
-  webpage+="      var alert_msg=document.getElementById(\"alert_message\");\n";
-  webpage+="      var alert_text=document.getElementById(\"alert_message_txt\");\n";
-  webpage+="      alert_text.innerHTML=text;\n";
-  webpage+="      alert_message.style.backgroundColor=bgcolor;\n";
-  webpage+="      alert_msg.style.visibility=\"visible\";\n";
-  webpage+="      if (hide) {\n";
-  webpage+="        window.setTimeout(function() {\n";
-  webpage+="          alert_msg.style.visibility=\"hidden\";\n";
-  webpage+="        }, timeout);\n";
-  webpage+="      }\n";
-  webpage+="    }\n";
-  webpage+="    function turnoff() {\n";
-  webpage+="        var command=[0,0,0,0,0,0,0,0,0,0];\n";
-  webpage+="        var alert_msg=document.getElementById(\"alert_message\");\n";
-  webpage+="        var alert_text=document.getElementById(\"alert_message_txt\");\n";
-  webpage+="        var xhr = new XMLHttpRequest();\n";
-  webpage+="        xhr.open(\"POST\", \"/acremote\");\n";
-  webpage+="        xhr.setRequestHeader(\"Content-type\", \"application/x-www-form-urlencoded\");\n";
-  webpage+="        xhr.timeout=6000;\n";
-  webpage+="        xhr.ontimeout = function() {\n";
-  webpage+="          alrt_message(\"Timed Out.\", 3000,\"red\", true);\n";
-  webpage+="        }\n";
-  webpage+="        xhr.send(\"command=\"+command);\n";
-  webpage+="        alrt_message(\"Sending Command...\", 3000,\"gray\",false);\n";
-  webpage+="        alert_text.innerHTML=\"Sending Command...\";\n";
-  webpage+="        alert_msg.style.visibility=\"visible\";\n";
-  webpage+="        xhr.onreadystatechange = function() {\n";
-  webpage+="          if(xhr.readyState == XMLHttpRequest.DONE && xhr.status == 200) {\n";
-  webpage+="            alrt_message(\"Command Sent.\", 5000,\"green\",true);\n";
-  webpage+="          }\n";
-  webpage+="          else if (xhr.readyState== XMLHttpRequest.DONE && xhr.status!=200){\n";
-  webpage+="            alrt_message(\"Error.\", 3000,\"red\",true);\n";
-  webpage+="          }\n";
-  webpage+="        }\n";
-  webpage+="    }\n";
-  webpage+="    </script>\n";
-  webpage+="    <script>\n";
-  webpage+="    function readstate() {\n";
-  webpage+="      var oldstate=";
-  webpage+=string_state;
-  webpage+=";\n";
-  webpage+="      //command format:[mode, temp, fan_speed,\n";
-  webpage+="      //                flap_auto_flag, flap,\n";
-  webpage+="      //                light, turbo, xfan, sleep, on_off]\n";
-  webpage+="      // See forms code.\n";
-  webpage+="      // All radiobuttons in Mode have id=M_XX where X is the value (from IRRemote)\n";
-  webpage+="      // All radiobuttons in Direction/Flap have id=F_XX where XX is the value (from IRRemote)\n";
-  webpage+="      // All radiobuttons in FanSpeed have id=S_XX where XX is the value (from IRRemote)\n";
-  webpage+="      var mode = document.getElementById(\"M_\"+oldstate[0]);\n";
-  webpage+="      var fanspeed=document.getElementById(\"S_\"+oldstate[2]);\n";
-  webpage+="      var direction = document.getElementById(\"F_\"+oldstate[4]);\n";
-  webpage+="      var options=document.options;\n";
-  webpage+="      var temp = document.getElementById(\"temperature\");\n";
-  webpage+="      var output = document.getElementById(\"showtemp\");\n";
-  webpage+="\n";
-  webpage+="      //Set UI to last settings\n";
-  webpage+="      mode.checked=true;\n";
-  webpage+="      fanspeed.checked=true;\n";
-  webpage+="      direction.checked=true;\n";
-  webpage+="      temp.value=oldstate[1];\n";
-  webpage+="      output.innerHTML = oldstate[1];\n";
-  webpage+="      // Set also the \"Options\"\n";
-  webpage+="      for(i=0;i<options.length;i++) {\n";
-  webpage+="        if(oldstate[5+i]==1) {\n";
-  webpage+="          options[i].checked=true;\n";
-  webpage+="        }\n";
-  webpage+="      }\n";
-  webpage+="    }\n";
-  webpage+="    </script>\n";
-  webpage+="  </body>\n";
-  webpage+="</html>\n";
-  webpage+="";
-
-server.send(200, "text/html", webpage);
+    // Nothing to send if the state does not change. Settings changed
+    // while the AC stays off are only saved, an Off frame does not carry them.
+    bool was_on = state[z][9]==1;
+    bool differs = memcmp(next, state[z], CMD_PARAMS) != 0;
+    if (differs) {
+      memcpy(state[z], next, CMD_PARAMS);
+      history_note_state(z, state[z]);
+      changed = true;
+    }
+    if (force || (differs && (was_on || next[9]==1))) {
+      zone_tx_id[z] = ir_queue_push(z, state[z]);
+    }
+    ids_len += snprintf(ids+ids_len, ids_size-ids_len, "%s%lu", ids_len ? "," : "", (unsigned long)zone_tx_id[z]);
+  }
+  if (changed) {
+    persist_state();
+  } else {
+    dedup_note_unchanged();
+  }
+}
+
+// Unsigned decimal up to max, digits only (strtoul would take "-1")
+static bool parse_bounded(const char *value, uint32_t max, uint32_t *out) {
+  if (!isdigit((unsigned char)*value)) {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  unsigned long number = strtoul(value, &end, 10);
+  if (*end || errno == ERANGE || number > max) {
+    return false;
+  }
+  *out = number;
+  return true;
+}
+
+// Runs of the schedule and thermostat corrections take the same path as
+// /acremote
+static void apply_fields(uint32_t zones, const uint8_t *cmd, uint16_t fields) {
+  char ids[DEDUP_RESULT_MAX];
+  apply_command(zones, cmd, fields, false, ids, sizeof(ids));
+  LOG_INFO("tx %s", ids);
 }
 
 // HTTP POST that gets command from WebUI and sends it to IR
-void postacremote(){
-  if (!server.authenticate(www_username, www_password)) {
-    return server.requestAuthentication(DIGEST_AUTH,www_realm,www_error_message);
-  }
-  String command = server.arg("command");
-  char tochar[command.length()+1];
-  command.toCharArray(tochar, command.length()+1);
-  Serial.println(command);
-  char *current_int =  strtok(tochar,",");
-  int command_index=0;
-  uint16_t command_received[CMD_PARAMS];
-  while(current_int!=NULL && command_index<CMD_PARAMS) {
-    command_received[command_index++]=atoi(current_int);
-
-    current_int=strtok(NULL, ",");
-  }
-  for (int j=0; j<CMD_PARAMS;j++) {
-    Serial.print("Param[");
-    Serial.print(j);
-    Serial.print("]: ");
-    Serial.println(command_received[j]);
-  }
-  //command format:[mode, temp, fan_speed,
-  //                flap_auto_flag, flap,
-  //                light, turbo, xfan, sleep, on_off]
-  // Executed only if we are turning on the AC..
-  if(command_received[9]==1) {
-    ac.setMode(command_received[0]);
-    ac.setTemp(command_received[1]);
-    ac.setFan(command_received[2]);
-    ac.setSwingVertical(command_received[3],command_received[4]);
-    ac.setLight(command_received[5]);
-    ac.setTurbo(command_received[6]);
-    ac.setXFan(command_received[7]);
-    ac.setSleep(command_received[8]);
-  }
-  ac.setPower(command_received[9]);
-  //Save params if we are not turning off..
-  if(command_received[9]==1) {
-    for(int h=0;h<CMD_PARAMS-1;h++) {
-      state[h]=command_received[h];
+//
+// Either "command" with all the params, or a partial update naming only
+// the fields to change, e.g. "temp=22&fan=2" (names from CMD_FIELDS).
+// Optional: "zones", "key"/Idempotency-Key or "seq" (see command_dedup.h),
+// "force=1" to transmit even if the state would not change.
+void postacremote(AsyncWebServerRequest *request){
+  HandlerTimer timer(METRIC_POSTACREMOTE);
+  if (!check_auth(request)) {
+    return;
+  }
+  // A retry of a command already handled gets the same answer
+  DedupTag tag;
+  tag.kind = 0;
+  uint32_t seq = 0;
+  bool has_seq = request->hasArg("seq");
+  const String *key = NULL;
+  if (has_seq) {
+    if (!parse_bounded(request->arg("seq").c_str(), 0xFFFFFFFFUL, &seq)) {
+      send_text(request, 400, "error: bad seq");
+      return;
+    }
+    dedup_seq_tag(seq, &tag);
+  } else if (request->hasHeader("Idempotency-Key")) {
+    key = &request->header("Idempotency-Key");
+  } else if (request->hasArg("key")) {
+    key = &request->arg("key");
+  }
+  if (key && !dedup_key_tag(key->c_str(), key->length(), &tag)) {
+    send_text(request, 400, "error: bad key");
+    return;
+  }
+  if (tag.kind) {
+    const char *result = dedup_find(tag);
+    if (result) {
+      AsyncWebServerResponse *response = body_response(request, 200, "text/plain", "ok", 2);
+      response->addHeader("X-Tx-Id", result);
+      response->addHeader("X-Replay", "1");
+      send(request, response);
+      return;
+    }
+    if (has_seq && dedup_seq_stale(seq)) {
+      send_text(request, 409, "error: stale seq");
+      return;
+    }
+  }
+
+  uint8_t cmd[CMD_PARAMS];
+  // Fields named by a partial update, bit i for field i
+  uint16_t fields = 0;
+  if (request->hasArg("command")) {
+    // Parsed in place, see command_parser.h
+    const String &command = request->arg("command");
+    LOG_DEBUG("command: %s", command.c_str());
+    CmdParseError err;
+    if (parse_command(command.c_str(), command.length(), cmd, &err) != CMD_PARSE_OK) {
+      char message[64];
+      snprintf(message, sizeof(message), "error: %s (param %u, offset %u)",
+               cmd_parse_result_name(err.result), err.field, err.offset);
+      send_text(request, 400, message);
+      return;
+    }
+  } else {
+    for (size_t i=0; i<request->args(); i++) {
+      const String &name = request->argName(i);
+      int8_t field = cmd_field_index(name.c_str(), name.length());
+      if (field < 0) {
+        continue;
+      }
+      const String &value = request->arg(i);
+      if (!cmd_parse_field(field, value.c_str(), value.length(), &cmd[field])) {
+        char message[48];
+        snprintf(message, sizeof(message), "error: bad value for %s", CMD_FIELDS[field].name);
+        send_text(request, 400, message);
+        return;
+      }
+      fields |= 1 << field;
+    }
+    if (!fields) {
+      send_text(request, 400, "error: no command");
+      return;
+    }
+  }
+  // Zones to drive: "zones=all", "zones=0,2", default zone 0
+  uint32_t zones = 1;
+  if (request->hasArg("zones")) {
+    const String &list = request->arg("zones");
+    zones = parse_zones(list.c_str(), list.length());
+    if (!zones) {
+      send_text(request, 400, "error: bad zones");
+      return;
     }
   }
-  //And save also in state if last command was
-  // a command or Off
-  state[9]=command_received[9];
-  int send_cmd_repeat = 0;
-  while(send_cmd_repeat<CMD_REPEAT) {
-    ac.send();
-    delay(1500);
-    send_cmd_repeat++;
+  bool force = request->arg("force") == "1";
+  // IR is sent from loop(), check /txstatus?id=<X-Tx-Id> for delivery
+  // (one id per zone, comma separated)
+  char ids[DEDUP_RESULT_MAX];
+  apply_command(zones, cmd, fields, force, ids, sizeof(ids));
+  if (tag.kind) {
+    dedup_store(tag, ids);
+    if (has_seq) {
+      dedup_seq_accept(seq);
+    }
   }
-  EEPROM.put(0,state);
-  EEPROM.commit();
 
-  server.send(200, "text/plain", "ok");
+  AsyncWebServerResponse *response = body_response(request, 200, "text/plain", "ok", 2);
+  response->addHeader("X-Tx-Id", ids);
+  send(request, response);
+
+}
 
+// IR transmit queue status, with ?id=N also the status of that command
+// {"depth":1,"repeats_left":2,"last_id":7,"done_id":6,"superseded":0,"status":"sending"}
+void handleTxStatus(AsyncWebServerRequest *request) {
+  HandlerTimer timer(METRIC_TXSTATUS);
+  if (!check_auth(request)) {
+    return;
+  }
+  char json[160];
+  int len = snprintf(json, sizeof(json),
+                     "{\"depth\":%u,\"repeats_left\":%u,\"last_id\":%lu,\"done_id\":%lu,\"superseded\":%lu",
+                     ir_queue_depth(), ir_queue_repeats_left(),
+                     (unsigned long)ir_queue_last_id(), (unsigned long)ir_queue_done_id(),
+                     (unsigned long)ir_queue_superseded());
+  if (request->hasArg("id")) {
+    uint32_t id = strtoul(request->arg("id").c_str(), NULL, 10);
+    len += snprintf(json+len, sizeof(json)-len, ",\"status\":\"%s\"",
+                    ir_tx_status_name(ir_queue_status(id)));
+  }
+  snprintf(json+len, sizeof(json)-len, "}");
+  AsyncWebServerResponse *response = body_response(request, 200, "application/json", json, strlen(json));
+  response->addHeader("Cache-Control", "no-store");
+  send(request, response);
 }
+
+// state[], DHT readings and IR queue in a fixed binary layout (see
+// status_frame.h). Pollers send the ETag back in If-None-Match and get an
+// empty 304 while nothing changed.
+void handleStatus(AsyncWebServerRequest *request) {
+  HandlerTimer timer(METRIC_STATUS);
+  if (!check_auth(request)) {
+    return;
+  }
+  uint8_t frame[STATUS_FRAME_SIZE];
+  char etag[24];
+  status_etag(status_frame(frame), etag, sizeof(etag));
+  AsyncWebServerResponse *response;
+  if (request->header("If-None-Match") == etag) {
+    response = request->beginResponse(304);
+  } else {
+    response = body_response(request, 200, "application/octet-stream", (const char *)frame, sizeof(frame));
+  }
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache");
+  send(request, response);
+}
+
+// Prometheus text metrics (see metrics.h)
+void handleMetrics(AsyncWebServerRequest *request) {
+#if METRICS_AUTH
+  if (!check_auth(request)) {
+    return;
+  }
+#endif
+  AsyncWebServerResponse *response = page_chunked(request, "text/plain; version=0.0.4", metrics_write);
+  if (!response) {
+    send_text(request, 503, "error: out of memory");
+    return;
+  }
+  send(request, response);
+}
+
+// Schedule entries (see schedule.h), one per line with its next run
+static bool schedule_page_part(Print &out, uint16_t part) {
+  char line[SCHEDULE_LINE_MAX];
+  if (part == 0) {
+    uint32_t now = schedule_now();
+    if (now) {
+      schedule_format_minute(now, line, sizeof(line));
+      out.printf("# now %s\n", line);
+    } else {
+      out.print("# clock not set\n");
+    }
+    return true;
+  }
+  uint8_t i = part - 1;
+  if (i >= schedule_count()) {
+    return false;
+  }
+  out.write((const uint8_t *)line, schedule_format(schedule_entry(i), line, sizeof(line)));
+  uint32_t next = schedule_next(i);
+  if (next) {
+    schedule_format_minute(next, line, sizeof(line));
+    out.printf("  # next %s\n", line);
+  } else {
+    out.print("\n");
+  }
+  return true;
+}
+
+void handleSchedule(AsyncWebServerRequest *request) {
+  HandlerTimer timer(METRIC_SCHEDULE);
+  if (!check_auth(request)) {
+    return;
+  }
+  AsyncWebServerResponse *response = page_chunked(request, "text/plain", schedule_page_part);
+  if (!response) {
+    send_text(request, 503, "error: out of memory");
+    return;
+  }
+  send(request, response);
+}
+
+// Raw body of POST /schedule, collected into the request's _tempObject
+// (freed with the request)
+#define SCHEDULE_BODY_MAX (SCHEDULE_MAX * SCHEDULE_LINE_MAX)
+
+static void scheduleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (total > SCHEDULE_BODY_MAX) {
+    return;
+  }
+  if (index == 0) {
+    request->_tempObject = malloc(total + 1);
+  }
+  char *body = (char *)request->_tempObject;
+  if (body) {
+    memcpy(body + index, data, len);
+    body[index + len] = '\0';
+  }
+}
+
+// The library takes a text/plain body that starts like name=value (as
+// "Mon-Fri 08:00 on_off=1" does) for a form and splits it into parameters
+// at '&' and the first '=' of each piece; put the text back together
+static String plain_post_body(AsyncWebServerRequest *request) {
+  String body;
+  for (size_t i = 0; i < request->params(); i++) {
+    AsyncWebParameter *param = request->getParam(i);
+    if (!param->isPost()) {
+      continue;
+    }
+    if (body.length()) {
+      body += '&';
+    }
+    if (param->name() != "body") {
+      body += param->name();
+      body += '=';
+    }
+    body += param->value();
+  }
+  return body;
+}
+
+// Replace the whole schedule with the entries in the request body
+// (text/plain) or the "entries" form field, same format as GET /schedule.
+// An empty body clears it.
+void postSchedule(AsyncWebServerRequest *request) {
+  HandlerTimer timer(METRIC_POSTSCHEDULE);
+  if (!check_auth(request)) {
+    return;
+  }
+  if (request->contentLength() > SCHEDULE_BODY_MAX) {
+    send_text(request, 413, "error: too long");
+    return;
+  }
+  const char *p = (const char *)request->_tempObject;
+  String text;
+  if (!p && request->contentType() == "text/plain" && request->contentLength()) {
+    text = plain_post_body(request);
+    p = text.c_str();
+  } else if (!p && request->hasArg("entries")) {
+    p = request->arg("entries").c_str();
+  } else if (!p && request->contentLength()) {
+    // A form without "entries" must not clear the schedule
+    send_text(request, 400, "error: no entries");
+    return;
+  } else if (!p) {
+    p = "";
+  }
+  ScheduleEntry entries[SCHEDULE_MAX];
+  uint8_t count = 0;
+  const char *end = p + strlen(p);
+  for (uint16_t line=1; p < end; line++) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    size_t len = eol ? eol - p : end - p;
+    const char *error = NULL;
+    if (count == SCHEDULE_MAX) {
+      error = "too many entries";
+    } else if (schedule_parse_line(p, len, &entries[count], &error) && entries[count].fields) {
+      count++;
+    }
+    if (error) {
+      char message[48];
+      snprintf(message, sizeof(message), "error: line %u: %s", line, error);
+      send_text(request, 400, message);
+      return;
+    }
+    p += len + 1;
+  }
+  if (!schedule_replace(entries, count)) {
+    send_text(request, 400, "error: bad entry");
+    return;
+  }
+  char message[24];
+  snprintf(message, sizeof(message), "ok %u entries", count);
+  send_text(request, 200, message);
+}
+
+// Thermostat tunables and controller state (see thermostat.h)
+// {"mode":"pi","zone":0,"fan":1,"target":24.0,"band":0.5,"kp":1.00,"ki":0.100,
+//  "interval_s":300,"status":"active","room":25.1,"error":-1.1,"integral":-0.2,
+//  "setpoint":22,"last_run_s":12,"commands":3}
+static void send_thermostat(AsyncWebServerRequest *request) {
+  const ThermostatConfig &cfg = thermostat_config();
+  char json[384];
+  char room[8] = "null";
+  if (!isnan(thermostat_room())) {
+    snprintf(room, sizeof(room), "%.1f", thermostat_room());
+  }
+  snprintf(json, sizeof(json),
+           "{\"mode\":\"%s\",\"zone\":%u,\"fan\":%u,\"target\":%.1f,\"band\":%.1f,\"kp\":%.2f,\"ki\":%.3f,"
+           "\"interval_s\":%lu,\"status\":\"%s\",\"room\":%s,\"error\":%.1f,\"integral\":%.2f,"
+           "\"setpoint\":%u,\"last_run_s\":%lu,\"commands\":%lu}",
+           thermostat_mode_name(cfg.mode), cfg.zone, cfg.drive_fan, cfg.target, cfg.band, cfg.kp, cfg.ki,
+           (unsigned long)(cfg.interval_ms / 1000), thermostat_status(),
+           room, thermostat_error(), thermostat_integral(),
+           thermostat_setpoint(), (unsigned long)((millis() - thermostat_last_run_ms()) / 1000),
+           (unsigned long)thermostat_commands());
+  AsyncWebServerResponse *response = body_response(request, 200, "application/json", json, strlen(json));
+  response->addHeader("Cache-Control", "no-store");
+  send(request, response);
+}
+
+void handleThermostat(AsyncWebServerRequest *request) {
+  if (!check_auth(request)) {
+    return;
+  }
+  send_thermostat(request);
+}
+
+// Change some tunables, e.g. "mode=pi&target=23.5", the others are kept.
+// Each value is checked before it is stored: the integer fields against
+// their range (a float out of it does not convert), the float ones for
+// being finite, then thermostat_configure() checks the rest.
+void postThermostat(AsyncWebServerRequest *request) {
+  if (!check_auth(request)) {
+    return;
+  }
+  ThermostatConfig cfg = thermostat_config();
+  for (size_t i=0; i<request->args(); i++) {
+    const String &name = request->argName(i);
+    const String &arg = request->arg(i);
+    const char *value = arg.c_str();
+    char *end;
+    float number = strtof(value, &end);
+    bool is_float = *value && !*end && isfinite(number);
+    uint32_t integer;
+    bool ok = true;
+    if (name == "mode") {
+      int8_t mode = thermostat_mode_index(value);
+      if ((ok = mode >= 0)) {
+        cfg.mode = mode;
+      }
+    } else if (name == "zone") {
+      if ((ok = parse_bounded(value, ZONE_COUNT - 1, &integer))) {
+        cfg.zone = integer;
+      }
+    } else if (name == "fan") {
+      if ((ok = parse_bounded(value, 1, &integer))) {
+        cfg.drive_fan = integer;
+      }
+    } else if (name == "interval_s") {
+      if ((ok = parse_bounded(value, 3600, &integer))) {
+        cfg.interval_ms = integer * 1000;
+      }
+    } else if (name == "target") {
+      if ((ok = is_float)) {
+        cfg.target = number;
+      }
+    } else if (name == "band") {
+      if ((ok = is_float)) {
+        cfg.band = number;
+      }
+    } else if (name == "kp") {
+      if ((ok = is_float)) {
+        cfg.kp = number;
+      }
+    } else if (name == "ki") {
+      if ((ok = is_float)) {
+        cfg.ki = number;
+      }
+    }
+    if (!ok) {
+      send_text(request, 400, "error: bad value");
+      return;
+    }
+  }
+  if (!thermostat_configure(cfg)) {
+    send_text(request, 400, "error: bad value");
+    return;
+  }
+  send_thermostat(request);
+}
+
+// Room readings or state changes over time (see history.h), streamed:
+// /history?from=<unix>&to=<unix>&step=<seconds>&what=room|state&format=csv|bin
+// Defaults: everything kept, 60s steps, room, csv
+// Decoded chunk by chunk as the connection takes it, the cursor lives in the
+// request's _tempObject (freed with the request).
+void handleHistory(AsyncWebServerRequest *request) {
+  if (!check_auth(request)) {
+    return;
+  }
+  uint32_t from = strtoul(request->arg("from").c_str(), NULL, 10);
+  uint32_t to = request->hasArg("to") ? strtoul(request->arg("to").c_str(), NULL, 10) : 0xFFFFFFFFUL;
+  uint32_t step = request->hasArg("step") ? strtoul(request->arg("step").c_str(), NULL, 10) : 60;
+  uint8_t what = request->arg("what") == "state" ? HISTORY_STATE : HISTORY_ROOM;
+  bool binary = request->arg("format") == "bin";
+  HistoryCursor *cursor = history_open(from, to, step, what, binary);
+  if (!cursor) {
+    send_text(request, 503, "error: out of memory");
+    return;
+  }
+  request->_tempObject = cursor;
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+      binary ? "application/octet-stream" : "text/csv",
+      [cursor](uint8_t *buf, size_t max, size_t) { return history_read(cursor, buf, max); });
+  // Unix time of the oldest sample kept
+  char oldest[12];
+  snprintf(oldest, sizeof(oldest), "%lu", (unsigned long)history_oldest());
+  response->addHeader("X-History-Oldest", oldest);
+  send(request, response);
+}
+
+// Log ring buffer (see log.h), oldest line first
+void handleLog(AsyncWebServerRequest *request) {
+  if (!check_auth(request)) {
+    return;
+  }
+  LogCursor *cursor = (LogCursor *)malloc(sizeof(LogCursor));
+  if (!cursor) {
+    send_text(request, 503, "error: out of memory");
+    return;
+  }
+  log_open(cursor);
+  // Freed with the request
+  request->_tempObject = cursor;
+  send(request, request->beginChunkedResponse("text/plain",
+      [cursor](uint8_t *buf, size_t max, size_t) { return log_read(cursor, buf, max); }));
+}
+
+// Server-Sent Events (see event_stream.h), pushed on change:
+//  event: state  data: 0:1=23,9=1   zone, changed fields of its state[] (index=value)
+//  event: room   data: 23.00,45.00  new filtered DHT reading (temp,humidity)
+//  event: tx     data: 1,7,6        IR queue depth, last id, done id
+// A new subscriber first gets all fields of state[] and the current values.
+static uint8_t published_state[ZONE_COUNT][CMD_PARAMS];
+static uint32_t published_room_at = 0;
+static uint32_t published_tx[3] = {0, 0, 0};
+
+// Fields of a zone's state[] that differ from old (all of them if old is NULL)
+static bool format_state_event(char *buf, size_t size, uint8_t zone, const uint8_t *old) {
+  size_t start = snprintf(buf, size, "%u:", zone);
+  size_t len = start;
+  for (uint8_t i=0; i<CMD_PARAMS; i++) {
+    if (old && old[i] == state[zone][i]) {
+      continue;
+    }
+    len += snprintf(buf+len, size-len, "%s%u=%u", len > start ? "," : "", i, state[zone][i]);
+  }
+  return len > start;
+}
+
+static bool format_room_event(char *buf) {
+  const DhtReading &room = dht_filtered();
+  if (!room.valid) {
+    return false;
+  }
+  dtostrf(room.temperature, 1, 2, buf);
+  size_t len = strlen(buf);
+  buf[len++] = ',';
+  dtostrf(room.humidity, 1, 2, buf+len);
+  return true;
+}
+
+static void format_tx_event(char *buf, size_t size, uint32_t *tx) {
+  tx[0] = ir_queue_depth();
+  tx[1] = ir_queue_last_id();
+  tx[2] = ir_queue_done_id();
+  snprintf(buf, size, "%lu,%lu,%lu", (unsigned long)tx[0], (unsigned long)tx[1], (unsigned long)tx[2]);
+}
+
+static void events_snapshot(AsyncEventSourceClient *client) {
+  char data[48];
+  uint32_t tx[3];
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    format_state_event(data, sizeof(data), z, NULL);
+    events_send(client, "state", data);
+  }
+  if (format_room_event(data)) {
+    events_send(client, "room", data);
+  }
+  format_tx_event(data, sizeof(data), tx);
+  events_send(client, "tx", data);
+}
+
+static void publish_events() {
+  if (events_subscribers() == 0) {
+    // Nothing to compare against once someone subscribes: a snapshot is sent
+    memcpy(published_state, state, sizeof(state));
+    published_room_at = dht_filtered().at_ms;
+    published_tx[0] = ir_queue_depth();
+    published_tx[1] = ir_queue_last_id();
+    published_tx[2] = ir_queue_done_id();
+    return;
+  }
+  char data[48];
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    if (format_state_event(data, sizeof(data), z, published_state[z])) {
+      events_publish("state", data);
+      memcpy(published_state[z], state[z], CMD_PARAMS);
+    }
+  }
+  if (dht_filtered().at_ms != published_room_at && format_room_event(data)) {
+    events_publish("room", data);
+    published_room_at = dht_filtered().at_ms;
+  }
+  if (ir_queue_depth() != published_tx[0] || ir_queue_last_id() != published_tx[1]
+      || ir_queue_done_id() != published_tx[2]) {
+    format_tx_event(data, sizeof(data), published_tx);
+    events_publish("tx", data);
+  }
+}
+
+static bool server_started = false;
+
+static void link_loop() {
+  if (!wifi_link_loop()) {
+    return;
+  }
+  boot_mark(BOOT_LINK_UP);
+  LOG_INFO("Connected to %s, IP address: %s (%lu ms, fast %u)", ssid, WiFi.localIP().toString().c_str(),
+           (unsigned long)wifi_link_connect_ms(), wifi_link_fast());
+  if (!server_started) {
+    server.begin();
+    server_started = true;
+    boot_mark(BOOT_SERVER_STARTED);
+    LOG_INFO("HTTP server started");
+  }
+}
+
+// SSE fan-out of the changes, then the keepalive
+static void events_task() {
+  publish_events();
+  events_loop();
+}
+
+static uint32_t task_clock_us() {
+  return micros();
+}
+
 void setup() {
   Serial.begin(115200);
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
+  // Associates in the background (see wifi_link.h), the AC is restored and
+  // the handlers registered meanwhile; the server starts once the link is up
+  wifi_link_begin(ssid, password);
   //WiFi.config(ip, gateway, subnet);
-  Serial.println("");
-  // EEPROM for state[]
-  EEPROM.begin(CMD_PARAMS*sizeof(uint8_t));
-  EEPROM.get(0,state);
-  for (int j=0; j<CMD_PARAMS;j++) {
-    Serial.print("setup:state[");
-    Serial.print(j);
-    Serial.print("]: ");
-    Serial.println(state[j]);
+  // state[] is kept in the flash journal, EEPROM is only read once to
+  // migrate the state saved by older firmwares
+  if (!journal_begin(JOURNAL_DEBOUNCE_MS)) {
+    LOG_ERROR("No room for the state journal in this flash layout!");
+  }
+  bool migrate = !restore_state();
+  if (migrate) {
+    // Older firmwares had a single zone, the others start from defaults
+    memset(state, 0xFF, sizeof(state));
+    EEPROM.begin(CMD_PARAMS*sizeof(uint8_t));
+    EEPROM.get(EEPROM_LEGACY_STATE,state[0]);
+    EEPROM.end();
+  }
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    LOG_DEBUG("setup:state[%u]: %u,%u,%u,%u,%u,%u,%u,%u,%u,%u", z,
+              state[z][0], state[z][1], state[z][2], state[z][3], state[z][4],
+              state[z][5], state[z][6], state[z][7], state[z][8], state[z][9]);
   }
   state_check();
-  // Wait for connection
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  ac.begin();
-  // IR send last known state
-  ac.setMode(state[0]);
-  ac.setTemp(state[1]);
-  ac.setFan(state[2]);
-  ac.setSwingVertical(state[3],state[4]);
-  ac.setLight(state[5]);
-  ac.setTurbo(state[6]);
-  ac.setXFan(state[7]);
-  ac.setSleep(state[8]);
-  ac.setPower(state[9]);
-
-  Serial.println("Done.");
-  Serial.println("");
-  Serial.print("Connected to ");
-  Serial.println(ssid);
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  if (migrate) {
+    persist_state();
+  }
+  boot_mark(BOOT_STATE_RESTORED);
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    zone_ac[z] = new IRGreeAC(zone_pins[z]);
+    zone_ac[z]->begin();
+    // Load the last known state, only sent with BOOT_IR_RESEND
+    ac_apply(*zone_ac[z], state[z]);
+  }
+  ir_queue_begin(zone_ac, IR_TIMER_TX ? zone_pins : NULL, CMD_REPEAT, CMD_REPEAT_GAP_MS);
+#if BOOT_IR_RESEND
+  for (uint8_t z=0; z<ZONE_COUNT; z++) {
+    zone_tx_id[z] = ir_queue_push(z, state[z]);
+  }
+#endif
+  boot_mark(BOOT_IR_RESTORED);
+  dht_sampler_begin(DHT, DHT11_PIN, DHT_INTERVAL_MS);
+  session_begin(SESSION_TTL_MS);
+  configTime(SCHEDULE_TZ, NTP_SERVER);
+  schedule_begin(apply_fields);
+  thermostat_begin(&state[0][0], apply_fields);
+  history_begin(&state[0][0]);
+  status_begin(&state[0][0]);
+  announce_begin(ANNOUNCE_GROUP, ANNOUNCE_PORT, ANNOUNCE_KEY, ANNOUNCE_HEARTBEAT_MS);
+
+  // Requests are parsed and answered from the TCP callbacks, several
+  // connections at a time; loop() never waits for a client
   server.onNotFound(handleNotFound);
   server.on("/acremote", HTTP_POST, postacremote);
-  server.on("/", handleAC);
-  server.begin();
-  Serial.println("HTTP server started");
+  server.on("/", HTTP_GET, handleAC);
+  server.on("/state", HTTP_GET, handleState);
+  server.on("/txstatus", HTTP_GET, handleTxStatus);
+  server.on("/status", HTTP_GET, handleStatus);
+  // Subscribers are taken by the event source, the others get the challenge
+  events_begin(server, authorized, events_snapshot);
+  server.on("/events", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->requestAuthentication(www_realm, true);
+  });
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/log", HTTP_GET, handleLog);
+  server.on("/schedule", HTTP_GET, handleSchedule);
+  server.on("/schedule", HTTP_POST, postSchedule, NULL, scheduleBody);
+  server.on("/thermostat", HTTP_GET, handleThermostat);
+  server.on("/thermostat", HTTP_POST, postThermostat);
+  server.on("/history", HTTP_GET, handleHistory);
+
+  // Work done from loop() (see task_scheduler.h): name, period ms, budget us.
+  // HTTP requests are answered from the TCP callbacks that run between
+  // tasks. The modules still pace themselves, the periods only bound how
+  // often they are polled; the budgets are their expected worst case
+  // (flash erase ~50ms, DHT11 read ~25ms, one Gree frame ~150ms when it
+  // is not played back by the timer).
+  tasks_begin(task_clock_us, yield);
+  task_add("wifi", link_loop, 100, 2000);
+  task_add("ir", ir_queue_loop, 0, IR_TIMER_TX ? 2000 : 200000);
+  task_add("dht", dht_sampler_loop, 100, 30000);
+  task_add("schedule", schedule_loop, 250, 60000);
+  task_add("thermostat", thermostat_loop, 1000, 60000);
+  task_add("history", history_loop, 250, 60000);
+  task_add("journal", journal_loop, 100, 60000);
+  task_add("events", events_task, 50, 5000);
+  task_add("announce", announce_loop, 250, 5000);
+  task_add("log", log_loop, 0, 2000);
+  boot_mark(BOOT_SETUP_DONE);
 }
 
 void loop() {
-  server.handleClient();
+  metrics_loop_tick();
+  tasks_run();
 }
@@ -0,0 +1,283 @@
+#include "metrics.h"
+#include <ESP8266WiFi.h>
+#include "ir_queue.h"
+#include "dht_sampler.h"
+#include "state_journal.h"
+#include "session_auth.h"
+#include "command_dedup.h"
+#include "schedule.h"
+#include "thermostat.h"
+#include "history.h"
+#include "event_stream.h"
+#include "log.h"
+#include "wifi_link.h"
+#include "boot_phases.h"
+#include "request_arena.h"
+#include "task_scheduler.h"
+#include "announce.h"
+
+// Upper bounds of the histogram buckets in us, plus +Inf
+#define METRIC_BUCKETS 12
+static const uint32_t bucket_us[METRIC_BUCKETS] = {
+  500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+
+struct Histogram {
+  uint32_t buckets[METRIC_BUCKETS + 1];  // not cumulative, last one is +Inf
+  uint32_t count;
+  uint64_t sum_us;
+};
+
+static const char *const handler_names[METRIC_HANDLERS] = {
+  "handleAC", "postacremote", "handleNotFound", "handleState", "handleTxStatus",
+  "handleSchedule", "postSchedule", "handleStatus"
+};
+
+static Histogram handler_hist[METRIC_HANDLERS];
+static Histogram loop_hist;
+static uint32_t loop_max_us = 0;
+static uint32_t loop_last = 0;
+
+static void record(Histogram &h, uint32_t us) {
+  uint8_t b = 0;
+  while (b < METRIC_BUCKETS && us > bucket_us[b]) {
+    b++;
+  }
+  h.buckets[b]++;
+  h.count++;
+  h.sum_us += us;
+}
+
+void metrics_record_handler(MetricHandler handler, uint32_t us) {
+  record(handler_hist[handler], us);
+  boot_mark(BOOT_FIRST_REQUEST);
+}
+
+void metrics_loop_tick() {
+  uint32_t now = micros();
+  if (loop_last) {
+    uint32_t us = now - loop_last;
+    record(loop_hist, us);
+    if (us > loop_max_us) {
+      loop_max_us = us;
+    }
+  }
+  loop_last = now;
+}
+
+static void write_header(Print &out, const char *name, const char *type, const char *help) {
+  out.print(F("# HELP "));
+  out.print(name);
+  out.print(' ');
+  out.println(help);
+  out.print(F("# TYPE "));
+  out.print(name);
+  out.print(' ');
+  out.println(type);
+}
+
+static void write_value(Print &out, const char *name, double value) {
+  out.print(name);
+  out.print(' ');
+  out.println(value, 0);
+}
+
+static void write_metric(Print &out, const char *name, const char *type, const char *help, double value) {
+  write_header(out, name, type, help);
+  write_value(out, name, value);
+}
+
+// label is either empty or e.g. handler="handleAC"
+static void write_histogram(Print &out, const char *name, const char *label, const Histogram &h) {
+  uint32_t cumulative = 0;
+  for (uint8_t b = 0; b <= METRIC_BUCKETS; b++) {
+    cumulative += h.buckets[b];
+    out.print(name);
+    out.print(F("_bucket{"));
+    if (*label) {
+      out.print(label);
+      out.print(',');
+    }
+    out.print(F("le=\""));
+    if (b < METRIC_BUCKETS) {
+      out.print(bucket_us[b] / 1e6, 4);
+    } else {
+      out.print(F("+Inf"));
+    }
+    out.print(F("\"} "));
+    out.println(cumulative);
+  }
+  out.print(name);
+  out.print(F("_sum"));
+  if (*label) {
+    out.print('{');
+    out.print(label);
+    out.print('}');
+  }
+  out.print(' ');
+  out.println(h.sum_us / 1e6, 6);
+  out.print(name);
+  out.print(F("_count"));
+  if (*label) {
+    out.print('{');
+    out.print(label);
+    out.print('}');
+  }
+  out.print(' ');
+  out.println(h.count);
+}
+
+// Per task stats of the loop() scheduler, label task="name"
+static void write_task_metric(Print &out, uint8_t m) {
+  static const char *const names[] = {
+    "gree_task_runs_total", "gree_task_overruns_total", "gree_task_wcet_seconds", "gree_task_seconds_total"
+  };
+  static const char *const types[] = {"counter", "counter", "gauge", "counter"};
+  static const char *const helps[] = {
+    "Task runs", "Runs longer than the task budget", "Longest run of the task", "Time spent in the task"
+  };
+  write_header(out, names[m], types[m], helps[m]);
+  for (uint8_t i = 0; i < task_count(); i++) {
+    const TaskStats &t = task_stats(i);
+    out.print(names[m]);
+    out.print(F("{task=\""));
+    out.print(t.name);
+    out.print(F("\"} "));
+    if (m == 0) {
+      out.println(t.runs);
+    } else if (m == 1) {
+      out.println(t.overruns);
+    } else if (m == 2) {
+      out.println(t.wcet_us / 1e6, 6);
+    } else {
+      out.println(t.total_us / 1e6, 6);
+    }
+  }
+}
+
+// Parts: the handler histogram header, one per handler histogram, then
+// groups of metrics small enough for a page part (see page_chunked())
+bool metrics_write(Print &out, uint16_t part) {
+  if (part == 0) {
+    write_header(out, "gree_http_request_duration_seconds", "histogram", "Handler latency");
+    return true;
+  }
+  part--;
+  if (part < METRIC_HANDLERS) {
+    char label[32];
+    snprintf(label, sizeof(label), "handler=\"%s\"", handler_names[part]);
+    write_histogram(out, "gree_http_request_duration_seconds", label, handler_hist[part]);
+    return true;
+  }
+  part -= METRIC_HANDLERS;
+  if (part < 4) {
+    write_task_metric(out, part);
+    return true;
+  }
+  switch (part - 4) {
+    case 0:
+      write_header(out, "gree_loop_duration_seconds", "histogram", "Time between loop() iterations");
+      write_histogram(out, "gree_loop_duration_seconds", "", loop_hist);
+      write_header(out, "gree_loop_max_stall_seconds", "gauge", "Longest loop() iteration since boot");
+      out.print(F("gree_loop_max_stall_seconds "));
+      out.println(loop_max_us / 1e6, 6);
+      return true;
+    case 1:
+      write_metric(out, "gree_ir_frames_sent_total", "counter", "IR frames sent",
+                   ir_queue_frames_sent());
+      write_header(out, "gree_ir_send_seconds_total", "counter", "Air time of the IR frames sent");
+      out.print(F("gree_ir_send_seconds_total "));
+      out.println(ir_queue_send_us_total() / 1e6, 6);
+      write_header(out, "gree_ir_send_max_seconds", "gauge", "Longest IR frame");
+      out.print(F("gree_ir_send_max_seconds "));
+      out.println(ir_queue_send_us_max() / 1e6, 6);
+      write_metric(out, "gree_ir_queue_depth", "gauge", "Commands pending or on air", ir_queue_depth());
+      write_metric(out, "gree_ir_superseded_total", "counter", "Commands dropped or cut short by a newer one",
+                   ir_queue_superseded());
+      return true;
+    case 2:
+      write_metric(out, "gree_cmd_replays_total", "counter", "Retried commands answered from the idempotency table",
+                   dedup_replays());
+      write_metric(out, "gree_cmd_unchanged_total", "counter", "Commands that did not change any zone state",
+                   dedup_unchanged());
+
+      write_metric(out, "gree_schedule_entries", "gauge", "Schedule entries", schedule_count());
+      write_metric(out, "gree_schedule_fired_total", "counter", "Schedule entries run", schedule_fired());
+
+      write_metric(out, "gree_thermostat_commands_total", "counter", "Setpoint/fan corrections sent by the thermostat",
+                   thermostat_commands());
+      write_metric(out, "gree_thermostat_setpoint_celsius", "gauge", "Last setpoint computed by the thermostat",
+                   thermostat_setpoint());
+      return true;
+    case 3:
+      write_metric(out, "gree_history_samples_total", "counter", "Room samples recorded", history_samples());
+      write_metric(out, "gree_history_ram_bytes", "gauge", "Bytes used by the history in RAM", history_ram_bytes());
+      write_metric(out, "gree_history_flash_blocks_written_total", "counter", "History blocks written to flash",
+                   history_flash_blocks_written());
+
+      write_metric(out, "gree_state_commits_total", "counter", "State records written to flash",
+                   journal_records_written());
+      write_metric(out, "gree_state_commits_avoided_total", "counter", "State changes that did not need a flash write",
+                   journal_writes_avoided());
+      write_metric(out, "gree_flash_sectors_erased_total", "counter", "Journal sectors erased",
+                   journal_sectors_erased());
+      return true;
+    case 4:
+      write_metric(out, "gree_dht_reads_total", "counter", "DHT11 read attempts", dht_reads());
+      write_header(out, "gree_dht_errors_total", "counter", "DHT11 failed reads");
+      out.print(F("gree_dht_errors_total{error=\"checksum\"} "));
+      out.println(dht_checksum_errors());
+      out.print(F("gree_dht_errors_total{error=\"timeout\"} "));
+      out.println(dht_timeout_errors());
+      out.print(F("gree_dht_errors_total{error=\"other\"} "));
+      out.println(dht_other_errors());
+
+      write_metric(out, "gree_auth_session_hits_total", "counter", "Requests authenticated by session cookie",
+                   session_hits());
+      write_metric(out, "gree_auth_session_misses_total", "counter", "Requests without a valid session cookie",
+                   session_misses());
+      write_metric(out, "gree_sse_subscribers", "gauge", "Connected /events clients", events_subscribers());
+      return true;
+    case 5:
+      write_metric(out, "gree_log_lines_total", "counter", "Lines logged", log_lines());
+      write_metric(out, "gree_log_serial_dropped_bytes_total", "counter", "Log bytes overwritten before reaching the UART",
+                   log_dropped_bytes());
+
+      write_metric(out, "gree_arena_requests_total", "counter", "Responses built in a request arena slot",
+                   arena_acquired());
+      write_metric(out, "gree_arena_busy_total", "counter", "Responses built on the heap, no free arena slot",
+                   arena_busy());
+      write_metric(out, "gree_arena_overflows_total", "counter", "Responses cut at the arena slot size",
+                   arena_overflows());
+      write_metric(out, "gree_arena_high_water_bytes", "gauge", "Most arena bytes used by a response",
+                   arena_high_water());
+      return true;
+    case 6:
+      write_metric(out, "gree_heap_free_bytes", "gauge", "Free heap", ESP.getFreeHeap());
+      write_metric(out, "gree_heap_max_block_bytes", "gauge", "Largest free heap block", ESP.getMaxFreeBlockSize());
+      write_metric(out, "gree_heap_fragmentation_percent", "gauge", "Heap fragmentation", ESP.getHeapFragmentation());
+      write_metric(out, "gree_wifi_rssi_dbm", "gauge", "WiFi signal strength", WiFi.RSSI());
+      write_metric(out, "gree_wifi_fast_connect", "gauge", "Boot association from cache: 0 scan, 1 BSSID and channel",
+                   wifi_link_fast());
+      write_metric(out, "gree_wifi_link_drops_total", "counter", "WiFi link losses", wifi_link_drops());
+      return true;
+    case 7:
+      write_metric(out, "gree_announce_sent_total", "counter", "UDP status announcements sent", announce_sent());
+      write_metric(out, "gree_announce_errors_total", "counter", "UDP status announcements that failed to send",
+                   announce_errors());
+      write_metric(out, "gree_announce_boot", "gauge", "Boot counter carried by the announcements", announce_boot());
+      write_header(out, "gree_boot_phase_seconds", "gauge", "millis() at which each boot phase completed");
+      for (uint8_t i = 0; i < BOOT_PHASES; i++) {
+        if (boot_phase_reached((BootPhase)i)) {
+          out.print(F("gree_boot_phase_seconds{phase=\""));
+          out.print(boot_phase_name((BootPhase)i));
+          out.print(F("\"} "));
+          out.println(boot_phase_ms((BootPhase)i) / 1e3, 3);
+        }
+      }
+      write_metric(out, "gree_uptime_seconds", "counter", "Seconds since boot", millis() / 1000);
+      return true;
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+
+// Counters and fixed-bucket latency histograms, rendered as Prometheus text
+// by metrics_write() (GET /metrics).
+//
+// Recording is a few integer increments, no allocation, so it stays enabled
+// in production. Handlers are timed with a HandlerTimer on their first line,
+// loop() calls metrics_loop_tick() first thing to measure iteration time.
+// Other modules keep their own counters, metrics_write() collects them.
+
+enum MetricHandler {
+  METRIC_HANDLE_AC = 0,
+  METRIC_POSTACREMOTE,
+  METRIC_NOT_FOUND,
+  METRIC_STATE,
+  METRIC_TXSTATUS,
+  METRIC_SCHEDULE,
+  METRIC_POSTSCHEDULE,
+  METRIC_STATUS,
+  METRIC_HANDLERS
+};
+
+void metrics_record_handler(MetricHandler handler, uint32_t us);
+// Call at the top of loop()
+void metrics_loop_tick();
+// Part `part` of the page, false once past the last one (GET /metrics is
+// sent a part at a time, see page_chunked())
+bool metrics_write(Print &out, uint16_t part);
+
+// Times the enclosing scope
+class HandlerTimer {
+ public:
+  explicit HandlerTimer(MetricHandler handler) : _handler(handler), _start(micros()) {}
+  ~HandlerTimer() { metrics_record_handler(_handler, micros() - _start); }
+
+ private:
+  MetricHandler _handler;
+  uint32_t _start;
+};
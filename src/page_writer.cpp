@@ -0,0 +1,197 @@
+#include "page_writer.h"
+#include "log.h"
+
+// Longest placeholder name accepted by render_P()
+#define PAGE_VAR_MAX 24
+
+PageWriter::PageWriter(AsyncWebServerRequest *request)
+    : _request(request), _code(200), _content_type(NULL), _arena(NULL), _body(NULL), _len(0), _cut(false),
+      _stream(NULL) {
+}
+
+void PageWriter::begin(int code, const char *content_type) {
+  _code = code;
+  _content_type = content_type;
+  _len = 0;
+  _cut = false;
+  _arena = arena_acquire();
+  if (_arena) {
+    _body = (uint8_t *)arena_alloc(_arena, 0);
+  } else {
+    // No free slot, on the heap
+    _stream = _request->beginResponseStream(_content_type);
+    _stream->setCode(_code);
+  }
+}
+
+size_t PageWriter::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t PageWriter::write(const uint8_t *data, size_t len) {
+  if (_stream) {
+    return _stream->write(data, len);
+  }
+  // What does not fit in the slot is dropped
+  size_t room = ARENA_SIZE - arena_used(_arena);
+  if (len > room) {
+    if (!_cut) {
+      _cut = true;
+      arena_note_overflow();
+      LOG_WARN("page: cut at %u bytes", (unsigned)(_len + room));
+    }
+    len = room;
+  }
+  if (!len || !arena_extend(_arena, _body, len)) {
+    return 0;
+  }
+  memcpy(_body + _len, data, len);
+  _len += len;
+  return len;
+}
+
+void PageWriter::print_P(PGM_P str) {
+  char c;
+  while ((c = pgm_read_byte(str++)) != 0) {
+    write((uint8_t)c);
+  }
+}
+
+void PageWriter::render_P(PGM_P tmpl, PageVarFn var, void *ctx) {
+  char name[PAGE_VAR_MAX];
+  char c;
+  while ((c = pgm_read_byte(tmpl++)) != 0) {
+    if (c != '{' || pgm_read_byte(tmpl) != '{') {
+      write((uint8_t)c);
+      continue;
+    }
+    // {{name}}: copy the name, unterminated or too long ones are written as is
+    PGM_P p = tmpl + 1;
+    size_t len = 0;
+    while ((c = pgm_read_byte(p)) != 0 && c != '}' && len < sizeof(name)) {
+      name[len++] = c;
+      p++;
+    }
+    if (c != '}' || pgm_read_byte(p + 1) != '}') {
+      write((uint8_t)'{');
+      continue;
+    }
+    var(*this, name, len, ctx);
+    tmpl = p + 2;
+  }
+}
+
+AsyncWebServerResponse *PageWriter::end() {
+  if (_stream) {
+    return _stream;
+  }
+  const uint8_t *body = _body;
+  size_t len = _len;
+  AsyncWebServerResponse *response = _request->beginResponse(_content_type, len,
+      [body, len](uint8_t *buf, size_t max, size_t index) -> size_t {
+        size_t n = len - index < max ? len - index : max;
+        memcpy(buf, body + index, n);
+        return n;
+      });
+  response->setCode(_code);
+  // The body is read until the response is sent
+  Arena *arena = _arena;
+  _request->onDisconnect([arena]() { arena_release(arena); });
+  return response;
+}
+
+bool page_var_is(const char *name, size_t len, const char *expected) {
+  return strlen(expected) == len && memcmp(name, expected, len) == 0;
+}
+
+// Chunked pages
+
+struct PageCursor {
+  PagePartFn fn;
+  uint16_t part;
+  bool done;
+  uint16_t len;   // bytes of the current part in buf
+  uint16_t off;   // of which sent
+  uint8_t buf[PAGE_PART_MAX];
+};
+
+// Writes into the cursor's buffer, what does not fit is dropped
+class PartPrint : public Print {
+ public:
+  explicit PartPrint(PageCursor *cursor) : _cursor(cursor), cut(false) {}
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+  size_t write(const uint8_t *data, size_t len) override {
+    size_t n = PAGE_PART_MAX - _cursor->len;
+    if (len > n) {
+      cut = true;
+    } else {
+      n = len;
+    }
+    memcpy(_cursor->buf + _cursor->len, data, n);
+    _cursor->len += n;
+    return n;
+  }
+  using Print::write;
+
+ private:
+  PageCursor *_cursor;
+
+ public:
+  bool cut;
+};
+
+static size_t page_fill(PageCursor *cursor, uint8_t *buf, size_t max) {
+  size_t n = 0;
+  while (n < max) {
+    if (cursor->off == cursor->len) {
+      if (cursor->done) {
+        break;
+      }
+      cursor->len = 0;
+      cursor->off = 0;
+      PartPrint out(cursor);
+      if (!cursor->fn(out, cursor->part)) {
+        cursor->done = true;
+      } else if (out.cut) {
+        LOG_WARN("page: part %u cut at %u bytes", cursor->part, PAGE_PART_MAX);
+      }
+      cursor->part++;
+      continue;
+    }
+    size_t k = cursor->len - cursor->off;
+    if (k > max - n) {
+      k = max - n;
+    }
+    memcpy(buf + n, cursor->buf + cursor->off, k);
+    cursor->off += k;
+    n += k;
+  }
+  return n;
+}
+
+static_assert(sizeof(PageCursor) <= ARENA_SIZE, "a page part buffer must fit in an arena slot");
+
+AsyncWebServerResponse *page_chunked(AsyncWebServerRequest *request, const char *content_type, PagePartFn part) {
+  // In an arena slot if one is free, else on the heap
+  Arena *arena = arena_acquire();
+  PageCursor *cursor = arena ? (PageCursor *)arena_alloc(arena, sizeof(PageCursor))
+                             : (PageCursor *)malloc(sizeof(PageCursor));
+  if (!cursor) {
+    return NULL;
+  }
+  cursor->fn = part;
+  cursor->part = 0;
+  cursor->done = false;
+  cursor->len = 0;
+  cursor->off = 0;
+  if (arena) {
+    request->onDisconnect([arena]() { arena_release(arena); });
+  } else {
+    // Freed with the request
+    request->_tempObject = cursor;
+  }
+  return request->beginChunkedResponse(content_type,
+      [cursor](uint8_t *buf, size_t max, size_t) { return page_fill(cursor, buf, max); });
+}
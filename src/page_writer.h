@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "request_arena.h"
+
+// Builds a response in RAM, sent by the async server once the handler
+// returns.
+//
+// The page goes into a request arena slot (request_arena.h) released when
+// the connection closes, so the common small pages do not touch the heap.
+// A page is at most ARENA_SIZE bytes: what goes past it is dropped and
+// counted (arena_overflows()), the heap held never grows with the page.
+// Only without a free slot it is an AsyncResponseStream on the heap. Long
+// outputs use a chunked response filled on demand instead: page_chunked()
+// below, or a reader of their own (see handleHistory() in main.cpp). Being a Print, all print()/println()
+// overloads work. render_P() expands {{name}} placeholders of a PROGMEM
+// template through a callback, writing values in place.
+
+class PageWriter;
+// Called for each {{name}} placeholder, name is not NUL terminated
+typedef void (*PageVarFn)(PageWriter &out, const char *name, size_t len, void *ctx);
+
+class PageWriter : public Print {
+ public:
+  explicit PageWriter(AsyncWebServerRequest *request);
+
+  void begin(int code, const char *content_type);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *data, size_t len) override;
+  using Print::write;
+  void print_P(PGM_P str);
+  void render_P(PGM_P tmpl, PageVarFn var, void *ctx);
+  // The response to send, headers can still be added to it
+  AsyncWebServerResponse *end();
+
+ private:
+  AsyncWebServerRequest *_request;
+  int _code;
+  const char *_content_type;
+  Arena *_arena;
+  uint8_t *_body;
+  size_t _len;
+  bool _cut;
+  AsyncResponseStream *_stream;
+};
+
+// Helper for PageVarFn callbacks
+bool page_var_is(const char *name, size_t len, const char *expected);
+
+// Largest part of a page_chunked() page
+#define PAGE_PART_MAX 1408
+
+// Writes part `part` of a page to out, false once part is past the last one
+typedef bool (*PagePartFn)(Print &out, uint16_t part);
+
+// Chunked response rendered a part at a time (e.g. a line, or a metric
+// family) into a PAGE_PART_MAX buffer as the connection drains, so the
+// memory held does not grow with the page. The buffer is a request arena
+// slot, the heap only when none is free. Each part is written in one go
+// and stays consistent even if the data changes while the page is sent.
+// NULL if out of memory.
+AsyncWebServerResponse *page_chunked(AsyncWebServerRequest *request, const char *content_type, PagePartFn part);
@@ -0,0 +1,77 @@
+#include "request_arena.h"
+
+struct Arena {
+  bool taken;
+  size_t used;
+  size_t last;    // offset of the last allocation
+  uint8_t data[ARENA_SIZE] __attribute__((aligned(4)));
+};
+
+static Arena slots[ARENA_SLOTS];
+static uint32_t acquired = 0;
+static uint32_t busy = 0;
+static uint32_t overflows = 0;
+static size_t high_water = 0;
+
+Arena *arena_acquire() {
+  for (uint8_t i = 0; i < ARENA_SLOTS; i++) {
+    if (!slots[i].taken) {
+      slots[i].taken = true;
+      slots[i].used = 0;
+      slots[i].last = 0;
+      acquired++;
+      return &slots[i];
+    }
+  }
+  busy++;
+  return NULL;
+}
+
+void arena_release(Arena *arena) {
+  if (arena->used > high_water) {
+    high_water = arena->used;
+  }
+  arena->taken = false;
+}
+
+void *arena_alloc(Arena *arena, size_t len) {
+  size_t at = (arena->used + 3) & ~(size_t)3;
+  if (at > ARENA_SIZE || len > ARENA_SIZE - at) {
+    return NULL;
+  }
+  arena->last = at;
+  arena->used = at + len;
+  return arena->data + at;
+}
+
+bool arena_extend(Arena *arena, void *last, size_t len) {
+  if ((uint8_t *)last != arena->data + arena->last || len > ARENA_SIZE - arena->used) {
+    return false;
+  }
+  arena->used += len;
+  return true;
+}
+
+size_t arena_used(const Arena *arena) {
+  return arena->used;
+}
+
+uint32_t arena_acquired() {
+  return acquired;
+}
+
+uint32_t arena_busy() {
+  return busy;
+}
+
+uint32_t arena_overflows() {
+  return overflows;
+}
+
+void arena_note_overflow() {
+  overflows++;
+}
+
+size_t arena_high_water() {
+  return high_water;
+}
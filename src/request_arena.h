@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+
+// Per-request bump allocators in static RAM.
+//
+// A request takes a slot with arena_acquire(), allocates from it by
+// bumping a pointer and gives the whole slot back with arena_release()
+// when the connection closes. Nothing comes from the heap, so the response
+// bodies of the frequent requests (/state, /txstatus, /acremote replies)
+// and the part buffer of the chunked pages (/metrics, /schedule, see
+// page_chunked()) no longer leave holes in it; a slot is sized for that
+// buffer. ARENA_SLOTS requests can hold one at the same time; callers fall
+// back to the heap when none is free, and cut what needs more than
+// ARENA_SIZE bytes (both counted, see /metrics).
+
+#ifndef ARENA_SLOTS
+#define ARENA_SLOTS 3
+#endif
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 1536
+#endif
+
+struct Arena;
+
+// NULL if all the slots are in use
+Arena *arena_acquire();
+void arena_release(Arena *arena);
+// len bytes aligned to 4, NULL if the slot is full
+void *arena_alloc(Arena *arena, size_t len);
+// Grow the last allocation in place, false if the slot is full
+bool arena_extend(Arena *arena, void *last, size_t len);
+size_t arena_used(const Arena *arena);
+
+uint32_t arena_acquired();
+// No free slot
+uint32_t arena_busy();
+// Responses cut at the slot size
+uint32_t arena_overflows();
+void arena_note_overflow();
+// Most bytes used by a request
+size_t arena_high_water();
@@ -0,0 +1,449 @@
+#include "schedule.h"
+#include <EEPROM.h>
+#include "eeprom_layout.h"
+#include <time.h>
+#include "log.h"
+
+#define SCHEDULE_MAGIC 0x4753
+// Bump when ScheduleEntry or CMD_FIELDS change
+#define SCHEDULE_VERSION 1
+// Clock steps up to this are caught up tick by tick (runs in between fire),
+// bigger ones re-arm every entry
+#define SCHEDULE_CATCHUP_MIN 60
+// time() below this: NTP has not set the clock yet
+#define SCHEDULE_MIN_EPOCH 1600000000UL
+
+struct ScheduleHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;
+};
+
+static_assert(EEPROM_SCHEDULE + sizeof(ScheduleHeader) + SCHEDULE_MAX * sizeof(ScheduleEntry) <= EEPROM_THERMOSTAT,
+              "schedule does not fit its EEPROM area");
+
+static const char DAY_NAMES[7][4] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+
+static ScheduleEntry entries[SCHEDULE_MAX];
+static uint8_t count = 0;
+static ScheduleFireFn fire_cb = NULL;
+static bool armed = false;
+static uint32_t last_check = 0;
+static uint32_t fired = 0;
+// Written by schedule_loop(), not from the web server callbacks
+static bool dirty = false;
+
+// Days since 1970-01-01 of a date (proleptic Gregorian, y >= 1970)
+static uint32_t days_from_civil(uint16_t y, uint8_t m, uint8_t d) {
+  y -= m <= 2;
+  uint32_t era = y / 400;
+  uint32_t yoe = y - era * 400;
+  uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(uint32_t days, uint16_t *y, uint8_t *m, uint8_t *d) {
+  uint32_t z = days + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = yoe + era * 400 + (*m <= 2);
+}
+
+// 0 Monday .. 6 Sunday, 1970-01-01 was a Thursday
+static uint8_t weekday(uint32_t days) {
+  return (days + 3) % 7;
+}
+
+// First run strictly after `after`, 0 if none
+static uint32_t next_run(const ScheduleEntry &e, uint32_t after) {
+  if (!e.days) {
+    return e.when > after ? e.when : 0;
+  }
+  uint32_t day = after / 1440;
+  for (uint8_t i = 0; i <= 7; i++, day++) {
+    uint32_t at = day * 1440 + e.when;
+    if ((e.days & (1 << weekday(day))) && at > after) {
+      return at;
+    }
+  }
+  return 0;
+}
+
+static bool entry_valid(const ScheduleEntry &e) {
+  if (!e.fields || e.fields >= (1 << CMD_PARAMS) || !e.zones || e.zones >= (1UL << ZONE_COUNT) ||
+      e.days >= 0x80 || (e.days && e.when >= 1440)) {
+    return false;
+  }
+  uint8_t cmd[CMD_PARAMS];
+  cmd_unpack(e.values, cmd);
+  return cmd_valid(cmd);
+}
+
+static void on_fire(uint8_t id, uint32_t minute) {
+  const ScheduleEntry &e = entries[id];
+  uint8_t cmd[CMD_PARAMS];
+  cmd_unpack(e.values, cmd);
+  fired++;
+  LOG_INFO("schedule: entry %u fired", id);
+  fire_cb(e.zones, cmd, e.fields);
+  if (e.days) {
+    wheel_add(id, next_run(e, minute));
+  }
+}
+
+// Runs after `after` are armed, the wheel restarts at now + 1
+static void arm_all(uint32_t now, uint32_t after) {
+  wheel_reset(now + 1);
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t at = next_run(entries[i], after);
+    if (at) {
+      wheel_add(i, at);
+    }
+  }
+  armed = true;
+}
+
+static void load() {
+  ScheduleHeader header;
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.get(EEPROM_SCHEDULE, header);
+  count = 0;
+  if (header.magic == SCHEDULE_MAGIC && header.version == SCHEDULE_VERSION && header.count <= SCHEDULE_MAX) {
+    for (uint8_t i = 0; i < header.count; i++) {
+      EEPROM.get(EEPROM_SCHEDULE + sizeof(header) + i * sizeof(ScheduleEntry), entries[count]);
+      if (entry_valid(entries[count])) {
+        count++;
+      }
+    }
+  }
+  EEPROM.end();
+}
+
+static bool save() {
+  ScheduleHeader header = {SCHEDULE_MAGIC, SCHEDULE_VERSION, count};
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.put(EEPROM_SCHEDULE, header);
+  for (uint8_t i = 0; i < count; i++) {
+    EEPROM.put(EEPROM_SCHEDULE + sizeof(header) + i * sizeof(ScheduleEntry), entries[i]);
+  }
+  bool ok = EEPROM.commit();
+  EEPROM.end();
+  return ok;
+}
+
+void schedule_begin(ScheduleFireFn fire) {
+  fire_cb = fire;
+  load();
+  LOG_INFO("schedule: %u entries", count);
+}
+
+void schedule_loop() {
+  if (dirty) {
+    dirty = false;
+    if (!save()) {
+      LOG_ERROR("schedule: not saved");
+    }
+  }
+  if (millis() - last_check < 1000) {
+    return;
+  }
+  last_check = millis();
+  uint32_t now = schedule_now();
+  if (!now) {
+    return;
+  }
+  if (!armed || now >= wheel_now() + SCHEDULE_CATCHUP_MIN) {
+    arm_all(now, now);
+    return;
+  }
+  if (now + 1 < wheel_now()) {
+    // Back in time: what ran up to the last minute processed is not run again
+    arm_all(now, wheel_now() - 1);
+    return;
+  }
+  wheel_advance(now, on_fire);
+}
+
+uint32_t schedule_now() {
+  time_t t = time(NULL);
+  if (t < (time_t)SCHEDULE_MIN_EPOCH) {
+    return 0;
+  }
+  struct tm tm;
+  localtime_r(&t, &tm);
+  return days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) * 1440 +
+         tm.tm_hour * 60 + tm.tm_min;
+}
+
+// Parsing
+
+static bool parse_number(const char *s, size_t len, uint8_t digits, uint16_t *value) {
+  if (len != digits) {
+    return false;
+  }
+  *value = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+    *value = *value * 10 + (s[i] - '0');
+  }
+  return true;
+}
+
+static int8_t day_index(const char *s, size_t len) {
+  for (uint8_t i = 0; len == 3 && i < 7; i++) {
+    if (memcmp(s, DAY_NAMES[i], 3) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// "daily", "Mon", "Mon-Fri", "Sat,Sun", "Fri-Mon,Wed"
+static bool parse_days(const char *s, size_t len, uint8_t *days) {
+  if (len == 5 && memcmp(s, "daily", 5) == 0) {
+    *days = 0x7F;
+    return true;
+  }
+  *days = 0;
+  while (len) {
+    size_t part = 0;
+    while (part < len && s[part] != ',') {
+      part++;
+    }
+    int8_t from = day_index(s, part < 3 ? part : 3);
+    int8_t to = from;
+    if (part == 7 && s[3] == '-') {
+      to = day_index(s + 4, 3);
+    } else if (part != 3) {
+      return false;
+    }
+    if (from < 0 || to < 0) {
+      return false;
+    }
+    for (int8_t d = from; ; d = (d + 1) % 7) {
+      *days |= 1 << d;
+      if (d == to) {
+        break;
+      }
+    }
+    if (part == len) {
+      break;
+    }
+    s += part + 1;
+    len -= part + 1;
+    if (!len) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// "YYYY-MM-DD", days since 1970
+static bool parse_date(const char *s, size_t len, uint32_t *days) {
+  uint16_t y, m, d;
+  if (len != 10 || s[4] != '-' || s[7] != '-' ||
+      !parse_number(s, 4, 4, &y) || !parse_number(s + 5, 2, 2, &m) || !parse_number(s + 8, 2, 2, &d) ||
+      y < 2000 || y > 2099 || m < 1 || m > 12 || d < 1 || d > 31) {
+    return false;
+  }
+  *days = days_from_civil(y, m, d);
+  // Reject days past the end of the month (e.g. 02-30)
+  uint16_t cy;
+  uint8_t cm, cd;
+  civil_from_days(*days, &cy, &cm, &cd);
+  return cm == m && cd == d;
+}
+
+// "HH:MM" or "H:MM", minute of the day
+static bool parse_time(const char *s, size_t len, uint32_t *minute) {
+  uint16_t h, m;
+  size_t colon = len - 3;
+  if (len < 4 || len > 5 || s[colon] != ':' ||
+      !parse_number(s, colon, colon, &h) || !parse_number(s + colon + 1, 2, 2, &m) ||
+      h > 23 || m > 59) {
+    return false;
+  }
+  *minute = h * 60 + m;
+  return true;
+}
+
+static bool next_token(const char **p, const char *end, const char **tok, size_t *len) {
+  while (*p < end && (**p == ' ' || **p == '\t' || **p == '\r')) {
+    (*p)++;
+  }
+  *tok = *p;
+  while (*p < end && **p != ' ' && **p != '\t' && **p != '\r') {
+    (*p)++;
+  }
+  *len = *p - *tok;
+  return *len > 0;
+}
+
+bool schedule_parse_line(const char *line, size_t len, ScheduleEntry *entry, const char **error) {
+  const char *comment = (const char *)memchr(line, '#', len);
+  const char *p = line;
+  const char *end = comment ? comment : line + len;
+  const char *tok;
+  size_t tok_len;
+  memset(entry, 0, sizeof(*entry));
+  if (!next_token(&p, end, &tok, &tok_len)) {
+    return true;
+  }
+  uint32_t day = 0;
+  if (tok_len == 10 && tok[0] >= '0' && tok[0] <= '9') {
+    if (!parse_date(tok, tok_len, &day)) {
+      *error = "bad date";
+      return false;
+    }
+  } else if (!parse_days(tok, tok_len, &entry->days)) {
+    *error = "bad days";
+    return false;
+  }
+  uint32_t minute;
+  if (!next_token(&p, end, &tok, &tok_len) || !parse_time(tok, tok_len, &minute)) {
+    *error = "bad time";
+    return false;
+  }
+  entry->when = entry->days ? minute : day * 1440 + minute;
+  entry->zones = 1;
+  uint8_t cmd[CMD_PARAMS];
+  cmd_default(cmd);
+  while (next_token(&p, end, &tok, &tok_len)) {
+    const char *eq = (const char *)memchr(tok, '=', tok_len);
+    if (!eq) {
+      *error = "expected name=value";
+      return false;
+    }
+    size_t name_len = eq - tok;
+    const char *value = eq + 1;
+    size_t value_len = tok_len - name_len - 1;
+    if (name_len == 5 && memcmp(tok, "zones", 5) == 0) {
+      entry->zones = parse_zones(value, value_len);
+      if (!entry->zones) {
+        *error = "bad zones";
+        return false;
+      }
+      continue;
+    }
+    int8_t field = cmd_field_index(tok, name_len);
+    if (field < 0) {
+      *error = "unknown field";
+      return false;
+    }
+    if ((entry->fields & (1 << field)) || !cmd_parse_field(field, value, value_len, &cmd[field])) {
+      *error = "bad field value";
+      return false;
+    }
+    entry->fields |= 1 << field;
+  }
+  if (!entry->fields) {
+    *error = "no fields";
+    return false;
+  }
+  cmd_pack(cmd, entry->values);
+  return true;
+}
+
+// Formatting
+
+#define APPEND(...) \
+  do { \
+    int n = snprintf(buf + len, len < size ? size - len : 0, __VA_ARGS__); \
+    len += n > 0 ? n : 0; \
+  } while (0)
+
+size_t schedule_format_minute(uint32_t minute, char *buf, size_t size) {
+  uint16_t y;
+  uint8_t m, d;
+  civil_from_days(minute / 1440, &y, &m, &d);
+  return snprintf(buf, size, "%04u-%02u-%02u %02u:%02u", y, m, d,
+                  (unsigned)(minute % 1440 / 60), (unsigned)(minute % 60));
+}
+
+size_t schedule_format(const ScheduleEntry &e, char *buf, size_t size) {
+  size_t len = 0;
+  if (!e.days) {
+    len = schedule_format_minute(e.when, buf, size);
+  } else {
+    if (e.days == 0x7F) {
+      APPEND("daily");
+    }
+    // Runs of 3+ days as ranges, e.g. "Mon-Wed,Sat"
+    for (uint8_t d = 0; d < 7 && e.days != 0x7F; d++) {
+      if (!(e.days & (1 << d))) {
+        continue;
+      }
+      uint8_t last = d;
+      while (last < 6 && (e.days & (1 << (last + 1)))) {
+        last++;
+      }
+      const char *sep = (e.days & ((1 << d) - 1)) ? "," : "";
+      if (last >= d + 2) {
+        APPEND("%s%s-%s", sep, DAY_NAMES[d], DAY_NAMES[last]);
+        d = last;
+      } else {
+        APPEND("%s%s", sep, DAY_NAMES[d]);
+      }
+    }
+    APPEND(" %02u:%02u", (unsigned)(e.when / 60), (unsigned)(e.when % 60));
+  }
+  if (e.zones != 1) {
+    APPEND(" zones=");
+    const char *sep = "";
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+      if (e.zones & (1 << z)) {
+        APPEND("%s%u", sep, z);
+        sep = ",";
+      }
+    }
+  }
+  uint8_t cmd[CMD_PARAMS];
+  cmd_unpack(e.values, cmd);
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    if (e.fields & (1 << i)) {
+      APPEND(" %s=%u", CMD_FIELDS[i].name, cmd[i]);
+    }
+  }
+  return len < size ? len : size - 1;
+}
+
+bool schedule_replace(const ScheduleEntry *list, uint8_t n) {
+  if (n > SCHEDULE_MAX) {
+    return false;
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    if (!entry_valid(list[i])) {
+      return false;
+    }
+  }
+  memcpy(entries, list, n * sizeof(ScheduleEntry));
+  count = n;
+  armed = false;
+  last_check = millis() - 1000;
+  dirty = true;
+  return true;
+}
+
+uint8_t schedule_count() {
+  return count;
+}
+
+const ScheduleEntry &schedule_entry(uint8_t i) {
+  return entries[i];
+}
+
+uint32_t schedule_next(uint8_t i) {
+  return armed && wheel_armed(i) ? wheel_expiry(i) : 0;
+}
+
+uint32_t schedule_fired() {
+  return fired;
+}
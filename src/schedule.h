@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include "ac_state.h"
+#include "timer_wheel.h"
+
+// On-device schedule: weekly programs and one-shot timers.
+//
+// One entry per line, e.g.
+//   Mon-Fri 08:00 mode=1 temp=23 on_off=1
+//   Mon-Fri 19:00 on_off=0
+//   Sat,Sun 10:30 zones=0,1 on_off=1
+//   2026-12-24 18:00 on_off=1
+// Days are Mon..Sun, ranges or lists of them, or "daily"; a date makes a
+// one-shot. The fields are the CMD_FIELDS names: only the named ones
+// change, as a partial update to /acremote does. zones defaults to 0.
+// Times are local (SCHEDULE_TZ in main.cpp), '#' starts a comment.
+//
+// Entries are saved in the EEPROM sector, after the state of older
+// firmwares, and each one is armed in the timer wheel (timer_wheel.h) at
+// its next run. schedule_loop() advances the wheel once NTP has set the
+// clock; if the clock jumps (first sync, big corrections) every entry is
+// armed again from the new time, runs in between are skipped. When it goes
+// back (DST ending) the runs already made are not repeated.
+
+#define SCHEDULE_MAX WHEEL_TIMERS
+#define SCHEDULE_LINE_MAX 96
+static_assert(ZONE_COUNT <= 8, "schedule zones are an 8 bit mask");
+
+struct ScheduleEntry {
+  uint32_t when;      // weekly: minute of the day, one-shot: local minutes since 1970
+  uint16_t fields;    // bit i: CMD_FIELDS[i] is set by the entry
+  uint8_t days;       // bit 0 Monday .. bit 6 Sunday, 0 for a one-shot
+  uint8_t zones;      // bitmask
+  uint8_t values[CMD_PACKED_BYTES];   // cmd_pack()ed, unset fields at default
+};
+
+// Called for each run, cmd holds the values of the fields set
+typedef void (*ScheduleFireFn)(uint32_t zones, const uint8_t *cmd, uint16_t fields);
+
+// Loads the saved entries
+void schedule_begin(ScheduleFireFn fire);
+// Call from loop()
+void schedule_loop();
+
+// Parse one line. Returns false with *error set if it is not valid; a blank
+// or comment line is valid and leaves entry->fields at 0.
+bool schedule_parse_line(const char *line, size_t len, ScheduleEntry *entry, const char **error);
+// Format an entry back as a line (no newline), returns its length
+size_t schedule_format(const ScheduleEntry &entry, char *buf, size_t size);
+// Format a local minute as "YYYY-MM-DD HH:MM"
+size_t schedule_format_minute(uint32_t minute, char *buf, size_t size);
+
+// Replace all the entries, false if one is not valid. They are saved by the
+// next schedule_loop().
+bool schedule_replace(const ScheduleEntry *entries, uint8_t count);
+uint8_t schedule_count();
+const ScheduleEntry &schedule_entry(uint8_t i);
+// Local minute of the next run, 0 if there is none (past one-shot, no clock)
+uint32_t schedule_next(uint8_t i);
+// Current local minute, 0 until NTP has set the clock
+uint32_t schedule_now();
+uint32_t schedule_fired();
@@ -0,0 +1,151 @@
+#include "session_auth.h"
+#include <bearssl/bearssl.h>
+
+#define SESSION_MAC_LEN 8
+
+struct Session {
+  uint32_t id;        // 0: free slot
+  uint32_t issued;
+  uint32_t last_used;
+};
+
+static Session sessions[SESSION_SLOTS];
+static uint8_t secret[32];
+static uint32_t ttl = 0;
+
+static uint32_t hits = 0;
+static uint32_t misses = 0;
+static uint32_t evictions = 0;
+
+void session_begin(uint32_t ttl_ms) {
+  ttl = ttl_ms;
+  ESP.random(secret, sizeof(secret));
+  memset(sessions, 0, sizeof(sessions));
+}
+
+static void session_mac(uint32_t id, uint32_t issued, uint8_t *mac) {
+  uint8_t msg[8];
+  memcpy(msg, &id, 4);
+  memcpy(msg + 4, &issued, 4);
+  br_hmac_key_context kc;
+  br_hmac_context ctx;
+  br_hmac_key_init(&kc, &br_sha256_vtable, secret, sizeof(secret));
+  br_hmac_init(&ctx, &kc, SESSION_MAC_LEN);
+  br_hmac_update(&ctx, msg, sizeof(msg));
+  br_hmac_out(&ctx, mac);
+}
+
+static bool expired(const Session &s) {
+  return millis() - s.issued >= ttl;
+}
+
+void session_issue(char *token) {
+  // Free or expired slot first, else the least recently used one
+  Session *slot = &sessions[0];
+  for (uint8_t i = 0; i < SESSION_SLOTS; i++) {
+    if (sessions[i].id == 0 || expired(sessions[i])) {
+      slot = &sessions[i];
+      break;
+    }
+    if (millis() - sessions[i].last_used > millis() - slot->last_used) {
+      slot = &sessions[i];
+    }
+  }
+  if (slot->id && !expired(*slot)) {
+    evictions++;
+  }
+  do {
+    slot->id = ESP.random();
+  } while (slot->id == 0);
+  slot->issued = millis();
+  slot->last_used = slot->issued;
+
+  uint8_t mac[SESSION_MAC_LEN];
+  session_mac(slot->id, slot->issued, mac);
+  int len = snprintf(token, SESSION_TOKEN_LEN + 1, "%08lx%08lx",
+                     (unsigned long)slot->id, (unsigned long)slot->issued);
+  for (uint8_t i = 0; i < SESSION_MAC_LEN; i++) {
+    len += snprintf(token + len, SESSION_TOKEN_LEN + 1 - len, "%02x", mac[i]);
+  }
+}
+
+static bool parse_hex(const char *s, uint8_t digits, uint32_t *out) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < digits; i++) {
+    char c = s[i];
+    uint8_t d;
+    if (c >= '0' && c <= '9') {
+      d = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      d = c - 'a' + 10;
+    } else {
+      return false;
+    }
+    v = (v << 4) | d;
+  }
+  *out = v;
+  return true;
+}
+
+static bool session_valid(const char *token) {
+  uint32_t id, issued;
+  if (!parse_hex(token, 8, &id) || !parse_hex(token + 8, 8, &issued) || id == 0) {
+    return false;
+  }
+  Session *slot = NULL;
+  for (uint8_t i = 0; i < SESSION_SLOTS; i++) {
+    if (sessions[i].id == id && sessions[i].issued == issued) {
+      slot = &sessions[i];
+      break;
+    }
+  }
+  if (slot == NULL || expired(*slot)) {
+    return false;
+  }
+  uint8_t mac[SESSION_MAC_LEN];
+  session_mac(id, issued, mac);
+  // Constant time: always look at every byte
+  uint8_t diff = 0;
+  for (uint8_t i = 0; i < SESSION_MAC_LEN; i++) {
+    uint32_t b;
+    if (!parse_hex(token + 16 + 2 * i, 2, &b)) {
+      return false;
+    }
+    diff |= mac[i] ^ (uint8_t)b;
+  }
+  if (diff) {
+    return false;
+  }
+  slot->last_used = millis();
+  return true;
+}
+
+bool session_check_cookie(const String &cookie) {
+  // Cookie: a=b; GREESID=<token>; c=d
+  const char *p = strstr(cookie.c_str(), SESSION_COOKIE "=");
+  if (p && (p == cookie.c_str() || p[-1] == ' ' || p[-1] == ';')) {
+    p += sizeof(SESSION_COOKIE);
+    if (strnlen(p, SESSION_TOKEN_LEN) == SESSION_TOKEN_LEN && session_valid(p)) {
+      hits++;
+      return true;
+    }
+  }
+  misses++;
+  return false;
+}
+
+uint32_t session_ttl_ms() {
+  return ttl;
+}
+
+uint32_t session_hits() {
+  return hits;
+}
+
+uint32_t session_misses() {
+  return misses;
+}
+
+uint32_t session_evictions() {
+  return evictions;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+
+// Session tokens handed out after a successful Digest login.
+//
+// A token is "<id><issued><mac>" in hex: a random slot id, the millis() it was
+// issued at and the first 8 bytes of HMAC-SHA256(boot secret, id|issued).
+// Live tokens are kept in a SESSION_SLOTS table, the least recently used one
+// is evicted when it is full. Validation is a table lookup, an expiry check
+// and a constant-time compare of the MAC, instead of nonce handling and MD5
+// on every request. The secret changes on every boot, which drops all
+// sessions.
+
+#define SESSION_SLOTS 8
+#define SESSION_TOKEN_LEN 32
+#define SESSION_COOKIE "GREESID"
+
+void session_begin(uint32_t ttl_ms);
+// Writes a new token (SESSION_TOKEN_LEN chars + NUL) into token
+void session_issue(char *token);
+// Check the token found in a Cookie header value, counts hits and misses
+bool session_check_cookie(const String &cookie);
+
+uint32_t session_ttl_ms();
+uint32_t session_hits();
+uint32_t session_misses();
+uint32_t session_evictions();
@@ -0,0 +1,173 @@
+#include "state_journal.h"
+#include <flash_hal.h>
+
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_SLOTS_PER_SECTOR (JOURNAL_SECTOR_SIZE / JOURNAL_RECORD_SIZE)
+#define JOURNAL_SLOTS (JOURNAL_SECTORS * JOURNAL_SLOTS_PER_SECTOR)
+#define JOURNAL_BLANK_SEQ 0xFFFFFFFFUL
+
+union JournalRecord {
+  struct {
+    uint32_t seq;
+    uint8_t payload[JOURNAL_PAYLOAD];
+    uint16_t crc;
+  } r;
+  uint32_t words[JOURNAL_RECORD_SIZE / 4];
+};
+
+static uint32_t journal_base = 0;   // flash offset of the first sector
+static bool journal_ok = false;
+static uint32_t debounce = 0;
+
+static uint32_t next_seq = 0;
+static uint16_t next_slot = 0;
+static bool have_record = false;
+static uint8_t committed[JOURNAL_PAYLOAD];
+
+static uint8_t pending[JOURNAL_PAYLOAD];
+static bool dirty = false;
+static uint32_t changed_at = 0;
+
+static uint32_t notes = 0;
+static uint32_t records_written = 0;
+static uint32_t sectors_erased = 0;
+
+// CRC-16/CCITT-FALSE, seeded with the record format
+static uint16_t crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF ^ JOURNAL_FORMAT;
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t record_crc(const JournalRecord &rec) {
+  return crc16((const uint8_t *)&rec.r, 4 + JOURNAL_PAYLOAD);
+}
+
+static uint32_t slot_addr(uint16_t slot) {
+  return journal_base + (uint32_t)slot * JOURNAL_RECORD_SIZE
+         + (slot / JOURNAL_SLOTS_PER_SECTOR) * (JOURNAL_SECTOR_SIZE % JOURNAL_RECORD_SIZE);
+}
+
+static bool read_slot(uint16_t slot, JournalRecord &rec) {
+  return ESP.flashRead(slot_addr(slot), rec.words, sizeof(rec.words));
+}
+
+static bool slot_blank(const JournalRecord &rec) {
+  for (uint8_t i = 0; i < sizeof(rec.words) / 4; i++) {
+    if (rec.words[i] != 0xFFFFFFFFUL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool journal_begin(uint32_t debounce_ms) {
+  debounce = debounce_ms;
+  if (FS_PHYS_SIZE < JOURNAL_SECTORS * JOURNAL_SECTOR_SIZE) {
+    journal_ok = false;
+    return false;
+  }
+  journal_base = FS_PHYS_ADDR + FS_PHYS_SIZE - JOURNAL_SECTORS * JOURNAL_SECTOR_SIZE;
+  journal_ok = true;
+
+  // Find the newest valid record
+  JournalRecord rec;
+  int32_t newest = -1;
+  uint32_t newest_seq = 0;
+  for (uint16_t slot = 0; slot < JOURNAL_SLOTS; slot++) {
+    if (!read_slot(slot, rec) || rec.r.seq == JOURNAL_BLANK_SEQ) {
+      continue;
+    }
+    if (rec.r.crc != record_crc(rec)) {
+      continue;
+    }
+    if (newest < 0 || rec.r.seq > newest_seq) {
+      newest = slot;
+      newest_seq = rec.r.seq;
+      memcpy(committed, rec.r.payload, JOURNAL_PAYLOAD);
+    }
+  }
+  have_record = newest >= 0;
+  next_seq = have_record ? newest_seq + 1 : 0;
+  next_slot = have_record ? (newest + 1) % JOURNAL_SLOTS : 0;
+  return true;
+}
+
+bool journal_load(uint8_t *data) {
+  if (!have_record) {
+    return false;
+  }
+  memcpy(data, committed, JOURNAL_PAYLOAD);
+  return true;
+}
+
+void journal_note(const uint8_t *data) {
+  notes++;
+  memcpy(pending, data, JOURNAL_PAYLOAD);
+  dirty = true;
+  changed_at = millis();
+}
+
+static void write_record(const uint8_t *data) {
+  JournalRecord rec;
+  // Skip slots that are not blank (torn writes after a reset), a new sector
+  // is always erased before its first record.
+  for (;;) {
+    if (next_slot % JOURNAL_SLOTS_PER_SECTOR == 0) {
+      uint32_t sector = slot_addr(next_slot) / JOURNAL_SECTOR_SIZE;
+      ESP.flashEraseSector(sector);
+      sectors_erased++;
+      break;
+    }
+    if (read_slot(next_slot, rec) && slot_blank(rec)) {
+      break;
+    }
+    next_slot = (next_slot + 1) % JOURNAL_SLOTS;
+  }
+
+  memset(rec.words, 0xFF, sizeof(rec.words));
+  rec.r.seq = next_seq;
+  memcpy(rec.r.payload, data, JOURNAL_PAYLOAD);
+  rec.r.crc = record_crc(rec);
+  ESP.flashWrite(slot_addr(next_slot), rec.words, sizeof(rec.words));
+
+  records_written++;
+  next_seq++;
+  next_slot = (next_slot + 1) % JOURNAL_SLOTS;
+  memcpy(committed, data, JOURNAL_PAYLOAD);
+  have_record = true;
+}
+
+void journal_flush() {
+  if (!dirty || !journal_ok) {
+    return;
+  }
+  dirty = false;
+  if (have_record && memcmp(pending, committed, JOURNAL_PAYLOAD) == 0) {
+    return;
+  }
+  write_record(pending);
+}
+
+void journal_loop() {
+  if (dirty && millis() - changed_at >= debounce) {
+    journal_flush();
+  }
+}
+
+uint32_t journal_records_written() {
+  return records_written;
+}
+
+uint32_t journal_writes_avoided() {
+  return notes > records_written ? notes - records_written : 0;
+}
+
+uint32_t journal_sectors_erased() {
+  return sectors_erased;
+}
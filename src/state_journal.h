@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include "ac_state.h"
+
+// Log-structured, wear-leveled journal for state[] (all zones in one record).
+//
+// Records are appended to a ring of JOURNAL_SECTORS flash sectors taken from
+// the end of the (unused) FS area, so a sector is erased once every
+// 4096/JOURNAL_RECORD_SIZE writes instead of on every EEPROM.commit().
+// Each record carries a sequence number and a CRC; on boot the newest valid
+// record wins, torn or blank slots are skipped.
+//
+// journal_note() only marks the state dirty: it is written by journal_loop()
+// once it has been stable for the debounce window, and only if it differs
+// from the last record.
+
+#define JOURNAL_SECTORS 4
+// Bit-packed state of every zone (see CMD_FIELDS)
+#define JOURNAL_PAYLOAD (CMD_PACKED_BYTES * ZONE_COUNT)
+// Seeds the record CRC, bump it when the payload layout changes so records
+// of an older layout are ignored instead of misread
+#define JOURNAL_FORMAT 2
+// seq(4) + payload + crc16(2), padded to the 4 bytes flash write granularity
+#define JOURNAL_RECORD_SIZE ((4 + JOURNAL_PAYLOAD + 2 + 3) & ~3)
+
+// Scan the journal, false if there is no room for it in this flash layout
+bool journal_begin(uint32_t debounce_ms);
+// Newest valid record, false if the journal is empty
+bool journal_load(uint8_t *data);
+// Record a new state, written later by journal_loop()
+void journal_note(const uint8_t *data);
+// Call from loop()
+void journal_loop();
+// Write a dirty state now, ignoring the debounce window
+void journal_flush();
+
+uint32_t journal_records_written();
+// journal_note() calls that did not turn into a flash write
+uint32_t journal_writes_avoided();
+uint32_t journal_sectors_erased();
@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include "status_frame.h"
+#include "dht_sampler.h"
+#include "ir_queue.h"
+
+static const uint8_t *status_state = NULL;
+static uint32_t boot_id = 0;
+static uint32_t version = 0;
+// Versioned part of the last frame
+static uint8_t last_body[STATUS_FRAME_SIZE - STATUS_HEADER_SIZE];
+
+void status_begin(const uint8_t *state) {
+  status_state = state;
+  boot_id = ESP.random();
+}
+
+static void put_u16(uint8_t *buf, uint16_t v) {
+  buf[0] = v;
+  buf[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *buf, uint32_t v) {
+  put_u16(buf, v);
+  put_u16(buf + 2, v >> 16);
+}
+
+static int16_t centi(float v) {
+  return (int16_t)lroundf(v * 100);
+}
+
+uint32_t status_frame(uint8_t *buf) {
+  const DhtReading &room = dht_filtered();
+  buf[0] = STATUS_FORMAT;
+  buf[1] = ZONE_COUNT;
+  put_u16(buf + STATUS_TEMP_OFFSET, room.valid ? centi(room.temperature) : STATUS_NO_READING);
+  put_u16(buf + STATUS_HUMIDITY_OFFSET, room.valid ? (uint16_t)centi(room.humidity) : 0xffff);
+  buf[STATUS_TX_OFFSET] = ir_queue_depth();
+  put_u32(buf + STATUS_TX_OFFSET + 1, ir_queue_last_id());
+  put_u32(buf + STATUS_TX_OFFSET + 5, ir_queue_done_id());
+  uint8_t *zone = buf + STATUS_ZONES_OFFSET;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    cmd_pack(status_state + z * CMD_PARAMS, zone);
+    zone[CMD_PACKED_BYTES] = ir_queue_zone_status(z);
+    zone += CMD_PACKED_BYTES + 1;
+  }
+  if (version == 0 || memcmp(last_body, buf + STATUS_HEADER_SIZE, sizeof(last_body)) != 0) {
+    memcpy(last_body, buf + STATUS_HEADER_SIZE, sizeof(last_body));
+    version++;
+  }
+  put_u32(buf + STATUS_VERSION_OFFSET, version);
+  put_u32(buf + STATUS_UPTIME_OFFSET, millis() / 1000);
+  return version;
+}
+
+void status_etag(uint32_t version, char *buf, size_t size) {
+  snprintf(buf, size, "\"%08lx-%lu\"", (unsigned long)boot_id, (unsigned long)version);
+}
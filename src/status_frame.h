@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ac_state.h"
+
+// Fixed-layout binary status (GET /status), for monitors polling many nodes.
+//
+// All fields little endian:
+//   0  u8   STATUS_FORMAT
+//   1  u8   ZONE_COUNT
+//   2  u32  version, bumped whenever a field from offset 10 on changes
+//   6  u32  uptime, seconds
+//   10 i16  temperature, 0.01 C, STATUS_NO_READING until the first DHT read
+//   12 u16  humidity, 0.01 %, 0xffff until the first DHT read
+//   14 u8   IR queue depth
+//   15 u32  last tx id
+//   19 u32  done tx id
+//   23 per zone: state[] packed (CMD_PACKED_BYTES, see CMD_FIELDS), then
+//      u8 IrTxStatus of the zone
+// 27 bytes with one zone. Built on the stack, no allocation.
+// Also carried by the UDP announcements (announce.h); no Arduino
+// dependency, the host tools decode it with the offsets below.
+// The version is recomputed on each call by comparing with the last frame,
+// it restarts at 1 on boot (the ETag also carries a per-boot id).
+
+#define STATUS_FORMAT 1
+#define STATUS_VERSION_OFFSET 2
+#define STATUS_UPTIME_OFFSET 6
+#define STATUS_HEADER_SIZE 10
+#define STATUS_TEMP_OFFSET 10
+#define STATUS_HUMIDITY_OFFSET 12
+#define STATUS_TX_OFFSET 14
+#define STATUS_ZONES_OFFSET 23
+#define STATUS_FRAME_BYTES(zones) (STATUS_ZONES_OFFSET + (zones) * (CMD_PACKED_BYTES + 1))
+#define STATUS_FRAME_SIZE STATUS_FRAME_BYTES(ZONE_COUNT)
+#define STATUS_NO_READING (-32768)
+
+// state: state[ZONE_COUNT][CMD_PARAMS]
+void status_begin(const uint8_t *state);
+// Writes the frame (STATUS_FRAME_SIZE bytes), returns its version
+uint32_t status_frame(uint8_t *buf);
+// Quoted ETag of a version, e.g. "5e2a91c0-12"
+void status_etag(uint32_t version, char *buf, size_t size);
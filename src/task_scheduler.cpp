@@ -0,0 +1,69 @@
+#include "task_scheduler.h"
+#include <stddef.h>
+
+struct Task {
+  TaskFn run;
+  uint32_t last_us;     // start of the last run
+  bool ran;
+  TaskStats stats;
+};
+
+static Task tasks[TASK_MAX];
+static uint8_t count = 0;
+static TaskClockFn clock_fn = NULL;
+static TaskYieldFn yield_fn = NULL;
+
+void tasks_begin(TaskClockFn clock_us, TaskYieldFn yield) {
+  clock_fn = clock_us;
+  yield_fn = yield;
+  count = 0;
+}
+
+int8_t task_add(const char *name, TaskFn run, uint32_t period_ms, uint32_t budget_us) {
+  if (count == TASK_MAX) {
+    return -1;
+  }
+  Task &t = tasks[count];
+  t.run = run;
+  t.last_us = 0;
+  t.ran = false;
+  t.stats = TaskStats();
+  t.stats.name = name;
+  t.stats.period_us = period_ms * 1000;
+  t.stats.budget_us = budget_us;
+  return count++;
+}
+
+void tasks_run() {
+  for (uint8_t i = 0; i < count; i++) {
+    Task &t = tasks[i];
+    uint32_t start = clock_fn();
+    if (t.ran && start - t.last_us < t.stats.period_us) {
+      continue;
+    }
+    // A late task runs once, it does not catch up on the periods it missed
+    t.ran = true;
+    t.last_us = start;
+    t.run();
+    uint32_t us = clock_fn() - start;
+    t.stats.runs++;
+    t.stats.total_us += us;
+    if (us > t.stats.wcet_us) {
+      t.stats.wcet_us = us;
+    }
+    if (us > t.stats.budget_us) {
+      t.stats.overruns++;
+    }
+    if (yield_fn) {
+      yield_fn();
+    }
+  }
+}
+
+uint8_t task_count() {
+  return count;
+}
+
+const TaskStats &task_stats(uint8_t i) {
+  return tasks[i].stats;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+// Cooperative scheduler for loop(): a fixed table of periodic tasks.
+//
+// Each task declares a period and a time budget. tasks_run() makes one
+// pass over the table, runs the tasks that are due and yields after each
+// one, so the watchdog is fed and the network stack (and with it the web
+// server callbacks) runs between tasks. A run longer than its budget is
+// counted as an overrun; runs, total and worst-case execution time are
+// kept per task (see /metrics).
+//
+// The clock and the yield are passed in, no allocation and no Arduino
+// dependency, so it can be built on a host with a simulated clock.
+
+#define TASK_MAX 12
+
+typedef void (*TaskFn)();
+// Microseconds, free running (wraps)
+typedef uint32_t (*TaskClockFn)();
+typedef void (*TaskYieldFn)();
+
+struct TaskStats {
+  const char *name;
+  uint32_t period_us;   // 0: every pass
+  uint32_t budget_us;
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t wcet_us;     // longest run
+  uint64_t total_us;
+};
+
+void tasks_begin(TaskClockFn clock_us, TaskYieldFn yield);
+// Index of the task, -1 if the table is full. Tasks run in the order added.
+int8_t task_add(const char *name, TaskFn run, uint32_t period_ms, uint32_t budget_us);
+// Call from loop()
+void tasks_run();
+
+uint8_t task_count();
+const TaskStats &task_stats(uint8_t i);
@@ -0,0 +1,202 @@
+#include "thermostat.h"
+#include <EEPROM.h>
+#include <ir_Gree.h>
+#include <math.h>
+#include "eeprom_layout.h"
+#include "dht_sampler.h"
+#include "log.h"
+
+#define THERMOSTAT_MAGIC 0x4754
+
+struct ThermostatRecord {
+  uint16_t magic;
+  uint16_t size;
+  ThermostatConfig config;
+};
+static_assert(EEPROM_THERMOSTAT + sizeof(ThermostatRecord) <= EEPROM_WIFI,
+              "thermostat does not fit its EEPROM area");
+
+static const char *const mode_names[] = {"off", "hysteresis", "pi"};
+
+static ThermostatConfig cfg = {THERMOSTAT_OFF, 0, 0, 24.0, 0.5, 1.0, 0.1, 300000UL};
+static const uint8_t *zone_states = NULL;
+static ThermostatApplyFn apply_cb = NULL;
+
+// Written by thermostat_loop(), not from the web server callbacks
+static bool dirty = false;
+static const char *status = "off";
+static bool ran = false;
+static uint32_t last_run = 0;
+static float room = NAN;
+static float error = 0;
+static float integral = 0;
+static uint8_t setpoint = 0;
+static uint32_t commands = 0;
+
+static bool config_valid(const ThermostatConfig &c) {
+  return c.mode <= THERMOSTAT_PI && c.zone < ZONE_COUNT && c.drive_fan <= 1 &&
+         c.target >= CMD_FIELDS[CMD_TEMP].min && c.target <= CMD_FIELDS[CMD_TEMP].max &&
+         c.band >= 0.1 && c.band <= 5 && c.kp >= 0 && c.kp <= 10 && c.ki >= 0 && c.ki <= 1 &&
+         c.interval_ms >= THERMOSTAT_MIN_INTERVAL_MS && c.interval_ms <= 3600000UL;
+}
+
+static void reset() {
+  status = cfg.mode == THERMOSTAT_OFF ? "off" : "idle";
+  ran = false;
+  error = 0;
+  integral = 0;
+  setpoint = 0;
+}
+
+void thermostat_begin(const uint8_t *states, ThermostatApplyFn apply) {
+  zone_states = states;
+  apply_cb = apply;
+  ThermostatRecord record;
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.get(EEPROM_THERMOSTAT, record);
+  EEPROM.end();
+  if (record.magic == THERMOSTAT_MAGIC && record.size == sizeof(record) && config_valid(record.config)) {
+    cfg = record.config;
+  }
+  reset();
+  LOG_INFO("thermostat: %s, target %.1f", mode_names[cfg.mode], cfg.target);
+}
+
+bool thermostat_configure(const ThermostatConfig &config) {
+  if (!config_valid(config)) {
+    return false;
+  }
+  cfg = config;
+  reset();
+  dirty = true;
+  return true;
+}
+
+static void save() {
+  ThermostatRecord record = {THERMOSTAT_MAGIC, sizeof(record), cfg};
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.put(EEPROM_THERMOSTAT, record);
+  if (!EEPROM.commit()) {
+    LOG_ERROR("thermostat: config not saved");
+  }
+  EEPROM.end();
+}
+
+// Fan speed from the demand (degrees the AC still has to move the room in
+// its mode), 0 (auto) when close or past the target
+static uint8_t fan_for(uint8_t ac_mode, float e) {
+  float demand = ac_mode == kGreeCool ? -e : e;
+  return demand >= 2 ? 3 : demand >= 1 ? 2 : demand >= 0.5 ? 1 : 0;
+}
+
+void thermostat_loop() {
+  if (dirty) {
+    dirty = false;
+    save();
+  }
+  if (cfg.mode == THERMOSTAT_OFF || (ran && millis() - last_run < cfg.interval_ms)) {
+    return;
+  }
+  uint32_t dt_ms = ran ? millis() - last_run : 0;
+  ran = true;
+  last_run = millis();
+
+  const uint8_t *zone = zone_states + cfg.zone * CMD_PARAMS;
+  const DhtReading &reading = dht_filtered();
+  bool active = false;
+  if (zone[CMD_ON_OFF] != 1) {
+    status = "ac off";
+  } else if (zone[CMD_MODE] != kGreeCool && zone[CMD_MODE] != kGreeHeat) {
+    status = "ac mode";
+  } else if (!reading.valid || millis() - reading.at_ms > THERMOSTAT_STALE_MS) {
+    status = "no reading";
+  } else {
+    status = "active";
+    active = true;
+  }
+  if (!active) {
+    // Start over once it can run again
+    integral = 0;
+    return;
+  }
+
+  room = reading.temperature;
+  error = cfg.target - room;
+  const uint8_t lo = CMD_FIELDS[CMD_TEMP].min;
+  const uint8_t hi = CMD_FIELDS[CMD_TEMP].max;
+  int16_t next = zone[CMD_TEMP];
+  if (cfg.mode == THERMOSTAT_HYSTERESIS) {
+    if (error > cfg.band) {
+      next++;
+    } else if (error < -cfg.band) {
+      next--;
+    }
+  } else {
+    float out = cfg.target + cfg.kp * error + integral;
+    // Anti windup: stop integrating towards a limit already reached
+    bool saturated = (out >= hi && error > 0) || (out <= lo && error < 0);
+    if (!saturated) {
+      integral += cfg.ki * error * dt_ms / 60000.0f;
+    }
+    next = lroundf(cfg.target + cfg.kp * error + integral);
+  }
+  setpoint = next < lo ? lo : next > hi ? hi : next;
+
+  uint8_t cmd[CMD_PARAMS];
+  cmd[CMD_TEMP] = setpoint;
+  cmd[CMD_FAN] = fan_for(zone[CMD_MODE], error);
+  uint16_t fields = 1 << CMD_TEMP;
+  if (cfg.drive_fan) {
+    fields |= 1 << CMD_FAN;
+  }
+  if (setpoint != zone[CMD_TEMP] || (cfg.drive_fan && cmd[CMD_FAN] != zone[CMD_FAN])) {
+    commands++;
+    LOG_INFO("thermostat: room %.1f target %.1f -> setpoint %u", room, cfg.target, setpoint);
+    apply_cb(1UL << cfg.zone, cmd, fields);
+  }
+}
+
+const ThermostatConfig &thermostat_config() {
+  return cfg;
+}
+
+const char *thermostat_mode_name(uint8_t mode) {
+  return mode <= THERMOSTAT_PI ? mode_names[mode] : "?";
+}
+
+int8_t thermostat_mode_index(const char *name) {
+  for (uint8_t i = 0; i <= THERMOSTAT_PI; i++) {
+    if (strcmp(name, mode_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char *thermostat_status() {
+  return status;
+}
+
+float thermostat_room() {
+  return room;
+}
+
+float thermostat_error() {
+  return error;
+}
+
+float thermostat_integral() {
+  return integral;
+}
+
+uint8_t thermostat_setpoint() {
+  return setpoint;
+}
+
+uint32_t thermostat_last_run_ms() {
+  return last_run;
+}
+
+uint32_t thermostat_commands() {
+  return commands;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+#include "ac_state.h"
+
+// Closed-loop thermostat: corrects the setpoint (and optionally the fan) of
+// one zone from the filtered DHT11 room temperature, so the room reaches the
+// target instead of what the AC's own sensor believes.
+//
+// Runs from thermostat_loop() once per interval, and only while the zone is
+// on in cool or heat mode with a fresh reading. With e = target - room:
+//  - hysteresis: outside target +/- band the setpoint moves one degree
+//    towards correcting e per interval, inside it is left alone
+//  - pi: setpoint = target + kp*e + integral, integral += ki*e per minute,
+//    not integrated further while the setpoint is clamped (anti windup)
+// The same sign works in both AC modes. The fan follows the demand of the
+// mode (room - target when cooling, target - room when heating) and drops
+// to auto once the room is at or past the target. Changes go through the
+// /acremote path (partial update of temp/fan), so an unchanged setpoint
+// sends nothing and at most one command is sent per interval.
+
+enum ThermostatMode {
+  THERMOSTAT_OFF = 0,
+  THERMOSTAT_HYSTERESIS,
+  THERMOSTAT_PI
+};
+
+// Tunables, saved in EEPROM after thermostat_configure()
+struct ThermostatConfig {
+  uint8_t mode;         // ThermostatMode
+  uint8_t zone;
+  uint8_t drive_fan;    // also set the fan speed from the demand
+  float target;         // room temperature wanted (C)
+  float band;           // hysteresis half width (C)
+  float kp;             // setpoint degrees per degree of error
+  float ki;             // setpoint degrees per degree of error per minute
+  uint32_t interval_ms; // minimum time between two evaluations/commands
+};
+
+#define THERMOSTAT_MIN_INTERVAL_MS 60000UL
+// Readings older than this are not used
+#define THERMOSTAT_STALE_MS 60000UL
+
+// Apply the temp/fan fields set in `fields` to the zones in the mask
+typedef void (*ThermostatApplyFn)(uint32_t zones, const uint8_t *cmd, uint16_t fields);
+
+// states: state[ZONE_COUNT][CMD_PARAMS] of main.cpp, read only
+void thermostat_begin(const uint8_t *states, ThermostatApplyFn apply);
+// Call from loop()
+void thermostat_loop();
+
+const ThermostatConfig &thermostat_config();
+// Validate and apply new tunables (controller state is reset), saved by the
+// next thermostat_loop()
+bool thermostat_configure(const ThermostatConfig &config);
+const char *thermostat_mode_name(uint8_t mode);
+// Mode by name, -1 if unknown
+int8_t thermostat_mode_index(const char *name);
+
+// Controller state, for the API
+const char *thermostat_status();   // "off", "idle", "active", "ac off", "ac mode", "no reading"
+float thermostat_room();
+float thermostat_error();
+float thermostat_integral();
+uint8_t thermostat_setpoint();
+uint32_t thermostat_last_run_ms();
+uint32_t thermostat_commands();
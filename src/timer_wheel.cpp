@@ -0,0 +1,108 @@
+#include "timer_wheel.h"
+#include <string.h>
+#include <stddef.h>
+
+#define WHEEL_NONE 0xFF
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_SPAN(level) (1UL << (WHEEL_BITS * ((level) + 1)))
+
+static uint8_t heads[WHEEL_LEVELS][WHEEL_SLOTS];
+// Doubly linked slot lists, so a timer can be removed without a search
+static uint8_t next_id[WHEEL_TIMERS];
+static uint8_t prev_id[WHEEL_TIMERS];
+static uint8_t *slot_of[WHEEL_TIMERS];   // list head, NULL if not armed
+static uint32_t expiry[WHEEL_TIMERS];
+static uint32_t cur = 0;
+
+static void link(uint8_t id) {
+  uint32_t at = expiry[id] < cur ? cur : expiry[id];
+  uint32_t delta = at - cur;
+  uint8_t level = 0;
+  while (level < WHEEL_LEVELS - 1 && delta >= WHEEL_SPAN(level)) {
+    level++;
+  }
+  if (delta >= WHEEL_SPAN(level)) {
+    // Beyond the wheel: park in the farthest slot of the last level
+    at = cur + WHEEL_SPAN(level) - 1;
+  }
+  uint8_t *head = &heads[level][(at >> (WHEEL_BITS * level)) & WHEEL_MASK];
+  prev_id[id] = WHEEL_NONE;
+  next_id[id] = *head;
+  if (*head != WHEEL_NONE) {
+    prev_id[*head] = id;
+  }
+  *head = id;
+  slot_of[id] = head;
+}
+
+void wheel_remove(uint8_t id) {
+  if (!slot_of[id]) {
+    return;
+  }
+  if (prev_id[id] != WHEEL_NONE) {
+    next_id[prev_id[id]] = next_id[id];
+  } else {
+    *slot_of[id] = next_id[id];
+  }
+  if (next_id[id] != WHEEL_NONE) {
+    prev_id[next_id[id]] = prev_id[id];
+  }
+  slot_of[id] = NULL;
+}
+
+void wheel_reset(uint32_t minute) {
+  memset(heads, WHEEL_NONE, sizeof(heads));
+  for (uint8_t id = 0; id < WHEEL_TIMERS; id++) {
+    slot_of[id] = NULL;
+  }
+  cur = minute;
+}
+
+void wheel_add(uint8_t id, uint32_t at) {
+  wheel_remove(id);
+  expiry[id] = at;
+  link(id);
+}
+
+bool wheel_armed(uint8_t id) {
+  return slot_of[id] != NULL;
+}
+
+uint32_t wheel_expiry(uint8_t id) {
+  return expiry[id];
+}
+
+// Move the timers of a slot of an upper level down to where they belong now
+static void cascade(uint8_t level, uint8_t slot) {
+  uint8_t id = heads[level][slot];
+  heads[level][slot] = WHEEL_NONE;
+  while (id != WHEEL_NONE) {
+    uint8_t next = next_id[id];
+    link(id);
+    id = next;
+  }
+}
+
+void wheel_advance(uint32_t minute, WheelFireFn fire) {
+  while ((int32_t)(minute - cur) >= 0) {
+    uint8_t slot = cur & WHEEL_MASK;
+    for (uint8_t level = 1; level < WHEEL_LEVELS && slot == 0; level++) {
+      slot = (cur >> (WHEEL_BITS * level)) & WHEEL_MASK;
+      cascade(level, slot);
+    }
+    // Detach the due list first, fire() may re-arm into the same slot
+    uint8_t id = heads[0][cur & WHEEL_MASK];
+    heads[0][cur & WHEEL_MASK] = WHEEL_NONE;
+    uint32_t now = cur++;
+    while (id != WHEEL_NONE) {
+      uint8_t next = next_id[id];
+      slot_of[id] = NULL;
+      fire(id, now);
+      id = next;
+    }
+  }
+}
+
+uint32_t wheel_now() {
+  return cur;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+// Hierarchical timer wheel with minute ticks, for the schedule.
+//
+// WHEEL_LEVELS levels of WHEEL_SLOTS slots: level 0 holds the timers due in
+// the next 64 minutes, one slot per minute, level 1 the next 64*64 minutes
+// (~2.8 days), level 2 the next 64^3 (~182 days). Add, remove and the work
+// done per tick do not depend on the number of timers; a timer moves down a
+// level at most twice before it fires. Timers further away than the last
+// level are parked in it and placed again when their slot comes around.
+//
+// Timers are the ids 0..WHEEL_TIMERS-1, linked in place, no allocation.
+// Times are plain minute counts, the caller picks the epoch.
+// No Arduino dependency, so it can be built on a host.
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3
+#define WHEEL_TIMERS 32
+
+typedef void (*WheelFireFn)(uint8_t id, uint32_t minute);
+
+// Drop all timers, the next tick processed is `minute`
+void wheel_reset(uint32_t minute);
+// (Re)arm a timer, a time already past fires on the next tick
+void wheel_add(uint8_t id, uint32_t at);
+void wheel_remove(uint8_t id);
+bool wheel_armed(uint8_t id);
+uint32_t wheel_expiry(uint8_t id);
+// Process every tick up to and including `minute`, fire() is called for
+// each expired timer (it can re-arm it)
+void wheel_advance(uint32_t minute, WheelFireFn fire);
+// Next tick to be processed
+uint32_t wheel_now();
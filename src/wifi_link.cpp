@@ -0,0 +1,160 @@
+#include "wifi_link.h"
+#include <ESP8266WiFi.h>
+#include <EEPROM.h>
+#include "eeprom_layout.h"
+#include "log.h"
+
+#define WIFI_CACHE_MAGIC 0x57464332UL   // "WFC2"
+// RTC user memory offset, in 4 byte blocks
+#define WIFI_RTC_BLOCK 0
+
+struct WifiCache {
+  uint32_t magic;
+  uint32_t ssid_hash;   // the cache is for this SSID only
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t pad;
+  uint32_t check;       // hash of the fields above
+};
+static_assert(sizeof(WifiCache) % 4 == 0, "RTC memory is read in 4 byte blocks");
+static_assert(EEPROM_WIFI + sizeof(WifiCache) <= EEPROM_ANNOUNCE, "WiFi cache does not fit its EEPROM area");
+
+static const char *link_ssid = NULL;
+static const char *link_password = NULL;
+static bool up = false;
+static bool trying_cache = false;
+static WifiLinkFast fast = WIFI_FAST_NONE;
+static uint32_t started = 0;
+static uint32_t connect_ms = 0;
+static uint32_t drops = 0;
+
+// FNV-1a
+static uint32_t hash(const void *data, size_t len, uint32_t h = 2166136261UL) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len--) {
+    h = (h ^ *p++) * 16777619UL;
+  }
+  return h;
+}
+
+static uint32_t cache_check(const WifiCache &c) {
+  return hash(&c, offsetof(WifiCache, check));
+}
+
+static bool cache_valid(const WifiCache &c) {
+  return c.magic == WIFI_CACHE_MAGIC && c.check == cache_check(c) && c.channel >= 1 && c.channel <= 14 &&
+         c.ssid_hash == hash(link_ssid, strlen(link_ssid));
+}
+
+static bool load_rtc(WifiCache &c) {
+  return ESP.rtcUserMemoryRead(WIFI_RTC_BLOCK, (uint32_t *)&c, sizeof(c)) && cache_valid(c);
+}
+
+static void save_rtc(WifiCache &c) {
+  ESP.rtcUserMemoryWrite(WIFI_RTC_BLOCK, (uint32_t *)&c, sizeof(c));
+}
+
+static bool load_eeprom(WifiCache &c) {
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.get(EEPROM_WIFI, c);
+  EEPROM.end();
+  return cache_valid(c);
+}
+
+// Only when the AP or channel changed
+static void save_eeprom(const WifiCache &rtc) {
+  WifiCache c;
+  bool same = load_eeprom(c) && memcmp(c.bssid, rtc.bssid, sizeof(c.bssid)) == 0 && c.channel == rtc.channel;
+  if (same) {
+    return;
+  }
+  c = rtc;
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  EEPROM.put(EEPROM_WIFI, c);
+  if (!EEPROM.commit()) {
+    LOG_ERROR("wifi: cache not saved");
+  }
+  EEPROM.end();
+}
+
+static void save_cache() {
+  WifiCache c;
+  memset(&c, 0, sizeof(c));
+  c.magic = WIFI_CACHE_MAGIC;
+  c.ssid_hash = hash(link_ssid, strlen(link_ssid));
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = WiFi.channel();
+  c.check = cache_check(c);
+  save_rtc(c);
+  save_eeprom(c);
+}
+
+static void begin_plain() {
+  // 0.0.0.0 turns DHCP back on
+  WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));
+  WiFi.begin(link_ssid, link_password);
+}
+
+void wifi_link_begin(const char *ssid, const char *password) {
+  link_ssid = ssid;
+  link_password = password;
+  // The SDK would otherwise rewrite its own copy of the config in flash
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  started = millis();
+  WifiCache c;
+  if (!load_rtc(c) && !load_eeprom(c)) {
+    fast = WIFI_FAST_NONE;
+    begin_plain();
+    return;
+  }
+  fast = WIFI_FAST_CHANNEL;
+  WiFi.begin(ssid, password, c.channel, c.bssid);
+  trying_cache = true;
+}
+
+bool wifi_link_loop() {
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected == up) {
+    if (!up && trying_cache && millis() - started >= WIFI_FAST_TIMEOUT_MS) {
+      LOG_WARN("wifi: cached AP not reachable, scanning");
+      trying_cache = false;
+      fast = WIFI_FAST_NONE;
+      WifiCache none;
+      memset(&none, 0, sizeof(none));
+      save_rtc(none);
+      WiFi.disconnect();
+      begin_plain();
+    }
+    return false;
+  }
+  up = connected;
+  if (!up) {
+    drops++;
+    LOG_WARN("wifi: link lost");
+    return false;
+  }
+  if (!connect_ms) {
+    connect_ms = millis() - started;
+  }
+  trying_cache = false;
+  save_cache();
+  return true;
+}
+
+bool wifi_link_up() {
+  return up;
+}
+
+WifiLinkFast wifi_link_fast() {
+  return fast;
+}
+
+uint32_t wifi_link_connect_ms() {
+  return connect_ms;
+}
+
+uint32_t wifi_link_drops() {
+  return drops;
+}
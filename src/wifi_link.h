@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+
+// Non-blocking WiFi association with a fast reconnect cache.
+//
+// wifi_link_begin() only starts the association, setup() goes on restoring
+// the AC and loop() runs while it completes. Once associated, the BSSID
+// and channel are cached so the next boot skips the scan:
+//  - in RTC memory, kept across resets, watchdog and OTA restarts but not
+//    power loss.
+//  - in the EEPROM sector, written only when the AP or channel changes,
+//    for the boots after a power loss.
+// The IP always comes from DHCP: a lease reused as a static address would
+// never be renewed, and the router could hand it to another host once it
+// expired.
+// If a cached attempt is not up within WIFI_FAST_TIMEOUT_MS the cache is
+// dropped and a plain scan association follows.
+
+#ifndef WIFI_FAST_TIMEOUT_MS
+#define WIFI_FAST_TIMEOUT_MS 5000
+#endif
+
+// How the current association was made
+enum WifiLinkFast {
+  WIFI_FAST_NONE = 0,   // scan + DHCP
+  WIFI_FAST_CHANNEL     // cached BSSID and channel, DHCP
+};
+
+void wifi_link_begin(const char *ssid, const char *password);
+// Call from loop(), true once each time the link comes up
+bool wifi_link_loop();
+bool wifi_link_up();
+
+WifiLinkFast wifi_link_fast();
+// millis() from wifi_link_begin() to the first link up
+uint32_t wifi_link_connect_ms();
+uint32_t wifi_link_drops();
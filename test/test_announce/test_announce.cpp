@@ -0,0 +1,140 @@
+// Announcements (announce.h) across simulated boots: the boot counter goes
+// up on every boot, resets and power losses mixed, without an EEPROM write
+// on each one, and the datagrams carry it.
+#include <unity.h>
+#include <native.h>
+#include <ESP8266WiFi.h>
+#include <EEPROM.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "announce.h"
+#include "eeprom_layout.h"
+#include "wifi_link.h"
+
+#define PORT 45710
+
+void setup();
+
+static void clear_rtc() {
+  uint32_t zero[32] = {0};
+  ESP.rtcUserMemoryWrite(0, zero, sizeof(zero));
+}
+
+static void clear_eeprom() {
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  for (uint16_t i = EEPROM_ANNOUNCE; i < EEPROM_LAYOUT_SIZE; i++) {
+    EEPROM.write(i, 0xFF);
+  }
+  EEPROM.commit();
+  EEPROM.end();
+}
+
+static uint32_t boot() {
+  announce_begin("127.0.0.1", PORT, "test", 30000);
+  return announce_boot();
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// Power loss every 9th boot, resets in between
+static void test_counter_goes_up(void) {
+  clear_rtc();
+  clear_eeprom();
+  uint32_t commits = native_eeprom_commits();
+  uint32_t last = boot();
+  uint16_t power_losses = 0;
+  for (uint16_t i = 1; i < 200; i++) {
+    if (i % 9 == 0) {
+      clear_rtc();
+      power_losses++;
+    }
+    uint32_t counter = boot();
+    TEST_ASSERT_GREATER_THAN(last, counter);
+    last = counter;
+  }
+  uint32_t writes = native_eeprom_commits() - commits;
+  printf("200 boots, %u power losses: %u EEPROM writes, last counter %u\n", power_losses, (unsigned)writes,
+         (unsigned)last);
+  // One per power loss and one per 16 resets, not one per boot
+  TEST_ASSERT_LESS_OR_EQUAL(1 + power_losses + 200 / 16 + 1, writes);
+}
+
+// Resets only: consecutive counters
+static void test_resets(void) {
+  uint32_t first = boot();
+  for (uint32_t i = 1; i <= 40; i++) {
+    TEST_ASSERT_EQUAL_UINT32(first + i, boot());
+  }
+}
+
+// The EEPROM bound lost (sector erased) while RTC memory holds the last
+// counter: it goes on from there
+static void test_eeprom_lost(void) {
+  uint32_t last = boot();
+  clear_eeprom();
+  TEST_ASSERT_EQUAL_UINT32(last + 1, boot());
+  // And the bound is written again for the next power loss
+  clear_rtc();
+  TEST_ASSERT_GREATER_THAN(last + 1, boot());
+}
+
+// Disabled announcements do not touch the counter or the EEPROM
+static void test_disabled(void) {
+  uint32_t last = boot();
+  uint32_t commits = native_eeprom_commits();
+  announce_begin("127.0.0.1", 0, "test", 30000);
+  clear_rtc();
+  announce_begin("not an address", PORT, "test", 30000);
+  TEST_ASSERT_EQUAL_UINT32(commits, native_eeprom_commits());
+  TEST_ASSERT_GREATER_THAN(last, boot());
+}
+
+// The datagram carries the counter, the sequence number starts from 1
+static void test_datagram(void) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(PORT);
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(fd, (sockaddr *)&local, sizeof(local)));
+  timeval timeout = {2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  TEST_ASSERT_TRUE(wifi_link_up());
+  uint32_t sent = announce_sent();
+  uint32_t counter = boot();
+  announce_loop();
+  uint8_t d[1500];
+  ssize_t len = recv(fd, d, sizeof(d), 0);
+  close(fd);
+  TEST_ASSERT_EQUAL(ANNOUNCE_BYTES(ZONE_COUNT), len);
+  TEST_ASSERT_EQUAL_MEMORY(ANNOUNCE_MAGIC, d, 4);
+  TEST_ASSERT_EQUAL_UINT32(counter, get_u32(d + ANNOUNCE_BOOT_OFFSET));
+  TEST_ASSERT_EQUAL_UINT32(1, get_u32(d + ANNOUNCE_SEQ_OFFSET));
+  TEST_ASSERT_EQUAL_UINT32(sent + 1, announce_sent());
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  {
+    NativeHeapScope firmware;
+    setup();
+    wifi_link_loop();
+  }
+  UNITY_BEGIN();
+  RUN_TEST(test_counter_goes_up);
+  RUN_TEST(test_resets);
+  RUN_TEST(test_eeprom_lost);
+  RUN_TEST(test_disabled);
+  RUN_TEST(test_datagram);
+  return UNITY_END();
+}
@@ -0,0 +1,130 @@
+// Latency, heap allocations and bytes allocated per call of the request
+// handlers, on the native build: pio test -e native -f test_bench_handlers
+//
+// The handlers run BENCH_CALLS times each through the AsyncWebServer mock,
+// from the request to the last byte of the response, with the session
+// cookie of a Digest login as the WebUI does. Allocations come from the
+// simulated heap (native.h) and follow the firmware's code paths, so they
+// are what the device does; latencies are host times, only comparable
+// between runs on the same machine. The allocation budgets fail the test
+// when a change adds heap work to one of these paths; they include the
+// mock server's own allocations (headers, params, response object), about
+// what the library does.
+#include <unity.h>
+#include <native.h>
+#include <native_session.h>
+#include <ESPAsyncWebServer.h>
+#include <chrono>
+
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 500
+#endif
+
+void loop();
+void state_check();
+
+struct BenchResult {
+  const char *name;
+  uint32_t calls;
+  double total_us;
+  double max_us;
+  uint32_t allocs;
+  uint64_t bytes;
+  uint32_t peak;      // most heap in use above the start of a call
+  int32_t retained;   // heap in use after all the calls, minus before
+};
+
+static double now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename Call>
+static BenchResult bench(const char *name, Call call) {
+  BenchResult r = {name, 0, 0, 0, 0, 0, 0, 0};
+  uint32_t used_before = native_heap_stats().used;
+  for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+    NativeHeapStats before = native_heap_stats();
+    native_heap_reset_peak();
+    double start = now_us();
+    call(i);
+    double elapsed = now_us() - start;
+    const NativeHeapStats &after = native_heap_stats();
+    r.calls++;
+    r.total_us += elapsed;
+    r.max_us = max(r.max_us, elapsed);
+    r.allocs += after.allocs - before.allocs;
+    r.bytes += after.bytes - before.bytes;
+    r.peak = max(r.peak, after.peak - before.used);
+    TEST_ASSERT_EQUAL_UINT32(before.failed, after.failed);
+  }
+  r.retained = (int32_t)native_heap_stats().used - (int32_t)used_before;
+  printf("%-16s %6u %9.1f %9.1f %12.1f %11.1f %8u %9d\n", r.name, (unsigned)r.calls, r.total_us / r.calls, r.max_us,
+         (double)r.allocs / r.calls, (double)r.bytes / r.calls, (unsigned)r.peak, (int)r.retained);
+  return r;
+}
+
+static void request(const char *method, const char *url, const char *body, int expected) {
+  NativeResponse response;
+  TEST_ASSERT_EQUAL(expected, native_session_request(method, url, body, &response));
+}
+
+// Loop runs between requests as on the device, outside the measurements
+static void run_loop() {
+  NativeHeapScope firmware;
+  loop();
+}
+
+static void test_login(void) {
+  TEST_ASSERT_TRUE(native_login());
+}
+
+static void test_handle_ac(void) {
+  BenchResult r = bench("handleAC", [](uint32_t) { request("GET", "/", NULL, 200); });
+  TEST_ASSERT_LESS_OR_EQUAL(20, r.allocs / r.calls);
+  TEST_ASSERT_LESS_OR_EQUAL(0, r.retained);
+}
+
+static void test_postacremote(void) {
+  BenchResult r = bench("postacremote", [](uint32_t i) {
+    // A different temperature each time, a repeated command is skipped
+    char body[48];
+    snprintf(body, sizeof(body), "command=1,%u,0,1,1,1,0,0,0,1", 20 + i % 8);
+    request("POST", "/acremote", body, 200);
+    run_loop();
+  });
+  TEST_ASSERT_LESS_OR_EQUAL(44, r.allocs / r.calls);
+}
+
+static void test_handle_not_found(void) {
+  BenchResult r = bench("handleNotFound", [](uint32_t) { request("GET", "/missing?a=1&b=2", NULL, 404); });
+  TEST_ASSERT_LESS_OR_EQUAL(18, r.allocs / r.calls);
+  TEST_ASSERT_LESS_OR_EQUAL(0, r.retained);
+}
+
+static void test_state_check(void) {
+  BenchResult r = bench("state_check", [](uint32_t) {
+    NativeHeapScope firmware;
+    state_check();
+  });
+  TEST_ASSERT_EQUAL_UINT32(0, r.allocs);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_login);
+  printf("%-16s %6s %9s %9s %12s %11s %8s %9s\n", "handler", "calls", "mean us", "max us", "allocs/call",
+         "bytes/call", "peak B", "retained");
+  RUN_TEST(test_handle_ac);
+  RUN_TEST(test_postacremote);
+  RUN_TEST(test_handle_not_found);
+  RUN_TEST(test_state_check);
+  return UNITY_END();
+}
@@ -0,0 +1,95 @@
+// Idempotent /acremote (command_dedup.h): a retry with the same key or seq
+// gets the first answer back, another key never does, and seqs match by
+// number.
+#include <unity.h>
+#include <native.h>
+#include <native_session.h>
+#include "command_dedup.h"
+
+void loop();
+
+static NativeResponse response;
+
+// POST /acremote, the X-Tx-Id answered
+static String post(const char *body, int expected = 200) {
+  TEST_ASSERT_EQUAL_MESSAGE(expected, native_session_request("POST", "/acremote", body, &response), body);
+  NativeHeapScope firmware;
+  loop();
+  return native_response_header(response, "X-Tx-Id");
+}
+
+static bool replayed() {
+  return native_response_header(response, "X-Replay") == "1";
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void test_login(void) {
+  TEST_ASSERT_TRUE(native_login());
+}
+
+static void test_key(void) {
+  String first = post("temp=21&on_off=1&key=alpha");
+  TEST_ASSERT_FALSE(replayed());
+  String again = post("temp=21&on_off=1&key=alpha");
+  TEST_ASSERT_EQUAL_STRING(first.c_str(), again.c_str());
+  TEST_ASSERT_TRUE(replayed());
+  // Another key is another command, whatever it hashes to
+  String second = post("temp=22&on_off=1&key=alphb");
+  TEST_ASSERT_FALSE(replayed());
+  TEST_ASSERT_FALSE(first == second);
+}
+
+// The direct API: tags differing only past what a hash would look at, and
+// key and seq tags of the same bytes
+static void test_tags(void) {
+  DedupTag a, b, s;
+  TEST_ASSERT_TRUE(dedup_key_tag("123456789012345678901234567890-aaaaa", 36, &a));
+  TEST_ASSERT_TRUE(dedup_key_tag("123456789012345678901234567890-aaaab", 36, &b));
+  uint32_t seq = 0x31323334;
+  dedup_seq_tag(seq, &s);
+  dedup_store(a, "1");
+  TEST_ASSERT_EQUAL_STRING("1", dedup_find(a));
+  TEST_ASSERT_NULL(dedup_find(b));
+  // The key "4321" has the bytes of seq 0x31323334
+  TEST_ASSERT_TRUE(dedup_key_tag("4321", 4, &a));
+  dedup_store(a, "2");
+  TEST_ASSERT_NULL(dedup_find(s));
+  TEST_ASSERT_FALSE(dedup_key_tag("1234567890123456789012345678901234567", DEDUP_KEY_MAX + 1, &a));
+  TEST_ASSERT_FALSE(dedup_key_tag("", 0, &a));
+}
+
+static void test_seq(void) {
+  String first = post("temp=23&seq=1007");
+  TEST_ASSERT_FALSE(replayed());
+  String again = post("temp=23&seq=01007");
+  TEST_ASSERT_EQUAL_STRING(first.c_str(), again.c_str());
+  TEST_ASSERT_TRUE(replayed());
+  post("temp=24&seq=1006", 409);
+  post("temp=24&seq=-1", 400);
+  post("temp=24&seq=4294967296", 400);
+  post("temp=24&seq=7x", 400);
+  post("temp=24&seq=1008");
+  TEST_ASSERT_FALSE(replayed());
+}
+
+static void test_bad_key(void) {
+  post("temp=25&key=", 400);
+  post("temp=25&key=1234567890123456789012345678901234567", 400);
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_login);
+  RUN_TEST(test_key);
+  RUN_TEST(test_tags);
+  RUN_TEST(test_seq);
+  RUN_TEST(test_bad_key);
+  return UNITY_END();
+}
@@ -0,0 +1,211 @@
+// parse_command() (command_parser.h): bounds and range rejection, a random
+// input run, and the parse cost per command against the String/strtok/atoi
+// code it replaced.
+#include <unity.h>
+#include <native.h>
+#include <chrono>
+#include <random>
+#include "command_parser.h"
+
+#ifndef BENCH_PARSES
+#define BENCH_PARSES 200000
+#endif
+
+static const uint8_t untouched[CMD_PARAMS] = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+static uint8_t cmd[CMD_PARAMS];
+static CmdParseError err;
+
+static CmdParseResult parse(const char *text) {
+  return parse_command(text, strlen(text), cmd, &err);
+}
+
+static void assert_rejected(CmdParseResult expected, uint8_t field, const char *text) {
+  TEST_ASSERT_EQUAL_STRING(cmd_parse_result_name(expected), cmd_parse_result_name(parse(text)));
+  TEST_ASSERT_EQUAL_UINT8(field, err.field);
+  // cmd is only written on success
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(untouched, cmd, CMD_PARAMS);
+}
+
+void setUp(void) {
+  memcpy(cmd, untouched, sizeof(cmd));
+  memset(&err, 0xFF, sizeof(err));
+}
+
+void tearDown(void) {
+}
+
+static void test_valid(void) {
+  static const uint8_t expected[CMD_PARAMS] = {1, 22, 0, 1, 1, 1, 0, 0, 0, 1};
+  TEST_ASSERT_EQUAL(CMD_PARSE_OK, parse("1,22,0,1,1,1,0,0,0,1"));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, cmd, CMD_PARAMS);
+  TEST_ASSERT_EQUAL(CMD_PARSE_OK, err.result);
+  // Leading zeros are digits like any other
+  TEST_ASSERT_EQUAL(CMD_PARSE_OK, parse("004,031,3,1,011,1,1,1,1,1"));
+  TEST_ASSERT_EQUAL_UINT8(31, cmd[1]);
+}
+
+static void test_out_of_range(void) {
+  assert_rejected(CMD_PARSE_RANGE, 0, "5,22,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_RANGE, 1, "1,15,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_RANGE, 1, "1,32,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_RANGE, 2, "1,22,4,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_RANGE, 4, "1,22,0,1,0,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_RANGE, 4, "1,22,0,1,12,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_RANGE, 9, "1,22,0,1,1,1,0,0,0,2");
+  // Above a byte: would wrap to a valid value in a uint8_t
+  assert_rejected(CMD_PARSE_OVERFLOW, 1, "1,278,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_OVERFLOW, 1, "1,0022,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_OVERFLOW, 9, "1,22,0,1,1,1,0,0,0,99999999999");
+}
+
+static void test_overlong_csv(void) {
+  assert_rejected(CMD_PARSE_TOO_MANY, 10, "1,22,0,1,1,1,0,0,0,1,1");
+  TEST_ASSERT_EQUAL_UINT16(21, err.offset);
+  // Stops at the first extra field, however long the rest is
+  static char big[8192];
+  for (size_t i = 0; i + 1 < sizeof(big); i += 2) {
+    big[i] = '1';
+    big[i + 1] = ',';
+  }
+  big[sizeof(big) - 1] = '1';
+  TEST_ASSERT_EQUAL(CMD_PARSE_TOO_MANY, parse_command(big, sizeof(big), cmd, &err));
+  TEST_ASSERT_EQUAL_UINT16(20, err.offset);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(untouched, cmd, CMD_PARAMS);
+}
+
+static void test_truncated_field(void) {
+  assert_rejected(CMD_PARSE_EMPTY_FIELD, 9, "1,22,0,1,1,1,0,0,0,");
+  assert_rejected(CMD_PARSE_EMPTY_FIELD, 3, "1,22,0,,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_EMPTY_FIELD, 0, ",1,22,0,1,1,1,0,0,0");
+  assert_rejected(CMD_PARSE_TOO_FEW, 9, "1,22,0,1,1,1,0,0,0");
+  TEST_ASSERT_EQUAL_UINT16(18, err.offset);
+  assert_rejected(CMD_PARSE_EMPTY, 0, "");
+  // len ends the input, the bytes after it are never read
+  const char *text = "1,22,0,1,1,1,0,0,0,1";
+  TEST_ASSERT_EQUAL(CMD_PARSE_EMPTY_FIELD, parse_command(text, 19, cmd, &err));
+  TEST_ASSERT_EQUAL(CMD_PARSE_TOO_FEW, parse_command(text, 16, cmd, &err));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(untouched, cmd, CMD_PARAMS);
+}
+
+static void test_bad_char(void) {
+  assert_rejected(CMD_PARSE_BAD_CHAR, 0, "-1,22,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_BAD_CHAR, 1, "1, 22,0,1,1,1,0,0,0,1");
+  assert_rejected(CMD_PARSE_BAD_CHAR, 9, "1,22,0,1,1,1,0,0,0,1\n");
+  assert_rejected(CMD_PARSE_BAD_CHAR, 2, "1,22,0x1,1,1,1,0,0,0,1");
+  const char nul[] = "1,22\0,0,1,1,1,0,0,0,1";
+  TEST_ASSERT_EQUAL(CMD_PARSE_BAD_CHAR, parse_command(nul, sizeof(nul) - 1, cmd, &err));
+  TEST_ASSERT_EQUAL_UINT16(4, err.offset);
+}
+
+// The UI sends zeros with Off: only on_off is range checked
+static void test_off_with_other_fields(void) {
+  TEST_ASSERT_EQUAL(CMD_PARSE_OK, parse("0,0,0,0,0,0,0,0,0,0"));
+  TEST_ASSERT_EQUAL_UINT8(0, cmd[CMD_ON_OFF]);
+  TEST_ASSERT_EQUAL(CMD_PARSE_OK, parse("9,99,9,9,99,9,9,9,9,0"));
+  TEST_ASSERT_EQUAL_UINT8(99, cmd[1]);
+  setUp();
+  // Still bounded by the syntax
+  assert_rejected(CMD_PARSE_OVERFLOW, 1, "0,999,0,0,0,0,0,0,0,0");
+  assert_rejected(CMD_PARSE_TOO_FEW, 9, "0,0,0,0,0,0,0,0,0");
+  // The same fields with On are checked
+  assert_rejected(CMD_PARSE_RANGE, 0, "9,99,9,9,99,9,9,9,9,1");
+}
+
+// Random and mutated inputs: an accepted command always passes the range
+// check, a rejected one leaves cmd alone and points inside the input
+static void test_random_inputs(void) {
+  static const char alphabet[] = "0123456789,,,, -x";
+  std::mt19937 rng(5);
+  char text[48];
+  for (uint32_t run = 0; run < 200000; run++) {
+    size_t len = rng() % sizeof(text);
+    if (run % 2) {
+      strcpy(text, "1,22,0,1,1,1,0,0,0,1");
+      len = strlen(text);
+      text[rng() % len] = alphabet[rng() % (sizeof(alphabet) - 1)];
+    } else {
+      for (size_t i = 0; i < len; i++) {
+        text[i] = alphabet[rng() % (sizeof(alphabet) - 1)];
+      }
+    }
+    memcpy(cmd, untouched, sizeof(cmd));
+    CmdParseResult result = parse_command(text, len, cmd, &err);
+    TEST_ASSERT_EQUAL(result, err.result);
+    if (result == CMD_PARSE_OK) {
+      TEST_ASSERT_EQUAL(-1, cmd_invalid_field(cmd, cmd[CMD_ON_OFF] == 0));
+    } else {
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(untouched, cmd, CMD_PARAMS);
+      TEST_ASSERT_LESS_OR_EQUAL(len, err.offset);
+      TEST_ASSERT_LESS_OR_EQUAL(CMD_PARAMS, err.field);
+    }
+  }
+}
+
+// The parsing of postacremote() before command_parser, without its Serial
+// prints: String copy of the argument, stack copy, strtok/atoi
+static bool legacy_parse(const String &arg, uint8_t *out) {
+  String command = arg;
+  char tochar[command.length() + 1];
+  command.toCharArray(tochar, command.length() + 1);
+  char *current_int = strtok(tochar, ",");
+  int command_index = 0;
+  uint16_t command_received[CMD_PARAMS] = {0};
+  while (current_int != NULL && command_index < CMD_PARAMS) {
+    command_received[command_index++] = atoi(current_int);
+    current_int = strtok(NULL, ",");
+  }
+  if (command_index < CMD_PARAMS) {
+    return false;
+  }
+  for (int j = 0; j < CMD_PARAMS; j++) {
+    out[j] = command_received[j];
+  }
+  return true;
+}
+
+static double ns_per_call(uint32_t calls, std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+static void test_bench_parse(void) {
+  String arg("1,22,0,1,1,1,0,0,0,1");
+  volatile uint8_t sink = 0;
+  NativeHeapScope firmware;
+
+  uint32_t allocs = native_heap_stats().allocs;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_PARSES; i++) {
+    parse_command(arg.c_str(), arg.length(), cmd, &err);
+    sink += cmd[1];
+  }
+  double parser_ns = ns_per_call(BENCH_PARSES, start);
+  uint32_t parser_allocs = native_heap_stats().allocs - allocs;
+
+  allocs = native_heap_stats().allocs;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_PARSES; i++) {
+    legacy_parse(arg, cmd);
+    sink += cmd[1];
+  }
+  double legacy_ns = ns_per_call(BENCH_PARSES, start);
+  uint32_t legacy_allocs = native_heap_stats().allocs - allocs;
+
+  printf("%-14s %10s %12s\n", "parse", "ns/call", "allocs/call");
+  printf("%-14s %10.1f %12.2f\n", "parse_command", parser_ns, (double)parser_allocs / BENCH_PARSES);
+  printf("%-14s %10.1f %12.2f\n", "strtok/String", legacy_ns, (double)legacy_allocs / BENCH_PARSES);
+  TEST_ASSERT_EQUAL_UINT32(0, parser_allocs);
+  (void)sink;
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_valid);
+  RUN_TEST(test_out_of_range);
+  RUN_TEST(test_overlong_csv);
+  RUN_TEST(test_truncated_field);
+  RUN_TEST(test_bad_char);
+  RUN_TEST(test_off_with_other_fields);
+  RUN_TEST(test_random_inputs);
+  RUN_TEST(test_bench_parse);
+  return UNITY_END();
+}
@@ -0,0 +1,91 @@
+// The history (history.h) on a simulated clock: samples recorded once a
+// minute decode back as CSV rows, also after the clock went back and two
+// blocks start on the same minute.
+#include <unity.h>
+#include <native.h>
+#include "dht_sampler.h"
+#include "history.h"
+
+// 2026-01-01 00:00 UTC, a minute boundary
+#define T0 1767225600UL
+
+static dht sensor;
+static uint8_t states[ZONE_COUNT * CMD_PARAMS];
+
+// The firmware's loop() once a second from 30 s into the minute at `start`,
+// reading `temperature`: one sample in each of `minutes` minutes
+static void run(uint32_t start, uint32_t minutes, float temperature) {
+  native_time_set(start + 30);
+  native_dht_set(temperature, 50);
+  // The median window full of the new reading first
+  for (uint8_t i = 0; i < DHT_MEDIAN_WINDOW; i++) {
+    native_advance_ms(1000);
+    dht_sampler_loop();
+  }
+  for (uint32_t at = start + 36; at < start + minutes * 60; at++) {
+    native_advance_ms(1000);
+    dht_sampler_loop();
+    history_loop();
+  }
+}
+
+static String read_all(uint32_t from, uint32_t to) {
+  HistoryCursor *cursor = history_open(from, to, 60, HISTORY_ROOM, false);
+  TEST_ASSERT_NOT_NULL(cursor);
+  String text;
+  uint8_t buf[64];
+  size_t n;
+  while ((n = history_read(cursor, buf, sizeof(buf))) > 0) {
+    text.concat((const char *)buf, n);
+  }
+  free(cursor);
+  return text;
+}
+
+static uint32_t count_rows(const String &text, const char *suffix) {
+  uint32_t n = 0;
+  for (int at = text.indexOf(suffix); at >= 0; at = text.indexOf(suffix, at + 1)) {
+    n++;
+  }
+  return n;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void test_rows(void) {
+  run(T0, 5, 21);
+  String text = read_all(0, 0xFFFFFFFFUL);
+  TEST_ASSERT_TRUE(text.startsWith("time,temp,humidity\n"));
+  TEST_ASSERT_EQUAL_UINT32(5, count_rows(text, ",21.0,50.0\n"));
+}
+
+// The clock set back twice to the same minute: the two blocks opened then
+// start on the same minute, and both are decoded, in the order written
+static void test_same_start_minute(void) {
+  const uint32_t t1 = T0 + 86400;
+  run(t1, 3, 23);
+  run(t1, 2, 26);
+  String first = read_all(t1, t1 + 3600);
+  TEST_ASSERT_EQUAL_UINT32(2, count_rows(first, ",26.0,50.0\n"));
+  run(t1, 1, 27);
+  String text = read_all(t1, t1 + 3600);
+  TEST_ASSERT_EQUAL_UINT32(3, count_rows(text, ",23.0,50.0\n"));
+  TEST_ASSERT_EQUAL_UINT32(2, count_rows(text, ",26.0,50.0\n"));
+  TEST_ASSERT_EQUAL_UINT32(1, count_rows(text, ",27.0,50.0\n"));
+  TEST_ASSERT_TRUE(text.startsWith(first));
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_clock_freeze(true);
+  dht_sampler_begin(sensor, 5, DHT11_MIN_INTERVAL_MS);
+  history_begin(states);
+  UNITY_BEGIN();
+  RUN_TEST(test_rows);
+  RUN_TEST(test_same_start_minute);
+  return UNITY_END();
+}
@@ -0,0 +1,196 @@
+// ir_gree_timings() (ir_timer.h) against the mark/space sequence of
+// IRsend::sendGree() for a range of IRGreeAC states, the block layout
+// (header, 0b010 footer, second block), and the timer1 playback of the
+// table lasting as long as the frame.
+#include <unity.h>
+#include <native.h>
+#include <ir_Gree.h>
+#include <random>
+#include "ir_timer.h"
+
+static uint16_t timings[IR_TIMINGS_MAX];
+static uint16_t count;
+
+// What IRGreeAC::send() put on air, adjacent marks (or spaces) merged as
+// the LED does not tell them apart
+static uint16_t sent[NATIVE_IR_PULSES_MAX];
+static uint16_t sent_count;
+
+static void send(IRGreeAC &ac) {
+  native_ir_clear();
+  ac.send();
+  const NativeIrPulse *pulses;
+  uint16_t n = native_ir_pulses(&pulses);
+  sent_count = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    bool mark = sent_count % 2 == 0;
+    if (sent_count && pulses[i].mark != mark) {
+      sent[sent_count - 1] += pulses[i].us;
+    } else if (!sent_count && !pulses[i].mark) {
+      // Nothing on air yet
+    } else {
+      sent[sent_count++] = pulses[i].us;
+    }
+  }
+  count = ir_gree_timings(ac.getRaw(), timings, IR_TIMINGS_MAX);
+}
+
+static void assert_same(IRGreeAC &ac) {
+  send(ac);
+  TEST_ASSERT_EQUAL(sent_count, count);
+  TEST_ASSERT_EQUAL_UINT16_ARRAY(sent, timings, count);
+}
+
+static uint32_t total_us(const uint16_t *t, uint16_t n) {
+  uint32_t us = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    us += t[i];
+  }
+  return us;
+}
+
+static bool done;
+
+static void on_done() {
+  done = true;
+}
+
+void setUp(void) {
+  native_clock_freeze(true);
+}
+
+void tearDown(void) {
+}
+
+static void test_states(void) {
+  IRGreeAC ac(4);
+  assert_same(ac);
+  for (uint8_t mode = kGreeAuto; mode <= kGreeHeat; mode++) {
+    for (uint8_t temp = kGreeMinTempC; temp <= kGreeMaxTempC; temp++) {
+      for (uint8_t fan = kGreeFanAuto; fan <= kGreeFanMax; fan++) {
+        ac.setPower(temp % 2);
+        ac.setMode(mode);
+        ac.setTemp(temp);
+        ac.setFan(fan);
+        ac.setSwingVertical(fan == kGreeFanAuto, temp % 7);
+        ac.setLight(mode % 2);
+        ac.setTurbo(fan == kGreeFanMax);
+        ac.setXFan(temp > 25);
+        ac.setSleep(mode == kGreeCool);
+        assert_same(ac);
+      }
+    }
+  }
+}
+
+// Any bytes, not only the ones IRGreeAC builds
+static void test_random_raw(void) {
+  std::mt19937 rng(23);
+  IRGreeAC ac(4);
+  uint8_t raw[kGreeStateLength];
+  for (uint16_t i = 0; i < 500; i++) {
+    for (uint8_t b = 0; b < kGreeStateLength; b++) {
+      raw[b] = rng();
+    }
+    ac.setRaw(raw);
+    assert_same(ac);
+  }
+  // All zero and all one bits: the longest run of equal spaces either way
+  memset(raw, 0x00, sizeof(raw));
+  ac.setRaw(raw);
+  assert_same(ac);
+  memset(raw, 0xFF, sizeof(raw));
+  ac.setRaw(raw);
+  assert_same(ac);
+}
+
+// Header, 32 bits, footer 0b010 LSB first, the message space, 32 bits,
+// the closing mark and message space
+static void test_layout(void) {
+  IRGreeAC ac(4);
+  ac.setPower(true);
+  ac.setMode(kGreeCool);
+  ac.setTemp(23);
+  send(ac);
+  const uint8_t *raw = ac.getRaw();
+  TEST_ASSERT_EQUAL(2 + 32 * 2 + 3 * 2 + 2 + 32 * 2 + 2, count);
+  TEST_ASSERT_EQUAL(kGreeHdrMark, timings[0]);
+  TEST_ASSERT_EQUAL(kGreeHdrSpace, timings[1]);
+  for (uint8_t bit = 0; bit < 32; bit++) {
+    bool one = raw[bit / 8] & (1 << (bit % 8));
+    TEST_ASSERT_EQUAL(kGreeBitMark, timings[2 + bit * 2]);
+    TEST_ASSERT_EQUAL(one ? kGreeOneSpace : kGreeZeroSpace, timings[3 + bit * 2]);
+  }
+  const uint16_t *footer = timings + 2 + 32 * 2;
+  TEST_ASSERT_EQUAL(kGreeBitMark, footer[0]);
+  TEST_ASSERT_EQUAL(kGreeZeroSpace, footer[1]);
+  TEST_ASSERT_EQUAL(kGreeBitMark, footer[2]);
+  TEST_ASSERT_EQUAL(kGreeOneSpace, footer[3]);
+  TEST_ASSERT_EQUAL(kGreeBitMark, footer[4]);
+  TEST_ASSERT_EQUAL(kGreeZeroSpace, footer[5]);
+  TEST_ASSERT_EQUAL(kGreeBitMark, footer[6]);
+  TEST_ASSERT_EQUAL(kGreeMsgSpace, footer[7]);
+  const uint16_t *block2 = footer + 8;
+  for (uint8_t bit = 0; bit < 32; bit++) {
+    bool one = raw[4 + bit / 8] & (1 << (bit % 8));
+    TEST_ASSERT_EQUAL(kGreeBitMark, block2[bit * 2]);
+    TEST_ASSERT_EQUAL(one ? kGreeOneSpace : kGreeZeroSpace, block2[1 + bit * 2]);
+  }
+  TEST_ASSERT_EQUAL(kGreeBitMark, block2[64]);
+  TEST_ASSERT_EQUAL(kGreeMsgSpace, block2[65]);
+}
+
+static void test_too_small(void) {
+  IRGreeAC ac(4);
+  uint16_t small[IR_TIMINGS_MAX];
+  uint16_t n = ir_gree_timings(ac.getRaw(), small, IR_TIMINGS_MAX);
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_EQUAL(n, ir_gree_timings(ac.getRaw(), small, n));
+  TEST_ASSERT_EQUAL(0, ir_gree_timings(ac.getRaw(), small, n - 1));
+}
+
+// timer1 plays the table for as long as IRsend takes to send the frame,
+// then ir_timer_loop() reports it done
+static void test_playback(void) {
+  IRGreeAC ac(4);
+  ac.setPower(true);
+  ac.setTemp(21);
+  send(ac);
+  done = false;
+  TEST_ASSERT_TRUE(ir_timer_send(4, timings, count, on_done));
+  TEST_ASSERT_TRUE(ir_timer_busy());
+  TEST_ASSERT_FALSE(ir_timer_send(4, timings, count, on_done));
+  uint64_t ticks = 0;
+  uint32_t fires = 0;
+  while (native_timer1_enabled()) {
+    native_timer1_fire();
+    fires++;
+    if (native_timer1_enabled()) {
+      ticks += native_timer1_ticks();
+    }
+  }
+  TEST_ASSERT_FALSE(ir_timer_busy());
+  TEST_ASSERT_FALSE(done);
+  ir_timer_loop();
+  TEST_ASSERT_TRUE(done);
+  // 80 ticks per us at TIM_DIV1
+  TEST_ASSERT_EQUAL_UINT64((uint64_t)total_us(sent, sent_count) * 80, ticks);
+  // Two fires per carrier period during the marks, about one per space
+  uint32_t marks_us = 0;
+  for (uint16_t i = 0; i < count; i += 2) {
+    marks_us += timings[i];
+  }
+  TEST_ASSERT_UINT32_WITHIN(count, marks_us * 2 * IR_CARRIER_HZ / 1000000 + count / 2, fires);
+  TEST_ASSERT_FALSE(ir_timer_supported(16));
+  TEST_ASSERT_FALSE(ir_timer_send(16, timings, count, on_done));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_states);
+  RUN_TEST(test_random_raw);
+  RUN_TEST(test_layout);
+  RUN_TEST(test_too_small);
+  RUN_TEST(test_playback);
+  return UNITY_END();
+}
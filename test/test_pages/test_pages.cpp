@@ -0,0 +1,187 @@
+// The long pages (/metrics, /log, /schedule) are sent as chunked responses
+// rendered a part at a time: the heap they hold stays the same whatever
+// their size, and the output is whole. POST /schedule takes text/plain
+// bodies the library parses as a form.
+#include <unity.h>
+#include <native.h>
+#include <native_session.h>
+#include <ESPAsyncWebServer.h>
+#include <ctype.h>
+#include "log.h"
+#include "metrics.h"
+#include "page_writer.h"
+#include "schedule.h"
+
+// Most heap held while serving the request, above what was in use before
+static uint32_t request_peak(const char *method, const char *url, const char *headers, const char *body,
+                             NativeResponse *response, int expected) {
+  uint32_t before = native_heap_stats().used;
+  native_heap_reset_peak();
+  TEST_ASSERT_EQUAL(expected, native_session_request(method, url, body, response, headers));
+  TEST_ASSERT_EQUAL_UINT32(before, native_heap_stats().used);
+  return native_heap_stats().peak - before;
+}
+
+static uint32_t count_lines(const String &text, const char *prefix) {
+  uint32_t n = 0;
+  int at = 0;
+  while (at < (int)text.length()) {
+    if (strncmp(text.c_str() + at, prefix, strlen(prefix)) == 0) {
+      n++;
+    }
+    int eol = text.indexOf('\n', at);
+    if (eol < 0) {
+      break;
+    }
+    at = eol + 1;
+  }
+  return n;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void test_login(void) {
+  TEST_ASSERT_TRUE(native_login());
+}
+
+// Every part fits the part buffer, with room for counters a few digits longer
+static void test_metrics_parts_fit(void) {
+  struct Count : public Print {
+    size_t n = 0;
+    size_t write(uint8_t) override {
+      n++;
+      return 1;
+    }
+  };
+  uint16_t part = 0;
+  size_t total = 0;
+  for (;; part++) {
+    Count count;
+    if (!metrics_write(count, part)) {
+      break;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(PAGE_PART_MAX - 160, count.n);
+    total += count.n;
+  }
+  TEST_ASSERT_GREATER_THAN(METRIC_HANDLERS, part);
+  printf("/metrics: %u parts, %u bytes\n", (unsigned)part, (unsigned)total);
+}
+
+static void test_metrics(void) {
+  NativeResponse response;
+  uint32_t peak = request_peak("GET", "/metrics", NULL, NULL, &response, 200);
+  printf("/metrics: %u bytes in %u chunks, peak heap %u B\n", response.body.length(), (unsigned)response.chunks,
+         (unsigned)peak);
+  TEST_ASSERT_GREATER_THAN(8000, response.body.length());
+  TEST_ASSERT_GREATER_THAN(4, response.chunks);
+  // Neither the page nor its part buffer, which is in an arena slot
+  TEST_ASSERT_LESS_OR_EQUAL(768, peak);
+  TEST_ASSERT_EQUAL_UINT32(METRIC_HANDLERS, count_lines(response.body, "gree_http_request_duration_seconds_count{"));
+  TEST_ASSERT_EQUAL_UINT32(METRIC_HANDLERS, count_lines(response.body, "gree_http_request_duration_seconds_sum{"));
+  TEST_ASSERT_EQUAL_UINT32(1, count_lines(response.body, "gree_uptime_seconds "));
+  TEST_ASSERT_EQUAL('\n', response.body[response.body.length() - 1]);
+  TEST_ASSERT_TRUE(response.body.indexOf("handler=\"postSchedule\"") > 0);
+}
+
+static void test_log(void) {
+  for (uint16_t i = 0; i < 200; i++) {
+    LOG_INFO("test line %u of a log longer than the ring", i);
+  }
+  NativeResponse response;
+  uint32_t peak = request_peak("GET", "/log", NULL, NULL, &response, 200);
+  printf("/log: %u bytes in %u chunks, peak heap %u B\n", response.body.length(), (unsigned)response.chunks,
+         (unsigned)peak);
+  TEST_ASSERT_GREATER_THAN(LOG_RING_SIZE - LOG_LINE_MAX, response.body.length());
+  TEST_ASSERT_LESS_OR_EQUAL(LOG_RING_SIZE, response.body.length());
+  TEST_ASSERT_LESS_OR_EQUAL(768, peak);
+  // Whole lines, the newest last
+  TEST_ASSERT_TRUE(isdigit(response.body[0]));
+  TEST_ASSERT_TRUE(response.body.endsWith("test line 199 of a log longer than the ring\n"));
+}
+
+// Lines overwritten while the page is read are skipped, not cut
+static void test_log_overwritten_while_read(void) {
+  LogCursor cursor;
+  log_open(&cursor);
+  uint8_t buf[64];
+  size_t n = log_read(&cursor, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(sizeof(buf), n);
+  for (uint16_t i = 0; i < 10; i++) {
+    LOG_INFO("overwriting line %u", i);
+  }
+  String rest;
+  while ((n = log_read(&cursor, buf, sizeof(buf))) > 0) {
+    rest.concat((const char *)buf, n);
+  }
+  // Goes on from the oldest whole line left, up to the end at log_open()
+  TEST_ASSERT_TRUE(rest.length() > 0);
+  TEST_ASSERT_TRUE(isdigit(rest[0]));
+  TEST_ASSERT_EQUAL(-1, rest.indexOf("overwriting"));
+  TEST_ASSERT_TRUE(rest.endsWith("test line 199 of a log longer than the ring\n"));
+
+  // All of it overwritten: nothing left to send
+  log_open(&cursor);
+  for (uint16_t i = 0; i < 100; i++) {
+    LOG_INFO("overwriting line %u", i);
+  }
+  TEST_ASSERT_EQUAL(0, log_read(&cursor, buf, sizeof(buf)));
+}
+
+static void test_schedule_text_plain(void) {
+  static const char text[] = "Mon-Fri 08:00 mode=1 temp=23 on_off=1\nMon-Fri 19:00 on_off=0\n# weekend\nSat,Sun 10:30 on_off=1";
+  NativeResponse response;
+  request_peak("POST", "/schedule", "Content-Type: text/plain", text, &response, 200);
+  TEST_ASSERT_EQUAL_STRING("ok 3 entries", response.body.c_str());
+  TEST_ASSERT_EQUAL(3, schedule_count());
+  // A body the library does not take for a form
+  request_peak("POST", "/schedule", "Content-Type: text/plain", "daily 07:00 on_off=1\n", &response, 200);
+  TEST_ASSERT_EQUAL_STRING("ok 1 entries", response.body.c_str());
+  request_peak("POST", "/schedule", "Content-Type: text/plain", "# comment first\ndaily 07:00 on_off=1\n", &response,
+               200);
+  TEST_ASSERT_EQUAL_STRING("ok 1 entries", response.body.c_str());
+  request_peak("POST", "/schedule", "Content-Type: application/x-www-form-urlencoded",
+               "entries=Mon%2007%3A00%20on_off%3D1%0ATue%2007%3A00%20on_off%3D1", &response, 200);
+  TEST_ASSERT_EQUAL_STRING("ok 2 entries", response.body.c_str());
+  request_peak("POST", "/schedule", "Content-Type: text/plain", "Mon-Fri 25:00 on_off=1", &response, 400);
+  TEST_ASSERT_EQUAL(2, schedule_count());
+}
+
+static void test_schedule_page(void) {
+  ScheduleEntry entries[SCHEDULE_MAX];
+  char line[SCHEDULE_LINE_MAX];
+  for (uint8_t i = 0; i < SCHEDULE_MAX; i++) {
+    snprintf(line, sizeof(line), "Mon,Wed,Fri %02u:%02u mode=1 temp=%u fan=2 flap=3 on_off=1", i % 24, i, 16 + i % 15);
+    const char *error;
+    TEST_ASSERT_TRUE(schedule_parse_line(line, strlen(line), &entries[i], &error));
+  }
+  TEST_ASSERT_TRUE(schedule_replace(entries, SCHEDULE_MAX));
+  NativeResponse response;
+  uint32_t peak = request_peak("GET", "/schedule", NULL, NULL, &response, 200);
+  printf("/schedule: %u bytes in %u chunks, peak heap %u B\n", response.body.length(), (unsigned)response.chunks,
+         (unsigned)peak);
+  TEST_ASSERT_EQUAL_UINT32(SCHEDULE_MAX, count_lines(response.body, "Mon,Wed,Fri "));
+  TEST_ASSERT_LESS_OR_EQUAL(768, peak);
+  // The page posts back as it is
+  String text = response.body;
+  request_peak("POST", "/schedule", "Content-Type: text/plain", text.c_str(), &response, 200);
+  snprintf(line, sizeof(line), "ok %u entries", SCHEDULE_MAX);
+  TEST_ASSERT_EQUAL_STRING(line, response.body.c_str());
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_login);
+  RUN_TEST(test_metrics_parts_fit);
+  RUN_TEST(test_metrics);
+  RUN_TEST(test_log);
+  RUN_TEST(test_log_overwritten_while_read);
+  RUN_TEST(test_schedule_text_plain);
+  RUN_TEST(test_schedule_page);
+  return UNITY_END();
+}
@@ -0,0 +1,255 @@
+// Request arenas (request_arena.h): slot acquire and release, the heap
+// fallback when they run out, pages cut at the slot size, release when the
+// connection closes, and a soak of mixed, overlapping requests after which
+// the slots are all free and the heap is as it was.
+#include <unity.h>
+#include <native.h>
+#include <native_session.h>
+#include <ESPAsyncWebServer.h>
+#include <random>
+#include <vector>
+#include "page_writer.h"
+#include "request_arena.h"
+
+void loop();
+
+static uint8_t free_slots() {
+  Arena *taken[ARENA_SLOTS + 1];
+  uint8_t n = 0;
+  while (n <= ARENA_SLOTS && (taken[n] = arena_acquire()) != NULL) {
+    n++;
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    arena_release(taken[i]);
+  }
+  return n;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+  TEST_ASSERT_EQUAL(ARENA_SLOTS, free_slots());
+}
+
+static void test_login(void) {
+  TEST_ASSERT_TRUE(native_login());
+}
+
+static void test_acquire_release(void) {
+  Arena *slots[ARENA_SLOTS];
+  uint32_t acquired = arena_acquired();
+  uint32_t busy = arena_busy();
+  for (uint8_t i = 0; i < ARENA_SLOTS; i++) {
+    slots[i] = arena_acquire();
+    TEST_ASSERT_NOT_NULL(slots[i]);
+    for (uint8_t j = 0; j < i; j++) {
+      TEST_ASSERT_TRUE(slots[i] != slots[j]);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(acquired + ARENA_SLOTS, arena_acquired());
+  TEST_ASSERT_NULL(arena_acquire());
+  TEST_ASSERT_EQUAL_UINT32(busy + 1, arena_busy());
+  // A released slot is the next one handed out, empty
+  uint8_t *a = (uint8_t *)arena_alloc(slots[1], 10);
+  TEST_ASSERT_NOT_NULL(a);
+  arena_release(slots[1]);
+  Arena *again = arena_acquire();
+  TEST_ASSERT_TRUE(again == slots[1]);
+  TEST_ASSERT_EQUAL(0, arena_used(again));
+  for (uint8_t i = 0; i < ARENA_SLOTS; i++) {
+    arena_release(slots[i]);
+  }
+}
+
+static void test_alloc(void) {
+  Arena *arena = arena_acquire();
+  uint8_t *a = (uint8_t *)arena_alloc(arena, 3);
+  uint8_t *b = (uint8_t *)arena_alloc(arena, 1);
+  TEST_ASSERT_EQUAL(4, b - a);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)b % 4);
+  // Only the last allocation grows, up to the slot size
+  TEST_ASSERT_FALSE(arena_extend(arena, a, 1));
+  TEST_ASSERT_TRUE(arena_extend(arena, b, 100));
+  TEST_ASSERT_EQUAL(105, arena_used(arena));
+  TEST_ASSERT_FALSE(arena_extend(arena, b, ARENA_SIZE));
+  TEST_ASSERT_TRUE(arena_extend(arena, b, ARENA_SIZE - 105));
+  TEST_ASSERT_EQUAL(ARENA_SIZE, arena_used(arena));
+  TEST_ASSERT_NULL(arena_alloc(arena, 1));
+  arena_release(arena);
+  TEST_ASSERT_EQUAL(ARENA_SIZE, arena_high_water());
+}
+
+// A page built while the slot is held is sent from it, and the slot comes
+// back when the connection closes, not when the handler returns
+static void test_release_on_disconnect(void) {
+  AsyncWebServerRequest *request = native_session_start("GET", "/state");
+  TEST_ASSERT_EQUAL(ARENA_SLOTS - 1, free_slots());
+  NativeResponse response;
+  TEST_ASSERT_EQUAL(200, native_session_finish(request, &response));
+  TEST_ASSERT_TRUE(response.body.startsWith("{"));
+  TEST_ASSERT_EQUAL(ARENA_SLOTS, free_slots());
+
+  // Same for the chunked pages, which hold their part buffer in a slot
+  request = native_session_start("GET", "/metrics");
+  TEST_ASSERT_EQUAL(ARENA_SLOTS - 1, free_slots());
+  TEST_ASSERT_EQUAL(200, native_session_finish(request, &response));
+  TEST_ASSERT_GREATER_THAN(8000, response.body.length());
+  TEST_ASSERT_EQUAL(ARENA_SLOTS, free_slots());
+
+  // And for a request closed before its response was read
+  request = native_session_start("GET", "/state");
+  TEST_ASSERT_EQUAL(ARENA_SLOTS - 1, free_slots());
+  native_request_abort(request);
+  TEST_ASSERT_EQUAL(ARENA_SLOTS, free_slots());
+}
+
+// Without a free slot the pages are built on the heap, the same bytes
+static void test_exhausted(void) {
+  NativeResponse in_arena, on_heap;
+  TEST_ASSERT_EQUAL(200, native_session_request("GET", "/state", NULL, &in_arena));
+
+  Arena *slots[ARENA_SLOTS];
+  for (uint8_t i = 0; i < ARENA_SLOTS; i++) {
+    slots[i] = arena_acquire();
+  }
+  uint32_t busy = arena_busy();
+  TEST_ASSERT_EQUAL(200, native_session_request("GET", "/state", NULL, &on_heap));
+  // All but the session counters, which count this request too
+  int auth = in_arena.body.indexOf(",\"auth\"");
+  TEST_ASSERT_TRUE(auth > 0);
+  TEST_ASSERT_EQUAL_STRING(in_arena.body.substring(0, auth).c_str(), on_heap.body.substring(0, auth).c_str());
+  TEST_ASSERT_EQUAL(200, native_session_request("GET", "/metrics", NULL, &on_heap));
+  TEST_ASSERT_GREATER_THAN(8000, on_heap.body.length());
+  TEST_ASSERT_EQUAL_UINT32(busy + 2, arena_busy());
+  for (uint8_t i = 0; i < ARENA_SLOTS; i++) {
+    arena_release(slots[i]);
+  }
+}
+
+// A page that outgrows its slot is cut at its end, not moved to the heap
+static void test_overflow(void) {
+  String url = "/missing?";
+  for (uint8_t i = 0; i < 100; i++) {
+    url += "argument" + String(i) + "=value" + String(i) + "&";
+  }
+  uint32_t overflows = arena_overflows();
+  NativeResponse response;
+  TEST_ASSERT_EQUAL(404, native_session_request("GET", url.c_str(), NULL, &response));
+  TEST_ASSERT_EQUAL(ARENA_SIZE, response.body.length());
+  TEST_ASSERT_TRUE(response.body.startsWith("File Not Found\n\nURI: /missing"));
+  TEST_ASSERT_TRUE(response.body.indexOf(" argument0: value0\n") > 0);
+  TEST_ASSERT_EQUAL_UINT32(overflows + 1, arena_overflows());
+}
+
+// About one request started per two steps, e.g. -DSOAK_STEPS=40000 for a
+// quick run
+#ifndef SOAK_STEPS
+#define SOAK_STEPS 4000000UL
+#endif
+#ifndef SOAK_PHASES
+#define SOAK_PHASES 8
+#endif
+
+struct OpenRequest {
+  AsyncWebServerRequest *request;
+  bool in_slot;
+};
+
+// Mixed requests, up to ARENA_SLOTS + 2 open at once and closed in random
+// order, loop() in between, SOAK_STEPS steps in SOAK_PHASES phases. Every
+// request takes a slot while one is free and is built on the heap
+// otherwise, none outgrows its slot. After each phase the slots are all
+// free, and the heap has the same free bytes and largest block as before.
+static void test_soak(void) {
+  static const char *const gets[] = {"/state", "/txstatus?id=1", "/metrics", "/schedule", "/nothing", "/log"};
+  std::mt19937 rng(21);
+  // Sessions do not expire while it runs
+  native_clock_freeze(true);
+  {
+    NativeHeapScope firmware;
+    loop();
+  }
+  uint32_t free_before = native_heap_free();
+  uint32_t block_before = native_heap_max_block();
+  uint32_t acquired = arena_acquired();
+  uint32_t busy = arena_busy();
+  uint32_t overflows = arena_overflows();
+  uint32_t in_slots = 0;
+  uint32_t on_heap = 0;
+  std::vector<OpenRequest> open;
+  uint8_t holding = 0;
+  for (uint8_t phase = 0; phase < SOAK_PHASES; phase++) {
+    for (uint32_t i = 0; i < SOAK_STEPS / SOAK_PHASES; i++) {
+      if (open.size() < ARENA_SLOTS + 2 && rng() % 3) {
+        OpenRequest r = {NULL, false};
+        // /log reads the log ring through a cursor of its own, no slot
+        bool slot = true;
+        if (rng() % 8 == 0) {
+          char body[48];
+          snprintf(body, sizeof(body), "command=1,%u,0,1,1,1,0,0,0,1", 20 + (unsigned)(rng() % 8));
+          r.request = native_session_start("POST", "/acremote", body);
+        } else {
+          const char *url = gets[rng() % (sizeof(gets) / sizeof(gets[0]))];
+          slot = strcmp(url, "/log") != 0;
+          r.request = native_session_start("GET", url);
+        }
+        if (slot && holding < ARENA_SLOTS) {
+          r.in_slot = true;
+          holding++;
+          in_slots++;
+        } else if (slot) {
+          on_heap++;
+        }
+        open.push_back(r);
+      } else if (!open.empty()) {
+        size_t k = rng() % open.size();
+        NativeResponse response;
+        TEST_ASSERT_TRUE(native_session_finish(open[k].request, &response) > 0);
+        holding -= open[k].in_slot;
+        open.erase(open.begin() + k);
+      }
+      if (i % 16 == 0) {
+        native_advance_ms(1);
+        NativeHeapScope firmware;
+        loop();
+      }
+    }
+    for (const OpenRequest &r : open) {
+      NativeResponse response;
+      native_session_finish(r.request, &response);
+    }
+    open.clear();
+    holding = 0;
+    {
+      NativeHeapScope firmware;
+      loop();
+    }
+    printf("soak phase %u: %u in slots, %u on the heap, heap free %u -> %u, largest block %u -> %u\n",
+           phase, (unsigned)in_slots, (unsigned)on_heap, (unsigned)free_before, (unsigned)native_heap_free(),
+           (unsigned)block_before, (unsigned)native_heap_max_block());
+    TEST_ASSERT_EQUAL(ARENA_SLOTS, free_slots());
+    TEST_ASSERT_EQUAL_UINT32(free_before, native_heap_free());
+    TEST_ASSERT_EQUAL_UINT32(block_before, native_heap_max_block());
+    // One slot per request while ARENA_SLOTS were held, never more
+    TEST_ASSERT_EQUAL_UINT32(in_slots, arena_acquired() - acquired - ARENA_SLOTS * (phase + 1));
+    TEST_ASSERT_EQUAL_UINT32(on_heap, arena_busy() - busy - (phase + 1));
+    TEST_ASSERT_EQUAL_UINT32(overflows, arena_overflows());
+    TEST_ASSERT_LESS_OR_EQUAL(ARENA_SIZE, arena_high_water());
+  }
+  native_clock_freeze(false);
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_login);
+  RUN_TEST(test_acquire_release);
+  RUN_TEST(test_alloc);
+  RUN_TEST(test_release_on_disconnect);
+  RUN_TEST(test_exhausted);
+  RUN_TEST(test_overflow);
+  RUN_TEST(test_soak);
+  return UNITY_END();
+}
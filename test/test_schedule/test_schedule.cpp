@@ -0,0 +1,310 @@
+// The timer wheel (timer_wheel.h) against a plain list of expiries, and a
+// week of the schedule (schedule.h) on a simulated clock: weekly programs
+// and one-shots fire on their minute and are armed again, clock jumps are
+// caught up, skipped or re-armed as schedule.h describes.
+#include <unity.h>
+#include <native.h>
+#include <random>
+#include <vector>
+#include "schedule.h"
+
+struct Fired {
+  uint32_t minute;
+  uint32_t zones;
+  uint16_t fields;
+  uint8_t cmd[CMD_PARAMS];
+};
+
+static std::vector<Fired> fired;
+
+static void record(uint32_t zones, const uint8_t *cmd, uint16_t fields) {
+  Fired f = {schedule_now(), zones, fields, {0}};
+  memcpy(f.cmd, cmd, CMD_PARAMS);
+  fired.push_back(f);
+}
+
+// Local minute of a UTC date (the test runs with TZ=UTC0)
+static uint32_t minute_at(int y, int m, int d, int h, int mi) {
+  struct tm tm = {};
+  tm.tm_year = y - 1900;
+  tm.tm_mon = m - 1;
+  tm.tm_mday = d;
+  tm.tm_hour = h;
+  tm.tm_min = mi;
+  return timegm(&tm) / 60;
+}
+
+static void set_clock(uint32_t minute, uint8_t second = 0) {
+  native_time_set((time_t)minute * 60 + second);
+}
+
+// Runs loop() for `seconds` of simulated time, once a second as the
+// firmware's loop() would at most throttle it
+static void run_for(uint32_t seconds) {
+  for (uint32_t s = 0; s < seconds; s++) {
+    native_advance_ms(1000);
+    schedule_loop();
+  }
+}
+
+static void load(const char *const *lines, uint8_t n) {
+  ScheduleEntry list[SCHEDULE_MAX];
+  for (uint8_t i = 0; i < n; i++) {
+    const char *error = NULL;
+    TEST_ASSERT_TRUE_MESSAGE(schedule_parse_line(lines[i], strlen(lines[i]), &list[i], &error), lines[i]);
+  }
+  TEST_ASSERT_TRUE(schedule_replace(list, n));
+  fired.clear();
+}
+
+void setUp(void) {
+  fired.clear();
+}
+
+void tearDown(void) {
+}
+
+// Timer wheel
+
+static std::vector<std::pair<uint8_t, uint32_t>> wheel_fired;
+
+static void wheel_record(uint8_t id, uint32_t minute) {
+  wheel_fired.push_back({id, minute});
+}
+
+// Every level, the level boundaries and a time beyond the wheel
+static void test_wheel_levels(void) {
+  static const uint32_t deltas[] = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 300000};
+  const uint32_t start = 1000003;
+  wheel_reset(start);
+  uint8_t n = sizeof(deltas) / sizeof(deltas[0]);
+  for (uint8_t id = 0; id < n; id++) {
+    wheel_add(id, start + deltas[id]);
+  }
+  wheel_fired.clear();
+  for (uint32_t m = start; m <= start + 300000; m++) {
+    wheel_advance(m, wheel_record);
+  }
+  TEST_ASSERT_EQUAL(n, wheel_fired.size());
+  for (uint8_t i = 0; i < n; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, wheel_fired[i].first);
+    TEST_ASSERT_EQUAL_UINT32(start + deltas[i], wheel_fired[i].second);
+    TEST_ASSERT_FALSE(wheel_armed(i));
+  }
+}
+
+// Random timers, removals and re-arms, advanced by random steps; each fire
+// must match the expiry a plain array holds for it
+static void test_wheel_random(void) {
+  std::mt19937 rng(15);
+  uint32_t expected[WHEEL_TIMERS];
+  bool armed[WHEEL_TIMERS] = {false};
+  uint32_t now = 5000;
+  wheel_reset(now);
+  uint32_t fires = 0;
+  for (uint32_t step = 0; step < 20000; step++) {
+    uint8_t id = rng() % WHEEL_TIMERS;
+    switch (rng() % 4) {
+      case 0:
+        wheel_remove(id);
+        armed[id] = false;
+        break;
+      default: {
+        uint32_t at = now + (rng() % 3 ? rng() % 200 : rng() % 400000);
+        wheel_add(id, at);
+        expected[id] = at;
+        armed[id] = true;
+        break;
+      }
+    }
+    uint32_t to = now + rng() % 90;
+    wheel_fired.clear();
+    wheel_advance(to, wheel_record);
+    for (auto &f : wheel_fired) {
+      TEST_ASSERT_TRUE(armed[f.first]);
+      TEST_ASSERT_EQUAL_UINT32(expected[f.first], f.second);
+      armed[f.first] = false;
+      fires++;
+    }
+    for (uint8_t i = 0; i < WHEEL_TIMERS; i++) {
+      // Nothing due is left behind
+      TEST_ASSERT_FALSE(armed[i] && expected[i] <= to);
+      TEST_ASSERT_EQUAL(armed[i], wheel_armed(i));
+    }
+    now = to + 1;
+    TEST_ASSERT_EQUAL_UINT32(now, wheel_now());
+  }
+  TEST_ASSERT_GREATER_THAN(1000, fires);
+}
+
+// fire() re-arming into the slot being processed and the next minute
+static void test_wheel_rearm_in_fire(void) {
+  wheel_reset(100);
+  wheel_add(0, 100);
+  static uint32_t count = 0;
+  count = 0;
+  wheel_advance(110, [](uint8_t id, uint32_t minute) {
+    count++;
+    if (count < 5) {
+      wheel_add(id, minute + 1);
+    }
+  });
+  TEST_ASSERT_EQUAL_UINT32(5, count);
+  TEST_ASSERT_FALSE(wheel_armed(0));
+  // A time already past fires on the next tick
+  wheel_add(1, 50);
+  wheel_fired.clear();
+  wheel_advance(111, wheel_record);
+  TEST_ASSERT_EQUAL(1, wheel_fired.size());
+  TEST_ASSERT_EQUAL_UINT32(111, wheel_fired[0].second);
+}
+
+// Schedule
+
+// Monday 2026-10-12 00:00 to the next Monday, second by second
+static void test_week(void) {
+  static const char *const lines[] = {
+    "Mon-Fri 08:00 mode=1 temp=23 on_off=1",
+    "Mon-Fri 19:00 on_off=0",
+    "Sat,Sun 10:30 zones=0 on_off=1",
+    "daily 00:00 fan=2",
+    "2026-10-15 12:34 temp=20",
+    "2026-10-01 12:00 temp=30",   // already past, never fires
+  };
+  const uint32_t monday = minute_at(2026, 10, 12, 0, 0);
+  set_clock(monday - 1, 30);
+  load(lines, sizeof(lines) / sizeof(lines[0]));
+  run_for(1);
+  // Armed at the next run of each entry
+  TEST_ASSERT_EQUAL_UINT32(monday + 8 * 60, schedule_next(0));
+  TEST_ASSERT_EQUAL_UINT32(monday + 19 * 60, schedule_next(1));
+  TEST_ASSERT_EQUAL_UINT32(monday + 5 * 1440 + 10 * 60 + 30, schedule_next(2));
+  TEST_ASSERT_EQUAL_UINT32(monday, schedule_next(3));
+  TEST_ASSERT_EQUAL_UINT32(minute_at(2026, 10, 15, 12, 34), schedule_next(4));
+  TEST_ASSERT_EQUAL_UINT32(0, schedule_next(5));
+
+  run_for(7 * 86400 + 60);
+
+  std::vector<std::pair<uint32_t, uint16_t>> expected;
+  for (uint8_t day = 0; day <= 7; day++) {
+    uint32_t midnight = monday + day * 1440;
+    expected.push_back({midnight, 1 << CMD_FAN});
+    if (day < 5) {
+      expected.push_back({midnight + 8 * 60, (1 << CMD_MODE) | (1 << CMD_TEMP) | (1 << CMD_ON_OFF)});
+    }
+    if (day == 3) {
+      expected.push_back({midnight + 12 * 60 + 34, 1 << CMD_TEMP});
+    }
+    if (day == 5 || day == 6) {
+      expected.push_back({midnight + 10 * 60 + 30, 1 << CMD_ON_OFF});
+    }
+    if (day < 5) {
+      expected.push_back({midnight + 19 * 60, 1 << CMD_ON_OFF});
+    }
+  }
+  TEST_ASSERT_EQUAL(expected.size(), fired.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(expected[i].first, fired[i].minute);
+    TEST_ASSERT_EQUAL_UINT16(expected[i].second, fired[i].fields);
+  }
+  // Values and zones of the entries
+  TEST_ASSERT_EQUAL_UINT32(1, fired[1].zones);
+  TEST_ASSERT_EQUAL_UINT8(1, fired[1].cmd[CMD_MODE]);
+  TEST_ASSERT_EQUAL_UINT8(23, fired[1].cmd[CMD_TEMP]);
+  TEST_ASSERT_EQUAL_UINT8(2, fired[0].cmd[CMD_FAN]);
+
+  // Re-armed a week on, the one-shots are done
+  const uint32_t next_monday = monday + 7 * 1440;
+  TEST_ASSERT_EQUAL_UINT32(next_monday + 8 * 60, schedule_next(0));
+  TEST_ASSERT_EQUAL_UINT32(next_monday + 19 * 60, schedule_next(1));
+  TEST_ASSERT_EQUAL_UINT32(next_monday + 5 * 1440 + 10 * 60 + 30, schedule_next(2));
+  TEST_ASSERT_EQUAL_UINT32(next_monday + 1440, schedule_next(3));
+  TEST_ASSERT_EQUAL_UINT32(0, schedule_next(4));
+}
+
+// Steps up to SCHEDULE_CATCHUP_MIN fire the runs they step over, once
+static void test_jump_forward_small(void) {
+  static const char *const lines[] = {"Mon-Fri 08:00 on_off=1", "Mon-Fri 08:20 on_off=0"};
+  const uint32_t tuesday = minute_at(2026, 10, 13, 0, 0);
+  set_clock(tuesday + 7 * 60 + 50);
+  load(lines, 2);
+  run_for(2);
+  set_clock(tuesday + 8 * 60 + 30);
+  run_for(2);
+  TEST_ASSERT_EQUAL(2, fired.size());
+  TEST_ASSERT_EQUAL_UINT16(1 << CMD_ON_OFF, fired[0].fields);
+  TEST_ASSERT_EQUAL_UINT8(1, fired[0].cmd[CMD_ON_OFF]);
+  TEST_ASSERT_EQUAL_UINT8(0, fired[1].cmd[CMD_ON_OFF]);
+  TEST_ASSERT_EQUAL_UINT32(tuesday + 1440 + 8 * 60, schedule_next(0));
+  run_for(3600);
+  TEST_ASSERT_EQUAL(2, fired.size());
+}
+
+// Bigger steps skip the runs in between and arm the next ones
+static void test_jump_forward_large(void) {
+  static const char *const lines[] = {"Mon-Fri 08:00 on_off=1", "2026-10-13 09:00 temp=25"};
+  const uint32_t tuesday = minute_at(2026, 10, 13, 0, 0);
+  set_clock(tuesday + 7 * 60);
+  load(lines, 2);
+  run_for(2);
+  set_clock(tuesday + 12 * 60);
+  run_for(2);
+  TEST_ASSERT_EQUAL(0, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(tuesday + 1440 + 8 * 60, schedule_next(0));
+  TEST_ASSERT_EQUAL_UINT32(0, schedule_next(1));
+  set_clock(tuesday + 1440 + 7 * 60 + 59, 50);
+  run_for(20);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(tuesday + 1440 + 8 * 60, fired[0].minute);
+}
+
+// Going back (DST end, a correction) does not run again what already ran
+static void test_jump_back(void) {
+  static const char *const lines[] = {"daily 02:30 on_off=1", "daily 03:10 on_off=0"};
+  const uint32_t sunday = minute_at(2026, 10, 25, 0, 0);
+  set_clock(sunday + 2 * 60 + 20);
+  load(lines, 2);
+  run_for(20 * 60);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(sunday + 2 * 60 + 30, fired[0].minute);
+  // 02:40 back to 01:40
+  set_clock(sunday + 60 + 40);
+  run_for(2 * 3600);
+  TEST_ASSERT_EQUAL(2, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(sunday + 3 * 60 + 10, fired[1].minute);
+  TEST_ASSERT_EQUAL_UINT32(sunday + 1440 + 2 * 60 + 30, schedule_next(0));
+}
+
+// Nothing runs before NTP; the first sync arms from the synced time
+static void test_clock_not_set(void) {
+  static const char *const lines[] = {"daily 06:00 on_off=1"};
+  native_time_set(1000);
+  load(lines, 1);
+  run_for(600);
+  TEST_ASSERT_EQUAL_UINT32(0, schedule_now());
+  TEST_ASSERT_EQUAL_UINT32(0, schedule_next(0));
+  const uint32_t day = minute_at(2026, 10, 14, 0, 0);
+  set_clock(day + 5 * 60 + 59, 55);
+  run_for(10);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(day + 6 * 60, fired[0].minute);
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_clock_freeze(true);
+  setenv("TZ", "UTC0", 1);
+  tzset();
+  NativeHeapScope firmware;
+  schedule_begin(record);
+  UNITY_BEGIN();
+  RUN_TEST(test_wheel_levels);
+  RUN_TEST(test_wheel_random);
+  RUN_TEST(test_wheel_rearm_in_fire);
+  RUN_TEST(test_week);
+  RUN_TEST(test_jump_forward_small);
+  RUN_TEST(test_jump_forward_large);
+  RUN_TEST(test_jump_back);
+  RUN_TEST(test_clock_not_set);
+  return UNITY_END();
+}
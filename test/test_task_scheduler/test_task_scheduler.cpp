@@ -0,0 +1,216 @@
+// tasks_run() (task_scheduler.h) on the frozen host clock: run order and
+// yields, periods, budget overrun accounting, no catch-up on missed
+// periods after a stall, and the micros() wrap.
+#include <unity.h>
+#include <native.h>
+#include "task_scheduler.h"
+
+// What ran, in order: a task letter, '.' for a yield
+static char trace[256];
+static uint8_t traced;
+
+static void note(char c) {
+  if (traced < sizeof(trace) - 1) {
+    trace[traced++] = c;
+    trace[traced] = 0;
+  }
+}
+
+static uint32_t clock_us() {
+  return micros();
+}
+
+static void yield_fn() {
+  note('.');
+}
+
+// Run time of each task in us, changed by the tests
+static uint32_t cost_a, cost_b, cost_c;
+
+static void task_a() {
+  note('a');
+  native_advance_us(cost_a);
+}
+
+static void task_b() {
+  note('b');
+  native_advance_us(cost_b);
+}
+
+static void task_c() {
+  note('c');
+  native_advance_us(cost_c);
+}
+
+// One pass every ms for ms milliseconds, on top of the time the tasks take
+static void run_passes(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    tasks_run();
+    native_advance_us(1000);
+  }
+}
+
+static void clear_trace() {
+  traced = 0;
+  trace[0] = 0;
+}
+
+void setUp(void) {
+  native_clock_freeze(true);
+  tasks_begin(clock_us, yield_fn);
+  cost_a = cost_b = cost_c = 0;
+  clear_trace();
+}
+
+void tearDown(void) {
+}
+
+// Table order, a yield after each task that ran and none after one that
+// was not due
+static void test_order(void) {
+  TEST_ASSERT_EQUAL(0, task_add("a", task_a, 0, 100));
+  TEST_ASSERT_EQUAL(1, task_add("b", task_b, 10, 100));
+  TEST_ASSERT_EQUAL(2, task_add("c", task_c, 0, 100));
+  tasks_run();
+  TEST_ASSERT_EQUAL_STRING("a.b.c.", trace);
+  clear_trace();
+  native_advance_us(1000);
+  tasks_run();
+  TEST_ASSERT_EQUAL_STRING("a.c.", trace);
+  clear_trace();
+  native_advance_us(9000);
+  tasks_run();
+  TEST_ASSERT_EQUAL_STRING("a.b.c.", trace);
+  TEST_ASSERT_EQUAL(3, task_count());
+  TEST_ASSERT_EQUAL_STRING("b", task_stats(1).name);
+}
+
+static void test_table_full(void) {
+  for (uint8_t i = 0; i < TASK_MAX; i++) {
+    TEST_ASSERT_EQUAL(i, task_add("a", task_a, 0, 100));
+  }
+  TEST_ASSERT_EQUAL(-1, task_add("b", task_b, 0, 100));
+  TEST_ASSERT_EQUAL(TASK_MAX, task_count());
+  tasks_begin(clock_us, yield_fn);
+  TEST_ASSERT_EQUAL(0, task_count());
+}
+
+// Runs on the first pass, then once per period
+static void test_periods(void) {
+  task_add("a", task_a, 10, 100);
+  task_add("b", task_b, 0, 100);
+  task_add("c", task_c, 25, 100);
+  run_passes(100);
+  TEST_ASSERT_EQUAL_UINT32(10, task_stats(0).runs);
+  TEST_ASSERT_EQUAL_UINT32(100, task_stats(1).runs);
+  TEST_ASSERT_EQUAL_UINT32(4, task_stats(2).runs);
+  TEST_ASSERT_EQUAL_UINT32(10 + 100 + 4, traced / 2);
+}
+
+// Counted when a run takes longer than the budget, not when it takes all of it
+static void test_overruns(void) {
+  task_add("a", task_a, 0, 500);
+  task_add("b", task_b, 0, 2000);
+  cost_a = 500;
+  cost_b = 300;
+  tasks_run();
+  cost_a = 501;
+  cost_b = 2500;
+  tasks_run();
+  cost_a = 200;
+  cost_b = 100;
+  tasks_run();
+  const TaskStats &a = task_stats(0);
+  TEST_ASSERT_EQUAL_UINT32(3, a.runs);
+  TEST_ASSERT_EQUAL_UINT32(1, a.overruns);
+  TEST_ASSERT_EQUAL_UINT32(501, a.wcet_us);
+  TEST_ASSERT_EQUAL_UINT64(500 + 501 + 200, a.total_us);
+  const TaskStats &b = task_stats(1);
+  TEST_ASSERT_EQUAL_UINT32(1, b.overruns);
+  TEST_ASSERT_EQUAL_UINT32(2500, b.wcet_us);
+  TEST_ASSERT_EQUAL_UINT64(300 + 2500 + 100, b.total_us);
+  // The budget and period are kept as declared
+  TEST_ASSERT_EQUAL_UINT32(500, a.budget_us);
+  TEST_ASSERT_EQUAL_UINT32(0, a.period_us);
+}
+
+// A task's run time is its own: the time an earlier task of the same pass
+// took makes a later one due, but is not charged to it
+static void test_overrun_not_charged_to_next(void) {
+  task_add("a", task_a, 0, 1000);
+  task_add("b", task_b, 10, 1000);
+  tasks_run();
+  cost_a = 12000;
+  cost_b = 50;
+  native_advance_us(1000);
+  clear_trace();
+  tasks_run();
+  TEST_ASSERT_EQUAL_STRING("a.b.", trace);
+  TEST_ASSERT_EQUAL_UINT32(1, task_stats(0).overruns);
+  TEST_ASSERT_EQUAL_UINT32(0, task_stats(1).overruns);
+  TEST_ASSERT_EQUAL_UINT32(50, task_stats(1).wcet_us);
+}
+
+// After a 55 ms stall a 10 ms task runs once, not once per missed period,
+// and its next run is a period after the late one
+static void test_no_catch_up(void) {
+  task_add("a", task_a, 10, 100);
+  task_add("b", task_b, 0, 50000);
+  run_passes(15);
+  TEST_ASSERT_EQUAL_UINT32(2, task_stats(0).runs);
+  cost_b = 55000;
+  tasks_run();
+  cost_b = 0;
+  native_advance_us(1000);
+  // a last ran at 10 ms, b stalled the loop until 70 ms
+  clear_trace();
+  run_passes(1);
+  TEST_ASSERT_EQUAL_STRING("a.b.", trace);
+  TEST_ASSERT_EQUAL_UINT32(3, task_stats(0).runs);
+  run_passes(9);
+  TEST_ASSERT_EQUAL_UINT32(3, task_stats(0).runs);
+  run_passes(1);
+  TEST_ASSERT_EQUAL_UINT32(4, task_stats(0).runs);
+  TEST_ASSERT_EQUAL_UINT32(1, task_stats(1).overruns);
+}
+
+// A task longer than its period runs on every pass
+static void test_longer_than_period(void) {
+  task_add("a", task_a, 2, 1000);
+  cost_a = 3000;
+  for (uint8_t i = 0; i < 5; i++) {
+    tasks_run();
+  }
+  TEST_ASSERT_EQUAL_STRING("a.a.a.a.a.", trace);
+  TEST_ASSERT_EQUAL_UINT32(5, task_stats(0).overruns);
+}
+
+// micros() wraps every 71 minutes: periods and run times go on across it
+static void test_clock_wrap(void) {
+  uint64_t to_wrap = 0x100000000ULL - (uint32_t)micros();
+  native_advance_us(to_wrap - 25000);
+  task_add("a", task_a, 10, 1000);
+  task_add("b", task_b, 0, 1000);
+  run_passes(50);
+  TEST_ASSERT_EQUAL_UINT32(5, task_stats(0).runs);
+  TEST_ASSERT_EQUAL_UINT32(50, task_stats(1).runs);
+  // A run across the wrap is timed right
+  native_advance_us(0x100000000ULL - (uint32_t)micros() - 100);
+  cost_b = 300;
+  tasks_run();
+  TEST_ASSERT_EQUAL_UINT32(300, task_stats(1).wcet_us);
+  TEST_ASSERT_EQUAL_UINT32(0, task_stats(1).overruns);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_order);
+  RUN_TEST(test_table_full);
+  RUN_TEST(test_periods);
+  RUN_TEST(test_overruns);
+  RUN_TEST(test_overrun_not_charged_to_next);
+  RUN_TEST(test_no_catch_up);
+  RUN_TEST(test_longer_than_period);
+  RUN_TEST(test_clock_wrap);
+  return UNITY_END();
+}
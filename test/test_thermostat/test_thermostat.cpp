@@ -0,0 +1,135 @@
+// The thermostat (thermostat.h) on the frozen host clock with simulated
+// DHT11 readings: the fan follows the demand of the AC mode, and drops to
+// auto when the room overshoots the target instead of speeding up. POST
+// /thermostat rejects values out of range before storing them.
+#include <unity.h>
+#include <native.h>
+#include <native_session.h>
+#include <ir_Gree.h>
+#include "dht_sampler.h"
+#include "thermostat.h"
+
+static dht sensor;
+static uint8_t states[ZONE_COUNT * CMD_PARAMS];
+
+// Last command the thermostat sent, applied to states[] as main.cpp does
+static uint8_t sent[CMD_PARAMS];
+static uint16_t sent_fields;
+static uint32_t sent_count;
+
+static void apply(uint32_t zones, const uint8_t *cmd, uint16_t fields) {
+  memcpy(sent, cmd, CMD_PARAMS);
+  sent_fields = fields;
+  sent_count++;
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (zones & (1UL << z)) {
+      for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+        if (fields & (1 << i)) {
+          states[z * CMD_PARAMS + i] = cmd[i];
+        }
+      }
+    }
+  }
+}
+
+// Fills the median window with one room temperature
+static void set_room(float temperature) {
+  native_dht_set(temperature, 50);
+  for (uint8_t i = 0; i < DHT_MEDIAN_WINDOW; i++) {
+    native_advance_ms(DHT11_MIN_INTERVAL_MS);
+    dht_sampler_loop();
+  }
+}
+
+// AC on in `mode` at `temp` with the fan at `fan`, thermostat holding 24 C
+static void start(uint8_t mode, uint8_t temp, uint8_t fan) {
+  states[CMD_MODE] = mode;
+  states[CMD_TEMP] = temp;
+  states[CMD_FAN] = fan;
+  states[CMD_ON_OFF] = 1;
+  ThermostatConfig config = {THERMOSTAT_HYSTERESIS, 0, 1, 24.0, 0.5, 1.0, 0.1, THERMOSTAT_MIN_INTERVAL_MS};
+  TEST_ASSERT_TRUE(thermostat_configure(config));
+  sent_count = 0;
+}
+
+// One evaluation, returns the fan it asked for
+static uint8_t run(float room) {
+  set_room(room);
+  thermostat_loop();
+  TEST_ASSERT_EQUAL_STRING("active", thermostat_status());
+  TEST_ASSERT_EQUAL_UINT32(1, sent_count);
+  TEST_ASSERT_TRUE(sent_fields & (1 << CMD_FAN));
+  return sent[CMD_FAN];
+}
+
+static void test_login(void) {
+  TEST_ASSERT_TRUE(native_login());
+}
+
+void setUp(void) {
+  native_clock_freeze(true);
+  memset(states, 0, sizeof(states));
+  dht_sampler_begin(sensor, 5, DHT11_MIN_INTERVAL_MS);
+  thermostat_begin(states, apply);
+}
+
+void tearDown(void) {
+}
+
+// The fan follows how far the room is from the target in the direction the
+// mode works
+static void test_demand(void) {
+  start(kGreeCool, 24, kGreeFanAuto);
+  TEST_ASSERT_EQUAL(kGreeFanMax, run(27));
+  start(kGreeHeat, 24, kGreeFanAuto);
+  TEST_ASSERT_EQUAL(kGreeFanMax, run(21));
+  start(kGreeCool, 24, kGreeFanAuto);
+  TEST_ASSERT_EQUAL(2, run(25));
+}
+
+// Past the target (too cold while cooling, too warm while heating): the fan
+// goes to auto, not up with the size of the error
+static void test_overshoot(void) {
+  start(kGreeCool, 22, kGreeFanMax);
+  TEST_ASSERT_EQUAL(kGreeFanAuto, run(21));
+  // And the setpoint goes up to stop cooling
+  TEST_ASSERT_EQUAL(23, sent[CMD_TEMP]);
+  start(kGreeHeat, 26, kGreeFanMax);
+  TEST_ASSERT_EQUAL(kGreeFanAuto, run(27));
+  TEST_ASSERT_EQUAL(25, sent[CMD_TEMP]);
+}
+
+// Out of range for the field's type (zone, fan, interval) or not finite:
+// 400 and nothing changed
+static void test_post_rejects(void) {
+  static const char *const bodies[] = {
+    "zone=256", "zone=1", "zone=-1", "zone=0.5", "fan=2", "fan=-1", "interval_s=-1", "interval_s=1e30",
+    "interval_s=4294968", "interval_s=99999999999", "interval_s=59", "target=nan", "target=inf", "kp=",
+    "ki=1e99", "mode=fast", "mode=pi&zone=300",
+  };
+  ThermostatConfig before = thermostat_config();
+  for (uint8_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++) {
+    NativeResponse response;
+    TEST_ASSERT_EQUAL_MESSAGE(400, native_session_request("POST", "/thermostat", bodies[i], &response), bodies[i]);
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&before, &thermostat_config(), sizeof(before), bodies[i]);
+  }
+  NativeResponse response;
+  TEST_ASSERT_EQUAL(200, native_session_request("POST", "/thermostat",
+                                                "mode=pi&zone=0&fan=1&target=23.5&interval_s=120", &response));
+  const ThermostatConfig &after = thermostat_config();
+  TEST_ASSERT_EQUAL(THERMOSTAT_PI, after.mode);
+  TEST_ASSERT_EQUAL(1, after.drive_fan);
+  TEST_ASSERT_EQUAL_FLOAT(23.5, after.target);
+  TEST_ASSERT_EQUAL_UINT32(120000, after.interval_ms);
+}
+
+int main(int argc, char **argv) {
+  native_serial_echo(false);
+  native_boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_demand);
+  RUN_TEST(test_overshoot);
+  RUN_TEST(test_login);
+  RUN_TEST(test_post_rejects);
+  return UNITY_END();
+}
@@ -0,0 +1,117 @@
+// wifi_link (wifi_link.h) across simulated boots: first association by
+// scan, then BSSID and channel from RTC memory after a reset and from the
+// EEPROM after a power loss, the IP from DHCP every time, and the EEPROM
+// written only when the AP or channel changes.
+#include <unity.h>
+#include <native.h>
+#include <ESP8266WiFi.h>
+#include <EEPROM.h>
+#include "eeprom_layout.h"
+#include "wifi_link.h"
+
+static void clear_rtc() {
+  uint32_t zero[32] = {0};
+  ESP.rtcUserMemoryWrite(0, zero, sizeof(zero));
+}
+
+static void clear_eeprom() {
+  EEPROM.begin(EEPROM_LAYOUT_SIZE);
+  for (uint16_t i = EEPROM_WIFI; i < EEPROM_LAYOUT_SIZE; i++) {
+    EEPROM.write(i, 0xFF);
+  }
+  EEPROM.commit();
+  EEPROM.end();
+}
+
+// Link down as at a reboot, associate again, up to the first link up
+static void boot() {
+  WiFi.disconnect();
+  wifi_link_loop();
+  TEST_ASSERT_FALSE(wifi_link_up());
+  wifi_link_begin("gree-test", "secret");
+  TEST_ASSERT_TRUE(wifi_link_loop());
+  TEST_ASSERT_TRUE(wifi_link_up());
+  // Never a static address: the lease is DHCP's to renew
+  TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)WiFi.staticIP());
+}
+
+void setUp(void) {
+  native_serial_echo(false);
+}
+
+void tearDown(void) {
+}
+
+static void test_first_boot_scans(void) {
+  clear_rtc();
+  clear_eeprom();
+  uint32_t commits = native_eeprom_commits();
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_NONE, wifi_link_fast());
+  // The channel is saved for the next boot
+  TEST_ASSERT_EQUAL_UINT32(commits + 1, native_eeprom_commits());
+}
+
+static void test_reset_uses_rtc(void) {
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_CHANNEL, wifi_link_fast());
+  // Same AP and channel: nothing written
+  uint32_t commits = native_eeprom_commits();
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_CHANNEL, wifi_link_fast());
+  TEST_ASSERT_EQUAL_UINT32(commits, native_eeprom_commits());
+}
+
+static void test_power_loss_uses_eeprom(void) {
+  clear_rtc();
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_CHANNEL, wifi_link_fast());
+}
+
+// The AP moved to another channel: saved once, and asked for after a
+// power loss
+static void test_channel_change(void) {
+  clear_rtc();
+  clear_eeprom();
+  WiFi.begin("gree-test", "secret", 11);
+  uint32_t commits = native_eeprom_commits();
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_NONE, wifi_link_fast());
+  TEST_ASSERT_EQUAL_UINT32(commits + 1, native_eeprom_commits());
+  clear_rtc();
+  WiFi.begin("gree-test", "secret", 6);
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_CHANNEL, wifi_link_fast());
+  TEST_ASSERT_EQUAL(11, WiFi.channel());
+  TEST_ASSERT_EQUAL_UINT32(commits + 1, native_eeprom_commits());
+}
+
+// A cache of an older layout (with the IP lease) is not used
+static void test_old_cache_ignored(void) {
+  clear_eeprom();
+  uint32_t old[8] = {0x57464331UL};
+  ESP.rtcUserMemoryWrite(0, old, sizeof(old));
+  boot();
+  TEST_ASSERT_EQUAL(WIFI_FAST_NONE, wifi_link_fast());
+}
+
+// The cache is for one SSID
+static void test_other_ssid(void) {
+  boot();
+  WiFi.disconnect();
+  wifi_link_loop();
+  wifi_link_begin("other", "secret");
+  TEST_ASSERT_EQUAL(WIFI_FAST_NONE, wifi_link_fast());
+  TEST_ASSERT_TRUE(wifi_link_loop());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_boot_scans);
+  RUN_TEST(test_reset_uses_rtc);
+  RUN_TEST(test_power_loss_uses_eeprom);
+  RUN_TEST(test_channel_change);
+  RUN_TEST(test_old_cache_ignored);
+  RUN_TEST(test_other_ssid);
+  return UNITY_END();
+}
@@ -0,0 +1,495 @@
+// Listener for the nodes' UDP status announcements, run on a host
+// (Linux/macOS).
+//
+// Joins the announcement group, checks the HMAC of each datagram with the
+// shared key and drops replays (boot counter below the last one of that
+// node, or sequence number not above the last one of that node and boot),
+// then keeps one row per node: address, boot, last sequence number,
+// datagrams lost, uptime, DHT readings, IR queue and the state of every
+// zone. What was seen is kept for the run only: a listener started anew
+// takes the first datagram of each node as it comes. On a terminal the table is redrawn in place,
+// otherwise each accepted datagram is logged on a line.
+// --emit sends synthetic announcements with the same layout instead, so
+// both sides can be tried on one host, e.g. over loopback:
+//   ./announce_listen --key test --group 127.0.0.1 -n 5 &
+//   ./announce_listen --key test --group 127.0.0.1 --emit 5
+//
+// Build (from the repo root, the layout comes from src/announce.h):
+//   g++ -O2 -std=gnu++17 -Isrc -o announce_listen tools/announce_listen.cpp
+// Run:
+//   ./announce_listen --key <ANNOUNCE_KEY>
+//   ./announce_listen --key <ANNOUNCE_KEY> --group 239.255.71.1 --port 4571 --iface 192.168.1.10
+#include <map>
+#include <string>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "announce.h"
+
+struct Options {
+  std::string group = "239.255.71.1";
+  int port = 4571;
+  std::string key;                // ANNOUNCE_KEY, required
+  std::string iface = "0.0.0.0";  // interface of the group membership
+  long count = 0;                 // exit after this many accepted, 0: never
+  double stale_s = 90;            // rows not heard from for this long are marked
+  long emit = 0;                  // send this many announcements instead
+  uint32_t node = 0x00c0ffee;     // --emit
+  uint32_t boot = 1;              // --emit
+  int zones = 1;                  // --emit
+  int interval_ms = 200;          // --emit
+};
+
+// SHA-256 (FIPS 180-4), for the HMAC
+
+struct Sha256 {
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  uint8_t buf[64];
+  uint64_t len = 0;
+
+  static uint32_t ror(uint32_t x, int c) { return (x >> c) | (x << (32 - c)); }
+
+  void block(const uint8_t *p) {
+    static const uint32_t K[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      w[i] = ((uint32_t)p[i * 4] << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t t1 = hh + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+      uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      hh = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += hh;
+  }
+
+  void update(const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (n--) {
+      buf[len++ % 64] = *p++;
+      if (len % 64 == 0) {
+        block(buf);
+      }
+    }
+  }
+
+  void digest(uint8_t *out) {
+    uint64_t bits = len * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (len % 64 != 56) {
+      update(&pad, 1);
+    }
+    for (int i = 7; i >= 0; i--) {
+      uint8_t b = bits >> (8 * i);
+      update(&b, 1);
+    }
+    for (int i = 0; i < 32; i++) {
+      out[i] = h[i / 4] >> (24 - 8 * (i % 4));
+    }
+  }
+};
+
+// RFC 2104, truncated to ANNOUNCE_MAC_LEN as the node sends it
+static void announce_mac(const std::string &key, const uint8_t *msg, size_t len, uint8_t *mac) {
+  uint8_t k[64] = {};
+  if (key.size() > 64) {
+    Sha256 kh;
+    kh.update(key.data(), key.size());
+    kh.digest(k);
+  } else {
+    memcpy(k, key.data(), key.size());
+  }
+  uint8_t pad[64];
+  uint8_t inner[32];
+  Sha256 in;
+  for (int i = 0; i < 64; i++) {
+    pad[i] = k[i] ^ 0x36;
+  }
+  in.update(pad, 64);
+  in.update(msg, len);
+  in.digest(inner);
+  uint8_t outer[32];
+  Sha256 out;
+  for (int i = 0; i < 64; i++) {
+    pad[i] = k[i] ^ 0x5c;
+  }
+  out.update(pad, 64);
+  out.update(inner, 32);
+  out.digest(outer);
+  memcpy(mac, outer, ANNOUNCE_MAC_LEN);
+}
+
+// Datagram fields
+
+static uint16_t get_u16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  put_u16(p, v);
+  put_u16(p + 2, v >> 16);
+}
+
+// As cmd_unpack() (src/ac_state.cpp)
+static void unpack_state(const uint8_t *packed, uint8_t *cmd) {
+  uint32_t bits = 0;
+  for (uint8_t b = 0; b < CMD_PACKED_BYTES; b++) {
+    bits |= (uint32_t)packed[b] << (8 * b);
+  }
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    uint8_t mask = (1 << CMD_FIELDS[i].bits) - 1;
+    cmd[i] = CMD_FIELDS[i].min + ((bits >> cmd_field_shift(i)) & mask);
+  }
+}
+
+// IrTxStatus order (src/ir_queue.h)
+static const char *tx_name(uint8_t status) {
+  static const char *const names[] = {"unknown", "pending", "sending", "done", "superseded"};
+  return status < sizeof(names) / sizeof(names[0]) ? names[status] : "?";
+}
+
+static double now_s() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: announce_listen [options]\n"
+          "  --group G        multicast group, or a unicast address (239.255.71.1)\n"
+          "  --port P         (4571)\n"
+          "  --key K          ANNOUNCE_KEY of the nodes (required)\n"
+          "  --iface A        interface address for the group (0.0.0.0: default)\n"
+          "  -n N             exit after N accepted announcements\n"
+          "  --stale S        mark nodes not heard from for S seconds (90)\n"
+          "  --emit N         send N synthetic announcements instead of listening\n"
+          "  --node ID        node id of --emit, hex (c0ffee)\n"
+          "  --boot N         boot counter of --emit (1)\n"
+          "  --zones Z        zones of --emit (1)\n"
+          "  --interval MS    between --emit announcements (200)\n");
+  exit(2);
+}
+
+static Options parse_args(int argc, char **argv) {
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!v) {
+      usage();
+    }
+    i++;
+    if (a == "--group") {
+      opt.group = v;
+    } else if (a == "--port") {
+      opt.port = atoi(v);
+    } else if (a == "--key") {
+      opt.key = v;
+    } else if (a == "--iface") {
+      opt.iface = v;
+    } else if (a == "-n") {
+      opt.count = atol(v);
+    } else if (a == "--stale") {
+      opt.stale_s = atof(v);
+    } else if (a == "--emit") {
+      opt.emit = atol(v);
+    } else if (a == "--node") {
+      opt.node = strtoul(v, NULL, 16);
+    } else if (a == "--boot") {
+      opt.boot = strtoul(v, NULL, 10);
+    } else if (a == "--zones") {
+      opt.zones = atoi(v);
+    } else if (a == "--interval") {
+      opt.interval_ms = atoi(v);
+    } else {
+      usage();
+    }
+  }
+  if (opt.key.empty() || opt.port < 1 || opt.port > 65535 || opt.zones < 1 || opt.zones > 32) {
+    usage();
+  }
+  return opt;
+}
+
+static bool parse_addr(const std::string &text, in_addr *addr) {
+  if (inet_pton(AF_INET, text.c_str(), addr) != 1) {
+    fprintf(stderr, "%s: not an IPv4 address\n", text.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Emitter: what announce_loop() sends, with made up values
+
+static int emit(const Options &opt) {
+  in_addr group, iface;
+  if (!parse_addr(opt.group, &group) || !parse_addr(opt.iface, &iface)) {
+    return 1;
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (IN_MULTICAST(ntohl(group.s_addr))) {
+    unsigned char ttl = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    if (iface.s_addr != INADDR_ANY) {
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+    }
+  }
+  sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_port = htons(opt.port);
+  to.sin_addr = group;
+  uint8_t cmd[CMD_PARAMS];
+  for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+    cmd[i] = CMD_FIELDS[i].def;
+  }
+  for (long seq = 1; seq <= opt.emit; seq++) {
+    uint8_t datagram[ANNOUNCE_BYTES(32)] = {};
+    memcpy(datagram, ANNOUNCE_MAGIC, 4);
+    put_u32(datagram + ANNOUNCE_NODE_OFFSET, opt.node);
+    put_u32(datagram + ANNOUNCE_BOOT_OFFSET, opt.boot);
+    put_u32(datagram + ANNOUNCE_SEQ_OFFSET, seq);
+    uint8_t *frame = datagram + ANNOUNCE_HEADER_SIZE;
+    frame[0] = STATUS_FORMAT;
+    frame[1] = opt.zones;
+    put_u32(frame + STATUS_VERSION_OFFSET, seq);
+    put_u32(frame + STATUS_UPTIME_OFFSET, seq * opt.interval_ms / 1000);
+    put_u16(frame + STATUS_TEMP_OFFSET, 2300 + seq % 50);
+    put_u16(frame + STATUS_HUMIDITY_OFFSET, 4500);
+    // One field changes per announcement, as a command would
+    cmd[1] = CMD_FIELDS[1].min + seq % (CMD_FIELDS[1].max - CMD_FIELDS[1].min + 1);
+    for (int z = 0; z < opt.zones; z++) {
+      uint8_t *zone = frame + STATUS_ZONES_OFFSET + z * (CMD_PACKED_BYTES + 1);
+      uint32_t bits = 0;
+      for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+        bits |= (uint32_t)(cmd[i] - CMD_FIELDS[i].min) << cmd_field_shift(i);
+      }
+      for (uint8_t b = 0; b < CMD_PACKED_BYTES; b++) {
+        zone[b] = bits >> (8 * b);
+      }
+      zone[CMD_PACKED_BYTES] = 3;  // done
+    }
+    size_t len = ANNOUNCE_HEADER_SIZE + STATUS_FRAME_BYTES(opt.zones);
+    announce_mac(opt.key, datagram, len, datagram + len);
+    len += ANNOUNCE_MAC_LEN;
+    if (sendto(fd, datagram, len, 0, (sockaddr *)&to, sizeof(to)) != (ssize_t)len) {
+      perror("sendto");
+      return 1;
+    }
+    if (seq < opt.emit) {
+      usleep(opt.interval_ms * 1000);
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+// Listener
+
+struct Node {
+  std::string addr;
+  uint32_t boot = 0;
+  uint32_t seq = 0;
+  double seen = 0;
+  long received = 0;
+  long lost = 0;     // sequence gaps
+  long reboots = 0;  // boot counter increases
+  std::string frame;
+};
+
+struct Counters {
+  long accepted = 0;
+  long bad_mac = 0;
+  long malformed = 0;
+  long replayed = 0;
+};
+
+static void print_node(uint32_t id, const Node &n, double now, double stale_s) {
+  const uint8_t *f = (const uint8_t *)n.frame.data();
+  int16_t temp = get_u16(f + STATUS_TEMP_OFFSET);
+  uint16_t humidity = get_u16(f + STATUS_HUMIDITY_OFFSET);
+  char room[24] = "-";
+  if (temp != STATUS_NO_READING) {
+    snprintf(room, sizeof(room), "%.2fC %.2f%%", temp / 100.0, humidity / 100.0);
+  }
+  printf("%08x %-15s %8u %7u %5ld %5.0fs%s %8us %-16s %u/%u/%u", id, n.addr.c_str(), n.boot, n.seq, n.lost,
+         now - n.seen, now - n.seen > stale_s ? "!" : " ", get_u32(f + STATUS_UPTIME_OFFSET), room,
+         f[STATUS_TX_OFFSET], get_u32(f + STATUS_TX_OFFSET + 1), get_u32(f + STATUS_TX_OFFSET + 5));
+  for (int z = 0; z < f[1]; z++) {
+    const uint8_t *zone = f + STATUS_ZONES_OFFSET + z * (CMD_PACKED_BYTES + 1);
+    uint8_t cmd[CMD_PARAMS];
+    unpack_state(zone, cmd);
+    printf("  [%d] %s mode=%u %uC fan=%u %s", z, cmd[CMD_ON_OFF] ? "on" : "off", cmd[CMD_MODE], cmd[CMD_TEMP],
+           cmd[CMD_FAN], tx_name(zone[CMD_PACKED_BYTES]));
+  }
+  printf("\n");
+}
+
+static void print_table(const std::map<uint32_t, Node> &nodes, const Counters &c, double stale_s) {
+  double now = now_s();
+  printf("%zu nodes, %ld accepted, %ld bad MAC, %ld replayed, %ld malformed\n", nodes.size(), c.accepted,
+         c.bad_mac, c.replayed, c.malformed);
+  printf("%-8s %-15s %-8s %7s %5s %6s %9s %-16s %s\n", "node", "address", "boot", "seq", "lost", "age",
+         "uptime", "room", "tx depth/last/done, zones");
+  for (const auto &it : nodes) {
+    print_node(it.first, it.second, now, stale_s);
+  }
+  fflush(stdout);
+}
+
+// Checks a datagram and updates its node, false if it is dropped
+static bool accept(const Options &opt, std::map<uint32_t, Node> &nodes, Counters &c, const uint8_t *d,
+                   size_t len, const sockaddr_in &from) {
+  const uint8_t *frame = d + ANNOUNCE_HEADER_SIZE;
+  if (len < ANNOUNCE_BYTES(0) || memcmp(d, ANNOUNCE_MAGIC, 4) != 0 || frame[0] != STATUS_FORMAT
+      || len != (size_t)ANNOUNCE_BYTES(frame[1])) {
+    c.malformed++;
+    return false;
+  }
+  size_t signed_len = len - ANNOUNCE_MAC_LEN;
+  uint8_t mac[ANNOUNCE_MAC_LEN];
+  announce_mac(opt.key, d, signed_len, mac);
+  if (memcmp(mac, d + signed_len, ANNOUNCE_MAC_LEN) != 0) {
+    c.bad_mac++;
+    return false;
+  }
+  uint32_t id = get_u32(d + ANNOUNCE_NODE_OFFSET);
+  uint32_t boot = get_u32(d + ANNOUNCE_BOOT_OFFSET);
+  uint32_t seq = get_u32(d + ANNOUNCE_SEQ_OFFSET);
+  auto it = nodes.find(id);
+  bool known = it != nodes.end();
+  Node &n = nodes[id];
+  // From an earlier boot, or not newer than the last one of this boot
+  if (known && (boot < n.boot || (boot == n.boot && seq <= n.seq))) {
+    c.replayed++;
+    return false;
+  }
+  if (known && boot > n.boot) {
+    n.reboots++;
+  } else if (known) {
+    n.lost += seq - n.seq - 1;
+  }
+  char addr[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &from.sin_addr, addr, sizeof(addr));
+  n.addr = addr;
+  n.boot = boot;
+  n.seq = seq;
+  n.seen = now_s();
+  n.received++;
+  n.frame.assign((const char *)frame, STATUS_FRAME_BYTES(frame[1]));
+  c.accepted++;
+  return true;
+}
+
+static int listen_loop(const Options &opt) {
+  in_addr group, iface;
+  if (!parse_addr(opt.group, &group) || !parse_addr(opt.iface, &iface)) {
+    return 1;
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(opt.port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (sockaddr *)&local, sizeof(local)) < 0) {
+    perror("bind");
+    return 1;
+  }
+  if (IN_MULTICAST(ntohl(group.s_addr))) {
+    ip_mreq mreq = {};
+    mreq.imr_multiaddr = group;
+    mreq.imr_interface = iface;
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+      perror("IP_ADD_MEMBERSHIP");
+      return 1;
+    }
+  }
+  bool tty = isatty(STDOUT_FILENO);
+  std::map<uint32_t, Node> nodes;
+  Counters c;
+  while (!opt.count || c.accepted < opt.count) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) {
+      perror("poll");
+      return 1;
+    }
+    bool changed = false;
+    if (pfd.revents & POLLIN) {
+      uint8_t d[1500];
+      sockaddr_in from = {};
+      socklen_t from_len = sizeof(from);
+      ssize_t len = recvfrom(fd, d, sizeof(d), 0, (sockaddr *)&from, &from_len);
+      if (len > 0 && accept(opt, nodes, c, d, len, from)) {
+        changed = true;
+        if (!tty) {
+          uint32_t id = get_u32(d + ANNOUNCE_NODE_OFFSET);
+          print_node(id, nodes[id], now_s(), opt.stale_s);
+          fflush(stdout);
+        }
+      }
+    }
+    // Ages move on a terminal even without traffic
+    if (tty && (changed || !(pfd.revents & POLLIN))) {
+      printf("\033[H\033[2J");
+      print_table(nodes, c, opt.stale_s);
+    }
+  }
+  print_table(nodes, c, opt.stale_s);
+  close(fd);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Options opt = parse_args(argc, argv);
+  return opt.emit ? emit(opt) : listen_loop(opt);
+}
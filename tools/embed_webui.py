@@ -0,0 +1,73 @@
+# Pre-build step: minify and gzip remote_ac.html into src/webui.h
+#
+# remote_ac.html is the only source of the WebUI. The generated header holds
+# the gzipped page as a PROGMEM byte array plus an ETag derived from its
+# content, so handleAC() can stream it straight from flash.
+#
+# Runs automatically from platformio.ini (extra_scripts), or by hand:
+#   python tools/embed_webui.py
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO/SCons)
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SOURCE = os.path.join(PROJECT_DIR, "remote_ac.html")
+TARGET = os.path.join(PROJECT_DIR, "src", "webui.h")
+
+
+def minify(html):
+    # Conservative: drop indentation, blank lines and whole-line // comments.
+    # Newlines are kept because the inline JS relies on ASI in a few places.
+    lines = []
+    for line in html.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines) + "\n"
+
+
+def render_header(data, etag, raw_len):
+    out = []
+    out.append("// Generated by tools/embed_webui.py from remote_ac.html, do not edit.")
+    out.append("#pragma once")
+    out.append("#include <Arduino.h>")
+    out.append("")
+    out.append("// Uncompressed (minified) size: %d bytes" % raw_len)
+    out.append("#define WEBUI_GZ_LEN %d" % len(data))
+    out.append("#define WEBUI_ETAG \"\\\"%s\\\"\"" % etag)
+    out.append("")
+    out.append("static const uint8_t WEBUI_GZ[WEBUI_GZ_LEN] PROGMEM = {")
+    for i in range(0, len(data), 16):
+        out.append("  " + ",".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    out.append("};")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    with open(SOURCE, "r", encoding="utf-8") as f:
+        raw = minify(f.read()).encode("utf-8")
+    # mtime=0 keeps the output (and therefore the ETag) reproducible
+    data = gzip.compress(raw, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(data).hexdigest()[:16]
+    header = render_header(data, etag, len(raw))
+
+    old = None
+    if os.path.exists(TARGET):
+        with open(TARGET, "r", encoding="utf-8") as f:
+            old = f.read()
+    # Only touch the header when the page changed, to avoid needless rebuilds
+    if old != header:
+        with open(TARGET, "w", encoding="utf-8") as f:
+            f.write(header)
+        print("webui: %s -> %s (%d -> %d bytes)" %
+              (os.path.basename(SOURCE), os.path.relpath(TARGET, PROJECT_DIR),
+               len(raw), len(data)))
+
+
+main()
@@ -0,0 +1,636 @@
+// Load generator for the node's HTTP API, run on a host (Linux/macOS).
+//
+// Reproduces the WebUI traffic: page loads of /, POST /acremote with a
+// "command" CSV, GET /state, plus 404 probes, from N concurrent clients
+// for a number of requests or seconds. Clients log in with Digest auth as
+// a browser does and then use the session cookie they get (--no-cookie to
+// answer every request with Digest). Reports throughput, error rates and
+// p50/p95/p99 latency per request kind, so two firmware versions can be
+// compared with numbers.
+//
+// Two targets:
+//  - a node, for the numbers that matter: flash it, take its address from
+//    the serial log and run from a host on the same WLAN. Latency includes
+//    the 80MHz CPU, lwIP and the radio; keep the host wired to the AP and
+//    compare runs made at the same distance.
+//  - the native firmware (pio run -e native, see README.txt), the same
+//    main.cpp, auth and handlers behind the host stand-in of the async
+//    server on 127.0.0.1. No hardware needed, for comparing two versions
+//    of the code and for leaks (gree_heap_* and gree_arena_* of /metrics
+//    after a run). Host CPU and kernel TCP: only the ratio between two
+//    versions says something, not the latencies themselves.
+//
+// Build (from the repo root, CMD_FIELDS comes from src/ac_state.h):
+//   g++ -O2 -std=gnu++17 -pthread -Isrc -o loadgen tools/loadgen.cpp
+// Run:
+//   ./loadgen --host 192.168.1.50 -c 8 -d 30 --mix page=1,command=4,notfound=1
+//   NATIVE_HTTP_PORT=8080 .pio/build/native/program &
+//   ./loadgen --host 127.0.0.1 --port 8080 -n 2000 -u antani -p antani
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "ac_state.h"
+
+enum Kind {
+  KIND_PAGE = 0,
+  KIND_COMMAND,
+  KIND_STATE,
+  KIND_NOT_FOUND,
+  KIND_STATUS,
+  KIND_COUNT
+};
+
+static const char *const kind_names[KIND_COUNT] = {"page", "command", "state", "notfound", "status"};
+
+struct Options {
+  std::string host = "192.168.1.50";
+  std::string port = "80";
+  std::string user = "antani";
+  std::string pass = "antani";
+  int concurrency = 4;
+  long requests = 0;       // total, 0: run for seconds
+  double seconds = 10;
+  int timeout_ms = 5000;
+  unsigned weights[KIND_COUNT] = {1, 4, 0, 1, 0};
+  std::string zones;       // "zones" argument of /acremote, empty: default
+  bool cookie = true;      // reuse the session cookie after a Digest login
+  bool revalidate = true;  // If-None-Match on page loads and /status, as a browser or poller does
+};
+
+// MD5 (RFC 1321), for Digest auth
+
+struct Md5 {
+  uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+  uint8_t buf[64];
+  uint64_t len = 0;
+
+  static uint32_t rol(uint32_t x, int c) { return (x << c) | (x >> (32 - c)); }
+
+  void block(const uint8_t *p) {
+    static const uint32_t K[64] = {
+      0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+      0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+      0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+      0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+      0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+      0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+      0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+      0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+    static const int R[64] = {
+      7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+      5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+      4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+      6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+      w[i] = p[i * 4] | (p[i * 4 + 1] << 8) | (p[i * 4 + 2] << 16) | ((uint32_t)p[i * 4 + 3] << 24);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (int i = 0; i < 64; i++) {
+      uint32_t f;
+      int g;
+      if (i < 16) {
+        f = (b & c) | (~b & d);
+        g = i;
+      } else if (i < 32) {
+        f = (d & b) | (~d & c);
+        g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+        f = b ^ c ^ d;
+        g = (3 * i + 5) % 16;
+      } else {
+        f = c ^ (b | ~d);
+        g = (7 * i) % 16;
+      }
+      uint32_t t = d;
+      d = c;
+      c = b;
+      b = b + rol(a + f + K[i] + w[g], R[i]);
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+  }
+
+  void update(const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (n--) {
+      buf[len++ % 64] = *p++;
+      if (len % 64 == 0) {
+        block(buf);
+      }
+    }
+  }
+
+  std::string hex() {
+    uint64_t bits = len * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (len % 64 != 56) {
+      update(&pad, 1);
+    }
+    for (int i = 0; i < 8; i++) {
+      uint8_t b = bits >> (8 * i);
+      update(&b, 1);
+    }
+    char out[33];
+    for (int i = 0; i < 16; i++) {
+      snprintf(out + i * 2, 3, "%02x", (h[i / 4] >> (8 * (i % 4))) & 0xFF);
+    }
+    return out;
+  }
+};
+
+static std::string md5_hex(const std::string &s) {
+  Md5 m;
+  m.update(s.data(), s.size());
+  return m.hex();
+}
+
+// HTTP client, one connection per request (the node closes it after each
+// response)
+
+struct Response {
+  int status = 0;          // 0: connection error or timeout
+  std::string headers;     // raw, lower cased names are searched
+  size_t body_len = 0;
+};
+
+static bool wait_fd(int fd, short events, const std::chrono::steady_clock::time_point &deadline) {
+  int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+  if (left <= 0) {
+    return false;
+  }
+  struct pollfd p = {fd, events, 0};
+  return poll(&p, 1, left) == 1;
+}
+
+static int connect_to(const addrinfo *ai, const std::chrono::steady_clock::time_point &deadline) {
+  int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (fd < 0) {
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return -1;
+  }
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (!wait_fd(fd, POLLOUT, deadline) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static Response http_request(const addrinfo *ai, const std::string &request, int timeout_ms) {
+  Response res;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  int fd = connect_to(ai, deadline);
+  if (fd < 0) {
+    return res;
+  }
+  size_t sent = 0;
+  while (sent < request.size()) {
+    if (!wait_fd(fd, POLLOUT, deadline)) {
+      close(fd);
+      return res;
+    }
+    ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0 && errno != EAGAIN) {
+      close(fd);
+      return res;
+    }
+    sent += n > 0 ? n : 0;
+  }
+  // Read until the server closes, or Content-Length is reached
+  std::string data;
+  size_t header_end = std::string::npos;
+  long content_length = -1;
+  char buf[2048];
+  for (;;) {
+    if (header_end != std::string::npos && content_length >= 0 &&
+        data.size() >= header_end + content_length) {
+      break;
+    }
+    if (!wait_fd(fd, POLLIN, deadline)) {
+      close(fd);
+      return res;
+    }
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EAGAIN) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    data.append(buf, n);
+    if (header_end == std::string::npos && (header_end = data.find("\r\n\r\n")) != std::string::npos) {
+      header_end += 4;
+      res.headers = data.substr(0, header_end);
+      std::transform(res.headers.begin(), res.headers.end(), res.headers.begin(), ::tolower);
+      size_t at = res.headers.find("\r\ncontent-length:");
+      if (at != std::string::npos) {
+        content_length = strtol(res.headers.c_str() + at + 17, NULL, 10);
+      }
+      // Keep the original case of the values (nonce, cookie)
+      res.headers = data.substr(0, header_end);
+    }
+  }
+  close(fd);
+  if (header_end == std::string::npos || sscanf(data.c_str(), "HTTP/1.%*d %d", &res.status) != 1) {
+    res.status = 0;
+    return res;
+  }
+  res.body_len = data.size() - header_end;
+  return res;
+}
+
+// Value of a response header, empty if absent
+static std::string header_value(const std::string &headers, const char *name) {
+  std::string lower = headers;
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  std::string key = std::string("\r\n") + name + ":";
+  size_t at = lower.find(key);
+  if (at == std::string::npos) {
+    return "";
+  }
+  at += key.size();
+  size_t end = headers.find("\r\n", at);
+  while (at < end && headers[at] == ' ') {
+    at++;
+  }
+  return headers.substr(at, end - at);
+}
+
+// Parameter of a Digest challenge, e.g. nonce="..."
+static std::string challenge_param(const std::string &challenge, const char *name) {
+  std::string key = std::string(name) + "=";
+  size_t at = 0;
+  while ((at = challenge.find(key, at)) != std::string::npos) {
+    if (at == 0 || challenge[at - 1] == ' ' || challenge[at - 1] == ',') {
+      break;
+    }
+    at += key.size();
+  }
+  if (at == std::string::npos) {
+    return "";
+  }
+  at += key.size();
+  if (challenge[at] == '"') {
+    size_t end = challenge.find('"', at + 1);
+    return challenge.substr(at + 1, end - at - 1);
+  }
+  size_t end = challenge.find_first_of(", ", at);
+  return challenge.substr(at, end == std::string::npos ? end : end - at);
+}
+
+// Per client
+
+struct Stats {
+  std::vector<double> latency_ms[KIND_COUNT];
+  long errors[KIND_COUNT] = {};
+  long timeouts[KIND_COUNT] = {};
+  long challenges = 0;
+  uint64_t bytes = 0;
+};
+
+class Client {
+ public:
+  Client(const Options &opt, const addrinfo *ai, unsigned seed) : _opt(opt), _ai(ai), _seed(seed) {}
+
+  void run_one(Kind kind, Stats &stats) {
+    std::string method = "GET";
+    std::string uri = "/";
+    std::string body;
+    if (kind == KIND_COMMAND) {
+      method = "POST";
+      uri = "/acremote";
+      body = "command=" + random_command();
+      if (!_opt.zones.empty()) {
+        body += "&zones=" + _opt.zones;
+      }
+    } else if (kind == KIND_STATE) {
+      uri = "/state";
+    } else if (kind == KIND_STATUS) {
+      uri = "/status";
+    } else if (kind == KIND_NOT_FOUND) {
+      uri = "/probe" + std::to_string(rand_r(&_seed) % 1000);
+    }
+    auto start = std::chrono::steady_clock::now();
+    Response res = http_request(_ai, build(kind, method, uri, body), _opt.timeout_ms);
+    if (res.status == 401 && kind != KIND_NOT_FOUND && take_challenge(res)) {
+      // A browser would answer the challenge, count the round trip too
+      stats.challenges++;
+      res = http_request(_ai, build(kind, method, uri, body), _opt.timeout_ms);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.latency_ms[kind].push_back(ms);
+    stats.bytes += res.body_len;
+    if (res.status == 0) {
+      stats.timeouts[kind]++;
+      return;
+    }
+    std::string cookie = header_value(res.headers, "set-cookie");
+    if (_opt.cookie && !cookie.empty()) {
+      _cookie = cookie.substr(0, cookie.find(';'));
+    }
+    if ((kind == KIND_PAGE || kind == KIND_STATUS) && res.status == 200) {
+      _etag[kind] = header_value(res.headers, "etag");
+    }
+    bool ok = kind == KIND_NOT_FOUND ? res.status == 404 :
+              kind == KIND_PAGE || kind == KIND_STATUS ? res.status == 200 || res.status == 304 :
+              res.status == 200;
+    if (!ok) {
+      stats.errors[kind]++;
+      // Session expired or evicted: log in again
+      if (res.status == 401) {
+        _cookie.clear();
+      }
+    }
+  }
+
+ private:
+  // Valid command (CMD_FIELDS ranges), on half of the time
+  std::string random_command() {
+    std::string cmd;
+    for (uint8_t i = 0; i < CMD_PARAMS; i++) {
+      const CmdField &f = CMD_FIELDS[i];
+      unsigned v = f.min + rand_r(&_seed) % (f.max - f.min + 1);
+      cmd += (i ? "," : "") + std::to_string(v);
+    }
+    return cmd;
+  }
+
+  bool take_challenge(const Response &res) {
+    std::string challenge = header_value(res.headers, "www-authenticate");
+    if (challenge.compare(0, 7, "Digest ") != 0) {
+      return false;
+    }
+    _realm = challenge_param(challenge, "realm");
+    _nonce = challenge_param(challenge, "nonce");
+    _opaque = challenge_param(challenge, "opaque");
+    _nc = 0;
+    _cookie.clear();
+    return !_nonce.empty();
+  }
+
+  std::string authorization(const std::string &method, const std::string &uri) {
+    char nc[9];
+    snprintf(nc, sizeof(nc), "%08x", ++_nc);
+    char cnonce[17];
+    snprintf(cnonce, sizeof(cnonce), "%08x%08x", rand_r(&_seed), rand_r(&_seed));
+    std::string ha1 = md5_hex(_opt.user + ":" + _realm + ":" + _opt.pass);
+    std::string ha2 = md5_hex(method + ":" + uri);
+    std::string response = md5_hex(ha1 + ":" + _nonce + ":" + nc + ":" + cnonce + ":auth:" + ha2);
+    return "Digest username=\"" + _opt.user + "\", realm=\"" + _realm + "\", nonce=\"" + _nonce +
+           "\", uri=\"" + uri + "\", algorithm=MD5, response=\"" + response + "\", opaque=\"" + _opaque +
+           "\", qop=auth, nc=" + nc + ", cnonce=\"" + cnonce + "\"";
+  }
+
+  std::string build(Kind kind, const std::string &method, const std::string &uri, const std::string &body) {
+    std::string req = method + " " + uri + " HTTP/1.1\r\nHost: " + _opt.host + "\r\nConnection: close\r\n";
+    if (kind != KIND_NOT_FOUND) {
+      if (!_cookie.empty()) {
+        req += "Cookie: " + _cookie + "\r\n";
+      } else if (!_nonce.empty()) {
+        req += "Authorization: " + authorization(method, uri) + "\r\n";
+      }
+    }
+    if (_opt.revalidate && !_etag[kind].empty()) {
+      req += "If-None-Match: " + _etag[kind] + "\r\n";
+    }
+    if (!body.empty()) {
+      req += "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+             std::to_string(body.size()) + "\r\n";
+    }
+    return req + "\r\n" + body;
+  }
+
+  const Options &_opt;
+  const addrinfo *_ai;
+  unsigned _seed;
+  std::string _realm;
+  std::string _nonce;
+  std::string _opaque;
+  unsigned _nc = 0;
+  std::string _cookie;
+  std::string _etag[KIND_COUNT];
+};
+
+// Command line
+
+static void usage() {
+  fprintf(stderr,
+          "usage: loadgen [options]\n"
+          "  --host H         node address (192.168.1.50)\n"
+          "  --port P         (80)\n"
+          "  -u, --user U     Digest user (antani)\n"
+          "  -p, --pass P     Digest password (antani)\n"
+          "  -c N             concurrent clients (4)\n"
+          "  -n N             total requests, else run for -d seconds\n"
+          "  -d S             duration in seconds (10)\n"
+          "  --timeout MS     per request (5000)\n"
+          "  --mix LIST       weights, e.g. page=1,command=4,state=0,notfound=1,status=0\n"
+          "  --zones Z        zones argument of /acremote, e.g. all\n"
+          "  --no-cookie      Digest on every request, no session cookie\n"
+          "  --no-revalidate  no If-None-Match on page loads and /status\n");
+  exit(2);
+}
+
+static bool parse_mix(const char *text, unsigned *weights) {
+  std::fill(weights, weights + KIND_COUNT, 0);
+  std::string s = text;
+  size_t at = 0;
+  while (at < s.size()) {
+    size_t end = s.find(',', at);
+    std::string item = s.substr(at, end == std::string::npos ? end : end - at);
+    size_t eq = item.find('=');
+    int kind = -1;
+    for (int k = 0; k < KIND_COUNT; k++) {
+      if (item.compare(0, eq, kind_names[k]) == 0) {
+        kind = k;
+      }
+    }
+    if (kind < 0 || eq == std::string::npos) {
+      return false;
+    }
+    weights[kind] = strtoul(item.c_str() + eq + 1, NULL, 10);
+    at = end == std::string::npos ? s.size() : end + 1;
+  }
+  unsigned total = 0;
+  for (int k = 0; k < KIND_COUNT; k++) {
+    total += weights[k];
+  }
+  return total > 0;
+}
+
+static Options parse_args(int argc, char **argv) {
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (a == "--no-cookie") {
+      opt.cookie = false;
+      continue;
+    }
+    if (a == "--no-revalidate") {
+      opt.revalidate = false;
+      continue;
+    }
+    if (!v) {
+      usage();
+    }
+    i++;
+    if (a == "--host") {
+      opt.host = v;
+    } else if (a == "--port") {
+      opt.port = v;
+    } else if (a == "-u" || a == "--user") {
+      opt.user = v;
+    } else if (a == "-p" || a == "--pass") {
+      opt.pass = v;
+    } else if (a == "-c") {
+      opt.concurrency = atoi(v);
+    } else if (a == "-n") {
+      opt.requests = atol(v);
+    } else if (a == "-d") {
+      opt.seconds = atof(v);
+    } else if (a == "--timeout") {
+      opt.timeout_ms = atoi(v);
+    } else if (a == "--mix") {
+      if (!parse_mix(v, opt.weights)) {
+        usage();
+      }
+    } else if (a == "--zones") {
+      opt.zones = v;
+    } else {
+      usage();
+    }
+  }
+  if (opt.concurrency < 1 || opt.timeout_ms < 1 || (!opt.requests && opt.seconds <= 0)) {
+    usage();
+  }
+  return opt;
+}
+
+// Nearest rank percentile of sorted values
+static double percentile(const std::vector<double> &v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  size_t rank = (size_t)(p / 100 * v.size() + 0.999999);
+  return v[rank ? rank - 1 : 0];
+}
+
+static void report_row(const char *name, std::vector<double> &v, long errors, long timeouts) {
+  std::sort(v.begin(), v.end());
+  double mean = 0;
+  for (double x : v) {
+    mean += x;
+  }
+  mean = v.empty() ? 0 : mean / v.size();
+  printf("%-9s %8zu %7.2f%% %7.2f%% %8.1f %8.1f %8.1f %8.1f %8.1f\n", name, v.size(),
+         v.empty() ? 0 : 100.0 * errors / v.size(), v.empty() ? 0 : 100.0 * timeouts / v.size(),
+         mean, percentile(v, 50), percentile(v, 95), percentile(v, 99), v.empty() ? 0 : v.back());
+}
+
+int main(int argc, char **argv) {
+  Options opt = parse_args(argc, argv);
+  signal(SIGPIPE, SIG_IGN);
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *ai = NULL;
+  int err = getaddrinfo(opt.host.c_str(), opt.port.c_str(), &hints, &ai);
+  if (err) {
+    fprintf(stderr, "%s: %s\n", opt.host.c_str(), gai_strerror(err));
+    return 1;
+  }
+  unsigned weight_total = 0;
+  for (int k = 0; k < KIND_COUNT; k++) {
+    weight_total += opt.weights[k];
+  }
+
+  std::atomic<long> issued(0);
+  std::mutex merge;
+  Stats total;
+  auto start = std::chrono::steady_clock::now();
+  auto stop_at = start + std::chrono::duration<double>(opt.seconds);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < opt.concurrency; t++) {
+    threads.emplace_back([&, t]() {
+      Client client(opt, ai, 0x9E3779B9u * (t + 1));
+      unsigned seed = t * 7919 + 1;
+      Stats stats;
+      for (;;) {
+        if (opt.requests ? issued++ >= opt.requests : std::chrono::steady_clock::now() >= stop_at) {
+          break;
+        }
+        unsigned pick = rand_r(&seed) % weight_total;
+        int kind = 0;
+        while (pick >= opt.weights[kind]) {
+          pick -= opt.weights[kind++];
+        }
+        client.run_one((Kind)kind, stats);
+      }
+      std::lock_guard<std::mutex> lock(merge);
+      for (int k = 0; k < KIND_COUNT; k++) {
+        total.latency_ms[k].insert(total.latency_ms[k].end(), stats.latency_ms[k].begin(), stats.latency_ms[k].end());
+        total.errors[k] += stats.errors[k];
+        total.timeouts[k] += stats.timeouts[k];
+      }
+      total.challenges += stats.challenges;
+      total.bytes += stats.bytes;
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  freeaddrinfo(ai);
+
+  std::vector<double> all;
+  long errors = 0;
+  long timeouts = 0;
+  for (int k = 0; k < KIND_COUNT; k++) {
+    all.insert(all.end(), total.latency_ms[k].begin(), total.latency_ms[k].end());
+    errors += total.errors[k];
+    timeouts += total.timeouts[k];
+  }
+  printf("%s:%s, %d clients, %.1f s, %zu requests, %.1f req/s, %.1f KB/s, %ld Digest challenges\n",
+         opt.host.c_str(), opt.port.c_str(), opt.concurrency, elapsed, all.size(), all.size() / elapsed,
+         total.bytes / 1024.0 / elapsed, total.challenges);
+  printf("%-9s %8s %8s %8s %8s %8s %8s %8s %8s\n", "kind", "count", "errors", "timeout",
+         "mean ms", "p50", "p95", "p99", "max");
+  for (int k = 0; k < KIND_COUNT; k++) {
+    if (opt.weights[k]) {
+      report_row(kind_names[k], total.latency_ms[k], total.errors[k], total.timeouts[k]);
+    }
+  }
+  report_row("all", all, errors, timeouts);
+  return errors || timeouts ? 1 : 0;
+}